@@ -0,0 +1,124 @@
+// Throughput of the batch API on many small messages.
+//
+// Usage: sbf_bench_batch [messages-per-batch] [threads]
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Encoded size of the table { "p": U8A[n] } is n plus this much framing.
+constexpr size_t Message_Overhead = 23;
+
+// Keep measuring until at least this much time has passed, for stable numbers.
+constexpr double Min_Seconds = 0.5;
+
+Node *MakeMessage(size_t encoded_size, size_t seed) {
+	const auto payload_length = encoded_size - Message_Overhead;
+
+	auto payload = (uint8_t *)malloc(payload_length);
+	for (size_t x = 0; x < payload_length; x++) payload[x] = (uint8_t)(seed + x);
+
+	auto keys = (char **)malloc(sizeof(char *));
+	auto values = (Node **)malloc(sizeof(Node *));
+
+	keys[0] = strdup("p");
+	values[0] = SBF_CreateNode_Array(NodeType_U8A, payload, payload_length);
+
+	return SBF_CreateNode_Table(keys, values, 1);
+}
+
+/// Runs body until Min_Seconds elapsed; returns processed messages per second.
+template<typename Body>
+double Measure(size_t count, Body body) {
+	size_t rounds = 0;
+	const auto start = Clock::now();
+	double elapsed = 0;
+
+	do {
+		body();
+		rounds++;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < Min_Seconds);
+
+	return (double)(count * rounds) / elapsed;
+}
+
+};
+
+int main(int argc, char **argv) {
+	const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000;
+	const size_t threads = argc > 2
+		? std::strtoull(argv[2], nullptr, 10)
+		: std::max(1u, std::thread::hardware_concurrency());
+
+	if (!count) {
+		std::fprintf(stderr, "messages-per-batch must be positive\n");
+		return 1;
+	}
+
+	std::printf("%zu messages per batch, %zu threads for parallel runs; messages/sec\n\n", count, threads);
+	std::printf("%6s %14s %14s %14s %14s %14s\n", "bytes", "serialize", "ser-parallel", "deser-heap", "deser-arena", "deser-parallel");
+
+	for (size_t size : { 32, 64, 128, 256 }) {
+		std::vector<Node *> nodes(count);
+		for (size_t x = 0; x < count; x++) nodes[x] = MakeMessage(size, x);
+
+		std::vector<size_t> offsets(count + 1);
+		const auto total = SBF_SerializeBatch(nodes.data(), count, nullptr, 0, offsets.data(), 1);
+
+		std::vector<uint8_t> bytes(total);
+
+		const auto serialize = Measure(count, [&]() {
+			SBF_SerializeBatch(nodes.data(), count, bytes.data(), bytes.size(), offsets.data(), 1);
+		});
+
+		const auto serialize_parallel = Measure(count, [&]() {
+			SBF_SerializeBatch(nodes.data(), count, bytes.data(), bytes.size(), offsets.data(), threads);
+		});
+
+		std::vector<const uint8_t *> buffers(count);
+		std::vector<size_t> lengths(count);
+
+		for (size_t x = 0; x < count; x++) {
+			buffers[x] = bytes.data() + offsets[x];
+			lengths[x] = offsets[x + 1] - offsets[x];
+		}
+
+		std::vector<Node *> out(count);
+
+		const auto heap = Measure(count, [&]() {
+			SBF_DeserializeBatch(buffers.data(), lengths.data(), count, nullptr, out.data(), 1);
+			for (auto node : out) SBF_DestroyNode(node);
+		});
+
+		auto arena = SBF_CreateArena(0);
+
+		const auto in_arena = Measure(count, [&]() {
+			SBF_DeserializeBatch(buffers.data(), lengths.data(), count, arena, out.data(), 1);
+			SBF_ResetArena(arena);
+		});
+
+		const auto parallel = Measure(count, [&]() {
+			SBF_DeserializeBatch(buffers.data(), lengths.data(), count, arena, out.data(), threads);
+			SBF_ResetArena(arena);
+		});
+
+		SBF_DestroyArena(arena);
+		for (auto node : nodes) SBF_DestroyNode(node);
+
+		std::printf("%6zu %14.0f %14.0f %14.0f %14.0f %14.0f\n", size, serialize, serialize_parallel, heap, in_arena, parallel);
+	}
+
+	return 0;
+}
@@ -0,0 +1,132 @@
+// Throughput of the array kernels for every instruction set the CPU supports.
+//
+// Usage: sbf_bench_kernels [elements]
+
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keep measuring until at least this much time has passed, for stable numbers.
+constexpr double Min_Seconds = 0.3;
+
+const char *const level_names[] = { "scalar", "baseline", "avx2", "avx512" };
+
+struct ArrayType {
+	const char *name;
+	NodeType type;
+	size_t element_size;
+};
+
+const ArrayType types[] = {
+	{ "I8A", NodeType_I8A, 1 },
+	{ "U8A", NodeType_U8A, 1 },
+	{ "I32A", NodeType_I32A, 4 },
+	{ "U32A", NodeType_U32A, 4 },
+	{ "I64A", NodeType_I64A, 8 },
+	{ "U64A", NodeType_U64A, 8 },
+	{ "F32A", NodeType_F32A, 4 },
+	{ "F64A", NodeType_F64A, 8 },
+};
+
+/// Fills bytes with elements of type spread over [0, 1000).
+void Fill(const ArrayType &type, std::vector<uint8_t> &bytes, size_t length) {
+	std::mt19937_64 random(36);
+
+	for (size_t x = 0; x < length; x++) {
+		const auto value = random() % 1000;
+		auto element = bytes.data() + x * type.element_size;
+
+		switch (type.type) {
+		case NodeType_F32A: { float f = (float)value / 3; std::memcpy(element, &f, 4); break; }
+		case NodeType_F64A: { double d = (double)value / 3; std::memcpy(element, &d, 8); break; }
+		// Only the low byte of 8-bit elements is kept, which stays within the range anyway.
+		default: std::memcpy(element, &value, type.element_size); break;
+		}
+	}
+}
+
+/// Runs body until Min_Seconds elapsed; returns GB/s over size bytes.
+template<typename Body>
+double Measure(size_t size, Body body) {
+	size_t rounds = 0;
+	const auto start = Clock::now();
+	double elapsed = 0;
+
+	do {
+		body();
+		rounds++;
+		elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (elapsed < Min_Seconds);
+
+	return (double)(size * rounds) / elapsed / 1e9;
+}
+
+};
+
+int main(int argc, char **argv) {
+	const size_t length = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 22;
+
+	if (!length) {
+		std::fprintf(stderr, "elements must be positive\n");
+		return 1;
+	}
+
+	const auto supported = SBF_GetSimdLevel();
+
+	std::printf("%zu elements per array; GB/s\n\n", length);
+	std::printf("%-6s %-9s %10s %10s %10s %10s\n", "type", "simd", "reduce", "count", "filter", "histogram");
+
+	std::vector<size_t> indices(length);
+	uint64_t counts[64];
+
+	for (auto &type : types) {
+		std::vector<uint8_t> bytes(length * type.element_size);
+		Fill(type, bytes, length);
+
+		SBF_Scalar low, high;
+		if (type.type == NodeType_F32A || type.type == NodeType_F64A) {
+			low.f64 = 100;
+			high.f64 = 200;
+		} else {
+			low.i64 = 100;
+			high.i64 = 200;
+		}
+
+		for (int level = SBF_SIMD_SCALAR; level <= supported; level++) {
+			SBF_SetSimdLevel((SBF_SimdLevel)level);
+
+			const auto reduce = Measure(bytes.size(), [&]() {
+				SBF_BufferReduce(type.type, bytes.data(), length, SBF_REDUCE_SUM | SBF_REDUCE_MIN | SBF_REDUCE_MAX);
+			});
+
+			const auto count = Measure(bytes.size(), [&]() {
+				SBF_BufferFilterRange(type.type, bytes.data(), length, low, high, nullptr);
+			});
+
+			const auto filter = Measure(bytes.size(), [&]() {
+				SBF_BufferFilterRange(type.type, bytes.data(), length, low, high, indices.data());
+			});
+
+			const auto histogram = Measure(bytes.size(), [&]() {
+				std::memset(counts, 0, sizeof(counts));
+				SBF_BufferHistogram(type.type, bytes.data(), length, 0, 256, 64, counts);
+			});
+
+			std::printf("%-6s %-9s %10.2f %10.2f %10.2f %10.2f\n", type.name, level_names[level], reduce, count, filter, histogram);
+		}
+	}
+
+	SBF_SetSimdLevel(supported);
+
+	return 0;
+}
@@ -0,0 +1,988 @@
+// Benchmark suite for the core (de)serialization paths and file I/O.
+//
+// Usage: sbf_bench [--json FILE] [--filter TEXT] [--scale N] [--min-time SECONDS] [--dir DIR]
+//
+// Results are printed as a table and, with --json, written as a JSON document
+// ("-" for stdout) so runs can be compared over time.
+
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <type_traits>
+#include <string>
+#include <vector>
+#include <ctime>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "SBF/sbf.h"
+
+// Allocation counting. Defining malloc and friends in the executable makes
+// the dynamic linker route every allocation through them, including the
+// ones made inside libSBF and libstdc++.
+
+#if defined(__GLIBC__)
+
+#define SBF_BENCH_COUNTS_ALLOCATIONS 1
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+}
+
+namespace {
+std::atomic<uint64_t> allocation_count = 0;
+std::atomic<uint64_t> allocated_bytes = 0;
+};
+
+extern "C" void *malloc(size_t size) {
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(count * size, std::memory_order_relaxed);
+	return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size) {
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void *pointer) {
+	__libc_free(pointer);
+}
+
+#else
+
+#define SBF_BENCH_COUNTS_ALLOCATIONS 0
+
+namespace {
+std::atomic<uint64_t> allocation_count = 0;
+std::atomic<uint64_t> allocated_bytes = 0;
+};
+
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t Max_Recursive_Depth = 10000;
+
+struct Options {
+	std::string json;
+	std::string filter;
+	size_t scale = 1;
+	double min_time = 0.5;
+	std::filesystem::path dir = std::filesystem::temp_directory_path();
+};
+
+/// A generated tree, with the node count the generator produced.
+/// Every node is counted once: when added to its parent table, or as the root.
+struct Tree {
+	Node *root = nullptr;
+	size_t nodes = 0;
+	/// Deepest nesting, the root being at depth 1.
+	size_t depth = 2;
+};
+
+struct Case {
+	const char *name;
+	const char *description;
+	std::function<Tree(size_t scale)> make;
+	/// Reads one field of every record, when the case holds records.
+	std::function<double(Node *root)> scan = nullptr;
+	/// Selector run over the tree and over its serialized bytes, when set.
+	const char *select = nullptr;
+};
+
+struct Result {
+	std::string name;
+	std::string operation;
+	size_t bytes;
+	size_t nodes;
+	size_t rounds;
+	double seconds;
+	double allocations;
+	double allocated_bytes;
+	long peak_rss_kb;
+};
+
+/// Accumulates the entries of a table before it is turned into a node.
+class TableBuilder {
+
+	std::vector<char *> keys;
+	std::vector<Node *> values;
+
+public:
+
+	Tree &tree;
+
+	explicit TableBuilder(Tree &tree) : tree(tree) {}
+
+	void Add(const std::string &key, Node *value) {
+		keys.push_back(strdup(key.c_str()));
+		values.push_back(value);
+		tree.nodes++;
+	}
+
+	Node *Build() {
+		const auto length = keys.size();
+
+		auto k = (char **)malloc(sizeof(char *) * (length ? length : 1));
+		auto v = (Node **)malloc(sizeof(Node *) * (length ? length : 1));
+
+		std::memcpy(k, keys.data(), sizeof(char *) * length);
+		std::memcpy(v, values.data(), sizeof(Node *) * length);
+
+		return SBF_CreateNode_Table(k, v, length);
+	}
+
+};
+
+template<typename T>
+Node *MakeArray(NodeType type, size_t length, std::mt19937_64 &random) {
+	auto array = (T *)malloc(sizeof(T) * (length ? length : 1));
+
+	if constexpr (std::is_floating_point_v<T>) {
+		std::uniform_real_distribution<T> distribution(-1000, 1000);
+		for (size_t x = 0; x < length; x++) array[x] = distribution(random);
+	} else {
+		for (size_t x = 0; x < length; x++) array[x] = (T)random();
+	}
+
+	return SBF_CreateNode_Array(type, array, length);
+}
+
+Node *MakeString(size_t length, std::mt19937_64 &random) {
+	static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+
+	auto chars = (char *)malloc(length + 1);
+	for (size_t x = 0; x < length; x++) chars[x] = alphabet[random() % (sizeof(alphabet) - 1)];
+	chars[length] = '\0';
+
+	return SBF_CreateNode_String(chars);
+}
+
+/// Nested tables: every level holds a few scalars and the next level.
+Tree DeepTables(size_t scale) {
+	std::mt19937_64 random(1);
+	Tree tree;
+
+	// Chains are kept shallow enough for the recursive decoder's stack use.
+	const size_t depth = 200;
+	const size_t chains = 50 * scale;
+
+	TableBuilder root(tree);
+
+	for (size_t chain = 0; chain < chains; chain++) {
+		Node *child = nullptr;
+
+		for (size_t level = 0; level < depth; level++) {
+			TableBuilder table(tree);
+
+			table.Add("depth", SBF_CreateNode_U32((uint32_t)(depth - level)));
+			table.Add("weight", SBF_CreateNode_F32((float)(random() % 1000) / 10));
+			table.Add("id", SBF_CreateNode_I64((int64_t)random()));
+
+			if (child) table.Add("child", child);
+
+			child = table.Build();
+		}
+
+		root.Add("chain" + std::to_string(chain), child);
+	}
+
+	tree.root = root.Build();
+	tree.nodes++;
+	tree.depth = depth + 2;
+	return tree;
+}
+
+/// Chains of single-entry tables nested depth deep, about a million tables in total whatever the depth,
+/// to compare the cost per level of the iterative and recursive decoders.
+Tree Chains(size_t depth, size_t scale) {
+	Tree tree;
+	TableBuilder root(tree);
+
+	const auto chains = std::max<size_t>(1, 1000000 * scale / depth);
+
+	for (size_t chain = 0; chain < chains; chain++) {
+		Node *child = SBF_CreateNode_U8((uint8_t)chain);
+
+		for (size_t level = 1; level < depth; level++) {
+			TableBuilder table(tree);
+			table.Add("c", child);
+			child = table.Build();
+		}
+
+		root.Add("c" + std::to_string(chain), child);
+	}
+
+	tree.root = root.Build();
+	tree.nodes++;
+	tree.depth = depth + 1;
+	return tree;
+}
+
+/// One table with a very large number of scalar entries.
+Tree WideTable(size_t scale) {
+	std::mt19937_64 random(2);
+	Tree tree;
+	TableBuilder root(tree);
+
+	for (size_t x = 0; x < 100000 * scale; x++) {
+		Node *value;
+
+		switch (x % 4) {
+		case 0: value = SBF_CreateNode_I32((int32_t)random()); break;
+		case 1: value = SBF_CreateNode_F64((double)random() / 3); break;
+		case 2: value = SBF_CreateNode_U8((uint8_t)random()); break;
+		default: value = SBF_CreateNode_U64(random()); break;
+		}
+
+		root.Add("field_" + std::to_string(x), value);
+	}
+
+	tree.root = root.Build();
+	tree.nodes++;
+	return tree;
+}
+
+/// A few large float arrays, as found in meshes and height maps.
+Tree FloatArrays(size_t scale) {
+	std::mt19937_64 random(3);
+	Tree tree;
+	TableBuilder root(tree);
+
+	root.Add("vertices", MakeArray<float>(NodeType_F32A, 3 * 1000000 * scale, random));
+	root.Add("normals", MakeArray<float>(NodeType_F32A, 3 * 1000000 * scale, random));
+	root.Add("heights", MakeArray<double>(NodeType_F64A, 1000000 * scale, random));
+
+	tree.root = root.Build();
+	tree.nodes++;
+	return tree;
+}
+
+/// Integer arrays of the kinds the array encodings target, as found in event logs and time series.
+Tree IntegerArrays(size_t scale) {
+	std::mt19937_64 random(7);
+	Tree tree;
+	TableBuilder root(tree);
+
+	const auto length = 1000000 * scale;
+
+	auto timestamps = (uint64_t *)malloc(sizeof(uint64_t) * length);
+	auto ids = (int32_t *)malloc(sizeof(int32_t) * length);
+	auto levels = (uint32_t *)malloc(sizeof(uint32_t) * length);
+	auto states = (int32_t *)malloc(sizeof(int32_t) * length);
+
+	uint64_t time = 1700000000000;
+
+	for (size_t x = 0; x < length; x++) {
+		time += random() % 1000;
+		timestamps[x] = time;
+		ids[x] = (int32_t)(x * 3 + random() % 3);
+		levels[x] = (uint32_t)(random() % 100);
+		states[x] = (int32_t)(x / 1000 % 4) - 1;
+	}
+
+	root.Add("timestamps", SBF_CreateNode_Array(NodeType_U64A, timestamps, length));
+	root.Add("ids", SBF_CreateNode_Array(NodeType_I32A, ids, length));
+	root.Add("levels", SBF_CreateNode_Array(NodeType_U32A, levels, length));
+	root.Add("states", SBF_CreateNode_Array(NodeType_I32A, states, length));
+	root.Add("random", MakeArray<int64_t>(NodeType_I64A, length, random));
+
+	tree.root = root.Build();
+	tree.nodes++;
+	return tree;
+}
+
+/// Marks every integer array of the tree to be written with the smallest encoding.
+void PackArrays(Node *root) {
+	std::vector<Node *> pending = { root };
+
+	while (!pending.empty()) {
+		auto node = pending.back();
+		pending.pop_back();
+
+		switch (SBF_GetNodeType(node)) {
+		case NodeType_I32A: case NodeType_I64A: case NodeType_U32A: case NodeType_U64A:
+			SBF_NodeSet_ArrayEncoding(node, SBF_ARRAY_AUTO);
+			break;
+
+		case NodeType_T:
+			{
+				char **keys;
+				Node **values;
+				SBF_NodeGet_Table(node, &keys, &values);
+				pending.insert(pending.end(), values, values + SBF_NodeGet_TableLength(node));
+			}
+			break;
+
+		case NodeType_Columns:
+			{
+				char **names;
+				Node **columns;
+				SBF_NodeGet_Columns(node, &names, &columns);
+				pending.insert(pending.end(), columns, columns + SBF_NodeGet_ColumnCount(node));
+			}
+			break;
+
+		default: break;
+		}
+	}
+}
+
+/// Many short strings, as found in dialogue and localization tables.
+Tree ShortStrings(size_t scale) {
+	std::mt19937_64 random(4);
+	Tree tree;
+	TableBuilder root(tree);
+
+	for (size_t x = 0; x < 100000 * scale; x++) {
+		root.Add("s" + std::to_string(x), MakeString(4 + random() % 28, random));
+	}
+
+	tree.root = root.Build();
+	tree.nodes++;
+	return tree;
+}
+
+/// Resembles a game save: player state, entities with inventories, map layers and a message log.
+Tree MixedSave(size_t scale) {
+	std::mt19937_64 random(5);
+	Tree tree;
+	TableBuilder root(tree);
+
+	root.Add("version", SBF_CreateNode_U32(3));
+	root.Add("seed", SBF_CreateNode_U64(random()));
+
+	{
+		TableBuilder player(tree);
+
+		player.Add("name", MakeString(12, random));
+		player.Add("level", SBF_CreateNode_I32(42));
+		player.Add("health", SBF_CreateNode_F32(87.5f));
+		player.Add("position", MakeArray<float>(NodeType_F32A, 3, random));
+		player.Add("unlocked", MakeArray<uint8_t>(NodeType_U8A, 256, random));
+
+		root.Add("player", player.Build());
+	}
+
+	{
+		TableBuilder entities(tree);
+
+		for (size_t x = 0; x < 5000 * scale; x++) {
+			TableBuilder entity(tree);
+
+			entity.Add("id", SBF_CreateNode_U64(x));
+			entity.Add("kind", MakeString(6 + random() % 10, random));
+			entity.Add("position", MakeArray<float>(NodeType_F32A, 3, random));
+			entity.Add("rotation", SBF_CreateNode_F32((float)(random() % 360)));
+			entity.Add("health", SBF_CreateNode_I32((int32_t)(random() % 100)));
+			entity.Add("flags", MakeArray<uint8_t>(NodeType_U8A, 16, random));
+
+			TableBuilder inventory(tree);
+			for (size_t item = 0, items = random() % 8; item < items; item++) {
+				inventory.Add("item" + std::to_string(item), SBF_CreateNode_I32((int32_t)(random() % 64)));
+			}
+
+			entity.Add("inventory", inventory.Build());
+
+			entities.Add("entity" + std::to_string(x), entity.Build());
+		}
+
+		root.Add("entities", entities.Build());
+	}
+
+	{
+		TableBuilder map(tree);
+
+		map.Add("tiles", MakeArray<uint32_t>(NodeType_U32A, 256 * 256 * scale, random));
+		map.Add("heights", MakeArray<float>(NodeType_F32A, 128 * 128 * scale, random));
+		map.Add("explored", MakeArray<uint8_t>(NodeType_U8A, 256 * 256 * scale, random));
+
+		root.Add("map", map.Build());
+	}
+
+	{
+		TableBuilder log(tree);
+
+		for (size_t x = 0; x < 2000 * scale; x++) {
+			log.Add("m" + std::to_string(x), MakeString(20 + random() % 60, random));
+		}
+
+		root.Add("log", log.Build());
+	}
+
+	tree.root = root.Build();
+	tree.nodes++;
+	// Values in the inventories of the entities.
+	tree.depth = 5;
+	return tree;
+}
+
+/// 100k records with the same fields, as a table of tables or converted to columns.
+/// The node count is the one of the table of tables either way, so nodes/s compare.
+Tree Records(size_t scale, bool columns) {
+	std::mt19937_64 random(6);
+	Tree tree;
+	TableBuilder root(tree);
+
+	for (size_t x = 0; x < 100000 * scale; x++) {
+		TableBuilder record(tree);
+
+		record.Add("id", SBF_CreateNode_U32((uint32_t)x));
+		record.Add("x", SBF_CreateNode_F64((double)(random() % 100000) / 100));
+		record.Add("y", SBF_CreateNode_F64((double)(random() % 100000) / 100));
+		record.Add("health", SBF_CreateNode_I32((int32_t)(random() % 100)));
+		record.Add("kind", MakeString(6 + random() % 10, random));
+
+		root.Add("r" + std::to_string(x), record.Build());
+	}
+
+	tree.root = root.Build();
+	tree.nodes++;
+	tree.depth = 3;
+
+	if (columns) {
+		auto table = tree.root;
+		tree.root = SBF_TableToColumns(table, "key");
+		SBF_DestroyNode(table);
+	}
+
+	return tree;
+}
+
+double ScanRecords(Node *root) {
+	char **keys;
+	Node **records;
+	SBF_NodeGet_Table(root, &keys, &records);
+
+	double sum = 0;
+
+	for (size_t x = 0; x < SBF_NodeGet_TableLength(root); x++) {
+		char **fields;
+		Node **values;
+		SBF_NodeGet_Table(records[x], &fields, &values);
+
+		for (size_t field = 0; field < SBF_NodeGet_TableLength(records[x]); field++) {
+			if (std::strcmp(fields[field], "x") == 0) sum += SBF_NodeGet_F64(values[field]);
+		}
+	}
+
+	return sum;
+}
+
+double ScanColumns(Node *root) {
+	auto column = SBF_NodeGet_Column(root, "x");
+	auto values = SBF_NodeGet_F64A(column);
+
+	double sum = 0;
+	for (size_t x = 0; x < SBF_NodeGet_ArrayLength(column); x++) sum += values[x];
+
+	return sum;
+}
+
+long PeakRssKb() {
+#if defined(_WIN32)
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+
+#if defined(__APPLE__)
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+/// Runs operation until min_time elapsed (at least three rounds), timing only operation itself.
+/// after runs untimed between rounds, e.g. to free what operation produced.
+Result Measure(const Options &options, const char *name, const char *operation, size_t bytes, size_t nodes,
+		const std::function<void()> &body, const std::function<void()> &after = nullptr) {
+
+	size_t rounds = 0;
+	double seconds = 0;
+	uint64_t allocations = 0;
+	uint64_t allocation_bytes = 0;
+
+	const auto start = Clock::now();
+
+	do {
+		const auto count_before = allocation_count.load();
+		const auto bytes_before = allocated_bytes.load();
+		const auto round_start = Clock::now();
+
+		body();
+
+		seconds += std::chrono::duration<double>(Clock::now() - round_start).count();
+		allocations += allocation_count.load() - count_before;
+		allocation_bytes += allocated_bytes.load() - bytes_before;
+		rounds++;
+
+		if (after) after();
+	} while (rounds < 3 || std::chrono::duration<double>(Clock::now() - start).count() < options.min_time);
+
+	return {
+		name,
+		operation,
+		bytes,
+		nodes,
+		rounds,
+		seconds / rounds,
+		(double)allocations / rounds,
+		(double)allocation_bytes / rounds,
+		PeakRssKb()
+	};
+}
+
+void RunCase(const Options &options, const Case &c, std::vector<Result> &results) {
+	auto tree = c.make(options.scale);
+
+	const auto size = SBF_CalculateSize(tree.root);
+	std::vector<uint8_t> bytes(size);
+
+	results.push_back(Measure(options, c.name, "calculate_size", size, tree.nodes, [&]() {
+		if (SBF_CalculateSize(tree.root) != size) throw std::runtime_error("size changed between runs");
+	}));
+
+	results.push_back(Measure(options, c.name, "serialize", size, tree.nodes, [&]() {
+		size_t cursor = 0;
+		SBF_Serialize(tree.root, bytes.data(), bytes.size(), &cursor);
+	}));
+
+	if (c.scan) {
+		// Keeps the sum alive, so the loop cannot be optimized away.
+		volatile double sink = 0;
+
+		results.push_back(Measure(options, c.name, "scan_field", size, tree.nodes, [&]() {
+			sink = sink + c.scan(tree.root);
+		}));
+	}
+
+	if (c.select) {
+		auto selector = SBF_CompileSelector(c.select);
+		const auto matches = SBF_SelectNodes(selector, tree.root, nullptr, nullptr);
+
+		results.push_back(Measure(options, c.name, "select_nodes", size, tree.nodes, [&]() {
+			if (SBF_SelectNodes(selector, tree.root, nullptr, nullptr) != matches) throw std::runtime_error("selector matched differently");
+		}));
+
+		results.push_back(Measure(options, c.name, "select_bytes", size, tree.nodes, [&]() {
+			size_t begin = 0;
+			if (SBF_SelectBytes(selector, bytes.data(), bytes.size(), &begin, nullptr, nullptr) != matches)
+				throw std::runtime_error("selector matched differently in the bytes");
+		}));
+
+		SBF_DestroySelector(selector);
+	}
+
+	Node *decoded = nullptr;
+
+	results.push_back(Measure(options, c.name, "deserialize", size, tree.nodes, [&]() {
+		size_t begin = 0;
+		decoded = SBF_Deserialize(bytes.data(), bytes.size(), &begin);
+	}, [&]() {
+		SBF_DestroyNode(decoded);
+		decoded = nullptr;
+	}));
+
+	// Deeper trees would run the recursive decoder off the end of the stack.
+	if (tree.depth <= Max_Recursive_Depth) {
+		SBF_DecodeOptions recursive = {};
+		recursive.flags = SBF_DECODE_RECURSIVE;
+		recursive.max_depth = tree.depth;
+
+		results.push_back(Measure(options, c.name, "deserialize_recursive", size, tree.nodes, [&]() {
+			size_t begin = 0;
+			decoded = SBF_DeserializeEx(bytes.data(), bytes.size(), &begin, &recursive);
+		}, [&]() {
+			SBF_DestroyNode(decoded);
+			decoded = nullptr;
+		}));
+	}
+
+	auto arena = SBF_CreateArena(0);
+
+	results.push_back(Measure(options, c.name, "deserialize_arena", size, tree.nodes, [&]() {
+		const uint8_t *buffer = bytes.data();
+		size_t length = bytes.size();
+		SBF_DeserializeBatch(&buffer, &length, 1, arena, &decoded, 1);
+	}, [&]() {
+		SBF_ResetArena(arena);
+		decoded = nullptr;
+	}));
+
+	SBF_DestroyArena(arena);
+
+	// The same tree in the other byte order, swapped on the way in and out.
+	std::vector<uint8_t> swapped(size);
+
+	SBF_EncodeOptions encode_big_endian = {};
+	encode_big_endian.flags = SBF_ENCODE_BIG_ENDIAN;
+
+	results.push_back(Measure(options, c.name, "serialize_big_endian", size, tree.nodes, [&]() {
+		size_t cursor = 0;
+		SBF_SerializeEx(tree.root, swapped.data(), swapped.size(), &cursor, &encode_big_endian);
+	}));
+
+	SBF_DecodeOptions decode_big_endian = {};
+	decode_big_endian.flags = SBF_DECODE_BIG_ENDIAN;
+
+	results.push_back(Measure(options, c.name, "deserialize_big_endian", size, tree.nodes, [&]() {
+		size_t begin = 0;
+		decoded = SBF_DeserializeEx(swapped.data(), swapped.size(), &begin, &decode_big_endian);
+	}, [&]() {
+		SBF_DestroyNode(decoded);
+		decoded = nullptr;
+	}));
+
+	// Sorting the keys of every table on the way out.
+	SBF_EncodeOptions encode_canonical = {};
+	encode_canonical.flags = SBF_ENCODE_CANONICAL;
+
+	results.push_back(Measure(options, c.name, "serialize_canonical", size, tree.nodes, [&]() {
+		size_t cursor = 0;
+		SBF_SerializeEx(tree.root, swapped.data(), swapped.size(), &cursor, &encode_canonical);
+	}));
+
+	// Arrays aligned for SIMD, and read back past their padding.
+	SBF_EncodeOptions encode_aligned = {};
+	encode_aligned.array_alignment = 64;
+
+	std::vector<uint8_t> aligned(SBF_CalculateSizeEx(tree.root, 0, &encode_aligned));
+
+	results.push_back(Measure(options, c.name, "serialize_aligned", size, tree.nodes, [&]() {
+		size_t cursor = 0;
+		SBF_SerializeEx(tree.root, aligned.data(), aligned.size(), &cursor, &encode_aligned);
+	}));
+
+	results.push_back(Measure(options, c.name, "deserialize_aligned", size, tree.nodes, [&]() {
+		size_t begin = 0;
+		decoded = SBF_Deserialize(aligned.data(), aligned.size(), &begin);
+	}, [&]() {
+		SBF_DestroyNode(decoded);
+		decoded = nullptr;
+	}));
+
+	// Integer arrays written with the smallest encoding, from a copy marked so, and decoded back.
+	auto packed_tree = SBF_CloneNode(tree.root, nullptr);
+	PackArrays(packed_tree);
+
+	std::vector<uint8_t> packed(SBF_CalculateSize(packed_tree));
+	std::fprintf(stderr, "  encoded arrays: %zu of %zu bytes\n", packed.size(), size);
+
+	results.push_back(Measure(options, c.name, "serialize_packed", size, tree.nodes, [&]() {
+		size_t cursor = 0;
+		SBF_Serialize(packed_tree, packed.data(), packed.size(), &cursor);
+	}));
+
+	SBF_DestroyNode(packed_tree);
+
+	results.push_back(Measure(options, c.name, "deserialize_packed", size, tree.nodes, [&]() {
+		size_t begin = 0;
+		decoded = SBF_Deserialize(packed.data(), packed.size(), &begin);
+	}, [&]() {
+		SBF_DestroyNode(decoded);
+		decoded = nullptr;
+	}));
+
+	// Fed in chunks the size of a socket read, as a decoder reading off the network sees them.
+	constexpr size_t Stream_Chunk_Size = 4096;
+
+	auto decoder = SBF_CreateDecoder(nullptr);
+
+	results.push_back(Measure(options, c.name, "deserialize_stream", size, tree.nodes, [&]() {
+		for (size_t offset = 0; offset < bytes.size(); offset += Stream_Chunk_Size) {
+			const auto length = std::min(Stream_Chunk_Size, bytes.size() - offset);
+			SBF_DecoderFeed(decoder, bytes.data() + offset, length, nullptr);
+		}
+
+		decoded = SBF_DecoderTake(decoder);
+		if (!decoded) throw std::runtime_error("stream decoder did not complete the tree");
+	}, [&]() {
+		SBF_DestroyNode(decoded);
+		decoded = nullptr;
+	}));
+
+	SBF_DestroyDecoder(decoder);
+
+	// Every destroy round needs a fresh tree, decoded untimed after the previous round.
+	size_t begin = 0;
+	decoded = SBF_Deserialize(bytes.data(), bytes.size(), &begin);
+
+	results.push_back(Measure(options, c.name, "destroy", size, tree.nodes, [&]() {
+		SBF_DestroyNode(decoded);
+		decoded = nullptr;
+	}, [&]() {
+		size_t begin = 0;
+		decoded = SBF_Deserialize(bytes.data(), bytes.size(), &begin);
+	}));
+
+	SBF_DestroyNode(decoded);
+
+	Node *clone = nullptr;
+
+	results.push_back(Measure(options, c.name, "clone", size, tree.nodes, [&]() {
+		clone = SBF_CloneNode(tree.root, nullptr);
+	}, [&]() {
+		SBF_DestroyNode(clone);
+		clone = nullptr;
+	}));
+
+	// A copy in other memory, so that comparing it reads both trees.
+	clone = SBF_CloneNode(tree.root, nullptr);
+
+	results.push_back(Measure(options, c.name, "equals", size, tree.nodes, [&]() {
+		if (!SBF_NodeEquals(tree.root, clone)) throw std::runtime_error("clone differs from the tree");
+	}));
+
+	SBF_DestroyNode(clone);
+
+	const auto hash = SBF_NodeHash(tree.root);
+
+	results.push_back(Measure(options, c.name, "hash", size, tree.nodes, [&]() {
+		if (SBF_NodeHash(tree.root) != hash) throw std::runtime_error("hash changed between runs");
+	}));
+
+	// The tree as JSON text and back, straight into SBF bytes too; MB/s of these count the text.
+	SBF_JsonOptions json_options = {};
+
+	const auto json_length = SBF_NodeToJson(tree.root, nullptr, 0, &json_options);
+	std::vector<char> json(json_length + 1);
+
+	results.push_back(Measure(options, c.name, "to_json", json_length, tree.nodes, [&]() {
+		SBF_NodeToJson(tree.root, json.data(), json.size(), &json_options);
+	}));
+
+	results.push_back(Measure(options, c.name, "from_json", json_length, tree.nodes, [&]() {
+		decoded = SBF_JsonToNode(json.data(), json_length, &json_options);
+	}, [&]() {
+		SBF_DestroyNode(decoded);
+		decoded = nullptr;
+	}));
+
+	auto json_arena = SBF_CreateArena(0);
+	json_options.arena = json_arena;
+
+	results.push_back(Measure(options, c.name, "from_json_arena", json_length, tree.nodes, [&]() {
+		decoded = SBF_JsonToNode(json.data(), json_length, &json_options);
+	}, [&]() {
+		SBF_ResetArena(json_arena);
+		decoded = nullptr;
+	}));
+
+	json_options.arena = nullptr;
+	SBF_DestroyArena(json_arena);
+
+	size_t json_cursor = 0;
+	std::vector<uint8_t> json_bytes(SBF_JsonToBytes(json.data(), json_length, nullptr, 0, &json_cursor, &json_options));
+
+	results.push_back(Measure(options, c.name, "json_to_bytes", json_length, tree.nodes, [&]() {
+		size_t cursor = 0;
+		SBF_JsonToBytes(json.data(), json_length, json_bytes.data(), json_bytes.size(), &cursor, &json_options);
+		if (cursor != json_bytes.size()) throw std::runtime_error("JSON encoded to a different size");
+	}));
+
+	// Lookups of a sample of the root's keys, scanning the table and binary-searching a sorted copy.
+	if (SBF_GetNodeType(tree.root) == NodeType_T && SBF_NodeGet_TableLength(tree.root)) {
+		char **keys;
+		Node **values;
+		SBF_NodeGet_Table(tree.root, &keys, &values);
+
+		const auto length = SBF_NodeGet_TableLength(tree.root);
+		const auto step = length < 1000 ? 1 : length / 1000;
+
+		std::vector<std::string> sample;
+		for (size_t x = 0; x < length; x += step) sample.push_back(keys[x]);
+
+		const auto lookup = [&](const Node *table) {
+			for (auto &key : sample) {
+				if (!SBF_TableGet(table, key.c_str())) throw std::runtime_error("key not found");
+			}
+		};
+
+		results.push_back(Measure(options, c.name, "table_get", size, tree.nodes, [&]() { lookup(tree.root); }));
+
+		auto sorted = SBF_CloneNode(tree.root, nullptr);
+		SBF_SortTable(sorted);
+
+		results.push_back(Measure(options, c.name, "table_get_sorted", size, tree.nodes, [&]() { lookup(sorted); }));
+
+		SBF_DestroyNode(sorted);
+	}
+
+	const auto path = options.dir / ("sbf_bench_" + std::string(c.name) + ".sbf");
+	const auto file = path.string();
+
+	results.push_back(Measure(options, c.name, "write_file", size, tree.nodes, [&]() {
+		SBF_WriteFile(file.c_str(), tree.root);
+	}));
+
+	results.push_back(Measure(options, c.name, "read_file", size, tree.nodes, [&]() {
+		uint8_t version = 0;
+		decoded = SBF_ReadFile(file.c_str(), &version);
+	}, [&]() {
+		SBF_DestroyNode(decoded);
+		decoded = nullptr;
+	}));
+
+	SBF_WriteOptions checksum = {};
+	checksum.flags = SBF_WRITE_CHECKSUM;
+
+	results.push_back(Measure(options, c.name, "write_file_checksum", size, tree.nodes, [&]() {
+		SBF_WriteFileEx(file.c_str(), tree.root, &checksum);
+	}));
+
+	results.push_back(Measure(options, c.name, "read_file_checksum", size, tree.nodes, [&]() {
+		uint8_t version = 0;
+		decoded = SBF_ReadFile(file.c_str(), &version);
+	}, [&]() {
+		SBF_DestroyNode(decoded);
+		decoded = nullptr;
+	}));
+
+	std::filesystem::remove(path);
+
+	SBF_DestroyNode(tree.root);
+}
+
+void PrintTable(const std::vector<Result> &results) {
+	std::printf("%-16s %-22s %10s %10s %12s %12s %14s %12s\n",
+		"case", "operation", "MB", "ms/op", "MB/s", "Mnodes/s", "allocs/op", "peak RSS MB");
+
+	for (auto &r : results) {
+		std::printf("%-16s %-22s %10.2f %10.3f %12.1f %12.2f %14.0f %12.1f\n",
+			r.name.c_str(),
+			r.operation.c_str(),
+			r.bytes / 1e6,
+			r.seconds * 1e3,
+			r.bytes / 1e6 / r.seconds,
+			r.nodes / 1e6 / r.seconds,
+			r.allocations,
+			r.peak_rss_kb / 1024.0);
+	}
+}
+
+void WriteJson(const Options &options, const std::vector<Result> &results) {
+	FILE *out = options.json == "-" ? stdout : std::fopen(options.json.c_str(), "w");
+	if (!out) throw std::runtime_error("failed to open " + options.json);
+
+	std::fprintf(out, "{\n");
+	std::fprintf(out, "  \"timestamp\": %lld,\n", (long long)std::time(nullptr));
+	std::fprintf(out, "  \"scale\": %zu,\n", options.scale);
+	std::fprintf(out, "  \"counts_allocations\": %s,\n", SBF_BENCH_COUNTS_ALLOCATIONS ? "true" : "false");
+	std::fprintf(out, "  \"results\": [\n");
+
+	for (size_t x = 0; x < results.size(); x++) {
+		auto &r = results[x];
+
+		std::fprintf(out,
+			"    {\"case\": \"%s\", \"operation\": \"%s\", \"bytes\": %zu, \"nodes\": %zu, \"rounds\": %zu, "
+			"\"seconds_per_op\": %.9g, \"mb_per_s\": %.6g, \"nodes_per_s\": %.6g, "
+			"\"allocations_per_op\": %.6g, \"allocated_bytes_per_op\": %.6g, \"peak_rss_kb\": %ld}%s\n",
+			r.name.c_str(),
+			r.operation.c_str(),
+			r.bytes,
+			r.nodes,
+			r.rounds,
+			r.seconds,
+			r.bytes / 1e6 / r.seconds,
+			r.nodes / r.seconds,
+			r.allocations,
+			r.allocated_bytes,
+			r.peak_rss_kb,
+			x + 1 < results.size() ? "," : "");
+	}
+
+	std::fprintf(out, "  ]\n}\n");
+
+	if (out != stdout) std::fclose(out);
+}
+
+};
+
+int main(int argc, char **argv) {
+	Options options;
+
+	for (int x = 1; x < argc; x++) {
+		std::string arg = argv[x];
+
+		if (x + 1 >= argc) {
+			std::fprintf(stderr, "missing value for %s\n", arg.c_str());
+			return 1;
+		}
+
+		const char *value = argv[++x];
+
+		if (arg == "--json") options.json = value;
+		else if (arg == "--filter") options.filter = value;
+		else if (arg == "--scale") options.scale = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+		else if (arg == "--min-time") options.min_time = std::strtod(value, nullptr);
+		else if (arg == "--dir") options.dir = value;
+		else {
+			std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	const Case cases[] = {
+		{ "deep_tables", "50 chains of 200 nested tables", DeepTables },
+		{ "wide_table", "one table of 100k scalars", WideTable },
+		{ "float_arrays", "two 3M F32 arrays and a 1M F64 array", FloatArrays },
+		{ "short_strings", "100k strings of 4-31 characters", ShortStrings },
+		{ "integer_arrays", "five 1M integer arrays: timestamps, IDs, small values, runs and noise", IntegerArrays },
+		{ "mixed_save", "player, 5k entities, map layers and a message log", MixedSave, nullptr, "entities[*].inventory.item0" },
+		{ "records", "100k records of 5 fields in a table of tables", [](size_t scale) { return Records(scale, false); }, ScanRecords, "*.x" },
+		{ "records_columns", "the same records in a columns node", [](size_t scale) { return Records(scale, true); }, ScanColumns, "x" },
+		{ "depth_10", "100k chains of 10 nested tables", [](size_t scale) { return Chains(10, scale); } },
+		{ "depth_100", "10k chains of 100 nested tables", [](size_t scale) { return Chains(100, scale); } },
+		{ "depth_1000", "1k chains of 1000 nested tables", [](size_t scale) { return Chains(1000, scale); } },
+		{ "depth_10000", "100 chains of 10k nested tables", [](size_t scale) { return Chains(10000, scale); } },
+		{ "depth_100000", "10 chains of 100k nested tables", [](size_t scale) { return Chains(100000, scale); } },
+		{ "depth_1000000", "one chain of 1M nested tables", [](size_t scale) { return Chains(1000000, scale); } },
+	};
+
+	std::vector<Result> results;
+
+	try {
+		for (auto &c : cases) {
+			if (!options.filter.empty() && std::string(c.name).find(options.filter) == std::string::npos) continue;
+
+			std::fprintf(stderr, "%s: %s\n", c.name, c.description);
+			RunCase(options, c, results);
+		}
+
+		// Keep stdout clean for the JSON document when it goes there.
+		if (options.json != "-") PrintTable(results);
+		if (!options.json.empty()) WriteJson(options, results);
+	} catch (std::exception &e) {
+		std::fprintf(stderr, "error: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,641 @@
+// Differential fuzz target for the decoder.
+//
+// Every input is decoded with each decoder mode (iterative and recursive,
+// heap and arena, batch), which must agree on the outcome (error, or the
+// same tree ending at the same byte), also under a tight depth limit. Decoded trees
+// are then round-tripped through the serializer in both byte orders, canonically and with sorted tables (also as
+// columns, when they hold records, and with aligned arrays), cloned and hashed, and the input is also fed through the file-image path that replays update records.
+// Selectors run over the bytes must find the same nodes as over the decoded tree.
+// The incremental decoder, fed the input byte by byte and in chunks of varying sizes, must agree with the reference too.
+// Integer arrays are written with each encoding in turn and must round-trip the same way.
+// Decoded trees are written as JSON and read back, and the input is read as JSON too: reading JSON into
+// a tree (heap or arena) and straight into bytes must agree.
+//
+// Built as a libFuzzer target with Clang, or linked with standalone.cpp otherwise.
+
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "exceptions.h"
+#include "packed.h"
+#include "arena.h"
+#include "node.h"
+#include "io.h"
+
+namespace {
+
+/// Outcome of one decode of the input.
+struct Decoded {
+	Node *node = nullptr;
+	size_t end = 0;
+	bool failed = false;
+};
+
+/// A way of decoding a single message, compared against the reference.
+struct Mode {
+	const char *name;
+	std::function<Decoded(const uint8_t *data, size_t size, SBF_Arena *arena)> decode;
+};
+
+void Check(bool condition, const char *mode, const char *what) {
+	if (condition) return;
+
+	std::fprintf(stderr, "sbf_fuzz: %s: %s\n", mode, what);
+	std::abort();
+}
+
+Decoded DecodeWith(const uint8_t *data, size_t size, const SBF_DecodeOptions &options) {
+	Decoded result;
+
+	try {
+		result.node = SBF_DeserializeEx(data, size, &result.end, &options);
+	} catch (SBF::SerdeException &) {
+		result.failed = true;
+	}
+
+	return result;
+}
+
+// Tiny blocks push every tree across block boundaries and through oversized allocations.
+constexpr size_t Arena_Block_Size = 256;
+
+// Every nesting level takes at least 11 bytes, so inputs up to this size stay
+// within the recursive decoder's default depth limit and must decode like the unlimited reference.
+constexpr size_t Max_Recursive_Input = 1024 * 11;
+
+const Mode modes[] = {
+	{ "recursive", [](const uint8_t *data, size_t size, SBF_Arena *) {
+		SBF_DecodeOptions options = {};
+		options.flags = SBF_DECODE_RECURSIVE;
+		return DecodeWith(data, size, options);
+	} },
+	{ "arena", [](const uint8_t *data, size_t size, SBF_Arena *arena) {
+		SBF_DecodeOptions options = {};
+		options.arena = arena;
+		return DecodeWith(data, size, options);
+	} },
+	{ "recursive arena", [](const uint8_t *data, size_t size, SBF_Arena *arena) {
+		SBF_DecodeOptions options = {};
+		options.flags = SBF_DECODE_RECURSIVE;
+		options.arena = arena;
+		return DecodeWith(data, size, options);
+	} },
+};
+
+/// Both decoders must reject the same inputs for being too deep, and accept the same ones.
+void CheckDepthLimit(const uint8_t *data, size_t size) {
+	SBF_DecodeOptions options = {};
+	options.max_depth = 3;
+
+	auto iterative = DecodeWith(data, size, options);
+
+	options.flags = SBF_DECODE_RECURSIVE;
+	auto recursive = DecodeWith(data, size, options);
+
+	Check(iterative.failed == recursive.failed, "depth limit", "decoders disagree on failure");
+	Check(!iterative.node == !recursive.node, "depth limit", "decoders disagree on the result");
+
+	if (iterative.node) {
+		Check(iterative.end == recursive.end, "depth limit", "decoders stopped at a different byte");
+		Check(SBF::NodesEqual(iterative.node, recursive.node), "depth limit", "decoded trees differ");
+	}
+
+	SBF_DestroyNode(iterative.node);
+	SBF_DestroyNode(recursive.node);
+}
+
+/// Serializes node into a buffer of exactly SBF_CalculateSize bytes.
+std::vector<uint8_t> Encode(const Node *node) {
+	std::vector<uint8_t> bytes(SBF_CalculateSize(node));
+
+	size_t cursor = 0;
+	SBF_Serialize(node, bytes.data(), bytes.size(), &cursor);
+
+	Check(cursor == bytes.size(), "serialize", "wrote a different size than calculated");
+
+	return bytes;
+}
+
+/// Every key of the sorted tables in the tree must be found by binary search, where it is.
+void CheckSortedLookups(const Node *root) {
+	std::vector<const Node *> pending = { root };
+
+	while (!pending.empty()) {
+		auto node = pending.back();
+		pending.pop_back();
+
+		if (node->type != NodeType_T) continue;
+
+		for (size_t x = 0; x < node->table_length; x++) {
+			if (node->flags & NodeFlag_Sorted) Check(SBF::FindEntry(node, node->keys[x]) == x, "sorted", "key not found where it is");
+			pending.push_back(node->values[x]);
+		}
+	}
+}
+
+void CheckRoundTrip(const Node *node) {
+	auto bytes = Encode(node);
+
+	size_t end = 0;
+	Node *decoded = nullptr;
+
+	try {
+		decoded = SBF_Deserialize(bytes.data(), bytes.size(), &end);
+	} catch (SBF::SerdeException &e) {
+		std::fprintf(stderr, "sbf_fuzz: %s\n", e.what());
+		Check(false, "round trip", "serialized tree does not decode");
+	}
+
+	Check(end == bytes.size(), "round trip", "decode stopped before the end");
+	Check(SBF::NodesEqual(node, decoded), "round trip", "decoded tree differs");
+	Check(Encode(decoded) == bytes, "round trip", "encoding is not stable");
+
+	// Copies compare equal and hash alike, whether decoded or cloned, on the heap or in an arena.
+	const auto hash = SBF_NodeHash(node);
+	Check(SBF_NodeHash(decoded) == hash, "hash", "decoded tree hashes differently");
+
+	SBF_DestroyNode(decoded);
+
+	auto clone = SBF_CloneNode(node, nullptr);
+	Check(SBF_NodeEquals(node, clone) && SBF_NodeHash(clone) == hash, "clone", "cloned tree differs");
+	SBF_DestroyNode(clone);
+
+	auto arena = SBF_CreateArena(0);
+	clone = SBF_CloneNode(node, arena);
+	Check(SBF_NodeEquals(clone, node) && SBF_NodeHash(clone) == hash, "clone", "tree cloned into an arena differs");
+	SBF_DestroyArena(arena);
+
+	// The same tree in big-endian order takes as many bytes, and decodes back to it.
+	SBF_EncodeOptions encode = {};
+	encode.flags = SBF_ENCODE_BIG_ENDIAN;
+
+	std::vector<uint8_t> swapped(bytes.size());
+	size_t cursor = 0;
+	SBF_SerializeEx(node, swapped.data(), swapped.size(), &cursor, &encode);
+
+	Check(cursor == swapped.size(), "big endian", "wrote a different size than calculated");
+
+	SBF_DecodeOptions decode = {};
+	decode.flags = SBF_DECODE_BIG_ENDIAN;
+
+	auto big_endian = DecodeWith(swapped.data(), swapped.size(), decode);
+
+	Check(!big_endian.failed && big_endian.end == swapped.size(), "big endian", "serialized tree does not decode");
+	Check(SBF::NodesEqual(node, big_endian.node), "big endian", "decoded tree differs");
+
+	SBF_DestroyNode(big_endian.node);
+
+	// The canonical encoding is as large but for encoded arrays, which it writes raw, and its own canonical
+	// encoding once decoded; trees with duplicate keys have none.
+	encode.flags = SBF_ENCODE_CANONICAL;
+
+	std::vector<uint8_t> canonical(SBF_CalculateSizeEx(node, 0, &encode));
+	cursor = 0;
+
+	try {
+		SBF_SerializeEx(node, canonical.data(), canonical.size(), &cursor, &encode);
+	} catch (std::invalid_argument &) {
+		Check(cursor == 0, "canonical", "failed encoding moved the cursor");
+		return;
+	}
+
+	Check(cursor == canonical.size(), "canonical", "wrote a different size than calculated");
+
+	end = 0;
+	decoded = SBF_Deserialize(canonical.data(), canonical.size(), &end);
+
+	std::vector<uint8_t> again(canonical.size());
+	cursor = 0;
+	SBF_SerializeEx(decoded, again.data(), again.size(), &cursor, &encode);
+
+	Check(again == canonical && Encode(decoded) == canonical, "canonical", "canonical encoding is not stable");
+
+	SBF_DestroyNode(decoded);
+
+	// Sorted tables are in canonical order too, which decoders check before marking them sorted.
+	encode.flags = SBF_ENCODE_SORTED_TABLES;
+
+	std::vector<uint8_t> sorted(bytes.size());
+	cursor = 0;
+	SBF_SerializeEx(node, sorted.data(), sorted.size(), &cursor, &encode);
+
+	Check(cursor == sorted.size(), "sorted", "wrote a different size than calculated");
+
+	auto resorted = DecodeWith(sorted.data(), sorted.size(), {});
+	Check(!resorted.failed && resorted.end == sorted.size(), "sorted", "serialized tree does not decode");
+
+	CheckSortedLookups(resorted.node);
+
+	encode.flags = SBF_ENCODE_CANONICAL;
+	cursor = 0;
+	SBF_SerializeEx(resorted.node, again.data(), again.size(), &cursor, &encode);
+
+	Check(again == canonical, "sorted", "decoded tree is not in canonical order");
+
+	SBF_DestroyNode(resorted.node);
+}
+
+/// Tables of records must survive the trip through a columns node and back.
+void CheckColumns(const Node *node) {
+	if (node->type != NodeType_T) return;
+
+	auto columns = SBF_TableToColumns(node, "key");
+	if (!columns) return;
+
+	CheckRoundTrip(columns);
+
+	// Records come back with the field order of the first one, so compare as columns again.
+	auto table = SBF_ColumnsToTable(columns, "key");
+	auto again = SBF_TableToColumns(table, "key");
+
+	Check(again && SBF::NodesEqual(columns, again), "columns", "records changed on the way back");
+
+	SBF_DestroyNode(again);
+	SBF_DestroyNode(table);
+	SBF_DestroyNode(columns);
+}
+
+const char *const selector_paths[] = { "", "*", "[0]", "*.*", "[1].*", "*.*.*", "key" };
+
+/// Runs selectors over the input; where it decodes, they must match what they match in the tree.
+void CheckSelectors(const uint8_t *data, size_t size, const Decoded &reference) {
+	for (auto path : selector_paths) {
+		auto selector = SBF_CompileSelector(path);
+
+		std::vector<std::pair<size_t, size_t>> spans;
+		size_t end = 0;
+		bool failed = false;
+
+		try {
+			SBF_SelectBytes(selector, data, size, &end, [](size_t offset, size_t length, void *user) {
+				((std::vector<std::pair<size_t, size_t>> *)user)->push_back({ offset, length });
+				return true;
+			}, &spans);
+		} catch (SBF::SerdeException &) {
+			failed = true;
+		}
+
+		if (reference.node) {
+			Check(!failed, path, "selector failed on bytes that decode");
+			Check(end == reference.end, path, "selector stopped at a different byte than the decoder");
+
+			std::vector<Node *> nodes;
+			SBF_SelectNodes(selector, reference.node, [](Node *node, void *user) {
+				((std::vector<Node *> *)user)->push_back(node);
+				return true;
+			}, &nodes);
+
+			Check(nodes.size() == spans.size(), path, "selector found a different number of nodes in the bytes");
+
+			for (size_t x = 0; x < nodes.size(); x++) {
+				size_t begin = spans[x].first;
+				auto node = SBF_Deserialize(data, size, &begin);
+
+				Check(begin == spans[x].first + spans[x].second, path, "selected span does not end with its node");
+				Check(SBF::NodesEqual(node, nodes[x]), path, "selected bytes differ from the selected node");
+
+				SBF_DestroyNode(node);
+			}
+		}
+
+		SBF_DestroySelector(selector);
+	}
+}
+
+/// The tree written with aligned arrays must decode back to it, scan to as many bytes,
+/// and select the same nodes as over the tree, also when written at an odd offset, where the padding differs.
+void CheckAligned(const Node *node) {
+	SBF_EncodeOptions encode = {};
+	encode.array_alignment = 16;
+
+	for (size_t offset : { 0, 7 }) {
+		std::vector<uint8_t> bytes(offset + SBF_CalculateSizeEx(node, offset, &encode));
+		size_t cursor = offset;
+		SBF_SerializeEx(node, bytes.data(), bytes.size(), &cursor, &encode);
+
+		Check(cursor == bytes.size(), "aligned", "wrote a different size than calculated");
+
+		size_t end = offset;
+		auto decoded = SBF_Deserialize(bytes.data(), bytes.size(), &end);
+
+		Check(end == bytes.size() && SBF::NodesEqual(node, decoded), "aligned", "decoded tree differs");
+		SBF_DestroyNode(decoded);
+
+		SBF_ScanStats stats = {};
+		end = offset;
+		SBF_ScanBytes(bytes.data(), bytes.size(), &end, &stats);
+
+		auto scanned = stats.key_bytes + stats.padding_bytes;
+		for (auto type_bytes : stats.bytes) scanned += type_bytes;
+
+		Check(end == bytes.size() && scanned == bytes.size() - offset, "aligned", "scan does not add up to the bytes");
+
+		if (!offset) {
+			Decoded reference;
+			reference.node = const_cast<Node *>(node);
+			reference.end = bytes.size();
+
+			CheckSelectors(bytes.data(), bytes.size(), reference);
+		}
+	}
+}
+
+void CheckBatch(const uint8_t *data, size_t size, const Decoded &reference) {
+	auto arena = SBF_CreateArena(Arena_Block_Size);
+
+	// Twice the same message, so a batch always spans more than one decode.
+	const uint8_t *buffers[] = { data, data };
+	const size_t lengths[] = { size, size };
+	Node *out[2];
+
+	auto decoded = SBF_DeserializeBatch(buffers, lengths, 2, arena, out, 1);
+
+	Check(decoded == (reference.node ? 2 : 0), "batch", "decoded a different number of messages");
+
+	for (auto node : out) {
+		Check(!node == !reference.node, "batch", "disagrees with the reference");
+		if (node) Check(SBF::NodesEqual(node, reference.node), "batch", "decoded tree differs");
+	}
+
+	SBF_DestroyArena(arena);
+}
+
+/// Feeds the input to an incremental decoder in chunks of chunk_size bytes (sizes drawn from the input itself
+/// when 0), which must end where the reference does with the same tree, or reject (or still wait on) what it rejects.
+void CheckStream(const uint8_t *data, size_t size, const Decoded &reference, size_t chunk_size, SBF_Arena *arena) {
+	SBF_DecodeOptions options = {};
+	options.arena = arena;
+
+	auto decoder = SBF_CreateDecoder(&options);
+
+	size_t offset = 0;
+	auto status = SBF_DECODE_NEED_MORE;
+	bool failed = false;
+
+	try {
+		while (offset < size && status == SBF_DECODE_NEED_MORE) {
+			auto length = chunk_size ? chunk_size : 1 + data[offset] % 13;
+			if (length > size - offset) length = size - offset;
+
+			size_t used;
+			status = SBF_DecoderFeed(decoder, data + offset, length, &used);
+
+			Check(status == SBF_DECODE_DONE || used == length, "stream", "stopped reading before the end of a node");
+			offset += used;
+		}
+	} catch (SBF::SerdeException &) {
+		failed = true;
+	}
+
+	if (reference.node) {
+		Check(!failed && status == SBF_DECODE_DONE, "stream", "did not decode what the reference does");
+		Check(offset == reference.end, "stream", "stopped at a different byte");
+
+		auto node = SBF_DecoderTake(decoder);
+		Check(SBF::NodesEqual(node, reference.node), "stream", "decoded tree differs");
+		SBF_DestroyNode(node);
+	} else {
+		Check(failed || status == SBF_DECODE_NEED_MORE, "stream", "decoded what the reference rejects");
+	}
+
+	SBF_DestroyDecoder(decoder);
+}
+
+/// The tree with its integer arrays written encoded, each encoding in turn, must round-trip like any other,
+/// decode incrementally and scan to as many bytes; with the smallest picked everywhere, it is never larger than with none.
+void CheckPacked(const Node *node) {
+	auto clone = SBF_CloneNode(node, nullptr);
+
+	std::vector<Node *> arrays;
+	std::vector<Node *> pending = { clone };
+
+	while (!pending.empty()) {
+		auto next = pending.back();
+		pending.pop_back();
+
+		if (SBF::IsPackableType(next->type)) arrays.push_back(next);
+		if (next->type == NodeType_T || next->type == NodeType_Columns) pending.insert(pending.end(), next->values, next->values + next->table_length);
+	}
+
+	if (arrays.empty()) return SBF_DestroyNode(clone);
+
+	for (auto array : arrays) SBF_NodeSet_ArrayEncoding(array, SBF_ARRAY_RAW);
+	const auto raw = SBF_CalculateSize(clone);
+
+	// Canonical encodings ignore the encodings of arrays; trees with duplicate keys have none.
+	SBF_EncodeOptions canonical_options = {};
+	canonical_options.flags = SBF_ENCODE_CANONICAL;
+
+	const auto Canonical = [&canonical_options](const Node *tree) {
+		std::vector<uint8_t> bytes(SBF_CalculateSizeEx(tree, 0, &canonical_options));
+		size_t cursor = 0;
+
+		try {
+			SBF_SerializeEx(tree, bytes.data(), bytes.size(), &cursor, &canonical_options);
+		} catch (std::invalid_argument &) {
+			bytes.clear();
+		}
+
+		return bytes;
+	};
+
+	const auto canonical = Canonical(clone);
+
+	for (auto array : arrays) SBF_NodeSet_ArrayEncoding(array, SBF_ARRAY_AUTO);
+	Check(SBF_CalculateSize(clone) <= raw, "packed", "smallest encoding is larger than none");
+
+	for (size_t turn = 0; turn < 4; turn++) {
+		for (size_t x = 0; x < arrays.size(); x++) {
+			SBF_NodeSet_ArrayEncoding(arrays[x], (SBF_ArrayEncoding)(SBF_ARRAY_FRAME_OF_REFERENCE + (x + turn) % 4));
+		}
+
+		CheckRoundTrip(clone);
+		Check(Canonical(clone) == canonical, "packed", "canonical encoding depends on the array encodings");
+
+		auto bytes = Encode(clone);
+
+		Decoded reference;
+		reference.node = clone;
+		reference.end = bytes.size();
+
+		CheckStream(bytes.data(), bytes.size(), reference, 0, nullptr);
+
+		SBF_ScanStats stats = {};
+		size_t end = 0;
+		SBF_ScanBytes(bytes.data(), bytes.size(), &end, &stats);
+
+		auto scanned = stats.key_bytes + stats.padding_bytes;
+		for (auto type_bytes : stats.bytes) scanned += type_bytes;
+
+		Check(end == bytes.size() && scanned == bytes.size(), "packed", "scan does not add up to the bytes");
+	}
+
+	SBF_DestroyNode(clone);
+}
+
+/// Reads JSON text into a tree, from the heap and from an arena, and straight into bytes, which must all agree.
+/// Returns the heap tree, or null if the text is not JSON (or a null document).
+Node *CheckJsonRead(const char *json, size_t length) {
+	Node *node = nullptr;
+
+	try {
+		node = SBF_JsonToNode(json, length, nullptr);
+	} catch (SBF::SerdeException &) {
+		size_t cursor = 0;
+		bool failed = false;
+
+		try {
+			SBF_JsonToBytes(json, length, nullptr, 0, &cursor, nullptr);
+		} catch (SBF::SerdeException &) {
+			failed = true;
+		}
+
+		Check(failed, "json", "bytes read JSON the tree rejects");
+		return nullptr;
+	}
+
+	size_t cursor = 0;
+	std::vector<uint8_t> bytes(SBF_JsonToBytes(json, length, nullptr, 0, &cursor, nullptr));
+	SBF_JsonToBytes(json, length, bytes.data(), bytes.size(), &cursor, nullptr);
+
+	Check(cursor == bytes.size(), "json", "bytes read JSON to a different size than they counted");
+
+	if (!node) {
+		Check(bytes.empty(), "json", "bytes wrote a null document");
+		return nullptr;
+	}
+
+	Check(Encode(node) == bytes, "json", "bytes differ from the serialized tree");
+
+	auto arena = SBF_CreateArena(Arena_Block_Size);
+	SBF_JsonOptions options = {};
+	options.arena = arena;
+
+	auto in_arena = SBF_JsonToNode(json, length, &options);
+	Check(SBF::NodesEqual(node, in_arena), "json", "arena tree differs");
+
+	SBF_DestroyArena(arena);
+
+	return node;
+}
+
+std::string ToJson(const Node *node) {
+	std::string text(SBF_NodeToJson(node, nullptr, 0, nullptr), '\0');
+
+	// Room for the text but not its terminator leaves the buffer unspecified, and must not overrun it.
+	if (!text.empty()) SBF_NodeToJson(node, text.data(), text.size(), nullptr);
+
+	Check(SBF_NodeToJson(node, text.data(), text.size() + 1, nullptr) == text.size(), "json", "wrote a different length than counted");
+
+	return text;
+}
+
+/// Trees written as JSON read back; once read, the text is stable: floats and numbers keep
+/// their values and types, and only what JSON cannot tell apart (integer widths, NaNs) changes on the first trip.
+void CheckJson(const Node *node) {
+	const auto text = ToJson(node);
+
+	auto first = CheckJsonRead(text.data(), text.size());
+	const auto again = first ? ToJson(first) : std::string("null");
+
+	auto second = CheckJsonRead(again.data(), again.size());
+	Check(!first == !second && (!first || SBF::NodesEqual(first, second)), "json", "tree changed through JSON");
+
+	SBF_DestroyNode(second);
+	SBF_DestroyNode(first);
+}
+
+void CheckFileImage(const uint8_t *data, size_t size) {
+	uint8_t version = 0;
+	Node *node = nullptr;
+
+	try {
+		node = SBF::DecodeFileBytes(data, size, &version);
+	} catch (std::exception &) {
+		// Malformed bases and records that do not apply are reported as errors; only crashes matter here.
+		return;
+	}
+
+	if (!node) return;
+
+	CheckRoundTrip(node);
+
+	// What SBF_AppendFile keeps of the image must read the same, torn tail or not.
+	size_t end = 0;
+	Node *kept = nullptr;
+
+	try {
+		end = SBF::IntactFileEnd(data, size);
+		kept = SBF::DecodeFileBytes(data, end, nullptr);
+	} catch (std::exception &) {}
+
+	Check(kept && SBF_NodeEquals(node, kept), "append", "intact part of a file image reads differently");
+
+	SBF_DestroyNode(kept);
+	SBF_DestroyNode(node);
+}
+
+};
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+	const auto reference = DecodeWith(data, size, {});
+
+	for (auto &mode : modes) {
+		if (size > Max_Recursive_Input && std::strstr(mode.name, "recursive")) continue;
+
+		auto arena = SBF_CreateArena(Arena_Block_Size);
+		const auto decoded = mode.decode(data, size, arena);
+
+		Check(decoded.failed == reference.failed, mode.name, "disagrees with the reference on failure");
+
+		if (!reference.failed) {
+			Check(!decoded.node == !reference.node, mode.name, "disagrees with the reference on the result");
+			Check(decoded.end == reference.end, mode.name, "stopped at a different byte");
+
+			if (reference.node) Check(SBF::NodesEqual(decoded.node, reference.node), mode.name, "decoded tree differs");
+		}
+
+		SBF_DestroyNode(decoded.node);
+		SBF_DestroyArena(arena);
+	}
+
+	CheckBatch(data, size, reference);
+
+	{
+		auto arena = SBF_CreateArena(Arena_Block_Size);
+
+		CheckStream(data, size, reference, 1, nullptr);
+		CheckStream(data, size, reference, 0, arena);
+		CheckStream(data, size, reference, size, nullptr);
+
+		SBF_DestroyArena(arena);
+	}
+
+	CheckSelectors(data, size, reference);
+	if (size <= Max_Recursive_Input) CheckDepthLimit(data, size);
+
+	if (reference.node) {
+		CheckRoundTrip(reference.node);
+		CheckAligned(reference.node);
+		CheckColumns(reference.node);
+		CheckPacked(reference.node);
+		CheckJson(reference.node);
+	}
+
+	SBF_DestroyNode(CheckJsonRead((const char *)data, size));
+
+	SBF_DestroyNode(reference.node);
+
+	CheckFileImage(data, size);
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+// Driver for the fuzz target when libFuzzer is not available.
+//
+// Usage: sbf_fuzz [-runs=N] [-seed=N] [-max_len=N] [FILE|DIR]...
+//
+// Every input file (directories are read recursively) is run once and timed,
+// which doubles as a benchmark of the harness over a fixed corpus. With -runs,
+// that many randomly mutated corpus entries are run afterwards. An input that
+// crashes is saved as crash-<seed>-<run> in the working directory.
+
+#include <filesystem>
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+extern "C" void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const std::vector<uint8_t> *current_input = nullptr;
+char crash_path[64] = "crash";
+
+void SaveCurrentInput() {
+#if !defined(_WIN32)
+	if (!current_input) return;
+
+	int fd = open(crash_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return;
+
+	auto written = write(fd, current_input->data(), current_input->size());
+	(void)written;
+
+	close(fd);
+
+	static const char message[] = "sbf_fuzz: crashing input saved\n";
+	written = write(STDERR_FILENO, message, sizeof(message) - 1);
+	(void)written;
+#endif
+}
+
+void OnSignal(int signal) {
+	SaveCurrentInput();
+
+	std::signal(signal, SIG_DFL);
+	std::raise(signal);
+}
+
+std::vector<uint8_t> ReadFile(const std::filesystem::path &path) {
+	std::ifstream file(path, std::ios::binary);
+
+	return std::vector<uint8_t>(
+		std::istreambuf_iterator<char>(file),
+		std::istreambuf_iterator<char>()
+	);
+}
+
+/// Values worth planting: tags, their closing counterparts and boundary lengths.
+uint8_t InterestingByte(std::mt19937_64 &random) {
+	static const uint8_t bytes[] = { 0, 1, 2, 9, 10, 18, 19, 20, 0x7f, 0x80, 0xff, (uint8_t)-1, (uint8_t)-9, (uint8_t)-18, (uint8_t)-19 };
+	return bytes[random() % sizeof(bytes)];
+}
+
+void Mutate(std::vector<uint8_t> &input, const std::vector<std::vector<uint8_t>> &corpus, size_t max_len, std::mt19937_64 &random) {
+	const auto mutations = 1 + random() % 4;
+
+	for (size_t x = 0; x < mutations; x++) {
+		const auto position = input.empty() ? 0 : random() % input.size();
+
+		switch (random() % 7) {
+		case 0:
+			if (!input.empty()) input[position] ^= (uint8_t)(1 << (random() % 8));
+			break;
+		case 1:
+			if (!input.empty()) input[position] = InterestingByte(random);
+			break;
+		case 2:
+			input.insert(input.begin() + position, InterestingByte(random));
+			break;
+		case 3:
+			if (!input.empty()) input.erase(input.begin() + position, input.begin() + std::min(input.size(), position + 1 + random() % 8));
+			break;
+		case 4:
+			// Overwrite what may be an array or string length with a boundary value.
+			if (input.size() >= 8) {
+				static const uint64_t lengths[] = { 0, 1, 7, 8, 0xffffffffull, 1ull << 61, ~0ull, ~0ull / 8 + 1 };
+				auto value = lengths[random() % (sizeof(lengths) / sizeof(lengths[0]))];
+				auto at = random() % (input.size() - 7);
+				std::memcpy(input.data() + at, &value, 8);
+			}
+			break;
+		case 5:
+			input.resize(position);
+			break;
+		default:
+			// Splice in a piece of another input, e.g. a table entry into another table.
+			{
+				auto &other = corpus[random() % corpus.size()];
+				if (other.empty()) break;
+
+				auto from = random() % other.size();
+				auto length = 1 + random() % (other.size() - from);
+				input.insert(input.begin() + position, other.begin() + from, other.begin() + from + length);
+			}
+			break;
+		}
+	}
+
+	if (input.size() > max_len) input.resize(max_len);
+}
+
+};
+
+int main(int argc, char **argv) {
+	uint64_t runs = 0;
+	uint64_t seed = std::random_device()();
+	size_t max_len = 4096;
+
+	std::vector<std::vector<uint8_t>> corpus;
+
+	for (int x = 1; x < argc; x++) {
+		std::string arg = argv[x];
+
+		if (arg.rfind("-runs=", 0) == 0) runs = std::strtoull(arg.c_str() + 6, nullptr, 10);
+		else if (arg.rfind("-seed=", 0) == 0) seed = std::strtoull(arg.c_str() + 6, nullptr, 10);
+		else if (arg.rfind("-max_len=", 0) == 0) max_len = std::strtoull(arg.c_str() + 9, nullptr, 10);
+		else if (std::filesystem::is_directory(arg)) {
+			for (auto &entry : std::filesystem::recursive_directory_iterator(arg)) {
+				if (entry.is_regular_file()) corpus.push_back(ReadFile(entry.path()));
+			}
+		}
+		else if (std::filesystem::is_regular_file(arg)) corpus.push_back(ReadFile(arg));
+		else {
+			std::fprintf(stderr, "sbf_fuzz: no such file or option: %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	if (corpus.empty()) corpus.emplace_back();
+
+	std::signal(SIGABRT, OnSignal);
+	std::signal(SIGSEGV, OnSignal);
+	if (__sanitizer_set_death_callback) __sanitizer_set_death_callback(SaveCurrentInput);
+
+	std::snprintf(crash_path, sizeof(crash_path), "crash-corpus");
+
+	size_t corpus_bytes = 0;
+	auto start = Clock::now();
+
+	for (auto &input : corpus) {
+		current_input = &input;
+		LLVMFuzzerTestOneInput(input.data(), input.size());
+		corpus_bytes += input.size();
+	}
+
+	auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::printf("corpus: %zu inputs, %zu bytes in %.3f s (%.0f execs/s, %.1f MB/s)\n",
+		corpus.size(), corpus_bytes, seconds, corpus.size() / seconds, corpus_bytes / 1e6 / seconds);
+
+	if (!runs) return 0;
+
+	std::mt19937_64 random(seed);
+	std::vector<uint8_t> input;
+
+	start = Clock::now();
+
+	for (uint64_t run = 0; run < runs; run++) {
+		input = corpus[random() % corpus.size()];
+		Mutate(input, corpus, max_len, random);
+
+		std::snprintf(crash_path, sizeof(crash_path), "crash-%llu-%llu", (unsigned long long)seed, (unsigned long long)run);
+		current_input = &input;
+
+		LLVMFuzzerTestOneInput(input.data(), input.size());
+	}
+
+	seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::printf("mutations: %llu runs with seed %llu in %.3f s (%.0f execs/s)\n",
+		(unsigned long long)runs, (unsigned long long)seed, seconds, runs / seconds);
+
+	return 0;
+}
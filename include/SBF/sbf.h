@@ -41,12 +41,336 @@ typedef enum {
 	// Has the same underlying representation as U8A (not null-terminated).
 	NodeType_String,
 	
-	NodeType_T
+	NodeType_T,
+
+	// Records stored column by column; see SBF_TableToColumns.
+	NodeType_Columns
 
 } NodeType;
 
 typedef struct Node Node;
 
+/// How an integer array (I32A, I64A, U32A or U64A) is written; see SBF_NodeSet_ArrayEncoding.
+/// Encoded arrays are stored in blocks of 128 values bit-packed at the width the block needs,
+/// in four 32-bit (or two 64-bit) interleaved lanes that SIMD code packs and unpacks a vector at a time.
+typedef enum {
+	/// Every element at its full width, as arrays are written by default.
+	SBF_ARRAY_RAW = 0,
+	/// Offsets from the smallest value of each block: for values in a narrow range, such as enums or small counts.
+	SBF_ARRAY_FRAME_OF_REFERENCE = 1,
+	/// Differences between consecutive values, as offsets from the smallest of each block:
+	/// for sorted IDs and timestamps (evenly spaced ones take no bits at all).
+	SBF_ARRAY_DELTA = 2,
+	/// Runs of up to 256 equal values, their values and lengths bit-packed: for long runs of repeated values.
+	SBF_ARRAY_RUN_LENGTH = 3,
+	/// Whichever of the above (raw included) is the smallest for the array at hand, picked when it is written.
+	SBF_ARRAY_AUTO = 4,
+} SBF_ArrayEncoding;
+
+/// Region that node trees can be allocated from and released with all at once.
+typedef struct SBF_Arena SBF_Arena;
+
+/// Decoded files shared between the parts of a process; see SBF_CreateCache.
+typedef struct SBF_Cache SBF_Cache;
+
+typedef enum {
+	/// Write into a temporary file next to the destination and rename it into place,
+	/// so a crash leaves either the old or the new file, never a torn one.
+	SBF_WRITE_ATOMIC = 1 << 0,
+
+	/// Flush the file data to stable storage (fdatasync) before returning;
+	/// with SBF_WRITE_ATOMIC, the directory entry is flushed after the rename as well.
+	SBF_WRITE_SYNC = 1 << 1,
+
+	/// Like SBF_WRITE_SYNC, but the flush (and the rename of an atomic write) happens
+	/// on a background thread. Reads of the same file wait for it to complete.
+	SBF_WRITE_ASYNC_FLUSH = 1 << 2,
+
+	/// Write format version 2, where the base node and every record appended by SBF_AppendFile
+	/// are followed by a CRC32C of their bytes, checked by every read. The checksums are computed
+	/// as the file is written and verified as it is read, without a pass of their own.
+	SBF_WRITE_CHECKSUM = 1 << 3,
+
+	/// Write the file in big-endian byte order (see SBF_ENCODE_BIG_ENDIAN), which is marked
+	/// in its version byte. SBF_ReadFile reads files of either order, and SBF_AppendFile
+	/// appends records in the order of the file.
+	SBF_WRITE_BIG_ENDIAN = 1 << 4,
+
+	/// Write the canonical encoding of the node (see SBF_ENCODE_CANONICAL).
+	/// Records appended by SBF_AppendFile are not affected.
+	SBF_WRITE_CANONICAL = 1 << 5,
+
+	/// Write the tables of the node as sorted ones (see SBF_ENCODE_SORTED_TABLES).
+	SBF_WRITE_SORTED_TABLES = 1 << 6,
+} SBF_WriteFlags;
+
+/// Receives the result of SBF_ReadFileAsync: either the node tree (owned by the callee)
+/// and format version, or a null node and an error message valid during the call only.
+typedef void (*SBF_ReadCallback)(Node *node, uint8_t version, const char *error, void *user);
+
+/// Receives the result of SBF_WriteFileAsync; error is null on success.
+typedef void (*SBF_WriteCallback)(const char *error, void *user);
+
+/// Zero-initialize for the default behavior (truncate and write in place).
+typedef struct {
+	/// Combination of SBF_WriteFlags.
+	uint32_t flags;
+
+	/// Files of at least this many bytes get their space preallocated before
+	/// writing (fallocate, Linux only). 0 disables preallocation.
+	size_t preallocate_threshold;
+
+	/// Aligns the arrays of the base node as SBF_EncodeOptions::array_alignment does, from the start
+	/// of the file, so that they can be used in place once the file is mapped in memory.
+	/// The alignment is recorded in the file, and kept by SBF_Compact; records appended later are packed.
+	uint32_t array_alignment;
+} SBF_WriteOptions;
+
+typedef enum {
+	/// Use the recursive reference decoder rather than the iterative one.
+	SBF_DECODE_RECURSIVE = 1 << 0,
+
+	/// The buffer was written with SBF_ENCODE_BIG_ENDIAN.
+	SBF_DECODE_BIG_ENDIAN = 1 << 1,
+} SBF_DecodeFlags;
+
+/// Zero-initialize for the defaults of SBF_Deserialize.
+typedef struct {
+	/// Combination of SBF_DecodeFlags.
+	uint32_t flags;
+
+	/// Deepest nesting accepted, the root being at depth 1; deeper input fails to decode.
+	/// 0 means no limit for the iterative decoder, whose memory use is bounded by the input size,
+	/// and 1024 for the recursive one, which uses the call stack.
+	size_t max_depth;
+
+	/// Allocate the tree from this arena rather than the heap; see SBF_DeserializeBatch.
+	SBF_Arena *arena;
+} SBF_DecodeOptions;
+
+typedef enum {
+	/// Write numbers, lengths and array elements in big-endian byte order rather than the
+	/// default little-endian one; decode the result with SBF_DECODE_BIG_ENDIAN.
+	/// Either order is written and read at full speed on any CPU: arrays in the order of
+	/// the CPU are copied as they are, and swapped in bulk otherwise.
+	SBF_ENCODE_BIG_ENDIAN = 1 << 0,
+
+	/// Write the canonical encoding of the tree, so that equal data always gives the same bytes
+	/// (for content-addressed storage, deduplication, signatures): the entries of tables and columns
+	/// nodes are written in the order of their keys, compared byte by byte (a key before the keys
+	/// it is a prefix of), every NaN as the positive quiet NaN without payload, and every array raw,
+	/// whatever its encoding (see SBF_NodeSet_ArrayEncoding). Keys are sorted with a radix quicksort
+	/// as the tree is written, and tables already in order cost a single scan.
+	/// Throws std::invalid_argument, leaving *cursor where it was, if a table has the same key twice.
+	/// The output decodes like any other, in its byte order.
+	SBF_ENCODE_CANONICAL = 1 << 1,
+
+	/// Write every table as a sorted table: its entries in canonical key order (see SBF_ENCODE_CANONICAL),
+	/// under a tag of its own that tells readers so. Decoders check the order and mark the tables
+	/// sorted (see SBF_SortTable), so lookups binary-search them as soon as they are decoded.
+	/// Throws std::invalid_argument, leaving *cursor where it was, if a table has the same key twice.
+	/// Readers older than sorted tables reject the output as having an invalid tag.
+	SBF_ENCODE_SORTED_TABLES = 1 << 2,
+} SBF_EncodeFlags;
+
+/// Zero-initialize for the defaults of SBF_Serialize.
+typedef struct {
+	/// Combination of SBF_EncodeFlags.
+	uint32_t flags;
+
+	/// 0 writes arrays packed. Otherwise a power of two up to 64: zero bytes are written before every
+	/// array but strings, so that its elements start at a multiple of this many bytes (or of their own size,
+	/// if larger) from the start of bytes. In a buffer aligned as much, they can then be used in place
+	/// as typed arrays, by SIMD code too; see SBF_ArrayInBytes. The padding depends on where the node
+	/// is written, and so does its size: see SBF_CalculateSizeEx. Decoders step over it, and so do
+	/// SBF_SelectBytes and SBF_ScanBytes; readers older than aligned arrays reject it as an invalid tag.
+	uint32_t array_alignment;
+} SBF_EncodeOptions;
+
+typedef enum {
+	/// When a file is due for a check, return the tree at hand and check (and reload) the file
+	/// on a library worker thread, rather than before returning.
+	SBF_CACHE_REVALIDATE_IN_BACKGROUND = 1 << 0,
+} SBF_CacheFlags;
+
+/// Zero-initialize for a cache without a memory limit that checks files on every lookup.
+typedef struct {
+	/// Combination of SBF_CacheFlags.
+	uint32_t flags;
+
+	/// Memory the trees nobody holds may take before the least recently used are dropped; 0 for no limit.
+	/// Held trees count towards it, but are never dropped.
+	size_t max_bytes;
+
+	/// Milliseconds a file is trusted not to have changed since it was last checked; 0 checks it every time.
+	uint32_t revalidate_ms;
+} SBF_CacheOptions;
+
+typedef enum {
+	/// SBF_NodeToJson puts every entry of an object on a line of its own, indented by two spaces per level.
+	SBF_JSON_PRETTY = 1 << 0,
+
+	/// SBF_JsonToBytes writes big-endian bytes, as SBF_ENCODE_BIG_ENDIAN does.
+	SBF_JSON_BIG_ENDIAN = 1 << 1,
+} SBF_JsonFlags;
+
+/// Zero-initialize for the defaults of the JSON functions.
+typedef struct {
+	/// Combination of SBF_JsonFlags.
+	uint32_t flags;
+
+	/// Deepest nesting accepted when reading JSON, the root being at depth 1; 0 means no limit.
+	/// Nesting is read with a stack of its own, so memory use is bounded by the input size either way.
+	size_t max_depth;
+
+	/// SBF_JsonToNode allocates the tree from this arena rather than the heap.
+	SBF_Arena *arena;
+} SBF_JsonOptions;
+
+/// Room for every NodeType in the per-type counters of SBF_Stats.
+#define SBF_STATS_NODE_TYPES 32
+
+/// Decoder counters, accumulated over every decode since the last SBF_ResetStats.
+/// Only collected when the library is built with SBF_ENABLE_STATS.
+typedef struct {
+	/// Nodes decoded, indexed by NodeType.
+	uint64_t nodes[SBF_STATS_NODE_TYPES];
+
+	/// Payload bytes decoded, indexed by NodeType: scalar values, array contents,
+	/// and for tables the bytes of their keys.
+	uint64_t bytes[SBF_STATS_NODE_TYPES];
+
+	/// Allocations made for decoded nodes, and their total size.
+	uint64_t allocations;
+	uint64_t allocated_bytes;
+
+	/// Deepest nesting reached; the root is at depth 1.
+	uint64_t max_depth;
+
+	/// Time spent copying array and string payloads.
+	uint64_t array_copy_ns;
+
+	/// Time spent parsing tables, not counting the array copies of their entries.
+	uint64_t table_parse_ns;
+
+	/// Top-level nodes decoded.
+	uint64_t decodes;
+} SBF_Stats;
+
+/// Buckets of the depth histogram of SBF_ScanStats.
+#define SBF_SCAN_DEPTHS 64
+
+/// Shape of serialized trees, gathered by SBF_ScanBytes without decoding them.
+/// The bytes of all the nodes, keys and padding add up to the bytes scanned.
+typedef struct {
+	/// Nodes, indexed by NodeType; sorted tables count as tables.
+	uint64_t nodes[SBF_STATS_NODE_TYPES];
+
+	/// Bytes of the nodes, indexed by NodeType: tags, length prefix and payload, but for
+	/// the entries of tables and columns nodes, which are counted as nodes and keys of their own.
+	uint64_t bytes[SBF_STATS_NODE_TYPES];
+
+	/// Keys of tables and names of columns, and their bytes.
+	uint64_t keys;
+	uint64_t key_bytes;
+
+	/// Zero bytes aligning arrays (see SBF_EncodeOptions::array_alignment).
+	uint64_t padding_bytes;
+
+	/// Arrays stored encoded (see SBF_ArrayEncoding), counted as the type they decode to as well.
+	uint64_t packed_arrays;
+
+	/// Nodes at each depth, the root being at depth 1; the last bucket counts the deeper ones too.
+	uint64_t depths[SBF_SCAN_DEPTHS];
+
+	/// Deepest nesting found.
+	uint64_t max_depth;
+
+	/// Top-level nodes scanned.
+	uint64_t trees;
+} SBF_ScanStats;
+
+/// Called when the decoder reaches a table, array or string at byte offset.
+typedef void (*SBF_TraceBegin)(NodeType type, size_t offset, void *user);
+
+/// Called when the node that started at offset is done, even if decoding it failed.
+/// length spans from its opening tag up to, not including, its closing tag.
+typedef void (*SBF_TraceEnd)(NodeType type, size_t offset, size_t length, void *user);
+
+/// Either callback may be null.
+typedef struct {
+	SBF_TraceBegin begin;
+	SBF_TraceEnd end;
+	void *user;
+} SBF_TraceHooks;
+
+typedef enum {
+	SBF_REDUCE_SUM = 1 << 0,
+	SBF_REDUCE_MIN = 1 << 1,
+	SBF_REDUCE_MAX = 1 << 2,
+} SBF_ReduceOps;
+
+/// A value of any array element type: i64 for signed integers,
+/// u64 for unsigned integers and strings (as bytes), f64 for floats.
+typedef union {
+	int64_t i64;
+	uint64_t u64;
+	double f64;
+} SBF_Scalar;
+
+/// Result of SBF_ArrayReduce, in the SBF_Scalar member matching the array type.
+/// Integer sums wrap around on overflow; floats are summed as doubles, in no particular order.
+/// min and max skip NaNs. Operations not asked for, and min and max of an empty array,
+/// hold their identity (0, the largest and the smallest value), so partial results merge.
+typedef struct {
+	size_t count;
+	SBF_Scalar sum;
+	SBF_Scalar min;
+	SBF_Scalar max;
+} SBF_Reduction;
+
+/// Instruction sets the array kernels can use, picked at runtime from what the CPU supports.
+typedef enum {
+	SBF_SIMD_SCALAR,
+	/// 128-bit vectors of the base instruction set (SSE2 on x86-64).
+	SBF_SIMD_BASELINE,
+	SBF_SIMD_AVX2,
+	/// AVX-512 F, BW, DQ and VL.
+	SBF_SIMD_AVX512,
+} SBF_SimdLevel;
+
+/// A path query compiled by SBF_CompileSelector.
+typedef struct SBF_Selector SBF_Selector;
+
+/// Decodes a node fed in chunks of any size; see SBF_CreateDecoder.
+typedef struct SBF_Decoder SBF_Decoder;
+
+typedef enum {
+	/// The node is not complete yet; feed the bytes following the chunk.
+	SBF_DECODE_NEED_MORE = 0,
+	/// The node is complete; take it with SBF_DecoderTake.
+	SBF_DECODE_DONE = 1,
+} SBF_DecodeStatus;
+
+/// Receives a node matched by SBF_SelectNodes; returning false stops the search.
+typedef bool (*SBF_SelectNodeCallback)(Node *node, void *user);
+
+/// Receives a node matched by SBF_SelectBytes, serialized in bytes [offset, offset + size)
+/// of the buffer, closing tag included; returning false stops the search.
+typedef bool (*SBF_SelectBytesCallback)(size_t offset, size_t size, void *user);
+
+// Threading
+//
+// Every function is reentrant. Between calls, the library keeps nothing but per-thread scratch space
+// and process-wide settings (SBF_SetSimdLevel, SBF_SetTraceHooks), which are safe to change at any time.
+//
+// Functions that take a tree without modifying it (the getters, size calculation, serialization and writing,
+// cloning, comparison, hashing, diffs, conversions between tables and columns, selectors, array kernels)
+// never write to it, nor cache anything in it. Any number of threads may run them on the same tree at once,
+// with no locking, as long as nothing modifies or destroys the tree meanwhile. Compiled selectors can be shared the same way.
+//
+// An arena serves one call at a time; SBF_DeserializeBatch spreads its single call over several threads.
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -70,19 +394,40 @@ SBF_API Node *SBF_CreateNode_String(char *str);
 /// The key strings must be null-terminated.
 SBF_API Node *SBF_CreateNode_Table(char **keys, Node **values, size_t length);
 
+/// Creates a columns node, taking ownership of name/column buffers.
+/// Every column is an array node (other than a string) of the same length,
+/// or a string column: one null-terminated string per row, back to back.
+/// Throws if the columns do not agree on the number of rows.
+SBF_API Node *SBF_CreateNode_Columns(char **names, Node **columns, size_t count);
+
 SBF_API void SBF_DestroyNode(Node *);
 
+/// Deep-copies a tree, arrays in bulk. With an arena, the copy is allocated from it and released with it,
+/// like the trees of SBF_DeserializeBatch (which must not use the arena at the same time); without one, from the heap.
+SBF_API Node *SBF_CloneNode(const Node *node, SBF_Arena *arena);
+
+/// Returns whether two trees hold the same types, keys (in the same order) and values, nulls included.
+/// Floats are compared by representation, as they are serialized. Stops at the first difference;
+/// the entries of a table are all checked before any table nested in it.
+SBF_API bool SBF_NodeEquals(const Node *a, const Node *b);
+
+/// 64-bit hash of a tree: the XXH64 (seed 0) of the bytes SBF_Serialize writes for it with every array raw,
+/// whatever its encoding (see SBF_NodeSet_ArrayEncoding), computed without writing them.
+/// It is the same on every platform and in every run, so it can key caches that outlive the process;
+/// equal trees (SBF_NodeEquals) hash alike, encodings aside. Throws std::invalid_argument where SBF_Serialize would.
+SBF_API uint64_t SBF_NodeHash(const Node *node);
+
 SBF_API NodeType SBF_GetNodeType(const Node *node);
-SBF_API int8_t SBF_NodeGet_I8(Node *node);
-SBF_API uint8_t SBF_NodeGet_U8(Node *node);
-SBF_API char SBF_NodeGet_Char(Node *node);
-SBF_API int32_t SBF_NodeGet_I32(Node *node);
-SBF_API int64_t SBF_NodeGet_I64(Node *node);
-SBF_API uint32_t SBF_NodeGet_U32(Node *node);
-SBF_API uint64_t SBF_NodeGet_U64(Node *node);
-SBF_API float SBF_NodeGet_F32(Node *node);
-SBF_API double SBF_NodeGet_F64(Node *node);
-SBF_API size_t SBF_NodeGet_ArrayLength(Node *node);
+SBF_API int8_t SBF_NodeGet_I8(const Node *node);
+SBF_API uint8_t SBF_NodeGet_U8(const Node *node);
+SBF_API char SBF_NodeGet_Char(const Node *node);
+SBF_API int32_t SBF_NodeGet_I32(const Node *node);
+SBF_API int64_t SBF_NodeGet_I64(const Node *node);
+SBF_API uint32_t SBF_NodeGet_U32(const Node *node);
+SBF_API uint64_t SBF_NodeGet_U64(const Node *node);
+SBF_API float SBF_NodeGet_F32(const Node *node);
+SBF_API double SBF_NodeGet_F64(const Node *node);
+SBF_API size_t SBF_NodeGet_ArrayLength(const Node *node);
 SBF_API int8_t *SBF_NodeGet_I8A(Node *node);
 SBF_API uint8_t *SBF_NodeGet_U8A(Node *node);
 SBF_API int32_t *SBF_NodeGet_I32A(Node *node);
@@ -98,24 +443,336 @@ SBF_API size_t SBF_NodeGet_StringLength(const Node *node);
 SBF_API char *SBF_NodeGet_String(Node *node);
 SBF_API size_t SBF_NodeGet_TableLength(const Node *node);
 SBF_API void SBF_NodeGet_Table(Node *node, char ***keys, Node ***values);
+SBF_API size_t SBF_NodeGet_ColumnCount(const Node *node);
+SBF_API size_t SBF_NodeGet_RowCount(const Node *node);
+SBF_API void SBF_NodeGet_Columns(Node *node, char ***names, Node ***columns);
+/// Returns the column with the given name, or null; its values are contiguous
+/// and read with the array getters (SBF_NodeGet_F64A, ...).
+SBF_API Node *SBF_NodeGet_Column(Node *node, const char *name);
+
+/// Setters change a scalar node in place; like the getters, they expect a node of their type.
+SBF_API void SBF_NodeSet_I8(Node *node, int8_t i8);
+SBF_API void SBF_NodeSet_U8(Node *node, uint8_t u8);
+SBF_API void SBF_NodeSet_Char(Node *node, char c);
+SBF_API void SBF_NodeSet_I32(Node *node, int32_t i32);
+SBF_API void SBF_NodeSet_I64(Node *node, int64_t i64);
+SBF_API void SBF_NodeSet_U32(Node *node, uint32_t u32);
+SBF_API void SBF_NodeSet_U64(Node *node, uint64_t u64);
+SBF_API void SBF_NodeSet_F32(Node *node, float f32);
+SBF_API void SBF_NodeSet_F64(Node *node, double f64);
+/// Copies a null-terminated string into a string node, reusing its buffer when it is large enough.
+SBF_API void SBF_NodeSet_String(Node *node, const char *str);
+
+/// Sets the encoding an integer array (I32A, I64A, U32A or U64A) is written with by the encoders;
+/// SBF_ARRAY_RAW, the default, can be set on any node. Encoded arrays decode into plain arrays, read
+/// with the getters like any other, that keep the encoding they were read with. Canonical encodings
+/// (SBF_ENCODE_CANONICAL) ignore it and write every array raw, so that equal trees give the same bytes
+/// whatever their encodings. Readers older than encoded arrays reject them as an invalid tag.
+/// Throws std::invalid_argument for other types.
+SBF_API void SBF_NodeSet_ArrayEncoding(Node *node, SBF_ArrayEncoding encoding);
+SBF_API SBF_ArrayEncoding SBF_NodeGet_ArrayEncoding(const Node *node);
+/// Returns the bytes the array node takes written with the given encoding (SBF_ARRAY_AUTO picking the smallest),
+/// tags included; throws std::invalid_argument if the node cannot be written with it.
+SBF_API size_t SBF_ArrayEncodedSize(const Node *node, SBF_ArrayEncoding encoding);
+
+/// Sets the length of an array or string node, keeping the elements it already has and zeroing new ones.
+/// Buffers grow geometrically and keep their room when shrunk, so growing an array one element
+/// at a time takes amortized constant time. Growth moves the buffer: pointers from the array getters
+/// are invalidated. Nodes allocated in an arena can shrink but not grow (std::invalid_argument).
+SBF_API void SBF_ArrayResize(Node *node, size_t length);
+/// Appends count elements of the node's type, which may come from the array itself; see SBF_ArrayResize.
+SBF_API void SBF_ArrayAppend(Node *node, const void *values, size_t count);
+
+/// Sets the value of key in a table, destroying the value it replaces, or appends the entry if the key is missing.
+/// The table takes ownership of value (which may be null); the key is copied. Entries are appended
+/// with amortized growth like arrays. Tables allocated in an arena cannot be modified (std::invalid_argument).
+SBF_API void SBF_TableSet(Node *table, const char *key, Node *value);
+/// Removes the entry of key from a table and destroys its value, keeping the order of the others
+/// and the room of the table. Returns false if the key is missing.
+SBF_API bool SBF_TableRemove(Node *table, const char *key);
+
+/// Sorts the entries of a table by key, in canonical order (see SBF_ENCODE_CANONICAL), and marks it sorted.
+/// Sorted tables are binary-searched by SBF_TableGet, SBF_TableSet, SBF_TableRemove and selectors,
+/// and keep their order through them; tables decoded from sorted tables are marked already.
+/// Keys changed through SBF_NodeGet_Table must keep the order. Tables in an arena can be sorted too.
+/// Throws std::invalid_argument, leaving the table as it was, if it has the same key twice.
+SBF_API void SBF_SortTable(Node *table);
+SBF_API bool SBF_TableIsSorted(const Node *table);
+/// Returns the value of key in a table, or null if the key is missing.
+SBF_API Node *SBF_TableGet(const Node *table, const char *key);
+/// Returns the position of the first entry of a sorted table whose key is not before key,
+/// or the table length: entries from SBF_TableLowerBound(a) up to SBF_TableLowerBound(b) have keys in [a, b).
+/// Throws std::invalid_argument for tables that are not sorted.
+SBF_API size_t SBF_TableLowerBound(const Node *table, const char *key);
+/// Returns the number of entries of a sorted table whose key starts with prefix,
+/// which are next to each other from the position stored in *first.
+SBF_API size_t SBF_TablePrefix(const Node *table, const char *prefix, size_t *first);
+
+/// Converts a table of records into a columns node, which stores every key once
+/// and the values under it as one array. Records must be tables with the same keys,
+/// each key holding scalars (but chars) of one type, or strings without null characters.
+/// With key_column, the keys of the records are kept in a string column of that name.
+/// Returns null if the records do not fit; the table is not modified.
+SBF_API Node *SBF_TableToColumns(const Node *table, const char *key_column);
+
+/// Converts a columns node back into a table of records.
+/// With key_column, that string column provides the keys of the records;
+/// otherwise they are numbered from "0".
+SBF_API Node *SBF_ColumnsToTable(const Node *columns, const char *key_column);
+
+/// Computes the operations in ops (a combination of SBF_ReduceOps) over an array or string node.
+SBF_API SBF_Reduction SBF_ArrayReduce(const Node *node, uint32_t ops);
+
+/// Same as SBF_ArrayReduce, over length elements of the given array type at data,
+/// e.g. one chunk of an array; see SBF_MergeReductions.
+SBF_API SBF_Reduction SBF_BufferReduce(NodeType type, const void *data, size_t length, uint32_t ops);
+
+/// Combines the reduction of another part of an array of the given type into into.
+SBF_API void SBF_MergeReductions(NodeType type, SBF_Reduction *into, const SBF_Reduction *from);
+
+/// Finds the elements of an array or string node within [low, high], bounds given in the
+/// SBF_Scalar member matching the array type. Their indices go to indices (room for the
+/// array length), unless it is null. Returns how many there are; NaNs never match.
+SBF_API size_t SBF_ArrayFilterRange(const Node *node, SBF_Scalar low, SBF_Scalar high, size_t *indices);
+
+/// Same as SBF_ArrayFilterRange, over length elements of the given array type at data.
+SBF_API size_t SBF_BufferFilterRange(NodeType type, const void *data, size_t length, SBF_Scalar low, SBF_Scalar high, size_t *indices);
+
+/// Counts the elements of an array or string node into bins of equal width over [low, high).
+/// Adds to counts, so that chunks of one array can be counted in turn; elements outside
+/// the range and NaNs are not counted. Bins are computed in double precision.
+SBF_API void SBF_ArrayHistogram(const Node *node, double low, double high, size_t bins, uint64_t *counts);
+
+/// Same as SBF_ArrayHistogram, over length elements of the given array type at data.
+SBF_API void SBF_BufferHistogram(NodeType type, const void *data, size_t length, double low, double high, size_t bins, uint64_t *counts);
+
+/// Instruction set used by the array kernels.
+SBF_API SBF_SimdLevel SBF_GetSimdLevel(void);
+
+/// Limits the array kernels to the given instruction set, or to the best one the CPU supports
+/// if it is lower. Returns the instruction set used from then on.
+SBF_API SBF_SimdLevel SBF_SetSimdLevel(SBF_SimdLevel level);
+
+/// Compiles a path such as "players[*].inventory.gold" into a selector, to be run any number of times.
+/// Each segment picks entries of the tables (or columns of the columns nodes) picked so far:
+/// a key, * or [*] for every entry, [N] for the entry at position N, or ["key"] for keys
+/// holding '.', '[', ']' or '"' (escaped as \"; a backslash as \\). The empty path picks the root.
+/// Throws std::invalid_argument if the path is malformed.
+SBF_API SBF_Selector *SBF_CompileSelector(const char *path);
+
+SBF_API void SBF_DestroySelector(SBF_Selector *selector);
+
+/// Passes every node under root matched by the selector to callback (which may be null),
+/// in the order they would be serialized. Returns the number of matches passed.
+SBF_API size_t SBF_SelectNodes(const SBF_Selector *selector, Node *root, SBF_SelectNodeCallback callback, void *user);
+
+/// Returns the first node under root matched by the selector, or null.
+SBF_API Node *SBF_SelectFirst(const SBF_Selector *selector, Node *root);
+
+/// Same as SBF_SelectNodes, over the node serialized at *begin, without deserializing it:
+/// only the keys of the tables on the way are read, and everything else is stepped over.
+/// *begin moves past the node, unless callback stopped the search; past the end of bytes, nothing matches.
+/// Throws an SBF::SerdeException on malformed bytes met on the way (row counts of columns are not checked).
+/// Only little-endian bytes are read.
+SBF_API size_t SBF_SelectBytes(const SBF_Selector *selector, const uint8_t *bytes, size_t length, size_t *begin, SBF_SelectBytesCallback callback, void *user);
+
+/// Adds the shape of the node serialized at *begin to stats (zero-initialized before the first call)
+/// and moves *begin past it. Returns false, past the end of bytes, where there is no node.
+/// Like SBF_SelectBytes, nothing is allocated and any depth is walked in constant memory;
+/// malformed bytes throw an SBF::SerdeException, leaving stats as they were. Only little-endian bytes are read.
+SBF_API bool SBF_ScanBytes(const uint8_t *bytes, size_t length, size_t *begin, SBF_ScanStats *stats);
+
+/// Returns the elements of the array (a string too) serialized at offset, in place in bytes, with its type
+/// and element count, stepping over the padding before it. Written with SBF_EncodeOptions::array_alignment,
+/// they are aligned as asked relative to bytes. Throws an SBF::SerdeException if there is no well-formed
+/// array at offset, or if it is encoded (see SBF_ArrayEncoding), as its elements are only there once decoded.
+/// Like SBF_SelectBytes, only little-endian bytes are read.
+SBF_API const void *SBF_ArrayInBytes(const uint8_t *bytes, size_t length, size_t offset, NodeType *type, size_t *count);
 
 SBF_API Node *SBF_Deserialize(const uint8_t *bytes, size_t length, size_t *begin);
 
+/// Same as SBF_Deserialize, with options (which may be null).
+SBF_API Node *SBF_DeserializeEx(const uint8_t *bytes, size_t length, size_t *begin, const SBF_DecodeOptions *options);
+
+/// Creates a decoder reading one node after another from bytes fed in chunks, as they come off a socket or pipe,
+/// and accepting the same bytes as SBF_DeserializeEx with the same options (which may be null; the
+/// SBF_DECODE_RECURSIVE flag is ignored, and max_depth is unlimited by default). Arrays are filled in place
+/// as their bytes arrive, in buffers growing with what was received rather than with the lengths announced.
+SBF_API SBF_Decoder *SBF_CreateDecoder(const SBF_DecodeOptions *options);
+
+/// Releases the decoder, along with any node it holds.
+SBF_API void SBF_DestroyDecoder(SBF_Decoder *decoder);
+
+/// Reads the chunk, keeping what it holds of a node incomplete at its end for the next call.
+/// Returns SBF_DECODE_DONE once the node is complete, and until it is taken. *used (if not null) receives the
+/// bytes of the chunk read, fewer than length when the node ends before the chunk does; if used is null,
+/// bytes past the end of the node are an error. Malformed bytes throw an SBF::SerdeException, at positions
+/// counted from the start of the node, and reset the decoder.
+SBF_API SBF_DecodeStatus SBF_DecoderFeed(SBF_Decoder *decoder, const uint8_t *chunk, size_t length, size_t *used);
+
+/// Returns the node decoded, to be released by the caller (null if it is not complete yet),
+/// and gets the decoder ready for the next one.
+SBF_API Node *SBF_DecoderTake(SBF_Decoder *decoder);
+
+/// Drops the node being decoded, so that the next chunk starts a new one.
+SBF_API void SBF_DecoderReset(SBF_Decoder *decoder);
+
+/// Returns the bytes of the current node read so far.
+SBF_API size_t SBF_DecoderOffset(const SBF_Decoder *decoder);
+
+/// Creates an arena allocating in blocks of block_size bytes (0 for the default of 64 KiB).
+/// An arena may only be used by one call at a time.
+SBF_API SBF_Arena *SBF_CreateArena(size_t block_size);
+
+/// Releases every node allocated from the arena, keeping its blocks for reuse.
+SBF_API void SBF_ResetArena(SBF_Arena *arena);
+
+/// Releases every node allocated from the arena, and the arena itself.
+SBF_API void SBF_DestroyArena(SBF_Arena *arena);
+
+/// Deserializes count independent messages, each one starting at buffers[i] and spanning lengths[i] bytes.
+/// out[i] receives the tree, or null if the message is malformed.
+/// With an arena, all trees are allocated from it; SBF_DestroyNode is then a no-op on them.
+/// threads > 1 lets large batches be spread over the library's worker threads.
+/// Returns the number of messages decoded successfully.
+SBF_API size_t SBF_DeserializeBatch(const uint8_t *const *buffers, const size_t *lengths, size_t count, SBF_Arena *arena, Node **out, size_t threads);
+
+/// Serializes count nodes back to back into bytes.
+/// offsets must hold count + 1 entries and receives where each message starts, plus the end.
+/// Returns the total size; when bytes is null or length is smaller, nothing is written.
+SBF_API size_t SBF_SerializeBatch(const Node *const *nodes, size_t count, uint8_t *bytes, size_t length, size_t *offsets, size_t threads);
+
+/// Copies the decoder counters into stats.
+/// Returns false, with stats zeroed, if the library was built without SBF_ENABLE_STATS.
+SBF_API bool SBF_GetStats(SBF_Stats *stats);
+
+/// Zeroes the decoder counters.
+SBF_API void SBF_ResetStats(void);
+
+/// Installs hooks called around every table, array and string decode, or removes them when null.
+/// Decodes already running keep the hooks they started with.
+/// Returns false if the library was built without SBF_ENABLE_STATS.
+SBF_API bool SBF_SetTraceHooks(const SBF_TraceHooks *hooks);
+
 /// Writes the given node into bytes with length at cursor.
 SBF_API void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *cursor);
 
+/// Same as SBF_Serialize, with options (which may be null).
+SBF_API void SBF_SerializeEx(const Node *node, uint8_t *bytes, size_t length, size_t *cursor, const SBF_EncodeOptions *options);
+
 /// Calculates the total size of the given node in bytes.
 SBF_API size_t SBF_CalculateSize(const Node *node);
 
+/// Size SBF_SerializeEx writes for the node at byte offset with options (which may be null);
+/// only aligned arrays make it depend on the offset. Throws std::invalid_argument like SBF_SerializeEx.
+SBF_API size_t SBF_CalculateSizeEx(const Node *node, size_t offset, const SBF_EncodeOptions *options);
+
 /// Serializes a node tree into a file.
 /// If filepath does not exist, a file is creates (if path is valid; otherwise exception).
 /// node pointer must not be null.
 SBF_API void SBF_WriteFile(const char *filepath, const Node *node);
 
+/// Same as SBF_WriteFile, with control over atomicity and flushing.
+/// options may be null for the defaults.
+SBF_API void SBF_WriteFileEx(const char *filepath, const Node *node, const SBF_WriteOptions *options);
+
+/// Waits for all writes made with SBF_WRITE_ASYNC_FLUSH to complete.
+/// Throws the first error a background flush ran into, if any.
+SBF_API void SBF_FlushPendingWrites(void);
+
+/// Reads and deserializes a file on a background thread, then calls callback from that thread.
+/// Uses io_uring on Linux when available, with all chunks of the file in flight at once; the base node of a file
+/// without checksums is then decoded as its chunks arrive, with SBF_DecoderFeed. Checksummed files are decoded
+/// once read and verified whole, as they are without io_uring.
+SBF_API void SBF_ReadFileAsync(const char *filepath, SBF_ReadCallback callback, void *user);
+
+/// Serializes and writes a node tree on a background thread, then calls callback (may be null) from that thread.
+/// With io_uring, the chunks of a table are written while the rest is still being encoded.
+/// The node tree must stay alive and unmodified until the callback runs. options may be null.
+SBF_API void SBF_WriteFileAsync(const char *filepath, const Node *node, const SBF_WriteOptions *options, SBF_WriteCallback callback, void *user);
+
 /// Deserializes file into a node tree, and retreives the format version.
 /// filepath must exist, and version pointer is optional (can be null).
+/// Update records appended with SBF_AppendFile are replayed on top of the base node;
+/// a truncated record at the tail (e.g. after a crash) is ignored, and any other malformed record throws.
+/// In files written with SBF_WRITE_CHECKSUM, a base node or record failing its checksum throws,
+/// but for the tail record, which is ignored as well.
+/// Files of either byte order are read; version does not include the mark of big-endian ones.
 SBF_API Node *SBF_ReadFile(const char *filepath, uint8_t *version);
 
+/// Appends an update record (a patch table, see SBF_Diff) to an existing file
+/// written by SBF_WriteFile. Returns the new size of the file in bytes,
+/// which can be used to decide when to call SBF_Compact.
+/// The records already there are stepped over first, without being decoded: a truncated one at the tail
+/// is cut off before the new record is written, and a malformed one anywhere else throws, leaving the file as it was.
+/// Records appended to files written with SBF_WRITE_CHECKSUM get a checksum too. Their blocks are found by
+/// their lengths alone, and only the last one is checked: cut short or failing its checksum, it is cut off the same way.
+SBF_API size_t SBF_AppendFile(const char *filepath, const Node *record);
+
+/// Rewrites a file into a fresh base node with all of its update records applied.
+/// Also drops a truncated tail record.
+/// The file is replaced atomically and flushed to disk, in the format version it had.
+SBF_API void SBF_Compact(const char *filepath);
+
+/// Extends crc, the CRC32C (Castagnoli) of earlier bytes, over size more bytes; pass 0 to start.
+/// Uses the CPU's CRC instructions when available. This is the checksum of SBF_WRITE_CHECKSUM files.
+SBF_API uint32_t SBF_Crc32c(uint32_t crc, const void *data, size_t size);
+
+/// Creates a cache of decoded files; options may be null for the defaults.
+/// Every part of a process asking it for a file shares a single decoded tree of it.
+SBF_API SBF_Cache *SBF_CreateCache(const SBF_CacheOptions *options);
+
+/// Destroys the cache and every tree in it, held or not, after any background check finishes.
+SBF_API void SBF_DestroyCache(SBF_Cache *cache);
+
+/// Returns the tree of a file, read with SBF_ReadFile unless the cache holds it already, along with its format version.
+/// A file is told apart by its path, device, inode, size and modification time, so a changed file is read again;
+/// those still holding the old tree keep it until they release it. Concurrent requests for a file that is
+/// being read wait for that read rather than reading it again. Throws what SBF_ReadFile throws.
+/// The tree is shared, and must not be modified; release it with SBF_CacheRelease once done.
+SBF_API const Node *SBF_CacheAcquire(SBF_Cache *cache, const char *filepath, uint8_t *version);
+
+/// Gives back a tree returned by SBF_CacheAcquire, as many times as it was acquired.
+SBF_API void SBF_CacheRelease(SBF_Cache *cache, const Node *node);
+
+/// Memory taken by the trees in the cache, held or not.
+SBF_API size_t SBF_CacheSize(SBF_Cache *cache);
+
+/// Computes a patch that turns old_node into new_node.
+/// The patch is a regular node tree made of tables and arrays, so it can be
+/// serialized and stored like any other node. Equal trees yield an empty table.
+/// Neither tree is modified; the returned patch must be destroyed by the caller.
+SBF_API Node *SBF_Diff(const Node *old_node, const Node *new_node);
+
+/// Applies a patch produced by SBF_Diff to the tree at *node.
+/// The root may be replaced, in which case *node is updated (and the old root destroyed).
+/// Throws on malformed patches or patches that do not fit the tree; the tree may then be partially patched.
+/// Trees in an arena cannot be patched; SBF_CloneNode them onto the heap first.
+SBF_API void SBF_ApplyPatch(Node **node, const Node *patch);
+
+/// Reads a JSON document of length bytes into a tree. Objects become tables, their keys in the order of the document;
+/// strings become String nodes (UTF-8, escapes decoded), and true and false U8 nodes holding 1 and 0.
+/// Numbers without fraction or exponent become I32, I64 or U64 nodes, the first that holds them, and others F64 nodes.
+/// Arrays of numbers become arrays of the first of I32A, I64A, U64A and F64A that holds them all (I32A when empty);
+/// other arrays become tables keyed by position, from "0". Null values are left out of tables, keys and all,
+/// so that SBF_TableGet finds them missing, and a null document gives a null tree.
+/// options may be null; with an arena, the tree is allocated from it.
+/// Throws an SBF::DeserException, at the offset of the error, on malformed JSON and on keys holding "\u0000".
+SBF_API Node *SBF_JsonToNode(const char *json, size_t length, const SBF_JsonOptions *options);
+
+/// Same as SBF_JsonToNode, writing the tree at *cursor in bytes as SBF_Serialize would, without building it.
+/// Returns the size of the encoding (0 for a null document). *cursor moves past it if it fits in length;
+/// otherwise *cursor stays and the bytes after it are unspecified, so call again with room for the size returned.
+SBF_API size_t SBF_JsonToBytes(const char *json, size_t json_length, uint8_t *bytes, size_t length, size_t *cursor, const SBF_JsonOptions *options);
+
+/// Writes a tree as JSON. Tables become objects, and so do columns nodes, holding an array per column;
+/// null values become null. Strings are written as their bytes, expected to be UTF-8, with quotes, backslashes
+/// and control characters escaped. Floats are written in the shortest form that reads back as the same value,
+/// with a fraction, and NaNs and infinities (which JSON lacks) as null.
+/// Returns the length of the text; json receives it with a null terminator if length leaves room for both,
+/// and holds unspecified characters otherwise. options may be null.
+SBF_API size_t SBF_NodeToJson(const Node *node, char *json, size_t length, const SBF_JsonOptions *options);
+
 #ifdef SBF_STRIP_PREFIX
 SBF_API inline Node *CreateNode_I8(int8_t i8) { return SBF_CreateNode_I8(i8); }
 SBF_API inline Node *CreateNode_U8(uint8_t u8) { return SBF_CreateNode_U8(u8); }
@@ -134,21 +791,31 @@ SBF_API inline Node *CreateNode_Array(NodeType type, void *array, size_t length)
 /// of the string buffer.
 SBF_API inline Node *CreateNode_String(char *str) { return SBF_CreateNode_String(str); } 
 SBF_API inline Node *CreateNode_Table(char **keys, Node **values, size_t length) { return SBF_CreateNode_Table(keys, values, length); }
+SBF_API inline Node *CreateNode_Columns(char **names, Node **columns, size_t count) { return SBF_CreateNode_Columns(names, columns, count); }
 
 
 SBF_API inline void DestroyNode(Node *node) { SBF_DestroyNode(node); }
 
+/// Deep-copies a tree, into arena if not null; see SBF_CloneNode.
+SBF_API inline Node *CloneNode(const Node *node, SBF_Arena *arena) { return SBF_CloneNode(node, arena); }
+
+/// Compares two trees; see SBF_NodeEquals.
+SBF_API inline bool NodeEquals(const Node *a, const Node *b) { return SBF_NodeEquals(a, b); }
+
+/// Hashes a tree the same way on every platform; see SBF_NodeHash.
+SBF_API inline uint64_t NodeHash(const Node *node) { return SBF_NodeHash(node); }
+
 SBF_API inline NodeType GetNodeType(const Node *node) { return SBF_GetNodeType(node); }
-SBF_API inline int8_t NodeGet_I8(Node *node) { return SBF_NodeGet_I8(node); }
-SBF_API inline uint8_t NodeGet_U8(Node *node) { return SBF_NodeGet_U8(node); }
-SBF_API inline char NodeGet_Char(Node *node) { return SBF_NodeGet_Char(node); }
-SBF_API inline int32_t NodeGet_I32(Node *node) { return SBF_NodeGet_I32(node); }
-SBF_API inline int64_t NodeGet_I64(Node *node) { return SBF_NodeGet_I64(node); }
-SBF_API inline uint32_t NodeGet_U32(Node *node) { return SBF_NodeGet_U32(node); }
-SBF_API inline uint64_t NodeGet_U64(Node *node) { return SBF_NodeGet_U64(node); }
-SBF_API inline float NodeGet_F32(Node *node) { return SBF_NodeGet_F32(node); }
-SBF_API inline double NodeGet_F64(Node *node) { return SBF_NodeGet_F64(node); }
-SBF_API inline size_t NodeGet_ArrayLength(Node *node) { return SBF_NodeGet_ArrayLength(node); }
+SBF_API inline int8_t NodeGet_I8(const Node *node) { return SBF_NodeGet_I8(node); }
+SBF_API inline uint8_t NodeGet_U8(const Node *node) { return SBF_NodeGet_U8(node); }
+SBF_API inline char NodeGet_Char(const Node *node) { return SBF_NodeGet_Char(node); }
+SBF_API inline int32_t NodeGet_I32(const Node *node) { return SBF_NodeGet_I32(node); }
+SBF_API inline int64_t NodeGet_I64(const Node *node) { return SBF_NodeGet_I64(node); }
+SBF_API inline uint32_t NodeGet_U32(const Node *node) { return SBF_NodeGet_U32(node); }
+SBF_API inline uint64_t NodeGet_U64(const Node *node) { return SBF_NodeGet_U64(node); }
+SBF_API inline float NodeGet_F32(const Node *node) { return SBF_NodeGet_F32(node); }
+SBF_API inline double NodeGet_F64(const Node *node) { return SBF_NodeGet_F64(node); }
+SBF_API inline size_t NodeGet_ArrayLength(const Node *node) { return SBF_NodeGet_ArrayLength(node); }
 SBF_API inline int8_t *NodeGet_I8A(Node *node) { return SBF_NodeGet_I8A(node); }
 SBF_API inline uint8_t *NodeGet_U8A(Node *node) { return SBF_NodeGet_U8A(node); }
 SBF_API inline int32_t *NodeGet_I32A(Node *node) { return SBF_NodeGet_I32A(node); }
@@ -164,27 +831,213 @@ SBF_API inline size_t NodeGet_StringLength(const Node *node) { return SBF_NodeGe
 SBF_API inline char *NodeGet_String(Node *node) { return SBF_NodeGet_String(node); }
 SBF_API inline size_t NodeGet_TableLength(const Node *node) { return SBF_NodeGet_TableLength(node); }
 SBF_API inline void NodeGet_Table(Node *node, char ***keys, Node ***values) { return SBF_NodeGet_Table(node, keys, values); }
+SBF_API inline size_t NodeGet_ColumnCount(const Node *node) { return SBF_NodeGet_ColumnCount(node); }
+SBF_API inline size_t NodeGet_RowCount(const Node *node) { return SBF_NodeGet_RowCount(node); }
+SBF_API inline void NodeGet_Columns(Node *node, char ***names, Node ***columns) { return SBF_NodeGet_Columns(node, names, columns); }
+SBF_API inline Node *NodeGet_Column(Node *node, const char *name) { return SBF_NodeGet_Column(node, name); }
+
+SBF_API inline void NodeSet_I8(Node *node, int8_t i8) { SBF_NodeSet_I8(node, i8); }
+SBF_API inline void NodeSet_U8(Node *node, uint8_t u8) { SBF_NodeSet_U8(node, u8); }
+SBF_API inline void NodeSet_Char(Node *node, char c) { SBF_NodeSet_Char(node, c); }
+SBF_API inline void NodeSet_I32(Node *node, int32_t i32) { SBF_NodeSet_I32(node, i32); }
+SBF_API inline void NodeSet_I64(Node *node, int64_t i64) { SBF_NodeSet_I64(node, i64); }
+SBF_API inline void NodeSet_U32(Node *node, uint32_t u32) { SBF_NodeSet_U32(node, u32); }
+SBF_API inline void NodeSet_U64(Node *node, uint64_t u64) { SBF_NodeSet_U64(node, u64); }
+SBF_API inline void NodeSet_F32(Node *node, float f32) { SBF_NodeSet_F32(node, f32); }
+SBF_API inline void NodeSet_F64(Node *node, double f64) { SBF_NodeSet_F64(node, f64); }
+SBF_API inline void NodeSet_String(Node *node, const char *str) { SBF_NodeSet_String(node, str); }
+
+/// Sets the encoding an integer array is written with; see SBF_NodeSet_ArrayEncoding.
+SBF_API inline void NodeSet_ArrayEncoding(Node *node, SBF_ArrayEncoding encoding) { SBF_NodeSet_ArrayEncoding(node, encoding); }
+SBF_API inline SBF_ArrayEncoding NodeGet_ArrayEncoding(const Node *node) { return SBF_NodeGet_ArrayEncoding(node); }
+SBF_API inline size_t ArrayEncodedSize(const Node *node, SBF_ArrayEncoding encoding) { return SBF_ArrayEncodedSize(node, encoding); }
+
+/// Sets the length of an array or string node; see SBF_ArrayResize.
+SBF_API inline void ArrayResize(Node *node, size_t length) { SBF_ArrayResize(node, length); }
+SBF_API inline void ArrayAppend(Node *node, const void *values, size_t count) { SBF_ArrayAppend(node, values, count); }
+
+/// Sets or appends a table entry, taking ownership of value; see SBF_TableSet.
+SBF_API inline void TableSet(Node *table, const char *key, Node *value) { SBF_TableSet(table, key, value); }
+SBF_API inline bool TableRemove(Node *table, const char *key) { return SBF_TableRemove(table, key); }
+
+/// Sorts a table by key for binary-searched lookups; see SBF_SortTable.
+SBF_API inline void SortTable(Node *table) { SBF_SortTable(table); }
+SBF_API inline bool TableIsSorted(const Node *table) { return SBF_TableIsSorted(table); }
+SBF_API inline Node *TableGet(const Node *table, const char *key) { return SBF_TableGet(table, key); }
+SBF_API inline size_t TableLowerBound(const Node *table, const char *key) { return SBF_TableLowerBound(table, key); }
+SBF_API inline size_t TablePrefix(const Node *table, const char *prefix, size_t *first) { return SBF_TablePrefix(table, prefix, first); }
+
+/// Converts a table of records into a columns node; see SBF_TableToColumns.
+SBF_API inline Node *TableToColumns(const Node *table, const char *key_column) { return SBF_TableToColumns(table, key_column); }
+
+/// Converts a columns node back into a table of records.
+SBF_API inline Node *ColumnsToTable(const Node *columns, const char *key_column) { return SBF_ColumnsToTable(columns, key_column); }
+
+/// Reduces an array or string node; see SBF_ArrayReduce.
+SBF_API inline SBF_Reduction ArrayReduce(const Node *node, uint32_t ops) { return SBF_ArrayReduce(node, ops); }
+SBF_API inline SBF_Reduction BufferReduce(NodeType type, const void *data, size_t length, uint32_t ops) { return SBF_BufferReduce(type, data, length, ops); }
+SBF_API inline void MergeReductions(NodeType type, SBF_Reduction *into, const SBF_Reduction *from) { SBF_MergeReductions(type, into, from); }
+
+/// Finds the elements within [low, high]; see SBF_ArrayFilterRange.
+SBF_API inline size_t ArrayFilterRange(const Node *node, SBF_Scalar low, SBF_Scalar high, size_t *indices) { return SBF_ArrayFilterRange(node, low, high, indices); }
+SBF_API inline size_t BufferFilterRange(NodeType type, const void *data, size_t length, SBF_Scalar low, SBF_Scalar high, size_t *indices) {
+	return SBF_BufferFilterRange(type, data, length, low, high, indices);
+}
+
+/// Counts the elements into bins over [low, high); see SBF_ArrayHistogram.
+SBF_API inline void ArrayHistogram(const Node *node, double low, double high, size_t bins, uint64_t *counts) { SBF_ArrayHistogram(node, low, high, bins, counts); }
+SBF_API inline void BufferHistogram(NodeType type, const void *data, size_t length, double low, double high, size_t bins, uint64_t *counts) {
+	SBF_BufferHistogram(type, data, length, low, high, bins, counts);
+}
+
+SBF_API inline SBF_SimdLevel GetSimdLevel() { return SBF_GetSimdLevel(); }
+SBF_API inline SBF_SimdLevel SetSimdLevel(SBF_SimdLevel level) { return SBF_SetSimdLevel(level); }
+
+/// Compiles a path query; see SBF_CompileSelector.
+SBF_API inline SBF_Selector *CompileSelector(const char *path) { return SBF_CompileSelector(path); }
+SBF_API inline void DestroySelector(SBF_Selector *selector) { SBF_DestroySelector(selector); }
+
+/// Passes the nodes matched by a selector to callback; see SBF_SelectNodes.
+SBF_API inline size_t SelectNodes(const SBF_Selector *selector, Node *root, SBF_SelectNodeCallback callback, void *user) {
+	return SBF_SelectNodes(selector, root, callback, user);
+}
+SBF_API inline Node *SelectFirst(const SBF_Selector *selector, Node *root) { return SBF_SelectFirst(selector, root); }
+
+/// Runs a selector over serialized bytes; see SBF_SelectBytes.
+SBF_API inline size_t SelectBytes(const SBF_Selector *selector, const uint8_t *bytes, size_t length, size_t *begin, SBF_SelectBytesCallback callback, void *user) {
+	return SBF_SelectBytes(selector, bytes, length, begin, callback, user);
+}
+
+/// Counts the nodes serialized at *begin by type and depth without decoding them; see SBF_ScanBytes.
+SBF_API inline bool ScanBytes(const uint8_t *bytes, size_t length, size_t *begin, SBF_ScanStats *stats) { return SBF_ScanBytes(bytes, length, begin, stats); }
+
+/// Elements of the array serialized at offset, in place; see SBF_ArrayInBytes.
+SBF_API inline const void *ArrayInBytes(const uint8_t *bytes, size_t length, size_t offset, NodeType *type, size_t *count) {
+	return SBF_ArrayInBytes(bytes, length, offset, type, count);
+}
 
 SBF_API inline Node *Deserialize(const uint8_t *bytes, size_t length, size_t *begin) {
 	return SBF_Deserialize(bytes, length, begin);
 }
 
+SBF_API inline Node *DeserializeEx(const uint8_t *bytes, size_t length, size_t *begin, const SBF_DecodeOptions *options) {
+	return SBF_DeserializeEx(bytes, length, begin, options);
+}
+
+/// Creates a decoder for nodes fed in chunks; see SBF_CreateDecoder.
+SBF_API inline SBF_Decoder *CreateDecoder(const SBF_DecodeOptions *options) { return SBF_CreateDecoder(options); }
+SBF_API inline void DestroyDecoder(SBF_Decoder *decoder) { SBF_DestroyDecoder(decoder); }
+
+/// Reads a chunk of the node being decoded; see SBF_DecoderFeed.
+SBF_API inline SBF_DecodeStatus DecoderFeed(SBF_Decoder *decoder, const uint8_t *chunk, size_t length, size_t *used) {
+	return SBF_DecoderFeed(decoder, chunk, length, used);
+}
+
+SBF_API inline Node *DecoderTake(SBF_Decoder *decoder) { return SBF_DecoderTake(decoder); }
+SBF_API inline void DecoderReset(SBF_Decoder *decoder) { SBF_DecoderReset(decoder); }
+SBF_API inline size_t DecoderOffset(const SBF_Decoder *decoder) { return SBF_DecoderOffset(decoder); }
+
+
+/// Creates an arena allocating in blocks of block_size bytes (0 for the default of 64 KiB).
+SBF_API inline SBF_Arena *CreateArena(size_t block_size) { return SBF_CreateArena(block_size); }
+
+/// Releases every node allocated from the arena, keeping its blocks for reuse.
+SBF_API inline void ResetArena(SBF_Arena *arena) { SBF_ResetArena(arena); }
+
+/// Releases every node allocated from the arena, and the arena itself.
+SBF_API inline void DestroyArena(SBF_Arena *arena) { SBF_DestroyArena(arena); }
+
+/// Deserializes count independent messages; see SBF_DeserializeBatch.
+SBF_API inline size_t DeserializeBatch(const uint8_t *const *buffers, const size_t *lengths, size_t count, SBF_Arena *arena, Node **out, size_t threads) {
+	return SBF_DeserializeBatch(buffers, lengths, count, arena, out, threads);
+}
+
+/// Serializes count nodes back to back; see SBF_SerializeBatch.
+SBF_API inline size_t SerializeBatch(const Node *const *nodes, size_t count, uint8_t *bytes, size_t length, size_t *offsets, size_t threads) {
+	return SBF_SerializeBatch(nodes, count, bytes, length, offsets, threads);
+}
+
+/// Copies the decoder counters into stats; see SBF_GetStats.
+SBF_API inline bool GetStats(SBF_Stats *stats) { return SBF_GetStats(stats); }
+
+/// Zeroes the decoder counters.
+SBF_API inline void ResetStats() { SBF_ResetStats(); }
+
+/// Installs decoder trace hooks; see SBF_SetTraceHooks.
+SBF_API inline bool SetTraceHooks(const SBF_TraceHooks *hooks) { return SBF_SetTraceHooks(hooks); }
 
 /// Writes the given node into bytes with length at cursor.
 SBF_API inline void Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *cursor) { return SBF_Serialize(node, bytes, length, cursor); }
 
+/// Same as Serialize, with options (which may be null).
+SBF_API inline void SerializeEx(const Node *node, uint8_t *bytes, size_t length, size_t *cursor, const SBF_EncodeOptions *options) {
+	SBF_SerializeEx(node, bytes, length, cursor, options);
+}
+
 /// Calculates the total size of the given node in bytes.
 SBF_API inline size_t CalculateSize(const Node *node) { return SBF_CalculateSize(node); }
 
+/// Size written for the node at offset with options; see SBF_CalculateSizeEx.
+SBF_API inline size_t CalculateSizeEx(const Node *node, size_t offset, const SBF_EncodeOptions *options) {
+	return SBF_CalculateSizeEx(node, offset, options);
+}
+
 
 /// Serializes a node tree into a file.
 /// If filepath does not exist, a file is creates (if path is valid; otherwise exception).
 /// node pointer must not be null.
 SBF_API inline void WriteFile(const char *filepath, const Node *node) { SBF_WriteFile(filepath, node); }
 
+/// Same as SBF_WriteFile, with control over atomicity and flushing.
+SBF_API inline void WriteFileEx(const char *filepath, const Node *node, const SBF_WriteOptions *options) { SBF_WriteFileEx(filepath, node, options); }
+
+/// Waits for all writes made with SBF_WRITE_ASYNC_FLUSH to complete.
+SBF_API inline void FlushPendingWrites(void) { SBF_FlushPendingWrites(); }
+
+/// Reads and deserializes a file on a background thread, then calls callback from that thread.
+SBF_API inline void ReadFileAsync(const char *filepath, SBF_ReadCallback callback, void *user) { SBF_ReadFileAsync(filepath, callback, user); }
+
+/// Serializes and writes a node tree on a background thread, then calls callback (may be null) from that thread.
+SBF_API inline void WriteFileAsync(const char *filepath, const Node *node, const SBF_WriteOptions *options, SBF_WriteCallback callback, void *user) { SBF_WriteFileAsync(filepath, node, options, callback, user); }
+
 /// Deserializes file into a node tree, and retreives the format version.
 /// filepath must exist, and version pointer is optional (can be null).
 SBF_API inline Node *ReadFile(const char *filepath, uint8_t *version) { return SBF_ReadFile(filepath, version); }
+
+/// Appends an update record (a patch table, see SBF_Diff) to an existing file.
+SBF_API inline size_t AppendFile(const char *filepath, const Node *record) { return SBF_AppendFile(filepath, record); }
+
+/// Rewrites a file into a fresh base node with all of its update records applied.
+SBF_API inline void Compact(const char *filepath) { SBF_Compact(filepath); }
+
+/// Extends crc, the CRC32C of earlier bytes, over size more bytes; pass 0 to start.
+SBF_API inline uint32_t Crc32c(uint32_t crc, const void *data, size_t size) { return SBF_Crc32c(crc, data, size); }
+
+/// Creates a cache of decoded files; see SBF_CreateCache.
+SBF_API inline SBF_Cache *CreateCache(const SBF_CacheOptions *options) { return SBF_CreateCache(options); }
+SBF_API inline void DestroyCache(SBF_Cache *cache) { SBF_DestroyCache(cache); }
+
+/// Returns the shared tree of a file; see SBF_CacheAcquire.
+SBF_API inline const Node *CacheAcquire(SBF_Cache *cache, const char *filepath, uint8_t *version) { return SBF_CacheAcquire(cache, filepath, version); }
+SBF_API inline void CacheRelease(SBF_Cache *cache, const Node *node) { SBF_CacheRelease(cache, node); }
+SBF_API inline size_t CacheSize(SBF_Cache *cache) { return SBF_CacheSize(cache); }
+
+/// Computes a patch that turns old_node into new_node.
+SBF_API inline Node *Diff(const Node *old_node, const Node *new_node) { return SBF_Diff(old_node, new_node); }
+
+/// Applies a patch produced by SBF_Diff to the tree at *node.
+SBF_API inline void ApplyPatch(Node **node, const Node *patch) { SBF_ApplyPatch(node, patch); }
+
+/// Reads a JSON document into a tree; see SBF_JsonToNode.
+SBF_API inline Node *JsonToNode(const char *json, size_t length, const SBF_JsonOptions *options) { return SBF_JsonToNode(json, length, options); }
+
+/// Reads a JSON document straight into its SBF encoding; see SBF_JsonToBytes.
+SBF_API inline size_t JsonToBytes(const char *json, size_t json_length, uint8_t *bytes, size_t length, size_t *cursor, const SBF_JsonOptions *options) {
+	return SBF_JsonToBytes(json, json_length, bytes, length, cursor, options);
+}
+
+/// Writes a tree as JSON; see SBF_NodeToJson.
+SBF_API inline size_t NodeToJson(const Node *node, char *json, size_t length, const SBF_JsonOptions *options) { return SBF_NodeToJson(node, json, length, options); }
 #endif
 
 
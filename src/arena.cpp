@@ -0,0 +1,94 @@
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <utility>
+#include <mutex>
+
+#include "SBF/sbf.h"
+
+#include "arena.h"
+#include "stats.h"
+
+namespace SBF {
+
+void *ArenaCursor::Allocate(size_t bytes, size_t alignment) {
+	auto aligned = (uint8_t *)(((uintptr_t)next + alignment - 1) & ~(uintptr_t)(alignment - 1));
+
+	if (!next || aligned + bytes > end) {
+		size_t size = 0;
+		auto block = arena->AcquireBlock(bytes + alignment, size);
+
+		// Oversized requests get a block of their own; keep bumping through the current one.
+		if (size > arena->block_size) {
+			return (void *)(((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+		}
+
+		next = block;
+		end = block + size;
+		aligned = (uint8_t *)(((uintptr_t)next + alignment - 1) & ~(uintptr_t)(alignment - 1));
+	}
+
+	next = aligned + bytes;
+	return aligned;
+}
+
+};
+
+uint8_t *SBF_Arena::AcquireBlock(size_t bytes, size_t &size) {
+	std::lock_guard lock(mutex);
+
+	void *block = nullptr;
+
+	// Requests above a quarter of a block would waste too much of a shared one.
+	if (bytes > block_size / 4) {
+		size = bytes > block_size ? bytes : block_size + 1;
+		block = malloc(size);
+		SBF::Stats::CountAllocation(size);
+	} else if (!spare.empty()) {
+		size = block_size;
+		block = spare.back();
+		spare.pop_back();
+	} else {
+		size = block_size;
+		block = malloc(size);
+		SBF::Stats::CountAllocation(size);
+	}
+
+	if (!block) throw std::bad_alloc();
+
+	blocks.emplace_back(block, size);
+	return (uint8_t *)block;
+}
+
+SBF_Arena *SBF_CreateArena(size_t block_size) {
+	auto arena = new SBF_Arena();
+
+	arena->block_size = block_size ? block_size : 64 * 1024;
+	arena->cursor.arena = arena;
+
+	return arena;
+}
+
+void SBF_ResetArena(SBF_Arena *arena) {
+	if (!arena) return;
+
+	std::lock_guard lock(arena->mutex);
+
+	for (auto [block, size] : arena->blocks) {
+		if (size == arena->block_size) arena->spare.push_back(block);
+		else free(block);
+	}
+
+	arena->blocks.clear();
+	arena->cursor.next = nullptr;
+	arena->cursor.end = nullptr;
+}
+
+void SBF_DestroyArena(SBF_Arena *arena) {
+	if (!arena) return;
+
+	for (auto [block, size] : arena->blocks) free(block);
+	for (auto block : arena->spare) free(block);
+
+	delete arena;
+}
@@ -0,0 +1,455 @@
+#include <filesystem>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <deque>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "SBF/sbf.h"
+
+#include "thread_pool.h"
+#include "checksum.h"
+#include "uring.h"
+#include "node.h"
+#include "tags.h"
+#include "io.h"
+
+namespace {
+
+// Large enough to keep per-request overhead negligible, small enough that
+// encoding the next chunk overlaps with the kernel writing the previous one.
+constexpr size_t Chunk_Size = 1 << 20;
+constexpr unsigned Queue_Depth = 16;
+
+#if !defined(_WIN32)
+
+[[noreturn]] void ThrowErrno(const std::string &what, int error) {
+	throw std::runtime_error(what + ": " + std::strerror(error));
+}
+
+/// Tracks the byte ranges of one file moving through a ring, resubmitting short transfers.
+class RingTransfer {
+
+	struct Range {
+		uint64_t offset;
+		uint32_t length;
+	};
+
+	SBF::Uring &ring;
+	int fd;
+	uint8_t *bytes;
+	bool writing;
+	std::deque<Range> waiting;
+	unsigned in_flight = 0;
+
+	/// Bytes still to be transferred in each chunk, and how many chunks from the start are done.
+	std::vector<uint32_t> left;
+	size_t done = 0;
+	size_t end = 0;
+
+	/// First failure met, thrown once the kernel is done with every range handed to it.
+	std::string error;
+
+	void QueueWaiting() {
+		while (error.empty() && !waiting.empty()) {
+			auto range = waiting.front();
+
+			bool queued = writing
+				? ring.QueueWrite(fd, bytes + range.offset, range.length, range.offset, range.offset | (uint64_t)range.length << 40)
+				: ring.QueueRead(fd, bytes + range.offset, range.length, range.offset, range.offset | (uint64_t)range.length << 40);
+
+			if (!queued) break;
+
+			waiting.pop_front();
+			in_flight++;
+		}
+	}
+
+	void Reap() {
+		uint64_t tag;
+		int32_t result;
+
+		while (ring.PopCompletion(tag, result)) {
+			in_flight--;
+
+			Range range = { tag & ((1ull << 40) - 1), (uint32_t)(tag >> 40) };
+
+			if (result == -EINTR || result == -EAGAIN) {
+				waiting.push_back(range);
+				continue;
+			}
+
+			// Other ranges of the buffer may still be in flight: nothing is thrown until they are back.
+			if (result <= 0) {
+				if (error.empty()) {
+					if (result < 0) error = std::string(writing ? "failed to write file: " : "failed to read file: ") + std::strerror(-result);
+					else error = writing ? "failed to write file" : "unexpected end of file";
+				}
+
+				continue;
+			}
+
+			if ((uint32_t)result < range.length) {
+				waiting.push_back({ range.offset + result, range.length - (uint32_t)result });
+			}
+
+			left[range.offset / Chunk_Size] -= (uint32_t)result;
+		}
+	}
+
+	/// Waits for the completion of every range submitted, queuing no more.
+	void Drain() {
+		waiting.clear();
+
+		// Entries queued but never submitted are not the kernel's; they go away with the ring.
+		while (in_flight > ring.Unsubmitted()) {
+			ring.Wait();
+			Reap();
+		}
+	}
+
+	void ThrowIfFailed() {
+		if (error.empty()) return;
+
+		Drain();
+		throw std::runtime_error(error);
+	}
+
+public:
+
+	RingTransfer(SBF::Uring &ring, int fd, uint8_t *bytes, bool writing)
+		: ring(ring), fd(fd), bytes(bytes), writing(writing) {}
+
+	/// The buffer, the fd and the ring are released by the caller right after, even when unwinding:
+	/// the kernel must be done with them first.
+	~RingTransfer() {
+		Drain();
+	}
+
+	RingTransfer(const RingTransfer &) = delete;
+	RingTransfer &operator=(const RingTransfer &) = delete;
+
+	/// Queues [offset, offset + length) in chunks and submits without waiting.
+	/// Ranges are added in order, and start on a chunk boundary but for the first one.
+	void Add(size_t offset, size_t length) {
+		end = offset + length;
+
+		while (length) {
+			auto part = length < Chunk_Size ? length : Chunk_Size;
+			waiting.push_back({ offset, (uint32_t)part });
+
+			if (left.size() <= offset / Chunk_Size) left.resize(offset / Chunk_Size + 1);
+			left[offset / Chunk_Size] += (uint32_t)part;
+
+			offset += part;
+			length -= part;
+		}
+
+		QueueWaiting();
+		ring.Submit(0);
+		Reap();
+		ThrowIfFailed();
+	}
+
+	/// Waits for every range to be transferred. When reading, arrived is called with Arrived() after every
+	/// completion, so that the bytes from the start are used as soon as they are there, while the rest is in flight.
+	template<typename Progress>
+	void Finish(Progress &&arrived) {
+		while (in_flight || !waiting.empty()) {
+			QueueWaiting();
+			ring.Submit(in_flight ? 1 : 0);
+			Reap();
+			ThrowIfFailed();
+
+			arrived(Arrived());
+		}
+	}
+
+	void Finish() {
+		Finish([](size_t) {});
+	}
+
+	/// End of the bytes transferred from the start, without gaps.
+	size_t Arrived() {
+		while (done < left.size() && left[done] == 0) done++;
+		return done < left.size() ? done * Chunk_Size : end;
+	}
+
+};
+
+/// Throws on the duplicate keys that writing node in key order runs into, as SBF_SerializeEx would.
+void CheckKeyOrder(const Node *node, const SBF_EncodeOptions &encode) {
+	const bool canonical = encode.flags & SBF_ENCODE_CANONICAL;
+	if (!canonical && !(encode.flags & SBF_ENCODE_SORTED_TABLES)) return;
+
+	std::vector<const Node *> pending = { node };
+	std::vector<size_t> order;
+
+	while (!pending.empty()) {
+		auto table = pending.back();
+		pending.pop_back();
+
+		// Sorted tables leave the columns of columns nodes in their order.
+		if (table->type == NodeType_Columns && !canonical) continue;
+
+		order.clear();
+		SBF::CanonicalOrder(table, order);
+
+		if (table->type == NodeType_Columns) continue;
+
+		for (size_t x = 0; x < table->table_length; x++) {
+			const auto value = table->values[x];
+			if (value->type == NodeType_T || value->type == NodeType_Columns) pending.push_back(value);
+		}
+	}
+}
+
+/// Reads and decodes a file like SBF_ReadFile. In files without checksums, the base node is decoded
+/// a chunk at a time as the chunks arrive, while the rest of the file is still being read.
+Node *ReadWholeFile(const std::filesystem::path &filepath, uint8_t *version) {
+	auto ring = SBF::Uring::Create(Queue_Depth);
+
+	if (!ring) {
+		SBF::BlockVerifier verifier;
+		auto bytes = SBF::ReadFileAsBytes(filepath, &verifier);
+		return SBF::DecodeFileBytes(bytes.data(), bytes.size(), version, &verifier);
+	}
+
+	int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) ThrowErrno("failed to open file", errno);
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+		close(fd);
+		throw std::runtime_error("path is not a file");
+	}
+
+	std::vector<uint8_t> bytes(info.st_size);
+
+	// Checksummed blocks are only decoded once verified, so they wait for the whole file.
+	SBF::BlockVerifier verifier;
+	SBF_Decoder *decoder = nullptr;
+	Node *base = nullptr;
+	size_t fed = 1;
+
+	try {
+		// All chunks are in flight at once, up to the queue depth.
+		RingTransfer transfer(*ring, fd, bytes.data(), false);
+		transfer.Add(0, bytes.size());
+
+		transfer.Finish([&](size_t arrived) {
+			verifier.Advance(bytes.data(), arrived);
+
+			if (base || arrived <= fed || bytes.size() < 3) return;
+
+			if (!decoder) {
+				if (SBF::FormatVersion(bytes[0]) == SBF::ChecksumVersion) return;
+
+				SBF_DecodeOptions options = {};
+				if (bytes[0] & SBF::BigEndianFlag) options.flags |= SBF_DECODE_BIG_ENDIAN;
+
+				decoder = SBF_CreateDecoder(&options);
+			}
+
+			size_t used = 0;
+			if (SBF_DecoderFeed(decoder, bytes.data() + fed, arrived - fed, &used) == SBF_DECODE_DONE) base = SBF_DecoderTake(decoder);
+			fed += used;
+		});
+	} catch (...) {
+		close(fd);
+		if (decoder) SBF_DestroyDecoder(decoder);
+		if (base) SBF_DestroyNode(base);
+		throw;
+	}
+
+	close(fd);
+	if (decoder) SBF_DestroyDecoder(decoder);
+
+	// Checksummed, too short, or a base node cut short: decoded as a whole, which reports the errors.
+	if (!base) return SBF::DecodeFileBytes(bytes.data(), bytes.size(), version, &verifier);
+
+	if (version) *version = SBF::FormatVersion(bytes[0]);
+
+	return SBF::ReplayRecords(base, bytes.data(), bytes.size(), fed);
+}
+
+void WriteWholeFile(const std::filesystem::path &filepath, const Node *node, const SBF_WriteOptions &options) {
+	const bool checksum = options.flags & SBF_WRITE_CHECKSUM;
+	const auto encode = SBF::EncodeOptionsFor(options);
+	const auto node_size = SBF_CalculateSizeEx(node, SBF::FileHeaderSize(checksum), &encode);
+	const auto size = SBF::FileImageSize(node_size, checksum);
+
+	auto ring = SBF::Uring::Create(Queue_Depth);
+
+	// Chunks of a table are handed to the kernel before the rest is encoded: find what would fail it first.
+	if (ring && node->type == NodeType_T) CheckKeyOrder(node, encode);
+
+	auto bytes = (uint8_t *)malloc(size);
+
+	SBF::FileWrite write;
+	try {
+		write = SBF::BeginFileWrite(filepath, size, options);
+	} catch (...) {
+		free(bytes);
+		throw;
+	}
+
+	try {
+		size_t cursor = SBF::EncodeFileHeader(bytes, node_size, options);
+		size_t submitted = 0;
+
+		// Chunks are checksummed just before they are handed over, right after being encoded.
+		SBF::BlockSealer sealer(bytes, size, checksum);
+
+		if (ring && node->type == NodeType_T) {
+			RingTransfer transfer(*ring, write.fd, bytes, true);
+
+			// Hand every completed chunk to the kernel while the rest of the table is being encoded.
+			const auto flush_chunks = [&]() {
+				auto ready = (cursor / Chunk_Size) * Chunk_Size;
+				if (ready > submitted) {
+					sealer.Seal(ready);
+					transfer.Add(submitted, ready - submitted);
+					submitted = ready;
+				}
+			};
+
+			// The entries are written one by one, so a canonical or sorted table is put in order here.
+			const bool sorted = encode.flags & SBF_ENCODE_SORTED_TABLES;
+
+			std::vector<size_t> order;
+			if (encode.flags & (SBF_ENCODE_CANONICAL | SBF_ENCODE_SORTED_TABLES)) SBF::CanonicalOrder(node, order);
+
+			bytes[cursor++] = (uint8_t)(sorted ? SBF::TagType::Open_Sorted_Table : SBF::TagType::Open_Table);
+
+			for (size_t n = 0; n < node->table_length; n++) {
+				const auto x = order.empty() ? n : order[n];
+
+				Node key;
+				key.type = NodeType_String;
+				key.flags = 0;
+				key.string = node->keys[x];
+				key.string_length = std::strlen(node->keys[x]);
+
+				SBF_SerializeEx(&key, bytes, size, &cursor, &encode);
+				SBF_SerializeEx(node->values[x], bytes, size, &cursor, &encode);
+
+				flush_chunks();
+			}
+
+			bytes[cursor++] = (uint8_t)(sorted ? SBF::TagType::Close_Sorted_Table : SBF::TagType::Close_Table);
+			if (checksum) cursor += SBF::BlockTrailerSize;
+
+			sealer.Seal(cursor);
+			transfer.Add(submitted, cursor - submitted);
+			transfer.Finish();
+		} else {
+			SBF_SerializeEx(node, bytes, size, &cursor, &encode);
+			if (checksum) cursor += SBF::BlockTrailerSize;
+
+			if (ring) {
+				RingTransfer transfer(*ring, write.fd, bytes, true);
+
+				for (; submitted < cursor; submitted += Chunk_Size) {
+					const auto part = std::min(cursor - submitted, Chunk_Size);
+					sealer.Seal(submitted + part);
+					transfer.Add(submitted, part);
+				}
+
+				transfer.Finish();
+			} else {
+				size_t written = 0;
+				while (written < cursor) {
+					const auto end = checksum ? std::min(cursor, written + Chunk_Size) : cursor;
+					sealer.Seal(end);
+
+					auto result = pwrite(write.fd, bytes + written, end - written, written);
+
+					if (result < 0) {
+						if (errno == EINTR) continue;
+						ThrowErrno("failed to write file", errno);
+					}
+
+					written += result;
+				}
+			}
+		}
+	} catch (...) {
+		SBF::AbortFileWrite(write);
+		free(bytes);
+		throw;
+	}
+
+	free(bytes);
+
+	SBF::EndFileWrite(std::move(write));
+}
+
+#else
+
+Node *ReadWholeFile(const std::filesystem::path &filepath, uint8_t *version) {
+	SBF::BlockVerifier verifier;
+	auto bytes = SBF::ReadFileAsBytes(filepath, &verifier);
+	return SBF::DecodeFileBytes(bytes.data(), bytes.size(), version, &verifier);
+}
+
+void WriteWholeFile(const std::filesystem::path &filepath, const Node *node, const SBF_WriteOptions &options) {
+	SBF_WriteFileEx(filepath.string().c_str(), node, &options);
+}
+
+#endif
+
+};
+
+void SBF_ReadFileAsync(const char *filepath, SBF_ReadCallback callback, void *user) {
+	if (!filepath) throw std::invalid_argument("file path argument must not be null");
+	if (!callback) throw std::invalid_argument("callback argument must not be null");
+
+	std::filesystem::path path(filepath);
+
+	SBF::ThreadPool::Shared().Submit([path, callback, user]() {
+		Node *node = nullptr;
+		uint8_t version = 0;
+
+		try {
+			SBF::WaitForPendingWrite(path);
+
+			node = ReadWholeFile(path, &version);
+		} catch (std::exception &e) {
+			callback(nullptr, 0, e.what(), user);
+			return;
+		}
+
+		callback(node, version, nullptr, user);
+	});
+}
+
+void SBF_WriteFileAsync(const char *filepath, const Node *node, const SBF_WriteOptions *options, SBF_WriteCallback callback, void *user) {
+	if (!filepath) throw std::invalid_argument("file path argument must not be null");
+	if (!node) throw std::invalid_argument("node pointer argument must not be null");
+
+	std::filesystem::path path(filepath);
+	SBF_WriteOptions opts = options ? *options : SBF_WriteOptions{};
+
+	SBF::ThreadPool::Shared().Submit([path, node, opts, callback, user]() {
+		try {
+			WriteWholeFile(path, node, opts);
+		} catch (std::exception &e) {
+			if (callback) callback(e.what(), user);
+			return;
+		}
+
+		if (callback) callback(nullptr, user);
+	});
+}
@@ -0,0 +1,93 @@
+#include <stdexcept>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "SBF/sbf.h"
+
+#include "exceptions.h"
+#include "thread_pool.h"
+#include "arena.h"
+#include "node.h"
+
+namespace {
+
+// Below this many messages per thread, handing work to the pool costs more than it saves.
+constexpr size_t Min_Messages_Per_Thread = 256;
+
+size_t PartsFor(size_t count, size_t threads) {
+	if (threads <= 1) return 1;
+
+	auto parts = count / Min_Messages_Per_Thread;
+	if (parts > threads) parts = threads;
+
+	return parts ? parts : 1;
+}
+
+};
+
+size_t SBF_DeserializeBatch(const uint8_t *const *buffers, const size_t *lengths, size_t count, SBF_Arena *arena, Node **out, size_t threads) {
+	if (count && (!buffers || !lengths || !out)) throw std::invalid_argument("batch arguments must not be null");
+
+	std::atomic<size_t> decoded = 0;
+
+	SBF::ThreadPool::Shared().ParallelFor(PartsFor(count, threads), [&](size_t part, size_t parts) {
+		const auto first = count * part / parts;
+		const auto last = count * (part + 1) / parts;
+
+		// Part 0 keeps filling the arena's own cursor; the other parts fill cursors of their own.
+		SBF::ArenaCursor local = { arena };
+		auto &cursor = part == 0 && arena ? arena->cursor : local;
+
+		size_t ok = 0;
+
+		for (auto x = first; x < last; x++) {
+			size_t begin = 0;
+
+			try {
+				out[x] = arena
+					? SBF::DeserializeInArena(buffers[x], lengths[x], &begin, cursor)
+					: SBF_Deserialize(buffers[x], lengths[x], &begin);
+			} catch (SBF::SerdeException &) {
+				out[x] = nullptr;
+			}
+
+			if (out[x]) ok++;
+		}
+
+		decoded += ok;
+	});
+
+	return decoded;
+}
+
+size_t SBF_SerializeBatch(const Node *const *nodes, size_t count, uint8_t *bytes, size_t length, size_t *offsets, size_t threads) {
+	if (count && (!nodes || !offsets)) throw std::invalid_argument("batch arguments must not be null");
+
+	auto &pool = SBF::ThreadPool::Shared();
+	const auto parts = PartsFor(count, threads);
+
+	offsets[0] = 0;
+
+	pool.ParallelFor(parts, [&](size_t part, size_t parts) {
+		for (auto x = count * part / parts; x < count * (part + 1) / parts; x++) {
+			if (!nodes[x]) throw std::invalid_argument("node was null");
+			offsets[x + 1] = SBF_CalculateSize(nodes[x]);
+		}
+	});
+
+	for (size_t x = 0; x < count; x++) offsets[x + 1] += offsets[x];
+
+	const auto total = offsets[count];
+
+	if (!bytes || length < total) return total;
+
+	pool.ParallelFor(parts, [&](size_t part, size_t parts) {
+		for (auto x = count * part / parts; x < count * (part + 1) / parts; x++) {
+			size_t cursor = offsets[x];
+			SBF_Serialize(nodes[x], bytes, length, &cursor);
+		}
+	});
+
+	return total;
+}
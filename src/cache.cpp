@@ -0,0 +1,432 @@
+#include <condition_variable>
+#include <unordered_map>
+#include <filesystem>
+#include <stdexcept>
+#include <exception>
+#include <iterator>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+#include "SBF/sbf.h"
+
+#include "thread_pool.h"
+#include "node.h"
+#include "io.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// What tells one version of a file from another.
+struct FileIdentity {
+	uint64_t device = 0;
+	uint64_t inode = 0;
+	uint64_t size = 0;
+	/// Modification time, in nanoseconds where the system keeps them.
+	int64_t modified = 0;
+
+	bool operator==(const FileIdentity &) const = default;
+};
+
+/// Returns false if the file cannot be found.
+bool Identify(const std::string &path, FileIdentity &identity) {
+	identity = {};
+
+#if defined(_WIN32)
+	std::error_code error;
+
+	const auto size = std::filesystem::file_size(path, error);
+	if (error) return false;
+
+	const auto modified = std::filesystem::last_write_time(path, error);
+	if (error) return false;
+
+	identity.size = size;
+	identity.modified = modified.time_since_epoch().count();
+#else
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0) return false;
+
+	identity.device = status.st_dev;
+	identity.inode = status.st_ino;
+	identity.size = status.st_size;
+
+	#if defined(__APPLE__)
+		identity.modified = (int64_t)status.st_mtimespec.tv_sec * 1000000000 + status.st_mtimespec.tv_nsec;
+	#else
+		identity.modified = (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+	#endif
+#endif
+
+	return true;
+}
+
+/// Memory taken by a heap tree: its nodes, arrays, keys and entry pointers.
+size_t Footprint(const Node *root) {
+	size_t bytes = 0;
+	std::vector<const Node *> pending = { root };
+
+	while (!pending.empty()) {
+		auto node = pending.back();
+		pending.pop_back();
+
+		if (!node) continue;
+
+		bytes += sizeof(Node);
+
+		if (SBF::IsArrayType(node->type)) {
+			bytes += node->array_length * SBF::ArrayElementSize(node->type) + (node->type == NodeType_String);
+		} else if (node->type == NodeType_T || node->type == NodeType_Columns) {
+			bytes += node->table_length * (sizeof(char *) + sizeof(Node *));
+
+			for (size_t x = 0; x < node->table_length; x++) {
+				bytes += std::strlen(node->keys[x]) + 1;
+				pending.push_back(node->values[x]);
+			}
+		}
+	}
+
+	return bytes;
+}
+
+/// One decoded version of a file.
+struct Entry {
+	enum State { Loading, Ready, Failed };
+
+	std::string key;
+	FileIdentity identity;
+
+	State state = Loading;
+	std::exception_ptr error;
+
+	Node *node = nullptr;
+	uint8_t version = 0;
+	size_t bytes = 0;
+
+	/// Acquisitions not released yet, and lookups waiting for the file to load.
+	size_t holders = 0;
+
+	/// Still the one handed out for its file, rather than replaced by a newer version or dropped.
+	bool current = true;
+
+	Clock::time_point checked;
+	bool revalidating = false;
+
+	/// Place in the cache's list of trees nobody holds, while in it.
+	std::list<Entry *>::iterator unheld;
+	bool is_unheld = false;
+};
+
+/// Trees to destroy once the cache is unlocked, so that lookups do not wait for them.
+/// Declared before the lock, so that it is destroyed after the lock is released.
+struct Garbage {
+	std::vector<Node *> trees;
+
+	~Garbage() {
+		for (auto tree : trees) SBF_DestroyNode(tree);
+	}
+};
+
+};
+
+struct SBF_Cache {
+	SBF_CacheOptions options;
+
+	std::mutex mutex;
+	/// Notified whenever a load or a background check finishes.
+	std::condition_variable changed;
+
+	/// The current version of every file, by key.
+	std::unordered_map<std::string, std::shared_ptr<Entry>> files;
+	/// Every loaded tree, current or not, until it is destroyed.
+	std::unordered_map<const Node *, std::shared_ptr<Entry>> trees;
+	/// Current trees nobody holds, least recently released first.
+	std::list<Entry *> unheld;
+
+	size_t bytes = 0;
+	size_t revalidations = 0;
+};
+
+namespace {
+
+// The helpers below run with the cache locked.
+
+void Hold(SBF_Cache &cache, Entry &entry) {
+	if (entry.holders++ || !entry.is_unheld) return;
+
+	cache.unheld.erase(entry.unheld);
+	entry.is_unheld = false;
+}
+
+/// Forgets a loaded tree nobody holds.
+void Drop(SBF_Cache &cache, std::shared_ptr<Entry> entry, Garbage &garbage) {
+	const auto node = entry->node;
+
+	cache.bytes -= entry->bytes;
+	cache.trees.erase(node);
+	garbage.trees.push_back(node);
+}
+
+/// Stops handing out entry; it goes away as soon as nobody holds it.
+void Retire(SBF_Cache &cache, std::shared_ptr<Entry> entry, Garbage &garbage) {
+	if (!entry->current) return;
+
+	entry->current = false;
+	cache.files.erase(entry->key);
+
+	if (entry->is_unheld) {
+		cache.unheld.erase(entry->unheld);
+		entry->is_unheld = false;
+	}
+
+	if (entry->state == Entry::Ready && !entry->holders) Drop(cache, entry, garbage);
+}
+
+/// Drops the least recently used trees nobody holds while over budget.
+void Trim(SBF_Cache &cache, Garbage &garbage) {
+	if (!cache.options.max_bytes) return;
+
+	while (cache.bytes > cache.options.max_bytes && !cache.unheld.empty()) {
+		Retire(cache, cache.files.at(cache.unheld.front()->key), garbage);
+	}
+}
+
+void MakeUnheld(SBF_Cache &cache, Entry &entry) {
+	cache.unheld.push_back(&entry);
+	entry.unheld = std::prev(cache.unheld.end());
+	entry.is_unheld = true;
+}
+
+void Release(SBF_Cache &cache, std::shared_ptr<Entry> entry, Garbage &garbage) {
+	if (--entry->holders || entry->state != Entry::Ready) return;
+
+	if (!entry->current) {
+		Drop(cache, entry, garbage);
+		return;
+	}
+
+	MakeUnheld(cache, *entry);
+	Trim(cache, garbage);
+}
+
+/// Makes the tree of a loaded entry available.
+void Publish(SBF_Cache &cache, const std::shared_ptr<Entry> &entry, Garbage &garbage) {
+	entry->state = Entry::Ready;
+	entry->checked = Clock::now();
+
+	cache.trees[entry->node] = entry;
+	cache.bytes += entry->bytes;
+
+	if (!entry->holders && entry->current) MakeUnheld(cache, *entry);
+
+	cache.changed.notify_all();
+	Trim(cache, garbage);
+}
+
+bool Due(const SBF_Cache &cache, const Entry &entry, Clock::time_point now) {
+	return now - entry.checked >= std::chrono::milliseconds(cache.options.revalidate_ms);
+}
+
+/// Checks a file on a worker thread. Lookups keep getting the tree at hand until a newer one is read;
+/// if the newer one fails to read (say, while being written), the check is left to the next lookup.
+void Revalidate(SBF_Cache *cache, std::shared_ptr<Entry> entry) {
+	FileIdentity identity;
+	const bool exists = Identify(entry->key, identity);
+	const bool changed = exists && identity != entry->identity;
+
+	auto fresh = std::make_shared<Entry>();
+
+	if (changed) {
+		try {
+			fresh->key = entry->key;
+			fresh->identity = identity;
+			fresh->node = SBF_ReadFile(entry->key.c_str(), &fresh->version);
+			fresh->bytes = Footprint(fresh->node);
+		} catch (...) {
+			fresh->node = nullptr;
+		}
+	}
+
+	Garbage garbage;
+	std::lock_guard lock(cache->mutex);
+
+	entry->revalidating = false;
+	cache->revalidations--;
+	cache->changed.notify_all();
+
+	if (!entry->current) {
+		if (fresh->node) garbage.trees.push_back(fresh->node);
+		return;
+	}
+
+	if (!exists) {
+		Retire(*cache, entry, garbage);
+	} else if (!changed) {
+		entry->checked = Clock::now();
+	} else if (fresh->node) {
+		Retire(*cache, entry, garbage);
+
+		cache->files[fresh->key] = fresh;
+		Publish(*cache, fresh, garbage);
+	}
+}
+
+};
+
+SBF_Cache *SBF_CreateCache(const SBF_CacheOptions *options) {
+	auto cache = new SBF_Cache;
+	cache->options = options ? *options : SBF_CacheOptions{};
+
+	return cache;
+}
+
+void SBF_DestroyCache(SBF_Cache *cache) {
+	if (!cache) return;
+
+	{
+		std::unique_lock lock(cache->mutex);
+		cache->changed.wait(lock, [cache]() { return !cache->revalidations; });
+	}
+
+	for (auto &[node, entry] : cache->trees) SBF_DestroyNode(entry->node);
+
+	delete cache;
+}
+
+const Node *SBF_CacheAcquire(SBF_Cache *cache, const char *filepath, uint8_t *version) {
+	if (!cache) throw std::invalid_argument("cache argument must not be null");
+	if (!filepath) throw std::invalid_argument("file path argument must not be null");
+
+	const auto key = SBF::FileKey(filepath);
+	const bool background = cache->options.flags & SBF_CACHE_REVALIDATE_IN_BACKGROUND;
+
+	Garbage garbage;
+	std::unique_lock lock(cache->mutex);
+
+	while (true) {
+		auto found = cache->files.find(key);
+
+		if (found == cache->files.end()) break;
+
+		auto entry = found->second;
+
+		// Someone else is reading the file: wait for them.
+		if (entry->state == Entry::Loading) {
+			Hold(*cache, *entry);
+			cache->changed.wait(lock, [&entry]() { return entry->state != Entry::Loading; });
+
+			if (entry->state == Entry::Failed) {
+				entry->holders--;
+				std::rethrow_exception(entry->error);
+			}
+
+			if (version) *version = entry->version;
+			return entry->node;
+		}
+
+		const auto now = Clock::now();
+
+		if (Due(*cache, *entry, now)) {
+			if (background) {
+				if (!entry->revalidating) {
+					entry->revalidating = true;
+					cache->revalidations++;
+
+					SBF::ThreadPool::Shared().Submit([cache, entry]() { Revalidate(cache, entry); });
+				}
+			} else {
+				lock.unlock();
+				FileIdentity identity;
+				const bool exists = Identify(key, identity);
+				lock.lock();
+
+				// Replaced or dropped meanwhile: look again.
+				if (!entry->current) continue;
+
+				if (!exists || identity != entry->identity) {
+					Retire(*cache, entry, garbage);
+					continue;
+				}
+
+				entry->checked = now;
+			}
+		}
+
+		Hold(*cache, *entry);
+
+		if (version) *version = entry->version;
+		return entry->node;
+	}
+
+	// Not in the cache: read it, while lookups of the same file wait.
+	auto entry = std::make_shared<Entry>();
+	entry->key = key;
+	entry->holders = 1;
+
+	cache->files[key] = entry;
+
+	lock.unlock();
+
+	std::exception_ptr error;
+
+	try {
+		// Identified first, so that a change while reading shows up at the next check.
+		Identify(key, entry->identity);
+
+		entry->node = SBF_ReadFile(key.c_str(), &entry->version);
+		entry->bytes = Footprint(entry->node);
+	} catch (...) {
+		error = std::current_exception();
+	}
+
+	lock.lock();
+
+	if (error) {
+		entry->state = Entry::Failed;
+		entry->error = error;
+		entry->holders--;
+
+		if (entry->current) {
+			entry->current = false;
+			cache->files.erase(key);
+		}
+
+		cache->changed.notify_all();
+		std::rethrow_exception(error);
+	}
+
+	Publish(*cache, entry, garbage);
+
+	if (version) *version = entry->version;
+	return entry->node;
+}
+
+void SBF_CacheRelease(SBF_Cache *cache, const Node *node) {
+	if (!cache) throw std::invalid_argument("cache argument must not be null");
+
+	Garbage garbage;
+	std::lock_guard lock(cache->mutex);
+
+	auto found = cache->trees.find(node);
+
+	if (found == cache->trees.end() || !found->second->holders)
+		throw std::invalid_argument("node is not held from this cache");
+
+	Release(*cache, found->second, garbage);
+}
+
+size_t SBF_CacheSize(SBF_Cache *cache) {
+	if (!cache) throw std::invalid_argument("cache argument must not be null");
+
+	std::lock_guard lock(cache->mutex);
+	return cache->bytes;
+}
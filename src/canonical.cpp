@@ -0,0 +1,153 @@
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "node.h"
+
+// Canonical key order: keys compared byte by byte as unsigned, a key before any key it is a prefix of.
+// Tables are sorted with a multikey quicksort (three-way radix quicksort) over eight bytes of the keys
+// at a time, kept next to them as a big-endian word so that partitioning does not chase key pointers.
+
+namespace {
+
+struct SortKey {
+	/// Eight bytes of the key from the depth being sorted on, zero past its end.
+	uint64_t word;
+	const uint8_t *key;
+	size_t index;
+};
+
+/// Keys of the table being sorted on this thread.
+thread_local std::vector<SortKey> sort_keys;
+
+/// Ranges this short are sorted by insertion instead.
+constexpr size_t Insertion_Threshold = 12;
+
+/// Bytes of the keys compared at every depth.
+constexpr size_t Word_Size = sizeof(uint64_t);
+
+inline uint64_t WordAt(const uint8_t *key, size_t depth) {
+	uint64_t word = 0;
+
+	size_t x = 0;
+	for (; x < Word_Size && key[depth + x]; x++) word = word << 8 | key[depth + x];
+
+	return x ? word << (8 * (Word_Size - x)) : 0;
+}
+
+void LoadWords(SortKey *keys, size_t count, size_t depth) {
+	for (size_t x = 0; x < count; x++) keys[x].word = WordAt(keys[x].key, depth);
+}
+
+/// A word ending in a zero byte holds the end of its key: keys with the same one are equal.
+inline bool Ends(uint64_t word) { return !(word & 0xff); }
+
+/// Compares two keys whose first depth bytes are equal, with their words loaded at depth.
+inline bool Less(const SortKey &a, const SortKey &b, size_t depth) {
+	if (a.word != b.word) return a.word < b.word;
+	if (Ends(a.word)) return false;
+
+	return std::strcmp((const char *)a.key + depth + Word_Size, (const char *)b.key + depth + Word_Size) < 0;
+}
+
+void InsertionSort(SortKey *keys, size_t count, size_t depth) {
+	for (size_t x = 1; x < count; x++) {
+		const auto key = keys[x];
+
+		size_t y = x;
+		for (; y > 0 && Less(key, keys[y - 1], depth); y--) keys[y] = keys[y - 1];
+
+		keys[y] = key;
+	}
+}
+
+/// Sorts keys whose first depth bytes are equal, with their words loaded at depth.
+void MultikeyQuicksort(SortKey *keys, size_t count, size_t depth) {
+	// The largest of the three ranges is iterated on and the others recursed into,
+	// which are at most half as large, so the recursion is logarithmic whatever the keys.
+	while (count > Insertion_Threshold) {
+		// Median of three against sorted or reversed input.
+		const auto a = keys[0].word, b = keys[count / 2].word, c = keys[count - 1].word;
+		const uint64_t pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+		// [0, less) < pivot, [less, x) == pivot, [greater, count) > pivot.
+		size_t less = 0, x = 0, greater = count;
+
+		while (x < greater) {
+			const auto word = keys[x].word;
+
+			if (word < pivot) std::swap(keys[less++], keys[x++]);
+			else if (word > pivot) std::swap(keys[x], keys[--greater]);
+			else x++;
+		}
+
+		struct Range { SortKey *keys; size_t count; size_t depth; };
+
+		// Keys ending within the pivot are all equal: duplicates, which the caller reports.
+		Range ranges[3] = {
+			{ keys, less, depth },
+			{ keys + less, Ends(pivot) ? 0 : greater - less, depth + Word_Size },
+			{ keys + greater, count - greater, depth },
+		};
+
+		LoadWords(ranges[1].keys, ranges[1].count, ranges[1].depth);
+
+		size_t largest = 0;
+		for (size_t r = 1; r < 3; r++) {
+			if (ranges[r].count > ranges[largest].count) largest = r;
+		}
+
+		for (size_t r = 0; r < 3; r++) {
+			if (r != largest) MultikeyQuicksort(ranges[r].keys, ranges[r].count, ranges[r].depth);
+		}
+
+		keys = ranges[largest].keys;
+		count = ranges[largest].count;
+		depth = ranges[largest].depth;
+	}
+
+	InsertionSort(keys, count, depth);
+}
+
+[[noreturn]] void DuplicateKey(const Node *table, const SortKey &key) {
+	throw std::invalid_argument(std::string("duplicate key '") + (const char *)key.key + "' in a "
+		+ (table->type == NodeType_Columns ? "columns node" : "table"));
+}
+
+};
+
+namespace SBF {
+
+void CanonicalOrder(const Node *table, std::vector<size_t> &order) {
+	const auto length = table->table_length;
+	const auto keys = (const uint8_t *const *)table->keys;
+
+	// Sorted tables are in order already, and trees built or decoded in canonical order are common: check for it first.
+	size_t sorted = table->flags & NodeFlag_Sorted ? length : 1;
+	while (sorted < length && std::strcmp((const char *)keys[sorted - 1], (const char *)keys[sorted]) < 0) sorted++;
+
+	if (sorted >= length) {
+		for (size_t x = 0; x < length; x++) order.push_back(x);
+		return;
+	}
+
+	auto &scratch = sort_keys;
+	scratch.resize(length);
+
+	for (size_t x = 0; x < length; x++) scratch[x] = { WordAt(keys[x], 0), keys[x], x };
+
+	MultikeyQuicksort(scratch.data(), length, 0);
+
+	for (size_t x = 1; x < length; x++) {
+		if (std::strcmp((const char *)scratch[x - 1].key, (const char *)scratch[x].key) == 0) DuplicateKey(table, scratch[x]);
+	}
+
+	for (size_t x = 0; x < length; x++) order.push_back(scratch[x].index);
+}
+
+};
@@ -0,0 +1,287 @@
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+#include "SBF/sbf.h"
+
+#include "checksum.h"
+#include "io.h"
+
+// CRC32C is computed with the CPU's CRC instructions where there are some (SSE4.2 on x86,
+// the CRC extension on ARMv8), and eight bytes at a time from tables otherwise.
+// The x86 version is picked at runtime; the ARM one when the compiler targets it.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#include <nmmintrin.h>
+	#define SBF_CRC_X86 1
+#else
+	#define SBF_CRC_X86 0
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+	#include <arm_acle.h>
+	#define SBF_CRC_ARM 1
+#else
+	#define SBF_CRC_ARM 0
+#endif
+
+namespace {
+
+/// Reflected Castagnoli polynomial.
+constexpr uint32_t Polynomial = 0x82f63b78;
+
+/// Bytes per stream for inputs long enough to be summed as three independent streams,
+/// which hides the latency of the CRC instruction. Both must be powers of two.
+constexpr size_t Long_Stream = 8192;
+constexpr size_t Short_Stream = 256;
+
+/// Operators appending runs of zero bytes to a CRC, applied one byte of it at a time.
+typedef uint32_t ZeroTables[4][256];
+
+struct Tables {
+	uint32_t bytes[8][256];
+	ZeroTables long_zeros;
+	ZeroTables short_zeros;
+};
+
+uint32_t MatrixTimes(const uint32_t *matrix, uint32_t vector) {
+	uint32_t sum = 0;
+
+	for (; vector; vector >>= 1, matrix++) {
+		if (vector & 1) sum ^= *matrix;
+	}
+
+	return sum;
+}
+
+void MatrixSquare(uint32_t *square, const uint32_t *matrix) {
+	for (size_t n = 0; n < 32; n++) square[n] = MatrixTimes(matrix, matrix[n]);
+}
+
+/// Builds the operator appending length zero bytes (a power of two) to a CRC.
+void ZerosOperator(uint32_t *even, size_t length) {
+	uint32_t odd[32];
+
+	// A single zero bit.
+	odd[0] = Polynomial;
+	for (size_t n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+
+	MatrixSquare(even, odd);
+	MatrixSquare(odd, even);
+
+	// Four zero bits are in odd; every squaring doubles them, up to length bytes.
+	while (true) {
+		MatrixSquare(even, odd);
+		length >>= 1;
+		if (!length) return;
+
+		MatrixSquare(odd, even);
+		length >>= 1;
+		if (!length) break;
+	}
+
+	std::memcpy(even, odd, sizeof(odd));
+}
+
+void BuildZeros(ZeroTables &zeros, size_t length) {
+	uint32_t op[32];
+	ZerosOperator(op, length);
+
+	for (uint32_t n = 0; n < 256; n++) {
+		for (size_t b = 0; b < 4; b++) zeros[b][n] = MatrixTimes(op, n << (b * 8));
+	}
+}
+
+const Tables &GetTables() {
+	static const Tables *tables = []() {
+		auto t = new Tables;
+
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t crc = n;
+			for (size_t k = 0; k < 8; k++) crc = crc & 1 ? (crc >> 1) ^ Polynomial : crc >> 1;
+			t->bytes[0][n] = crc;
+		}
+
+		for (uint32_t n = 0; n < 256; n++) {
+			for (size_t k = 1; k < 8; k++) t->bytes[k][n] = (t->bytes[k - 1][n] >> 8) ^ t->bytes[0][t->bytes[k - 1][n] & 0xff];
+		}
+
+		BuildZeros(t->long_zeros, Long_Stream);
+		BuildZeros(t->short_zeros, Short_Stream);
+
+		return t;
+	}();
+
+	return *tables;
+}
+
+inline uint32_t Shift(const ZeroTables &zeros, uint32_t crc) {
+	return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^ zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+uint64_t Load64(const uint8_t *bytes) {
+	uint64_t value;
+	std::memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+uint32_t SoftwareCrc(uint32_t crc, const uint8_t *bytes, size_t size) {
+	const auto &t = GetTables().bytes;
+
+	// Slicing by eight expects the words in little-endian order.
+	for (; size >= 8; size -= 8, bytes += 8) {
+		const auto word = (uint64_t)crc ^ SBF::ReadLE<uint64_t>(bytes);
+
+		crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff] ^ t[5][(word >> 16) & 0xff] ^ t[4][(word >> 24) & 0xff]
+			^ t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff] ^ t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+	}
+
+	for (; size; size--, bytes++) crc = (crc >> 8) ^ t[0][(crc ^ *bytes) & 0xff];
+
+	return crc;
+}
+
+#if SBF_CRC_X86 || SBF_CRC_ARM
+
+#if SBF_CRC_X86
+	#define SBF_CRC_TARGET __attribute__((target("sse4.2")))
+
+	SBF_CRC_TARGET inline uint32_t Step8(uint32_t crc, uint8_t byte) { return _mm_crc32_u8(crc, byte); }
+
+	#if defined(__x86_64__)
+		SBF_CRC_TARGET inline uint32_t Step64(uint32_t crc, uint64_t word) { return (uint32_t)_mm_crc32_u64(crc, word); }
+	#else
+		SBF_CRC_TARGET inline uint32_t Step64(uint32_t crc, uint64_t word) {
+			return _mm_crc32_u32(_mm_crc32_u32(crc, (uint32_t)word), (uint32_t)(word >> 32));
+		}
+	#endif
+#else
+	#define SBF_CRC_TARGET
+
+	inline uint32_t Step8(uint32_t crc, uint8_t byte) { return __crc32cb(crc, byte); }
+	inline uint32_t Step64(uint32_t crc, uint64_t word) { return __crc32cd(crc, word); }
+#endif
+
+/// Sums three streams of Stream bytes at a time, then appends the later ones to the first.
+template<size_t Stream>
+SBF_CRC_TARGET inline uint32_t Streams(uint32_t crc, const uint8_t *&bytes, size_t &size, const ZeroTables &zeros) {
+	for (; size >= Stream * 3; size -= Stream * 3, bytes += Stream * 3) {
+		uint32_t crc1 = 0, crc2 = 0;
+
+		for (size_t x = 0; x < Stream; x += 8) {
+			crc = Step64(crc, Load64(bytes + x));
+			crc1 = Step64(crc1, Load64(bytes + Stream + x));
+			crc2 = Step64(crc2, Load64(bytes + Stream * 2 + x));
+		}
+
+		crc = Shift(zeros, crc) ^ crc1;
+		crc = Shift(zeros, crc) ^ crc2;
+	}
+
+	return crc;
+}
+
+SBF_CRC_TARGET uint32_t HardwareCrc(uint32_t crc, const uint8_t *bytes, size_t size) {
+	const auto &tables = GetTables();
+
+	crc = Streams<Long_Stream>(crc, bytes, size, tables.long_zeros);
+	crc = Streams<Short_Stream>(crc, bytes, size, tables.short_zeros);
+
+	for (; size >= 8; size -= 8, bytes += 8) crc = Step64(crc, Load64(bytes));
+	for (; size; size--, bytes++) crc = Step8(crc, *bytes);
+
+	return crc;
+}
+
+#endif
+
+typedef uint32_t (*CrcFunction)(uint32_t crc, const uint8_t *bytes, size_t size);
+
+CrcFunction SelectCrc() {
+#if SBF_CRC_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2")) return HardwareCrc;
+#elif SBF_CRC_ARM
+	return HardwareCrc;
+#endif
+
+	return SoftwareCrc;
+}
+
+};
+
+namespace SBF {
+
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size) {
+	static const auto function = SelectCrc();
+
+	return ~function(~crc, (const uint8_t *)data, size);
+}
+
+void BlockSealer::Seal(size_t end) {
+	if (!active) return;
+
+	const auto block_end = size - BlockTrailerSize;
+	const auto upto = end < block_end ? end : block_end;
+
+	if (upto > summed) {
+		crc = Crc32c(crc, image + summed, upto - summed);
+		summed = upto;
+	}
+
+	if (end <= block_end) return;
+
+	if (image[0] & BigEndianFlag) WriteBE<uint32_t>(image + block_end, crc);
+	else WriteLE<uint32_t>(image + block_end, crc);
+}
+
+void BlockVerifier::Advance(const uint8_t *image, size_t available) {
+	if (available == 0 || FormatVersion(image[0]) != ChecksumVersion || failed_end) return;
+
+	const bool big_endian = image[0] & BigEndianFlag;
+
+	while (true) {
+		if (!block_end) {
+			if (available - block < BlockHeaderSize) return;
+
+			const auto length = big_endian ? ReadBE<uint64_t>(image + block) : ReadLE<uint64_t>(image + block);
+			const auto start = block + BlockHeaderSize;
+
+			// A length running past any possible image cannot be right; it never completes.
+			if (length > SIZE_MAX - start - BlockTrailerSize) {
+				block_end = summed = SIZE_MAX - BlockTrailerSize;
+				return;
+			}
+
+			crc = Crc32c(0, image + block, BlockHeaderSize);
+			summed = start;
+			block_end = start + length;
+		}
+
+		if (available <= summed) return;
+
+		const auto end = available < block_end ? available : block_end;
+		crc = Crc32c(crc, image + summed, end - summed);
+		summed = end;
+
+		if (available < block_end || available - block_end < BlockTrailerSize) return;
+
+		const auto expected = big_endian ? ReadBE<uint32_t>(image + block_end) : ReadLE<uint32_t>(image + block_end);
+
+		if (expected != crc) {
+			failed_end = block_end + BlockTrailerSize;
+			return;
+		}
+
+		verified = block = block_end + BlockTrailerSize;
+		block_end = 0;
+	}
+}
+
+};
+
+uint32_t SBF_Crc32c(uint32_t crc, const void *data, size_t size) {
+	if (!data && size) throw std::invalid_argument("data pointer argument must not be null");
+
+	return SBF::Crc32c(crc, data, size);
+}
@@ -0,0 +1,324 @@
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "node.h"
+
+// A columns node shares the layout of a table: keys hold the column names,
+// values the columns and table_length their count. Every column is an array
+// node; a string column holds one null-terminated string per row, back to back.
+
+namespace {
+
+/// Layout of one column while a table of records is being converted.
+struct ColumnPlan {
+	const char *name;
+	NodeType type;
+	size_t bytes;
+};
+
+/// Finds the value of key in a record, trying the position it has in the first record first.
+const Node *FindValue(const Node *record, size_t hint, const char *key) {
+	if (hint < record->table_length && std::strcmp(record->keys[hint], key) == 0) return record->values[hint];
+
+	for (size_t x = 0; x < record->table_length; x++) {
+		if (std::strcmp(record->keys[x], key) == 0) return record->values[x];
+	}
+
+	return nullptr;
+}
+
+char *CopyKey(const char *key, size_t length) {
+	auto copy = (char *)malloc(length + 1);
+	std::memcpy(copy, key, length);
+	copy[length] = '\0';
+	return copy;
+}
+
+/// Column type holding values of the given type, or NodeType_None if there is none.
+NodeType ColumnTypeFor(NodeType type) {
+	// Chars would turn into a string column, which is read back as strings.
+	if (SBF::IsScalarType(type) && type != NodeType_Char) return (NodeType)(type + (NodeType_I32A - NodeType_I32));
+	if (type == NodeType_String) return NodeType_String;
+
+	return NodeType_None;
+}
+
+};
+
+namespace SBF {
+
+size_t ColumnRows(const Node *column) {
+	if (column->type != NodeType_String) return column->array_length;
+
+	size_t rows = 0;
+	const char *cursor = column->string;
+	const char *end = column->string + column->string_length;
+
+	while (cursor < end) {
+		auto terminator = (const char *)std::memchr(cursor, '\0', end - cursor);
+		if (!terminator) break;
+
+		rows++;
+		cursor = terminator + 1;
+	}
+
+	return rows;
+}
+
+size_t CheckColumns(const Node *node) {
+	size_t rows = 0;
+
+	for (size_t x = 0; x < node->table_length; x++) {
+		auto column = node->values[x];
+
+		if (!column) throw std::invalid_argument("column #" + std::to_string(x) + " was null");
+		if (!IsArrayType(column->type)) throw std::invalid_argument("column #" + std::to_string(x) + " is not an array");
+
+		if (column->type == NodeType_String && column->string_length && column->string[column->string_length - 1] != '\0')
+			throw std::invalid_argument("string column #" + std::to_string(x) + " does not end with a null character");
+
+		auto column_rows = ColumnRows(column);
+
+		if (x == 0) rows = column_rows;
+		else if (column_rows != rows)
+			throw std::invalid_argument(
+				"column #" + std::to_string(x) + " holds " + std::to_string(column_rows)
+					+ " rows, but column #0 holds " + std::to_string(rows)
+			);
+	}
+
+	return rows;
+}
+
+};
+
+Node *SBF_CreateNode_Columns(char **names, Node **columns, size_t count) {
+	Node check;
+	check.type = NodeType_Columns;
+	check.keys = names;
+	check.values = columns;
+	check.table_length = count;
+
+	SBF::CheckColumns(&check);
+
+	auto node = (Node *)malloc(sizeof(Node));
+	std::memcpy(node, &check, sizeof(Node));
+	node->flags = 0;
+
+	return node;
+}
+
+size_t SBF_NodeGet_ColumnCount(const Node *node) { return node->table_length; }
+size_t SBF_NodeGet_RowCount(const Node *node) { return node->table_length ? SBF::ColumnRows(node->values[0]) : 0; }
+void SBF_NodeGet_Columns(Node *node, char ***names, Node ***columns) {
+	*names = node->keys;
+	*columns = node->values;
+}
+
+Node *SBF_NodeGet_Column(Node *node, const char *name) {
+	for (size_t x = 0; x < node->table_length; x++) {
+		if (std::strcmp(node->keys[x], name) == 0) return node->values[x];
+	}
+
+	return nullptr;
+}
+
+Node *SBF_TableToColumns(const Node *table, const char *key_column) {
+	if (!table) throw std::invalid_argument("table argument must not be null");
+	if (table->type != NodeType_T) throw std::invalid_argument("only tables convert to columns");
+
+	const auto rows = table->table_length;
+
+	std::vector<ColumnPlan> plan;
+
+	if (key_column) plan.push_back({ key_column, NodeType_String, 0 });
+
+	// The first record sets the columns; every other one must match it.
+	if (rows) {
+		auto first = table->values[0];
+		if (!first || first->type != NodeType_T) return nullptr;
+
+		for (size_t x = 0; x < first->table_length; x++) {
+			if (key_column && std::strcmp(first->keys[x], key_column) == 0) return nullptr;
+			if (!first->values[x]) return nullptr;
+
+			auto type = ColumnTypeFor(first->values[x]->type);
+			if (type == NodeType_None) return nullptr;
+
+			plan.push_back({ first->keys[x], type, 0 });
+		}
+	}
+
+	// Without any column, the number of rows would be lost.
+	if (rows && plan.empty()) return nullptr;
+
+	const size_t first_field = key_column ? 1 : 0;
+	const auto fields = plan.size() - first_field;
+
+	for (size_t row = 0; row < rows; row++) {
+		auto record = table->values[row];
+		if (!record || record->type != NodeType_T || record->table_length != fields) return nullptr;
+
+		if (key_column) {
+			auto key = table->keys[row];
+			plan[0].bytes += std::strlen(key) + 1;
+		}
+
+		for (size_t x = 0; x < fields; x++) {
+			auto &column = plan[first_field + x];
+
+			auto value = FindValue(record, x, column.name);
+			if (!value || ColumnTypeFor(value->type) != column.type) return nullptr;
+
+			if (column.type != NodeType_String) {
+				column.bytes += SBF::ArrayElementSize(column.type);
+				continue;
+			}
+
+			// Null characters separate the rows of a string column.
+			if (value->string_length && std::memchr(value->string, '\0', value->string_length)) return nullptr;
+
+			column.bytes += value->string_length + 1;
+		}
+	}
+
+	auto names = (char **)malloc(sizeof(char *) * plan.size());
+	auto columns = (Node **)malloc(sizeof(Node *) * plan.size());
+
+	for (size_t x = 0; x < plan.size(); x++) {
+		auto &column = plan[x];
+
+		names[x] = CopyKey(column.name, std::strlen(column.name));
+
+		// One more byte keeps string columns null-terminated as a whole, like any string node.
+		auto array = malloc(column.type == NodeType_String ? column.bytes + 1 : column.bytes);
+		size_t cursor = 0;
+
+		for (size_t row = 0; row < rows; row++) {
+			auto bytes = (uint8_t *)array;
+
+			if (x < first_field) {
+				auto key = table->keys[row];
+				auto key_length = std::strlen(key) + 1;
+
+				std::memcpy(bytes + cursor, key, key_length);
+				cursor += key_length;
+				continue;
+			}
+
+			auto value = FindValue(table->values[row], x - first_field, column.name);
+
+			if (column.type == NodeType_String) {
+				if (value->string_length) std::memcpy(bytes + cursor, value->string, value->string_length);
+				cursor += value->string_length;
+				bytes[cursor++] = '\0';
+			} else {
+				// Scalars sit at the start of the union, whatever their size.
+				auto size = SBF::ArrayElementSize(column.type);
+				std::memcpy(bytes + cursor, &value->u64, size);
+				cursor += size;
+			}
+		}
+
+		if (column.type == NodeType_String) ((char *)array)[cursor] = '\0';
+
+		columns[x] = SBF_CreateNode_Array(column.type, array, column.type == NodeType_String ? column.bytes : rows);
+	}
+
+	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
+	node->type = NodeType_Columns;
+	node->keys = names;
+	node->values = columns;
+	node->table_length = plan.size();
+
+	return node;
+}
+
+Node *SBF_ColumnsToTable(const Node *columns, const char *key_column) {
+	if (!columns) throw std::invalid_argument("columns argument must not be null");
+	if (columns->type != NodeType_Columns) throw std::invalid_argument("expected a columns node");
+
+	const auto rows = SBF::CheckColumns(columns);
+	const auto count = columns->table_length;
+
+	size_t key_index = count;
+
+	if (key_column) {
+		for (size_t x = 0; x < count; x++) {
+			if (std::strcmp(columns->keys[x], key_column) == 0) key_index = x;
+		}
+
+		if (key_index == count) throw std::invalid_argument(std::string("no column named '") + key_column + "'");
+		if (columns->values[key_index]->type != NodeType_String) throw std::invalid_argument("key column must be a string column");
+	}
+
+	const auto fields = key_index == count ? count : count - 1;
+
+	// Where the next row of each string column starts.
+	std::vector<const char *> strings(count, nullptr);
+	for (size_t x = 0; x < count; x++) {
+		if (columns->values[x]->type == NodeType_String) strings[x] = columns->values[x]->string;
+	}
+
+	auto keys = (char **)malloc(sizeof(char *) * rows);
+	auto records = (Node **)malloc(sizeof(Node *) * rows);
+
+	for (size_t row = 0; row < rows; row++) {
+		auto record_keys = fields ? (char **)malloc(sizeof(char *) * fields) : nullptr;
+		auto record_values = fields ? (Node **)malloc(sizeof(Node *) * fields) : nullptr;
+
+		size_t field = 0;
+
+		for (size_t x = 0; x < count; x++) {
+			auto column = columns->values[x];
+
+			if (column->type == NodeType_String) {
+				auto string = strings[x];
+				auto string_length = std::strlen(string);
+				strings[x] += string_length + 1;
+
+				if (x == key_index) {
+					keys[row] = CopyKey(string, string_length);
+					continue;
+				}
+
+				auto value = (Node *)malloc(sizeof(Node));
+				value->flags = 0;
+				value->type = NodeType_String;
+				value->string = CopyKey(string, string_length);
+				value->string_length = string_length;
+
+				record_values[field] = value;
+			} else {
+				auto size = SBF::ArrayElementSize(column->type);
+
+				auto value = (Node *)malloc(sizeof(Node));
+				value->flags = 0;
+				value->type = (NodeType)(column->type - (NodeType_I32A - NodeType_I32));
+				value->u64 = 0;
+				std::memcpy(&value->u64, (const uint8_t *)column->array + row * size, size);
+
+				record_values[field] = value;
+			}
+
+			record_keys[field] = CopyKey(columns->keys[x], std::strlen(columns->keys[x]));
+			field++;
+		}
+
+		if (key_index == count) {
+			auto number = std::to_string(row);
+			keys[row] = CopyKey(number.c_str(), number.size());
+		}
+
+		records[row] = SBF_CreateNode_Table(record_keys, record_values, fields);
+	}
+
+	return SBF_CreateNode_Table(keys, records, rows);
+}
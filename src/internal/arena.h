@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <mutex>
+
+#include "SBF/sbf.h"
+
+#include "stats.h"
+#include "node.h"
+
+namespace SBF {
+
+/// Bump allocator over blocks taken from an SBF_Arena.
+/// Every thread allocating from the same arena needs its own cursor.
+struct ArenaCursor {
+	SBF_Arena *arena;
+	uint8_t *next = nullptr;
+	uint8_t *end = nullptr;
+
+	void *Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+};
+
+/// Allocator policy for plain malloc'd trees, released with SBF_DestroyNode.
+struct HeapAllocator {
+	inline Node *NewNode() {
+		Stats::CountAllocation(sizeof(Node));
+
+		auto node = (Node *)malloc(sizeof(Node));
+		node->flags = 0;
+		return node;
+	}
+
+	inline void *Allocate(size_t bytes) {
+		Stats::CountAllocation(bytes);
+		return malloc(bytes);
+	}
+
+	inline void Destroy(Node *node) { SBF_DestroyNode(node); }
+	inline void Free(void *ptr) { free(ptr); }
+};
+
+/// Allocator policy for trees owned by an arena.
+struct ArenaAllocator {
+	ArenaCursor &cursor;
+
+	inline Node *NewNode() {
+		auto node = (Node *)cursor.Allocate(sizeof(Node), alignof(Node));
+		node->flags = NodeFlag_Arena;
+		return node;
+	}
+
+	inline void *Allocate(size_t bytes) { return cursor.Allocate(bytes); }
+	inline void Destroy(Node *) {}
+	inline void Free(void *) {}
+};
+
+/// Same as SBF_DeserializeEx, allocating the tree from the cursor's arena; options->arena is ignored.
+Node *DeserializeInArena(const uint8_t *bytes, size_t length, size_t *begin, ArenaCursor &cursor, const SBF_DecodeOptions *options = nullptr);
+
+};
+
+struct SBF_Arena {
+	std::mutex mutex;
+	size_t block_size;
+
+	/// Blocks handed out since the last reset; oversized ones are freed on reset.
+	std::vector<std::pair<void *, size_t>> blocks;
+	/// Standard-size blocks kept around by SBF_ResetArena for reuse.
+	std::vector<void *> spare;
+
+	/// Cursor used by single-threaded entry points.
+	SBF::ArenaCursor cursor;
+
+	/// Returns a block of at least bytes; thread-safe.
+	uint8_t *AcquireBlock(size_t bytes, size_t &size);
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace SBF {
+
+/// Extends crc, the CRC32C (Castagnoli) of earlier bytes, over size more bytes; 0 starts a new one.
+uint32_t Crc32c(uint32_t crc, const void *data, size_t size);
+
+/// Computes the checksum of the base block of a file image (see EncodeFileHeader) a chunk at a time,
+/// right before each chunk is written so that the write finds its bytes in cache,
+/// and fills it in ahead of the chunk holding it. Does nothing for images without checksums.
+class BlockSealer {
+
+	uint8_t *image;
+	size_t size;
+	bool active;
+
+	size_t summed = 1;
+	uint32_t crc = 0;
+
+public:
+
+	BlockSealer(uint8_t *image, size_t size, bool active) : image(image), size(size), active(active) {}
+
+	/// Prepares the bytes of the image up to end to be written.
+	void Seal(size_t end);
+
+};
+
+/// Checks the blocks of a checksummed file image as its bytes arrive, in order,
+/// so that reading and verifying it take a single pass over the data.
+/// Images of other format versions are left alone.
+class BlockVerifier {
+
+	/// Start of the block being checked, and where its node ends (0 until its length is known).
+	size_t block = 1;
+	size_t block_end = 0;
+
+	size_t summed = 0;
+	uint32_t crc = 0;
+
+	size_t verified = 1;
+	size_t failed_end = 0;
+
+public:
+
+	/// Checks what it can of image, of which the first available bytes have arrived.
+	void Advance(const uint8_t *image, size_t available);
+
+	/// End of the intact blocks at the start of the image.
+	size_t Verified() const { return verified; }
+
+	/// End of the complete block that failed its checksum right after them; 0 if none did.
+	size_t FailedEnd() const { return failed_end; }
+
+};
+
+};
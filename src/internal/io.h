@@ -1,213 +1,247 @@
 #pragma once
 
 #include <filesystem>
+#include <type_traits>
 #include <concepts>
+#include <bit>
 #include <cstdint>
 #include <cstring>
+#include <string>
 #include <vector>
 
-namespace SBF {
+#include "SBF/sbf.h"
+
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
 
-std::vector<uint8_t> ReadFileAsBytes(const std::filesystem::path &filepath);
+namespace SBF {
 
+class BlockVerifier;
 
-inline int32_t ReadI32LE(const uint8_t bytes[4]) { return *reinterpret_cast<const int32_t *>(bytes); }
-inline int64_t ReadI64LE(const uint8_t bytes[8]) { return *reinterpret_cast<const int64_t *>(bytes); }
-inline float ReadF32LE(const uint8_t bytes[4]) { return *reinterpret_cast<const float *>(bytes); }
-inline double ReadF64LE(const uint8_t bytes[8]) { return *reinterpret_cast<const double *>(bytes); }
-inline uint32_t ReadU32LE(const uint8_t bytes[4]) { return *reinterpret_cast<const uint32_t *>(bytes); }
-inline uint64_t ReadU64LE(const uint8_t bytes[8]) { return *reinterpret_cast<const uint64_t *>(bytes); }
+/// Format version of files whose base node and update records are stored in checksummed blocks:
+/// a u64 length, the node, then the CRC32C of both.
+constexpr uint8_t ChecksumVersion = 2;
 
+constexpr size_t BlockHeaderSize = 8;
+constexpr size_t BlockTrailerSize = 4;
 
-inline int32_t ReadI32BE(const uint8_t bytes[4]) { 
-	return 
-		(static_cast<int32_t>(bytes[0]) << 24) |
-		(static_cast<int32_t>(bytes[1]) << 16) |
-		(static_cast<int32_t>(bytes[2]) << 8) | 
-		static_cast<int32_t>(bytes[3]); 
-}
-inline int64_t ReadI64BE(const uint8_t bytes[8]) { 
-	return 
-		(static_cast<int64_t>(bytes[0]) << 56) |
-		(static_cast<int64_t>(bytes[1]) << 48) |
-		(static_cast<int64_t>(bytes[2]) << 40) |
-		(static_cast<int64_t>(bytes[3]) << 32) |
-		(static_cast<int64_t>(bytes[4]) << 24) |
-		(static_cast<int64_t>(bytes[5]) << 16) |
-		(static_cast<int64_t>(bytes[6]) << 8) |
-		static_cast<int64_t>(bytes[7]); 
+/// Size of the image of a file whose base node serializes to node_size bytes.
+inline size_t FileImageSize(size_t node_size, bool checksum) {
+	return 1 + node_size + (checksum ? BlockHeaderSize + BlockTrailerSize : 0);
 }
-inline uint32_t ReadU32BE(const uint8_t bytes[4]) { 
-	return 
-		(static_cast<uint32_t>(bytes[0]) << 24) |
-		(static_cast<uint32_t>(bytes[1]) << 16) |
-		(static_cast<uint32_t>(bytes[2]) << 8) | 
-		static_cast<uint32_t>(bytes[3]); 
+
+/// Set in the version byte of files written in big-endian byte order.
+constexpr uint8_t BigEndianFlag = 0x80;
+
+/// Bits of the version byte holding the array alignment of the base node
+/// (see SBF_WriteOptions::array_alignment): its base-2 logarithm plus one, or 0 when packed.
+constexpr uint8_t AlignmentMask = 0x70;
+constexpr int AlignmentShift = 4;
+
+/// Format version in a version byte, without the flags next to it.
+inline uint8_t FormatVersion(uint8_t version) {
+	return version & ~(BigEndianFlag | AlignmentMask);
 }
-inline uint64_t ReadU64BE(const uint8_t bytes[8]) { 
-	return 
-		(static_cast<uint64_t>(bytes[0]) << 56) |
-		(static_cast<uint64_t>(bytes[1]) << 48) |
-		(static_cast<uint64_t>(bytes[2]) << 40) |
-		(static_cast<uint64_t>(bytes[3]) << 32) |
-		(static_cast<uint64_t>(bytes[4]) << 24) |
-		(static_cast<uint64_t>(bytes[5]) << 16) |
-		(static_cast<uint64_t>(bytes[6]) << 8) |
-		static_cast<uint64_t>(bytes[7]); 
+
+/// Array alignment recorded in a version byte; 0 for files written packed.
+inline uint32_t FileAlignment(uint8_t version) {
+	const auto log = (version & AlignmentMask) >> AlignmentShift;
+	return log ? 1u << (log - 1) : 0;
 }
-inline float ReadF32BE(const uint8_t bytes[4]) { 
-	auto i = ReadU32BE(bytes);
-	float res;
-	std::memcpy(&res, &i, sizeof(float));
-	return res;
+
+/// Size of the file header written by EncodeFileHeader.
+inline size_t FileHeaderSize(bool checksum) {
+	return 1 + (checksum ? BlockHeaderSize : 0);
 }
-inline double ReadF64BE(const uint8_t bytes[8]) { 
-	auto f = ReadU32BE(bytes);
-	double res;
-	std::memcpy(&res, &f, sizeof(double));
-	return res;
+
+/// Writes the file header (format version, and the block header of the base node
+/// of node_size bytes when checksummed) as options ask, and returns its size.
+size_t EncodeFileHeader(uint8_t *bytes, size_t node_size, const SBF_WriteOptions &options);
+
+/// Options serializing nodes in the byte order and encoding options ask for.
+inline SBF_EncodeOptions EncodeOptionsFor(const SBF_WriteOptions &options) {
+	SBF_EncodeOptions encode = {};
+	if (options.flags & SBF_WRITE_BIG_ENDIAN) encode.flags |= SBF_ENCODE_BIG_ENDIAN;
+	if (options.flags & SBF_WRITE_CANONICAL) encode.flags |= SBF_ENCODE_CANONICAL;
+	if (options.flags & SBF_WRITE_SORTED_TABLES) encode.flags |= SBF_ENCODE_SORTED_TABLES;
+	encode.array_alignment = options.array_alignment;
+	return encode;
 }
 
-template<typename T>
-concept Primitive = std::integral<T> || std::floating_point<T>;
+/// Returns the offset of the array that the zero bytes at offset align (see SBF_EncodeOptions::array_alignment).
+/// Throws an SBF::DeserException if they run past the end or past the longest padding, or pad anything else.
+size_t SkipPadding(const uint8_t *bytes, size_t length, size_t offset);
+
+/// Returns the offset past the node serialized at offset, in either byte order, stepping over it like
+/// SBF_ScanBytes: without allocating anything or checking more than its tags and lengths.
+/// Throws an SBF::DeserException on malformed bytes, and on bytes that end before the node does.
+size_t SkipSerialized(const uint8_t *bytes, size_t length, size_t offset, bool big_endian);
+
+/// Decodes a whole file image: the header, the base node and any update records.
+/// verifier may hold the result of checking the image while it was read; it is checked here otherwise.
+Node *DecodeFileBytes(const uint8_t *bytes, size_t size, uint8_t *version, BlockVerifier *verifier = nullptr);
+
+/// Applies the update records of a file image without checksums, from offset on, to node, its base node,
+/// and returns the tree patched (node may be replaced). Destroys node before throwing.
+Node *ReplayRecords(Node *node, const uint8_t *bytes, size_t size, size_t offset);
+
+/// End of the file image that SBF_AppendFile keeps: everything but an update record cut short at its tail.
+/// Nothing is decoded: records without checksums are stepped over with SkipSerialized, and only the one
+/// it stops at is decoded to tell a record cut short from a malformed one, which throws an SBF::SerdeException.
+/// Blocks are stepped over by their lengths, and only the last one is checked against its checksum;
+/// failing it, it is cut off like a block cut short. Throws if no whole base node is left.
+size_t IntactFileEnd(const uint8_t *bytes, size_t size);
+
+/// Same as IntactFileEnd over the file at filepath, reading only what it needs of it: the lengths of the
+/// blocks and the last one in checksummed files, the whole file otherwise. *version gets its version byte.
+size_t IntactFileEnd(const std::filesystem::path &filepath, uint8_t *version);
+
+/// Reads a whole file, feeding verifier (when not null) as the bytes arrive.
+std::vector<uint8_t> ReadFileAsBytes(const std::filesystem::path &filepath, BlockVerifier *verifier);
+
+/// Absolute, normalized form of filepath, naming a file the same way however the path was written.
+std::string FileKey(const std::filesystem::path &filepath);
+
+/// Writes a complete file image honoring the SBF_WriteFlags in options.
+/// With SBF_WRITE_CHECKSUM, the image ends with the room for the checksum of its base block,
+/// which is computed and filled in as the bytes are written.
+void WriteBytesToFile(const std::filesystem::path &filepath, uint8_t *bytes, size_t size, const SBF_WriteOptions &options);
+
+/// Blocks until every write queued with SBF_WRITE_ASYNC_FLUSH has completed;
+/// rethrows the first error a background flush ran into.
+void FlushPendingWrites();
+
+/// Blocks until no asynchronously flushed write to filepath is in flight.
+void WaitForPendingWrite(const std::filesystem::path &filepath);
+
+#if !defined(_WIN32)
+/// A file opened by BeginFileWrite that still needs to be flushed and/or moved into place.
+struct FileWrite {
+	int fd;
+	bool sync;
+	bool async;
+	/// Empty when the file is written in place.
+	std::filesystem::path temp;
+	std::filesystem::path target;
+	std::string key;
+};
 
-template<Primitive T>
-inline T ReadLE(const uint8_t *bytes) { return *reinterpret_cast<const T *>(bytes); }
+/// Opens (and possibly preallocates) the file that an image of size bytes will be written to.
+FileWrite BeginFileWrite(const std::filesystem::path &filepath, size_t size, const SBF_WriteOptions &options);
 
-template<Primitive T>
-inline T ReadBE(const uint8_t *bytes) {
-	uint8_t reveresed[sizeof(T)];
+/// Closes a write begun with BeginFileWrite, removing its temporary file.
+void AbortFileWrite(FileWrite &write);
 
-	for (auto l = 0; l < sizeof(T); l++) {
-		reveresed[l] = bytes[sizeof(T) - 1 - l];		
-	}
+/// Flushes and moves a fully written file into place, or hands it to the background flusher.
+void EndFileWrite(FileWrite &&write);
+#endif
 
-	return *reinterpret_cast<T *>(reveresed);
-}
 
-//
+// Byte order of the wire format. Buffers are little-endian unless written otherwise
+// (SBF_ENCODE_BIG_ENDIAN); every value goes through the helpers below, which load and store
+// with memcpy (values sit at any offset) and swap bytes only when the orders differ.
 
-inline void WriteI32LE(uint8_t bytes[4], int32_t i32) { *reinterpret_cast<int32_t *>(bytes) = i32; }
-inline void WriteI64LE(uint8_t bytes[8], int64_t i64) { *reinterpret_cast<int64_t *>(bytes) = i64; }
-inline void WriteF32LE(uint8_t bytes[4], float f32) { *reinterpret_cast<float *>(bytes) = f32; }
-inline void WriteF64LE(uint8_t bytes[8], double f64) { *reinterpret_cast<double *>(bytes) = f64; }
-inline void WriteU32LE(uint8_t bytes[4], uint32_t u32) { *reinterpret_cast<uint32_t *>(bytes) = u32; }
-inline void WriteU64LE(uint8_t bytes[8], uint64_t u64) { *reinterpret_cast<uint64_t *>(bytes) = u64; }
+template<typename T>
+concept Primitive = std::integral<T> || std::floating_point<T>;
 
-
-inline void WriteI32BE(uint8_t bytes[4], int32_t i32) { 
-	bytes[0] = static_cast<uint8_t>(i32 << 24);
-	bytes[1] = static_cast<uint8_t>(i32 << 16);
-	bytes[2] = static_cast<uint8_t>(i32 << 8); 
-	bytes[3] = static_cast<uint8_t>(i32); 
-}
-inline void WriteI64BE(uint8_t bytes[8], int64_t i64) { 
-	bytes[0] = static_cast<uint8_t>(i64 >> 56);
-	bytes[1] = static_cast<uint8_t>(i64 >> 48);
-	bytes[2] = static_cast<uint8_t>(i64 >> 40);
-	bytes[3] = static_cast<uint8_t>(i64 >> 32);
-	bytes[4] = static_cast<uint8_t>(i64 >> 24);
-	bytes[5] = static_cast<uint8_t>(i64 >> 16);
-	bytes[6] = static_cast<uint8_t>(i64 >> 8);
-	bytes[7] = static_cast<uint8_t>(i64); 
-}
-inline void WriteU32BE(uint8_t bytes[4], uint32_t u32) { 
-	bytes[0] = static_cast<uint8_t>(u32 << 24);
-	bytes[1] = static_cast<uint8_t>(u32 << 16);
-	bytes[2] = static_cast<uint8_t>(u32 << 8); 
-	bytes[3] = static_cast<uint8_t>(u32); 
-}
-inline void WriteU64BE(uint8_t bytes[8], uint64_t u64) { 
-	bytes[0] = static_cast<uint8_t>(u64 >> 56);
-	bytes[1] = static_cast<uint8_t>(u64 >> 48);
-	bytes[2] = static_cast<uint8_t>(u64 >> 40);
-	bytes[3] = static_cast<uint8_t>(u64 >> 32);
-	bytes[4] = static_cast<uint8_t>(u64 >> 24);
-	bytes[5] = static_cast<uint8_t>(u64 >> 16);
-	bytes[6] = static_cast<uint8_t>(u64 >> 8);
-	bytes[7] = static_cast<uint8_t>(u64); 
-}
-inline void WriteF32BE(uint8_t bytes[4], float f) { 
-	std::memcpy(bytes, &f, sizeof(float));
-}
-inline void WriteF64BE(uint8_t bytes[8], double d) { 
-	std::memcpy(bytes, &d, sizeof(double));
-}
+/// Unsigned integer of the given size.
+template<size_t Size>
+using UnsignedOfSize = std::conditional_t<Size == 1, uint8_t,
+	std::conditional_t<Size == 2, uint16_t,
+	std::conditional_t<Size == 4, uint32_t, uint64_t>>>;
 
 template<Primitive T>
-inline void WriteLE(uint8_t *bytes, const T &value) { std::memcpy(bytes, &value, sizeof(T)); }
+inline T ByteSwap(T value) {
+	if constexpr (sizeof(T) == 1) {
+		return value;
+	} else {
+		UnsignedOfSize<sizeof(T)> bits;
+		std::memcpy(&bits, &value, sizeof(T));
+
+#if defined(__GNUC__) || defined(__clang__)
+		if constexpr (sizeof(T) == 2) bits = __builtin_bswap16(bits);
+		else if constexpr (sizeof(T) == 4) bits = __builtin_bswap32(bits);
+		else bits = __builtin_bswap64(bits);
+#elif defined(_MSC_VER)
+		if constexpr (sizeof(T) == 2) bits = _byteswap_ushort(bits);
+		else if constexpr (sizeof(T) == 4) bits = _byteswap_ulong(bits);
+		else bits = _byteswap_uint64(bits);
+#else
+		decltype(bits) swapped = 0;
+		for (size_t b = 0; b < sizeof(T); b++) swapped |= ((bits >> (b * 8)) & 0xff) << ((sizeof(T) - 1 - b) * 8);
+		bits = swapped;
+#endif
 
-template<Primitive T>
-inline void WriteBE(uint8_t *bytes, const T &value) {
-	for (auto l = 0; l < sizeof(T); l++) {
-		bytes[sizeof(T) - 1 - l] = reinterpret_cast<const uint8_t *>(&value)[l];
+		std::memcpy(&value, &bits, sizeof(T));
+		return value;
 	}
 }
 
-#if defined(__BYTE_ORDER__)
+/// Reads and writes values, and copies arrays, in the byte order Order.
+template<std::endian Order>
+struct ByteOrder {
+	static constexpr bool Swaps = Order != std::endian::native;
 
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-inline int32_t ReadI32(const uint8_t bytes[4]) { return ReadI32LE(bytes); }
-inline int64_t ReadI64(const uint8_t bytes[8]) { return ReadI64LE(bytes); }
-inline float ReadF32(const uint8_t bytes[4]) { return ReadF32LE(bytes); }
-inline double ReadF64(const uint8_t bytes[8]) { return ReadF64LE(bytes); }
-inline uint32_t ReadU32(const uint8_t bytes[4]) { return ReadU32LE(bytes); }
-inline uint64_t ReadU64(const uint8_t bytes[8]) { return ReadU64LE(bytes); }
+	template<Primitive T>
+	static inline T Read(const uint8_t *bytes) {
+		T value;
+		std::memcpy(&value, bytes, sizeof(T));
 
-template<Primitive T>
-inline T Read(const uint8_t *bytes) { return ReadLE<T>(bytes); }
+		if constexpr (Swaps) return ByteSwap(value);
+		else return value;
+	}
 
-inline void WriteI32(uint8_t bytes[4], int32_t i32) { WriteI32LE(bytes, i32); }
-inline void WriteI64(uint8_t bytes[8], int64_t i64) { WriteI64LE(bytes, i64); }
-inline void WriteF32(uint8_t bytes[4], float f32) { WriteF32LE(bytes, f32); }
-inline void WriteF64(uint8_t bytes[8], double f64) { WriteF64LE(bytes, f64); }
-inline void WriteU32(uint8_t bytes[4], uint32_t u32) { WriteU32LE(bytes, u32); }
-inline void WriteU64(uint8_t bytes[8], uint64_t u64) { WriteU64LE(bytes, u64); }
+	template<Primitive T>
+	static inline void Write(uint8_t *bytes, T value) {
+		if constexpr (Swaps) value = ByteSwap(value);
+		std::memcpy(bytes, &value, sizeof(T));
+	}
 
-template<Primitive T>
-inline void Write(uint8_t *bytes, const T &value) { WriteLE<T>(bytes, value); }
-#else
-inline int32_t ReadI32(uint8_t bytes[4]) { return ReadI32BE(bytes); }
-inline int64_t ReadI64(uint8_t bytes[8]) { return ReadI64BE(bytes); }
-inline float ReadF32(uint8_t bytes[4]) { return ReadF32BE(bytes); }
-inline double ReadF64(uint8_t bytes[8]) { return ReadF64BE(bytes); }
-inline uint32_t ReadU32(uint8_t bytes[4]) { return ReadU32BE(bytes); }
-inline uint64_t ReadU64(uint8_t bytes[8]) { return ReadU64BE(bytes); }
+	/// Copies count elements from (or to) a buffer in this order; a plain copy when no swap is needed.
+	/// The loop swapping them is simple enough for the compiler to vectorize.
+	template<Primitive T>
+	static inline void CopyArray(void *to, const void *from, size_t count) {
+		if (!count) return;
+
+		if constexpr (!Swaps || sizeof(T) == 1) {
+			std::memcpy(to, from, count * sizeof(T));
+		} else {
+			using U = UnsignedOfSize<sizeof(T)>;
+
+			auto target = (uint8_t *)to;
+			auto source = (const uint8_t *)from;
+
+			for (size_t x = 0; x < count; x++) {
+				U bits;
+				std::memcpy(&bits, source + x * sizeof(U), sizeof(U));
+				bits = ByteSwap(bits);
+				std::memcpy(target + x * sizeof(U), &bits, sizeof(U));
+			}
+		}
+	}
+};
+
+using LittleEndian = ByteOrder<std::endian::little>;
+using BigEndian = ByteOrder<std::endian::big>;
 
 template<Primitive T>
-inline T Read(const uint8_t *bytes) { return ReadBE<T>(bytes); }
+inline T ReadLE(const uint8_t *bytes) { return LittleEndian::Read<T>(bytes); }
 
-inline void WriteI32(uint8_t bytes[4], int32_t i32) { WriteI32BE(bytes, i32); }
-inline void WriteI64(uint8_t bytes[8], int64_t i64) { WriteI64BE(bytes, i64); }
-inline void WriteF32(uint8_t bytes[4], float f32) { WriteF32BE(bytes, f32); }
-inline void WriteF64(uint8_t bytes[8], double f64) { WriteF64BE(bytes, f64); }
-inline void WriteU32(uint8_t bytes[4], uint32_t u32) { WriteU32BE(bytes, u32); }
-inline void WriteU64(uint8_t bytes[8], uint64_t u64) { WriteU64BE(bytes, u64); }
+template<Primitive T>
+inline T ReadBE(const uint8_t *bytes) { return BigEndian::Read<T>(bytes); }
 
 template<Primitive T>
-inline T Write(const uint8_t *bytes, const T &value) { WriteBE<T>(bytes, value); }
-#endif
+inline void WriteLE(uint8_t *bytes, T value) { LittleEndian::Write<T>(bytes, value); }
 
-#elif defined(_WIN32)
-inline int32_t ReadI32(uint8_t bytes[4]) { return ReadI32LE(bytes); }
-inline int64_t ReadI64(uint8_t bytes[8]) { return ReadI64LE(bytes); }
-inline float ReadF32(uint8_t bytes[4]) { return ReadF32LE(bytes); }
-inline double ReadF64(uint8_t bytes[8]) { return ReadF64LE(bytes); }
-inline uint32_t ReadU32(uint8_t bytes[4]) { return ReadU32LE(bytes); }
-inline uint64_t ReadU64(uint8_t bytes[8]) { return ReadU64LE(bytes); }
+template<Primitive T>
+inline void WriteBE(uint8_t *bytes, T value) { BigEndian::Write<T>(bytes, value); }
 
+/// Values in the default (little-endian) order of the format.
 template<Primitive T>
 inline T Read(const uint8_t *bytes) { return ReadLE<T>(bytes); }
 
-inline void WriteI32(uint8_t bytes[4], int32_t i32) { WriteI32LE(bytes, i32); }
-inline void WriteI64(uint8_t bytes[8], int64_t i64) { WriteI64LE(bytes, i64); }
-inline void WriteF32(uint8_t bytes[4], float f32) { WriteF32LE(bytes, f32); }
-inline void WriteF64(uint8_t bytes[8], double f64) { WriteF64LE(bytes, f64); }
-inline void WriteU32(uint8_t bytes[4], uint32_t u32) { WriteU32LE(bytes, u32); }
-inline void WriteU64(uint8_t bytes[8], uint64_t u64) { WriteU64LE(bytes, u64); }
-
 template<Primitive T>
-inline void Write(uint8_t *bytes, const T &value) { WriteLE<T>(bytes, value); }
-#endif
+inline void Write(uint8_t *bytes, T value) { WriteLE<T>(bytes, value); }
 
 };
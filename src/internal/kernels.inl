@@ -0,0 +1,304 @@
+// Array kernels for one instruction set.
+//
+// kernels.cpp includes this file once per instruction set, each time in a namespace
+// of its own, with SBF_KERNEL_BYTES set to the width of its vectors (0 for plain loops)
+// and that instruction set enabled. Helpers shared by every inclusion live in kernels.cpp.
+
+#if SBF_VECTORS
+
+// Vectors are passed by reference: wider ones than the default target has registers for change the ABI.
+
+template<typename V>
+inline void LoadVector(V &vector, const void *data) {
+	std::memcpy(&vector, data, sizeof(V));
+}
+
+template<typename V, typename T>
+inline void Broadcast(V &vector, T value) {
+	for (size_t x = 0; x < sizeof(V) / sizeof(T); x++) vector[x] = value;
+}
+
+template<typename M>
+inline bool AnyLane(const M &mask) {
+	uint64_t words[sizeof(M) / sizeof(uint64_t)];
+	std::memcpy(words, &mask, sizeof(M));
+
+	uint64_t any = 0;
+	for (auto word : words) any |= word;
+
+	return any != 0;
+}
+
+#endif
+
+template<typename T, bool Sum, bool Bounds>
+inline void Reduce(const uint8_t *data, size_t length, typename SumTypes<T>::Total &sum, T &low, T &high) {
+	using Partial = typename SumTypes<T>::Partial;
+
+	size_t x = 0;
+
+#if SBF_VECTORS && SBF_KERNEL_BYTES
+	constexpr size_t Lanes = SBF_KERNEL_BYTES / sizeof(T);
+	using V = Vector<T, Lanes>;
+
+	// Sums are widened from slices of the vector loaded on their own,
+	// so that every partial fits in a register as well.
+	constexpr size_t Slices = sizeof(Partial) / sizeof(T);
+	constexpr size_t Slice_Lanes = Lanes / Slices;
+	using S = Vector<T, Slice_Lanes>;
+	using P = Vector<Partial, Slice_Lanes>;
+
+	V lows, highs;
+	Broadcast(lows, low);
+	Broadcast(highs, high);
+
+	while (length - x >= Lanes) {
+		const auto block = std::min((length - x) / Lanes, SumTypes<T>::Block);
+
+		P partials[Slices] = {};
+
+		for (size_t b = 0; b < block; b++, x += Lanes) {
+			const auto bytes = data + x * sizeof(T);
+
+			if constexpr (Sum) {
+				for (size_t s = 0; s < Slices; s++) {
+					S slice;
+					LoadVector(slice, bytes + s * sizeof(S));
+					partials[s] += __builtin_convertvector(slice, P);
+				}
+			}
+
+			// NaNs compare false, so they never replace a bound.
+			if constexpr (Bounds) {
+				V v;
+				LoadVector(v, bytes);
+				lows = v < lows ? v : lows;
+				highs = v > highs ? v : highs;
+			}
+		}
+
+		if constexpr (Sum) {
+			for (auto &partial : partials) {
+				for (size_t l = 0; l < Slice_Lanes; l++) sum += partial[l];
+			}
+		}
+	}
+
+	if constexpr (Bounds) {
+		for (size_t l = 0; l < Lanes; l++) {
+			if (lows[l] < low) low = lows[l];
+			if (highs[l] > high) high = highs[l];
+		}
+	}
+#endif
+
+	for (; x < length; x++) {
+		auto v = Load<T>(data + x * sizeof(T));
+
+		if constexpr (Sum) sum += (Partial)v;
+
+		if constexpr (Bounds) {
+			if (v < low) low = v;
+			if (v > high) high = v;
+		}
+	}
+}
+
+template<typename T>
+inline size_t Filter(const uint8_t *data, size_t length, T low, T high, size_t *indices) {
+	size_t found = 0;
+	size_t x = 0;
+
+#if SBF_VECTORS && SBF_KERNEL_BYTES
+	constexpr size_t Lanes = SBF_KERNEL_BYTES / sizeof(T);
+	using V = Vector<T, Lanes>;
+
+	// Counts as wide as the elements, so masks need no conversion; narrow ones are folded often.
+	using Unsigned = std::make_unsigned_t<std::conditional_t<std::is_floating_point_v<T>, Int<sizeof(T)>, T>>;
+	using Count = Vector<Unsigned, Lanes>;
+	constexpr size_t Block = std::min<size_t>(std::numeric_limits<Unsigned>::max(), Block_Vectors);
+
+	V lows, highs;
+	Broadcast(lows, low);
+	Broadcast(highs, high);
+
+	if (indices) {
+		for (; length - x >= Lanes; x += Lanes) {
+			V v;
+			LoadVector(v, data + x * sizeof(T));
+			auto mask = (v >= lows) & (v <= highs);
+
+			if (!AnyLane(mask)) continue;
+
+			// Writing every lane and advancing only on matches avoids a branch per element.
+			for (size_t l = 0; l < Lanes; l++) {
+				indices[found] = x + l;
+				found += mask[l] & 1;
+			}
+		}
+	} else {
+		while (length - x >= Lanes) {
+			const auto block = std::min((length - x) / Lanes, Block);
+
+			// Matching lanes are -1, so subtracting them counts.
+			Count counts = {};
+
+			for (size_t b = 0; b < block; b++, x += Lanes) {
+				V v;
+				LoadVector(v, data + x * sizeof(T));
+				counts -= (Count)((v >= lows) & (v <= highs));
+			}
+
+			for (size_t l = 0; l < Lanes; l++) found += counts[l];
+		}
+	}
+#endif
+
+	for (; x < length; x++) {
+		auto v = Load<T>(data + x * sizeof(T));
+		const bool inside = v >= low && v <= high;
+
+		if (indices) indices[found] = x;
+		found += inside;
+	}
+
+	return found;
+}
+
+template<typename T>
+inline void Histogram(const uint8_t *data, size_t length, double low, double high, size_t bins, uint64_t *counts) {
+	const double scale = (double)bins / (high - low);
+	const size_t last = bins - 1;
+
+	size_t x = 0;
+
+	// Bytes can only take 256 values: tally them, then bin each value once.
+	// Several tallies take turns, so that runs of one value do not wait on the same counter.
+	if constexpr (sizeof(T) == 1) {
+		uint64_t tallies[4][256] = {};
+
+		for (; length - x >= 4; x += 4) {
+			for (size_t t = 0; t < 4; t++) tallies[t][data[x + t]]++;
+		}
+
+		for (; x < length; x++) tallies[0][data[x]]++;
+
+		for (size_t byte = 0; byte < 256; byte++) {
+			const auto tally = tallies[0][byte] + tallies[1][byte] + tallies[2][byte] + tallies[3][byte];
+			const auto v = (double)(T)byte;
+
+			if (tally && v >= low && v < high) counts[std::min((size_t)((v - low) * scale), last)] += tally;
+		}
+
+		return;
+	}
+
+#if SBF_VECTORS && SBF_KERNEL_BYTES
+	// As many elements as doubles fit, since bins are computed in double precision.
+	constexpr size_t Lanes = SBF_KERNEL_BYTES / sizeof(double);
+	using V = Vector<T, Lanes>;
+	using D = Vector<double, Lanes>;
+	using I = Vector<int64_t, Lanes>;
+
+	D lows, highs, scales;
+	Broadcast(lows, low);
+	Broadcast(highs, high);
+	Broadcast(scales, scale);
+
+	for (; length - x >= Lanes; x += Lanes) {
+		V elements;
+		LoadVector(elements, data + x * sizeof(T));
+
+		auto v = __builtin_convertvector(elements, D);
+		auto inside = (v >= lows) & (v < highs);
+
+		// Lanes outside the range would not convert to an integer; they are skipped anyway.
+		auto offsets = inside ? (v - lows) * scales : D{};
+		auto bin = __builtin_convertvector(offsets, I);
+
+		for (size_t l = 0; l < Lanes; l++) {
+			if (inside[l]) counts[std::min((size_t)bin[l], last)]++;
+		}
+	}
+#endif
+
+	for (; x < length; x++) {
+		auto v = (double)Load<T>(data + x * sizeof(T));
+
+		if (!(v >= low && v < high)) continue;
+
+		counts[std::min((size_t)((v - low) * scale), last)]++;
+	}
+}
+
+template<typename T>
+inline void ReduceAs(const void *data, size_t length, uint32_t ops, SBF_Reduction &out) {
+	typename SumTypes<T>::Total sum = 0;
+	T low = Highest<T>();
+	T high = Lowest<T>();
+
+	const auto bytes = (const uint8_t *)data;
+	const bool sums = ops & SBF_REDUCE_SUM;
+	const bool bounds = ops & (SBF_REDUCE_MIN | SBF_REDUCE_MAX);
+
+	if (sums && bounds) Reduce<T, true, true>(bytes, length, sum, low, high);
+	else if (sums) Reduce<T, true, false>(bytes, length, sum, low, high);
+	else if (bounds) Reduce<T, false, true>(bytes, length, sum, low, high);
+
+	out.count = length;
+	Store<T>(out.sum, sum);
+	if (ops & SBF_REDUCE_MIN) Store<T>(out.min, low);
+	if (ops & SBF_REDUCE_MAX) Store<T>(out.max, high);
+}
+
+template<typename T>
+inline size_t FilterAs(const void *data, size_t length, SBF_Scalar low, SBF_Scalar high, size_t *indices) {
+	T from, to;
+	if (!RangeOf<T>(low, high, from, to)) return 0;
+
+	return Filter<T>((const uint8_t *)data, length, from, to, indices);
+}
+
+void ReduceArray(NodeType type, const void *data, size_t length, uint32_t ops, SBF_Reduction &out) {
+	switch (type) {
+	case NodeType_I8A: ReduceAs<int8_t>(data, length, ops, out); break;
+	case NodeType_U8A: case NodeType_String: ReduceAs<uint8_t>(data, length, ops, out); break;
+	case NodeType_I32A: ReduceAs<int32_t>(data, length, ops, out); break;
+	case NodeType_U32A: ReduceAs<uint32_t>(data, length, ops, out); break;
+	case NodeType_I64A: ReduceAs<int64_t>(data, length, ops, out); break;
+	case NodeType_U64A: ReduceAs<uint64_t>(data, length, ops, out); break;
+	case NodeType_F32A: ReduceAs<float>(data, length, ops, out); break;
+	case NodeType_F64A: ReduceAs<double>(data, length, ops, out); break;
+	default: break;
+	}
+}
+
+size_t FilterArray(NodeType type, const void *data, size_t length, SBF_Scalar low, SBF_Scalar high, size_t *indices) {
+	switch (type) {
+	case NodeType_I8A: return FilterAs<int8_t>(data, length, low, high, indices);
+	case NodeType_U8A: case NodeType_String: return FilterAs<uint8_t>(data, length, low, high, indices);
+	case NodeType_I32A: return FilterAs<int32_t>(data, length, low, high, indices);
+	case NodeType_U32A: return FilterAs<uint32_t>(data, length, low, high, indices);
+	case NodeType_I64A: return FilterAs<int64_t>(data, length, low, high, indices);
+	case NodeType_U64A: return FilterAs<uint64_t>(data, length, low, high, indices);
+	case NodeType_F32A: return FilterAs<float>(data, length, low, high, indices);
+	case NodeType_F64A: return FilterAs<double>(data, length, low, high, indices);
+	default: return 0;
+	}
+}
+
+void HistogramArray(NodeType type, const void *data, size_t length, double low, double high, size_t bins, uint64_t *counts) {
+	const auto bytes = (const uint8_t *)data;
+
+	switch (type) {
+	case NodeType_I8A: Histogram<int8_t>(bytes, length, low, high, bins, counts); break;
+	case NodeType_U8A: case NodeType_String: Histogram<uint8_t>(bytes, length, low, high, bins, counts); break;
+	case NodeType_I32A: Histogram<int32_t>(bytes, length, low, high, bins, counts); break;
+	case NodeType_U32A: Histogram<uint32_t>(bytes, length, low, high, bins, counts); break;
+	case NodeType_I64A: Histogram<int64_t>(bytes, length, low, high, bins, counts); break;
+	case NodeType_U64A: Histogram<uint64_t>(bytes, length, low, high, bins, counts); break;
+	case NodeType_F32A: Histogram<float>(bytes, length, low, high, bins, counts); break;
+	case NodeType_F64A: Histogram<double>(bytes, length, low, high, bins, counts); break;
+	default: break;
+	}
+}
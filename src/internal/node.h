@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+enum NodeFlags : uint32_t {
+	/// The node and its buffers live in an SBF_Arena and are released with it.
+	NodeFlag_Arena = 1 << 0,
+
+	/// The keys of a table are in canonical order, so lookups binary-search them; see SBF_SortTable.
+	NodeFlag_Sorted = 1 << 1,
+
+	/// SBF_ArrayEncoding an integer array is written with; see SBF_NodeSet_ArrayEncoding.
+	NodeFlag_Encoding = 0x7u << 2,
+
+	/// Room of an array or table grown in place; see SBF::Capacity.
+	NodeFlag_Capacity = 0xffu << 24,
+};
+
+// Memory inefficient. Needs better implementation in the future.
+typedef struct Node {
+	NodeType type;
+
+	/// Combination of NodeFlags; fits in the padding before the union.
+	uint32_t flags;
+
+	union {
+
+		int8_t i8;
+		uint8_t u8;
+		int32_t i32;
+		int64_t i64;
+		uint32_t u32;
+		uint64_t u64;
+		float f32;
+		double f64;
+		char c;
+
+		struct {
+			/// A non-null terminated character array.
+			char *string;
+			size_t string_length;
+		};
+
+		struct {
+			/// Array of type determinated by the type of the struct.
+			void *array;
+			size_t array_length;
+		};
+
+		struct {
+			char **keys;
+	        Node **values;
+			size_t table_length;
+		};
+	};
+} Node;
+
+namespace SBF {
+
+/// Size in bytes of a single element of an array node type (String included).
+/// Returns 0 for non-array types.
+inline size_t ArrayElementSize(NodeType type) {
+	switch (type) {
+	case NodeType_I8A: case NodeType_U8A: case NodeType_String: return 1;
+	case NodeType_I32A: case NodeType_U32A: case NodeType_F32A: return 4;
+	case NodeType_I64A: case NodeType_U64A: case NodeType_F64A: return 8;
+	default: return 0;
+	}
+}
+
+/// Size in bytes of a scalar node type's value; 0 for other types.
+inline size_t ScalarSize(NodeType type) {
+	switch (type) {
+	case NodeType_I8: case NodeType_U8: case NodeType_Char: return 1;
+	case NodeType_I32: case NodeType_U32: case NodeType_F32: return 4;
+	case NodeType_I64: case NodeType_U64: case NodeType_F64: return 8;
+	default: return 0;
+	}
+}
+
+inline bool IsArrayType(NodeType type) { return type >= NodeType_I32A && type <= NodeType_String; }
+inline bool IsScalarType(NodeType type) { return type >= NodeType_I32 && type <= NodeType_Char; }
+
+/// Largest array alignment encoders accept; see SBF_EncodeOptions::array_alignment.
+constexpr size_t MaxArrayAlignment = 64;
+
+/// Checks an array alignment given in options (0, or a power of two up to MaxArrayAlignment) and returns it.
+/// Throws std::invalid_argument otherwise.
+size_t CheckAlignment(uint32_t alignment);
+
+/// Zero bytes written before an array (strings aside) at offset, so that its elements,
+/// 9 bytes past the opening tag, start at a multiple of alignment or of their size if larger.
+/// Always 0 without alignment, and less than MaxArrayAlignment otherwise.
+inline size_t ArrayPadding(NodeType type, size_t offset, size_t alignment) {
+	if (!alignment || type < NodeType_I32A || type > NodeType_U8A) return 0;
+
+	const auto boundary = alignment > ArrayElementSize(type) ? alignment : ArrayElementSize(type);
+	return (boundary - (offset + 9) % boundary) % boundary;
+}
+
+/// Name of a node type as used in error messages, or "UNKNOWN".
+const char *TypeName(NodeType type);
+
+/// Number of rows in a column: its length, or the number of strings in a string column.
+size_t ColumnRows(const Node *column);
+
+/// Returns the number of rows of a columns node, after checking that every column
+/// is an array holding that many rows. Throws std::invalid_argument otherwise.
+size_t CheckColumns(const Node *node);
+
+/// Shift of the NodeFlag_Encoding bits, which hold an SBF_ArrayEncoding.
+constexpr uint32_t EncodingShift = 2;
+
+/// Encoding the array is written with, as set on the node (SBF_ARRAY_AUTO unresolved).
+inline SBF_ArrayEncoding ArrayEncoding(const Node *node) {
+	return (SBF_ArrayEncoding)((node->flags & NodeFlag_Encoding) >> EncodingShift);
+}
+
+/// Shift of the NodeFlag_Capacity bits, which hold the base-2 logarithm of the capacity plus one.
+/// Zero means the buffers hold the length and no more, as they do when created, decoded or cloned.
+constexpr uint32_t CapacityShift = 24;
+
+/// Number of elements (array) or entries (table) the node's buffers have room for.
+/// Strings have room for a null terminator past it.
+inline size_t Capacity(const Node *node) {
+	const auto log = node->flags >> CapacityShift;
+	if (log) return (size_t)1 << (log - 1);
+
+	return node->type == NodeType_T || node->type == NodeType_Columns ? node->table_length : node->array_length;
+}
+
+/// Makes room for length elements in an array or string node, growing its buffer geometrically.
+/// Throws std::invalid_argument for nodes in an arena, which cannot grow.
+void ReserveArray(Node *node, size_t length);
+
+/// Makes room for length entries in a table node, growing its buffers geometrically.
+void ReserveTable(Node *node, size_t length);
+
+/// Appends the positions of the entries of a table or columns node in canonical order
+/// (see SBF_ENCODE_CANONICAL). Throws std::invalid_argument if two keys are the same.
+void CanonicalOrder(const Node *table, std::vector<size_t> &order);
+
+/// Position of the first entry of a sorted table whose key is not before key in canonical order.
+size_t LowerBound(const Node *table, const char *key);
+
+/// Position of the entry of key in a table, or its length if missing;
+/// sorted tables are binary-searched, others scanned.
+size_t FindEntry(const Node *table, const char *key);
+
+/// Deep-copies a node tree into freshly malloc'd nodes, or into arena when given.
+Node *CloneNode(const Node *node, SBF_Arena *arena = nullptr);
+
+/// Structural equality; array contents are compared bytewise. See SBF_NodeEquals.
+bool NodesEqual(const Node *a, const Node *b);
+
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SBF/sbf.h"
+
+#include "node.h"
+#include "tags.h"
+
+// Integer arrays stored encoded (see SBF_ArrayEncoding), under an opening tag of their own:
+//
+//     Open_Packed_Array, u64 body length, body, Close_Packed_Array
+//
+// The body starts with the tag of the array it decodes to, the encoding and the element count (u64),
+// followed by one or more streams of values: frame of reference writes the values, delta a base value (as
+// wide as the elements) and the differences from each value to the next, run length the number of runs (u64),
+// then their values and their lengths minus one. A stream of n values holds ceil(n / 128) blocks:
+// the bit width of every block (a byte each), then its reference (the smallest value, as wide as the elements),
+// then every block's offsets from its reference, each one 16 * width bytes. Offsets are packed
+// in the interleaved layout of SIMD-BP128: value i of a block goes to lane i % L of L = 16 / element size
+// lanes, and the words of a lane, one every L words, hold its values one after the other from the low bit up.
+
+namespace SBF {
+
+/// Whether arrays of the type can be written encoded: I32A, I64A, U32A and U64A.
+inline bool IsPackableType(NodeType type) {
+	return type == NodeType_I32A || type == NodeType_I64A || type == NodeType_U32A || type == NodeType_U64A;
+}
+
+/// Whether the opening tag is one of an array, encoded or not (String included).
+inline bool IsArrayTag(uint8_t tag) {
+	return IsArrayType((NodeType)tag) || tag == (uint8_t)TagType::Open_Packed_Array;
+}
+
+/// Encoding the node is written with: its own, SBF_ARRAY_AUTO resolved to the smallest, and
+/// SBF_ARRAY_RAW for nodes written as they are. With size, also returns the bytes it takes written so.
+SBF_ArrayEncoding WrittenEncoding(const Node *node, size_t *size = nullptr);
+
+/// Bytes the integer array takes written with encoding (not SBF_ARRAY_AUTO), tags included.
+size_t PackedSize(const Node *node, SBF_ArrayEncoding encoding);
+
+/// Zero bytes written before node at offset; see ArrayPadding. Encoded arrays have none.
+inline size_t NodePadding(const Node *node, size_t offset, size_t alignment) {
+	if (!alignment || ((node->flags & NodeFlag_Encoding) && WrittenEncoding(node))) return 0;
+	return ArrayPadding(node->type, offset, alignment);
+}
+
+/// Writes the integer array at *cursor with encoding (not SBF_ARRAY_RAW or SBF_ARRAY_AUTO)
+/// and moves *cursor past its closing tag; the caller made sure it fits.
+template<typename Order>
+void EncodePacked(const Node *node, SBF_ArrayEncoding encoding, uint8_t *bytes, size_t *cursor);
+
+/// What the body of an encoded array decodes to.
+struct PackedHeader {
+	NodeType type;
+	SBF_ArrayEncoding encoding;
+	size_t count;
+};
+
+/// Reads the start of the body of the encoded array whose opening tag is at tag_offset.
+/// The count is checked to be backed by enough bytes, so that it can be allocated before the rest is read.
+/// Throws SBF::DeserException if the body is malformed.
+template<typename Order>
+PackedHeader ReadPackedHeader(const uint8_t *body, size_t body_length, size_t tag_offset);
+
+/// Decodes the elements of the body into out, which has room for header.count of them.
+/// Throws SBF::DeserException if the body is malformed.
+template<typename Order>
+void DecodePacked(const uint8_t *body, size_t body_length, const PackedHeader &header, void *out, size_t tag_offset);
+
+};
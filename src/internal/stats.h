@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "SBF/sbf.h"
+
+// Decoder instrumentation. Everything here compiles to nothing unless the
+// library is built with SBF_ENABLE_STATS, so the hot paths can call it freely.
+
+namespace SBF::Stats {
+
+#if defined(SBF_ENABLE_STATS)
+
+/// Counters of the decode running on this thread; published when its outermost node is done.
+struct Local {
+	uint64_t nodes[SBF_STATS_NODE_TYPES];
+	uint64_t bytes[SBF_STATS_NODE_TYPES];
+	uint64_t allocations;
+	uint64_t allocated_bytes;
+	uint64_t array_copy_ns;
+	uint64_t table_parse_ns;
+	uint32_t depth;
+	uint32_t max_depth;
+
+	/// Open tables, and when the outermost one started.
+	uint32_t table_depth;
+	uint64_t table_start;
+	uint64_t table_copies;
+
+	/// Hooks installed when the outermost decode started.
+	SBF_TraceHooks hooks;
+};
+
+inline thread_local Local local = {};
+
+uint64_t Now();
+
+/// Picks up the currently installed trace hooks.
+void LoadHooks();
+
+/// Adds the local counters to the global ones and clears them.
+void Publish();
+
+inline void CountNode(NodeType type, size_t bytes) {
+	local.nodes[type]++;
+	local.bytes[type] += bytes;
+}
+
+/// Only allocations made while a decode is running count; clones and JSON trees share the allocators.
+inline void CountAllocation(size_t bytes) {
+	if (local.depth == 0) return;
+
+	local.allocations++;
+	local.allocated_bytes += bytes;
+}
+
+inline void ReachDepth(uint32_t depth) {
+	if (depth > local.max_depth) local.max_depth = depth;
+}
+
+/// Spans one call of the recursive decoder, or a whole call of the iterative one.
+class DecodeScope {
+public:
+	inline DecodeScope() {
+		if (local.depth == 0) LoadHooks();
+		ReachDepth(++local.depth);
+	}
+
+	inline ~DecodeScope() {
+		if (--local.depth == 0) Publish();
+	}
+};
+
+/// Times the copy of an array or string payload and reports it to the trace hooks.
+class ArraySpan {
+	NodeType type;
+	size_t offset;
+	size_t length;
+	uint64_t start;
+
+public:
+	inline ArraySpan(NodeType type, size_t offset, size_t length)
+		: type(type), offset(offset), length(length) {
+		if (local.hooks.begin) local.hooks.begin(type, offset, local.hooks.user);
+		start = Now();
+	}
+
+	inline ~ArraySpan() {
+		local.array_copy_ns += Now() - start;
+		if (local.hooks.end) local.hooks.end(type, offset, length, local.hooks.user);
+	}
+};
+
+/// Starts timing a table, unless it is nested in one already being timed, and reports it to the trace hooks.
+inline void EnterTable(size_t offset) {
+	if (local.hooks.begin) local.hooks.begin(NodeType_T, offset, local.hooks.user);
+
+	if (local.table_depth++ == 0) {
+		local.table_start = Now();
+		local.table_copies = local.array_copy_ns;
+	}
+}
+
+/// Every EnterTable must be matched, also when decoding fails.
+/// Tables are timed minus the array copies of their entries.
+inline void LeaveTable(size_t offset, size_t length) {
+	if (--local.table_depth == 0) {
+		local.table_parse_ns += (Now() - local.table_start) - (local.array_copy_ns - local.table_copies);
+	}
+
+	if (local.hooks.end) local.hooks.end(NodeType_T, offset, length, local.hooks.user);
+}
+
+/// Pairs EnterTable and LeaveTable around one scope of the recursive decoder.
+class TableSpan {
+	size_t offset;
+	const size_t *cursor;
+
+public:
+	inline TableSpan(size_t offset, const size_t *cursor)
+		: offset(offset), cursor(cursor) {
+		EnterTable(offset);
+	}
+
+	inline ~TableSpan() {
+		LeaveTable(offset, *cursor - offset);
+	}
+};
+
+#else
+
+inline void CountNode(NodeType, size_t) {}
+inline void CountAllocation(size_t) {}
+inline void ReachDepth(uint32_t) {}
+inline void EnterTable(size_t) {}
+inline void LeaveTable(size_t, size_t) {}
+
+class DecodeScope {
+public:
+	inline DecodeScope() {}
+};
+
+class ArraySpan {
+public:
+	inline ArraySpan(NodeType, size_t, size_t) {}
+};
+
+class TableSpan {
+public:
+	inline TableSpan(size_t, const size_t *) {}
+};
+
+#endif
+
+};
@@ -25,6 +25,9 @@ enum class TagType : uint8_t {
 	Open_U8_Array = 17,	// unsigned 8-bit integer array
 	Open_String = 18,
 	Open_Table = 19,	// table
+	Open_Columns = 20,	// records stored column by column
+	Open_Sorted_Table = 21,	// table whose keys are in canonical order
+	Open_Packed_Array = 22,	// integer array stored encoded (see SBF_ArrayEncoding)
 
 	
 	Close_I32 = (uint8_t)-1,
@@ -46,6 +49,9 @@ enum class TagType : uint8_t {
 	Close_U8_Array = (uint8_t)-17,
 	Close_String = (uint8_t)-18,
 	Close_Table = (uint8_t)-19,
+	Close_Columns = (uint8_t)-20,
+	Close_Sorted_Table = (uint8_t)-21,
+	Close_Packed_Array = (uint8_t)-22,
 
 };
 
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+namespace SBF {
+
+/// Fixed-size pool of worker threads running jobs in submission order.
+class ThreadPool {
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::function<void()>> jobs;
+	std::vector<std::thread> threads;
+	bool stopping = false;
+
+	void Run();
+
+public:
+
+	explicit ThreadPool(size_t thread_count);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	void Submit(std::function<void()> job);
+
+	/// Runs body(part, parts) for every part in [0, parts), spreading them over the
+	/// pool and the calling thread. Returns once all parts are done; rethrows the first exception.
+	/// Safe to call from a pool worker: parts nobody picked up run on the caller.
+	void ParallelFor(size_t parts, const std::function<void(size_t part, size_t parts)> &body);
+
+	inline size_t Size() const { return threads.size(); }
+
+	/// Process-wide pool used by the asynchronous and batch APIs, started on first use.
+	static ThreadPool &Shared();
+
+};
+
+};
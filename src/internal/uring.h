@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace SBF {
+
+/// Minimal io_uring submission/completion wrapper used for batched file I/O.
+/// Talks to the kernel through raw syscalls, so there is no dependency on liburing.
+class Uring {
+
+	int ring_fd = -1;
+
+	void *sq_ring = nullptr;
+	size_t sq_ring_size = 0;
+	void *cq_ring = nullptr;
+	size_t cq_ring_size = 0;
+	void *sqes = nullptr;
+	size_t sqes_size = 0;
+
+	unsigned *sq_head = nullptr;
+	unsigned *sq_tail = nullptr;
+	unsigned *sq_array = nullptr;
+	unsigned sq_mask = 0;
+	unsigned sq_entries = 0;
+
+	unsigned *cq_head = nullptr;
+	unsigned *cq_tail = nullptr;
+	unsigned cq_mask = 0;
+	void *cqes = nullptr;
+
+	/// Queued but not yet submitted entries.
+	unsigned queued = 0;
+
+	Uring() = default;
+
+	bool Queue(uint8_t opcode, int fd, const void *buffer, uint32_t length, uint64_t offset, uint64_t tag);
+
+public:
+
+	/// Returns nullptr when io_uring is not compiled in or the kernel refuses to set up a ring,
+	/// in which case callers fall back to regular blocking I/O.
+	static std::unique_ptr<Uring> Create(unsigned entries);
+
+	~Uring();
+
+	Uring(const Uring &) = delete;
+	Uring &operator=(const Uring &) = delete;
+
+	/// Both return false when the submission queue is full.
+	bool QueueRead(int fd, void *buffer, uint32_t length, uint64_t offset, uint64_t tag);
+	bool QueueWrite(int fd, const void *buffer, uint32_t length, uint64_t offset, uint64_t tag);
+
+	/// Submits every queued entry, blocking until at least wait_for completions are available.
+	void Submit(unsigned wait_for);
+
+	/// Blocks until a completion is available, submitting nothing.
+	void Wait();
+
+	/// Entries queued but not submitted yet.
+	unsigned Unsubmitted() const { return queued; }
+
+	/// Pops one completion; result is the byte count or a negated errno.
+	bool PopCompletion(uint64_t &tag, int32_t &result);
+
+};
+
+};
@@ -1,27 +1,374 @@
+#include "checksum.h"
 #include "io.h"
 
+#include <condition_variable>
+#include <unordered_map>
+#include <system_error>
 #include <filesystem>
 #include <stdexcept>
+#include <exception>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <string>
+#include <thread>
 #include <vector>
+#include <deque>
+#include <mutex>
 #include <ios>
 
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace SBF {
 
-std::vector<uint8_t> ReadFileAsBytes(const std::filesystem::path &filepath) {
+namespace {
+
+/// Reads and writes that checksums are computed between are this large at most,
+/// so that the bytes are still in cache for whichever of the two comes second.
+constexpr size_t Chunk_Size = 1 << 20;
+
+};
+
+std::vector<uint8_t> ReadFileAsBytes(const std::filesystem::path &filepath, BlockVerifier *verifier) {
 
 	if (!std::filesystem::exists(filepath)) throw std::runtime_error("file not found");
 	if (!std::filesystem::is_regular_file(filepath)) throw std::runtime_error("path is not a file");
 
-	std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+	std::ifstream file(filepath, std::ios::binary);
 
 	if (!file.is_open()) throw std::runtime_error("failed to open file");
 
-	return std::vector<uint8_t>(
-			std::istreambuf_iterator<char>(file),
-			std::istreambuf_iterator<char>()
-	);
+	std::vector<uint8_t> bytes(std::filesystem::file_size(filepath));
+	size_t read = 0;
+
+	// Checksums are verified a chunk at a time, while the chunk just read is still in cache.
+	while (read < bytes.size()) {
+		const auto part = std::min(bytes.size() - read, Chunk_Size);
+
+		file.read(reinterpret_cast<char *>(bytes.data() + read), part);
+		read += file.gcount();
+
+		if (verifier) verifier->Advance(bytes.data(), read);
+
+		if (!file) break;
+	}
+
+	bytes.resize(read);
+
+	return bytes;
+}
+
+std::string FileKey(const std::filesystem::path &filepath) {
+	std::error_code error;
+	auto absolute = std::filesystem::absolute(filepath, error);
+	return (error ? filepath : absolute).lexically_normal().string();
+}
+
+namespace {
+
+std::filesystem::path TempPathFor(const std::filesystem::path &filepath) {
+	static std::atomic<uint64_t> counter = 0;
+
+#if defined(_WIN32)
+	auto pid = 0;
+#else
+	auto pid = getpid();
+#endif
+
+	auto name = "." + filepath.filename().string()
+		+ ".tmp." + std::to_string(pid)
+		+ "." + std::to_string(counter.fetch_add(1, std::memory_order_relaxed));
+
+	return filepath.parent_path() / name;
+}
+
+#if !defined(_WIN32)
+
+[[noreturn]] void ThrowErrno(const std::string &what, int error) {
+	throw std::runtime_error(what + ": " + std::strerror(error));
+}
+
+void SyncData(int fd) {
+#if defined(__APPLE__)
+	if (fsync(fd) != 0) ThrowErrno("failed to flush file", errno);
+#else
+	if (fdatasync(fd) != 0) ThrowErrno("failed to flush file", errno);
+#endif
+}
+
+void SyncDirectory(const std::filesystem::path &filepath) {
+	auto dir = filepath.parent_path();
+	if (dir.empty()) dir = ".";
+
+	int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) return;
+
+	// Some filesystems refuse to fsync directories; the rename is still atomic there.
+	if (fsync(fd) != 0 && errno != EINVAL && errno != EROFS) {
+		auto error = errno;
+		close(fd);
+		ThrowErrno("failed to flush directory", error);
+	}
+
+	close(fd);
+}
+
+/// Flushes, closes and renames a written file, in the order needed for crash safety.
+void Complete(FileWrite &write) {
+	try {
+		if (write.sync) SyncData(write.fd);
+	} catch (...) {
+		close(write.fd);
+		if (!write.temp.empty()) unlink(write.temp.c_str());
+		throw;
+	}
+
+	if (close(write.fd) != 0 && errno != EINTR) {
+		auto error = errno;
+		if (!write.temp.empty()) unlink(write.temp.c_str());
+		ThrowErrno("failed to close file", error);
+	}
+
+	if (!write.temp.empty()) {
+		if (rename(write.temp.c_str(), write.target.c_str()) != 0) {
+			auto error = errno;
+			unlink(write.temp.c_str());
+			ThrowErrno("failed to replace file", error);
+		}
+
+		if (write.sync) SyncDirectory(write.target);
+	}
+}
+
+/// Background thread completing writes made with SBF_WRITE_ASYNC_FLUSH, in submission order.
+class Flusher {
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<FileWrite> queue;
+	std::unordered_map<std::string, size_t> in_flight;
+	std::exception_ptr error;
+	std::thread thread;
+	bool stopping = false;
+
+	void Run() {
+		std::unique_lock lock(mutex);
+
+		while (true) {
+			changed.wait(lock, [this]() { return stopping || !queue.empty(); });
+
+			if (queue.empty()) return;
+
+			auto write = std::move(queue.front());
+			queue.pop_front();
+
+			lock.unlock();
+
+			std::exception_ptr failure;
+			try {
+				Complete(write);
+			} catch (...) {
+				failure = std::current_exception();
+			}
+
+			lock.lock();
+
+			if (failure && !error) error = failure;
+			if (--in_flight[write.key] == 0) in_flight.erase(write.key);
+
+			changed.notify_all();
+		}
+	}
+
+public:
+
+	void Push(FileWrite write) {
+		std::lock_guard lock(mutex);
+
+		if (!thread.joinable()) thread = std::thread([this]() { Run(); });
+
+		in_flight[write.key]++;
+		queue.push_back(std::move(write));
+
+		changed.notify_all();
+	}
+
+	void WaitFor(const std::string &key) {
+		std::unique_lock lock(mutex);
+		changed.wait(lock, [&]() { return !in_flight.contains(key); });
+	}
+
+	void Drain() {
+		std::unique_lock lock(mutex);
+		changed.wait(lock, [this]() { return in_flight.empty(); });
+
+		if (error) {
+			auto failure = error;
+			error = nullptr;
+			std::rethrow_exception(failure);
+		}
+	}
+
+	~Flusher() {
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+			changed.notify_all();
+		}
+
+		// Pending writes are still completed before the thread exits.
+		if (thread.joinable()) thread.join();
+	}
+
+};
+
+Flusher &GetFlusher() {
+	static Flusher flusher;
+	return flusher;
+}
+
+#endif
+
+};
+
+#if defined(_WIN32)
+
+void WriteBytesToFile(const std::filesystem::path &filepath, uint8_t *bytes, size_t size, const SBF_WriteOptions &options) {
+	const bool atomic = options.flags & SBF_WRITE_ATOMIC;
+	const auto destination = atomic ? TempPathFor(filepath) : filepath;
+
+	{
+		std::ofstream file(destination, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open()) throw std::runtime_error("failed to open file");
+
+		BlockSealer sealer(bytes, size, options.flags & SBF_WRITE_CHECKSUM);
+
+		for (size_t written = 0; written < size && file; ) {
+			const auto end = std::min(size, written + Chunk_Size);
+			sealer.Seal(end);
+
+			file.write(reinterpret_cast<const char *>(bytes + written), end - written);
+			written = end;
+		}
+
+		// No portable way to reach FlushFileBuffers from a stream; flushing
+		// hands the data to the OS, which is the best available here.
+		if (options.flags & (SBF_WRITE_SYNC | SBF_WRITE_ASYNC_FLUSH)) file.flush();
+
+		if (!file) {
+			file.close();
+			if (atomic) std::filesystem::remove(destination);
+			throw std::runtime_error("failed to write file");
+		}
+	}
+
+	if (atomic) std::filesystem::rename(destination, filepath);
+}
+
+void FlushPendingWrites() {}
+
+void WaitForPendingWrite(const std::filesystem::path &) {}
+
+#else
+
+FileWrite BeginFileWrite(const std::filesystem::path &filepath, size_t size, const SBF_WriteOptions &options) {
+	const bool atomic = options.flags & SBF_WRITE_ATOMIC;
+	const bool async = options.flags & SBF_WRITE_ASYNC_FLUSH;
+
+	FileWrite write = {
+		-1,
+		async || (options.flags & SBF_WRITE_SYNC),
+		async,
+		atomic ? TempPathFor(filepath) : std::filesystem::path(),
+		filepath,
+		FileKey(filepath)
+	};
+
+	// An earlier write to the same file may still be waiting to be renamed into place.
+	if (!async) GetFlusher().WaitFor(write.key);
+
+	if (atomic) {
+		write.fd = open(write.temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+
+		// Keep the permissions of the file being replaced.
+		struct stat existing;
+		if (write.fd >= 0 && stat(filepath.c_str(), &existing) == 0) fchmod(write.fd, existing.st_mode & 07777);
+	} else {
+		write.fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	}
+
+	if (write.fd < 0) ThrowErrno("failed to open file", errno);
+
+#if defined(__linux__)
+	// Reserving the extents up front avoids fragmentation and repeated
+	// block allocation for large files. Not every filesystem supports it.
+	if (options.preallocate_threshold && size >= options.preallocate_threshold) {
+		if (fallocate(write.fd, 0, 0, size) != 0 && errno != EOPNOTSUPP && errno != ENOSYS) {
+			auto error = errno;
+			AbortFileWrite(write);
+			ThrowErrno("failed to preallocate file", error);
+		}
+	}
+#endif
+
+	return write;
+}
+
+void AbortFileWrite(FileWrite &write) {
+	close(write.fd);
+	if (!write.temp.empty()) unlink(write.temp.c_str());
+}
+
+void EndFileWrite(FileWrite &&write) {
+	if (write.async) GetFlusher().Push(std::move(write));
+	else Complete(write);
+}
+
+void WriteBytesToFile(const std::filesystem::path &filepath, uint8_t *bytes, size_t size, const SBF_WriteOptions &options) {
+	auto write = BeginFileWrite(filepath, size, options);
+
+	const bool checksum = options.flags & SBF_WRITE_CHECKSUM;
+	BlockSealer sealer(bytes, size, checksum);
+
+	size_t written = 0;
+	while (written < size) {
+		// Without a checksum to compute, the whole image is handed over at once.
+		const auto end = checksum ? std::min(size, written + Chunk_Size) : size;
+		sealer.Seal(end);
+
+		auto result = ::write(write.fd, bytes + written, end - written);
+
+		if (result < 0) {
+			if (errno == EINTR) continue;
+
+			auto error = errno;
+			AbortFileWrite(write);
+			ThrowErrno("failed to write file", error);
+		}
+
+		written += result;
+	}
+
+	EndFileWrite(std::move(write));
 }
+
+void FlushPendingWrites() {
+	GetFlusher().Drain();
+}
+
+void WaitForPendingWrite(const std::filesystem::path &filepath) {
+	GetFlusher().WaitFor(FileKey(filepath));
+}
+
+#endif
+
 };
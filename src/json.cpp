@@ -0,0 +1,986 @@
+#include <stdexcept>
+#include <string_view>
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "exceptions.h"
+#include "node.h"
+#include "arena.h"
+#include "tags.h"
+#include "io.h"
+
+// JSON bridge. The reader parses with a stack of its own, so any depth is fine, and hands what it reads
+// to a sink: one builds a tree (from the heap or an arena), the other writes the SBF encoding of that tree
+// straight into a buffer. Arrays of numbers are read ahead into scratch space, so that they become one typed
+// array; an array found to hold anything else is read again as a table. The writer walks trees the same way.
+
+namespace {
+
+/// Name given to the reader's errors in place of a node type.
+constexpr const char *JsonName = "JSON";
+
+[[noreturn]] void SyntaxError(const std::string &what, size_t offset) {
+	throw SBF::DeserException(what, JsonName, offset);
+}
+
+inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+/// A JSON number: an integer when written without fraction or exponent and held by 64 bits.
+struct Number {
+	enum Kind : uint8_t { Signed, Unsigned, Float } kind;
+
+	union {
+		int64_t i;
+		uint64_t u;
+		double f;
+	};
+
+	inline double AsDouble() const {
+		return kind == Signed ? (double)i : kind == Unsigned ? (double)u : f;
+	}
+};
+
+/// Narrowest node type holding a number, or every number of an array.
+struct NumberRange {
+	bool floats = false;
+	bool negative = false;
+	/// Integers above INT64_MAX.
+	bool large = false;
+	/// Integers outside of int32_t.
+	bool wide = false;
+
+	inline void Add(const Number &number) {
+		if (number.kind == Number::Float) {
+			floats = true;
+		} else if (number.kind == Number::Unsigned) {
+			large = wide = true;
+		} else {
+			negative |= number.i < 0;
+			wide |= number.i < INT32_MIN || number.i > INT32_MAX;
+		}
+	}
+
+	inline NodeType ArrayType() const {
+		if (floats || (large && negative)) return NodeType_F64A;
+		if (large) return NodeType_U64A;
+		return wide ? NodeType_I64A : NodeType_I32A;
+	}
+
+	inline NodeType ScalarType() const {
+		if (floats) return NodeType_F64;
+		if (large) return NodeType_U64;
+		return wide ? NodeType_I64 : NodeType_I32;
+	}
+};
+
+/// Elements of an array of numbers of the given array type, converted from what was read.
+template<typename T>
+inline T Element(const Number &number) {
+	if constexpr (std::is_floating_point_v<T>) return (T)number.AsDouble();
+	else if constexpr (std::is_unsigned_v<T>) return (T)number.u;
+	else return (T)number.i;
+}
+
+/// Containers being read on this thread, each call using the part above where it stood when it started.
+struct Frame {
+	/// Arrays read as tables get their positions as keys.
+	bool array;
+	size_t index;
+};
+
+thread_local std::vector<Frame> json_frames;
+
+/// Numbers of the array being read ahead on this thread.
+thread_local std::vector<Number> json_numbers;
+
+/// Characters of the last key, and of the last string with escapes, read on this thread.
+thread_local std::string json_key;
+thread_local std::string json_string;
+
+template<typename Sink>
+class Reader {
+
+	const char *const start;
+	const char *const end;
+	const char *p;
+	const size_t max_depth;
+	Sink &sink;
+
+	inline size_t Offset(const char *at) const { return at - start; }
+
+	inline void SkipSpace() {
+		while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+	}
+
+	void ExpectLiteral(const char *literal, size_t length) {
+		if ((size_t)(end - p) < length || std::memcmp(p, literal, length) != 0) SyntaxError("invalid literal", Offset(p));
+		p += length;
+	}
+
+	/// Reads the number at p, known to start with '-' or a digit.
+	Number ReadNumber() {
+		const auto first = p;
+
+		const bool negative = *p == '-';
+		if (negative) p++;
+
+		if (p == end || !IsDigit(*p)) SyntaxError("invalid number", Offset(first));
+
+		const auto digits = p;
+		uint64_t magnitude = 0;
+
+		// No leading zeros: a zero is followed by the fraction, the exponent or the end of the number.
+		if (*p == '0') {
+			p++;
+		} else {
+			while (p < end && IsDigit(*p)) magnitude = magnitude * 10 + (*p++ - '0');
+		}
+
+		const auto digit_count = p - digits;
+
+		// Power of ten of the leading digit, for telling overflows from underflows.
+		int64_t scale = *digits == '0' ? 0 : digit_count;
+		bool integral = true;
+
+		if (p < end && *p == '.') {
+			integral = false;
+			if (++p == end || !IsDigit(*p)) SyntaxError("invalid number", Offset(first));
+
+			if (*digits == '0') {
+				while (p < end && *p == '0') p++, scale--;
+			}
+
+			while (p < end && IsDigit(*p)) p++;
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			integral = false;
+
+			bool below = false;
+			if (++p < end && (*p == '+' || *p == '-')) below = *p++ == '-';
+			if (p == end || !IsDigit(*p)) SyntaxError("invalid number", Offset(first));
+
+			int64_t exponent = 0;
+			while (p < end && IsDigit(*p)) exponent = std::min<int64_t>(exponent * 10 + (*p++ - '0'), 1 << 20);
+
+			scale += below ? -exponent : exponent;
+		}
+
+		Number number;
+
+		// Up to 19 digits cannot overflow the accumulation; 20 may still fit an unsigned integer.
+		if (integral && digit_count <= 19) {
+			if (!negative) {
+				number.kind = magnitude <= (uint64_t)INT64_MAX ? Number::Signed : Number::Unsigned;
+				number.u = magnitude;
+				return number;
+			}
+
+			if (magnitude <= (uint64_t)INT64_MAX + 1) {
+				number.kind = Number::Signed;
+				number.u = 0 - magnitude;
+				return number;
+			}
+		} else if (integral && !negative && digit_count == 20) {
+			const auto result = std::from_chars(digits, p, number.u);
+
+			if (result.ec == std::errc()) {
+				number.kind = Number::Unsigned;
+				return number;
+			}
+		}
+
+		number.kind = Number::Float;
+		const auto result = std::from_chars(first, p, number.f);
+
+		if (result.ec == std::errc::result_out_of_range) {
+			// Numbers too small for a double are read as zero.
+			if (scale > 0) SyntaxError("number out of the range of a double", Offset(first));
+			number.f = negative ? -0.0 : 0.0;
+		}
+
+		return number;
+	}
+
+	static void AppendUtf8(std::string &text, uint32_t code) {
+		if (code < 0x80) {
+			text += (char)code;
+		} else if (code < 0x800) {
+			text += (char)(0xc0 | (code >> 6));
+			text += (char)(0x80 | (code & 0x3f));
+		} else if (code < 0x10000) {
+			text += (char)(0xe0 | (code >> 12));
+			text += (char)(0x80 | ((code >> 6) & 0x3f));
+			text += (char)(0x80 | (code & 0x3f));
+		} else {
+			text += (char)(0xf0 | (code >> 18));
+			text += (char)(0x80 | ((code >> 12) & 0x3f));
+			text += (char)(0x80 | ((code >> 6) & 0x3f));
+			text += (char)(0x80 | (code & 0x3f));
+		}
+	}
+
+	uint32_t ReadHex(const char *escape) {
+		if (end - p < 4) SyntaxError("invalid \\u escape", Offset(escape));
+
+		uint32_t code = 0;
+
+		for (int x = 0; x < 4; x++) {
+			const auto c = *p++;
+			code <<= 4;
+
+			if (IsDigit(c)) code |= c - '0';
+			else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+			else SyntaxError("invalid \\u escape", Offset(escape));
+		}
+
+		return code;
+	}
+
+	/// Reads the string whose opening quote is at p. Strings without escapes are
+	/// returned in place; others are unescaped into text.
+	std::string_view ReadString(std::string &text) {
+		const auto quote = p++;
+		const auto first = p;
+
+		while (p < end && *p != '"' && *p != '\\' && (uint8_t)*p >= 0x20) p++;
+
+		if (p < end && *p == '"') return std::string_view(first, p++ - first);
+
+		text.assign(first, p - first);
+
+		while (true) {
+			if (p == end) SyntaxError("unterminated string", Offset(quote));
+
+			const auto c = *p;
+
+			if (c == '"') {
+				p++;
+				return text;
+			}
+
+			if ((uint8_t)c < 0x20) SyntaxError("control character in string", Offset(p));
+
+			if (c != '\\') {
+				const auto run = p;
+				while (p < end && *p != '"' && *p != '\\' && (uint8_t)*p >= 0x20) p++;
+				text.append(run, p - run);
+				continue;
+			}
+
+			const auto escape = p++;
+			if (p == end) SyntaxError("unterminated string", Offset(quote));
+
+			switch (*p++) {
+			case '"': text += '"'; break;
+			case '\\': text += '\\'; break;
+			case '/': text += '/'; break;
+			case 'b': text += '\b'; break;
+			case 'f': text += '\f'; break;
+			case 'n': text += '\n'; break;
+			case 'r': text += '\r'; break;
+			case 't': text += '\t'; break;
+			case 'u':
+				{
+					auto code = ReadHex(escape);
+
+					// Characters beyond the basic plane are escaped as a pair of surrogates.
+					if (code >= 0xdc00 && code <= 0xdfff) SyntaxError("unpaired surrogate", Offset(escape));
+
+					if (code >= 0xd800 && code <= 0xdbff) {
+						if (end - p < 2 || p[0] != '\\' || p[1] != 'u') SyntaxError("unpaired surrogate", Offset(escape));
+						p += 2;
+
+						const auto low = ReadHex(escape);
+						if (low < 0xdc00 || low > 0xdfff) SyntaxError("unpaired surrogate", Offset(escape));
+
+						code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+					}
+
+					AppendUtf8(text, code);
+					break;
+				}
+			default: SyntaxError("invalid escape", Offset(escape));
+			}
+		}
+	}
+
+	/// Reads the key of an object member up to its colon.
+	void ReadKey() {
+		SkipSpace();
+		if (p == end || *p != '"') SyntaxError("expected a key", Offset(p));
+
+		const auto at = p;
+		const auto key = ReadString(json_string);
+
+		// Keys are C strings.
+		if (std::memchr(key.data(), '\0', key.size())) SyntaxError("key holds a null character", Offset(at));
+
+		json_key.assign(key.data(), key.size());
+
+		SkipSpace();
+		if (p == end || *p != ':') SyntaxError("expected ':'", Offset(p));
+		p++;
+	}
+
+	void IndexKey(size_t index) {
+		char digits[24];
+		const auto result = std::to_chars(digits, digits + sizeof(digits), index);
+		json_key.assign(digits, result.ptr - digits);
+	}
+
+	/// Reads the array whose elements start at p as an array of numbers, if that is what it is.
+	/// Leaves p where it was otherwise.
+	bool ReadNumbers() {
+		auto &numbers = json_numbers;
+		numbers.clear();
+
+		NumberRange range;
+		const auto first = p;
+
+		SkipSpace();
+
+		if (p < end && *p == ']') {
+			p++;
+			sink.Numbers(NodeType_I32A, numbers.data(), 0);
+			return true;
+		}
+
+		while (true) {
+			SkipSpace();
+
+			if (p == end || (*p != '-' && !IsDigit(*p))) break;
+
+			numbers.push_back(ReadNumber());
+			range.Add(numbers.back());
+
+			SkipSpace();
+			if (p == end) break;
+
+			if (*p == ',') {
+				p++;
+			} else if (*p == ']') {
+				p++;
+				sink.Numbers(range.ArrayType(), numbers.data(), numbers.size());
+				return true;
+			} else {
+				break;
+			}
+		}
+
+		p = first;
+		return false;
+	}
+
+public:
+
+	Reader(const char *json, size_t length, size_t max_depth, Sink &sink)
+		: start(json), end(json + length), p(json), max_depth(max_depth ? max_depth : SIZE_MAX), sink(sink) {}
+
+	void Read() {
+		auto &frames = json_frames;
+		const auto base = frames.size();
+
+		try {
+			ReadFrom(base);
+		} catch (...) {
+			frames.resize(base);
+			throw;
+		}
+
+		SkipSpace();
+		if (p != end) SyntaxError("unexpected characters after the document", Offset(p));
+	}
+
+	void ReadFrom(size_t base) {
+		auto &frames = json_frames;
+
+		while (true) {
+			SkipSpace();
+			if (p == end) SyntaxError("unexpected end of input", Offset(p));
+
+			if (frames.size() - base + 1 > max_depth) SyntaxError("nesting deeper than " + std::to_string(max_depth), Offset(p));
+
+			const auto c = *p;
+
+			// Null values are left out, keys included.
+			if (c == 'n') {
+				ExpectLiteral("null", 4);
+			} else {
+				if (frames.size() > base) sink.Key(json_key);
+
+				if (c == '{') {
+					p++;
+					sink.OpenTable();
+					frames.push_back({ false, 0 });
+
+					SkipSpace();
+
+					if (p < end && *p == '}') {
+						p++;
+						frames.pop_back();
+						sink.CloseTable();
+					} else {
+						ReadKey();
+						continue;
+					}
+				} else if (c == '[') {
+					p++;
+
+					if (!ReadNumbers()) {
+						sink.OpenTable();
+						frames.push_back({ true, 0 });
+
+						IndexKey(0);
+						continue;
+					}
+				} else if (c == '"') {
+					sink.String(ReadString(json_string));
+				} else if (c == 't') {
+					ExpectLiteral("true", 4);
+					sink.Bool(true);
+				} else if (c == 'f') {
+					ExpectLiteral("false", 5);
+					sink.Bool(false);
+				} else if (c == '-' || IsDigit(c)) {
+					sink.Scalar(ReadNumber());
+				} else {
+					SyntaxError(std::string("unexpected character '") + c + "'", Offset(p));
+				}
+			}
+
+			// The value is complete: close the containers it completes, and move on to the next entry.
+			while (frames.size() > base) {
+				SkipSpace();
+				if (p == end) SyntaxError("unexpected end of input", Offset(p));
+
+				auto &frame = frames.back();
+
+				if (*p == ',') {
+					p++;
+					frame.index++;
+
+					if (frame.array) IndexKey(frame.index);
+					else ReadKey();
+
+					break;
+				}
+
+				if (*p != (frame.array ? ']' : '}')) SyntaxError(frame.array ? "expected ',' or ']'" : "expected ',' or '}'", Offset(p));
+
+				p++;
+				frames.pop_back();
+				sink.CloseTable();
+			}
+
+			if (frames.size() == base) return;
+		}
+	}
+};
+
+/// Entries of the tables being built on this thread.
+struct TableScratch {
+	std::vector<char *> keys;
+	std::vector<Node *> values;
+	/// Where the entries of each open table start.
+	std::vector<std::pair<size_t, size_t>> open;
+};
+
+thread_local TableScratch json_tables;
+
+/// Builds the tree of a JSON document.
+template<typename Allocator>
+class TreeSink {
+
+	Allocator &allocator;
+	TableScratch &scratch = json_tables;
+
+	const size_t first_key = scratch.keys.size();
+	const size_t first_value = scratch.values.size();
+	const size_t first_open = scratch.open.size();
+
+	Node *NewNode(NodeType type) {
+		auto node = allocator.NewNode();
+		node->type = type;
+		return node;
+	}
+
+	void Add(Node *node) {
+		if (scratch.open.size() == first_open) root = node;
+		else scratch.values.push_back(node);
+	}
+
+	template<typename T>
+	void AddArray(NodeType type, const Number *numbers, size_t count) {
+		auto node = NewNode(type);
+		node->array = nullptr;
+		node->array_length = count;
+
+		if (count) {
+			auto array = (T *)allocator.Allocate(sizeof(T) * count);
+			for (size_t x = 0; x < count; x++) array[x] = Element<T>(numbers[x]);
+
+			node->array = array;
+		}
+
+		Add(node);
+	}
+
+public:
+
+	Node *root = nullptr;
+
+	explicit TreeSink(Allocator &allocator) : allocator(allocator) {}
+
+	/// Releases everything built so far.
+	void Discard() {
+		for (auto x = first_key; x < scratch.keys.size(); x++) allocator.Free(scratch.keys[x]);
+		for (auto x = first_value; x < scratch.values.size(); x++) allocator.Destroy(scratch.values[x]);
+
+		scratch.keys.resize(first_key);
+		scratch.values.resize(first_value);
+		scratch.open.resize(first_open);
+
+		if (root) allocator.Destroy(root);
+		root = nullptr;
+	}
+
+	void Key(std::string_view key) {
+		auto chars = (char *)allocator.Allocate(key.size() + 1);
+		std::memcpy(chars, key.data(), key.size());
+		chars[key.size()] = '\0';
+
+		scratch.keys.push_back(chars);
+	}
+
+	void OpenTable() {
+		scratch.open.emplace_back(scratch.keys.size(), scratch.values.size());
+	}
+
+	void CloseTable() {
+		const auto [keys_at, values_at] = scratch.open.back();
+		scratch.open.pop_back();
+
+		const auto length = scratch.values.size() - values_at;
+
+		auto node = NewNode(NodeType_T);
+		node->keys = nullptr;
+		node->values = nullptr;
+		node->table_length = length;
+
+		if (length) {
+			node->keys = (char **)allocator.Allocate(sizeof(char *) * length);
+			node->values = (Node **)allocator.Allocate(sizeof(Node *) * length);
+
+			std::memcpy(node->keys, scratch.keys.data() + keys_at, sizeof(char *) * length);
+			std::memcpy(node->values, scratch.values.data() + values_at, sizeof(Node *) * length);
+
+			scratch.keys.resize(keys_at);
+			scratch.values.resize(values_at);
+		}
+
+		Add(node);
+	}
+
+	void String(std::string_view text) {
+		auto chars = (char *)allocator.Allocate(text.size() + 1);
+		std::memcpy(chars, text.data(), text.size());
+		chars[text.size()] = '\0';
+
+		auto node = NewNode(NodeType_String);
+		node->string = chars;
+		node->string_length = text.size();
+
+		Add(node);
+	}
+
+	void Bool(bool value) {
+		auto node = NewNode(NodeType_U8);
+		node->u64 = 0;
+		node->u8 = value;
+
+		Add(node);
+	}
+
+	void Scalar(const Number &number) {
+		NumberRange range;
+		range.Add(number);
+
+		auto node = NewNode(range.ScalarType());
+		node->u64 = 0;
+
+		switch (node->type) {
+		case NodeType_I32: node->i32 = (int32_t)number.i; break;
+		case NodeType_I64: node->i64 = number.i; break;
+		case NodeType_U64: node->u64 = number.u; break;
+		default: node->f64 = number.f; break;
+		}
+
+		Add(node);
+	}
+
+	void Numbers(NodeType type, const Number *numbers, size_t count) {
+		switch (type) {
+		case NodeType_I32A: AddArray<int32_t>(type, numbers, count); break;
+		case NodeType_I64A: AddArray<int64_t>(type, numbers, count); break;
+		case NodeType_U64A: AddArray<uint64_t>(type, numbers, count); break;
+		default: AddArray<double>(type, numbers, count); break;
+		}
+	}
+};
+
+/// Writes the SBF encoding of the tree of a JSON document, in the byte order Order.
+/// Bytes go to the buffer while they fit, and are only counted past that.
+template<typename Order>
+class ByteSink {
+
+	uint8_t *const bytes;
+	const size_t room;
+
+	inline uint8_t *Reserve(size_t count) {
+		const auto at = size;
+		size += count;
+
+		return size <= room ? bytes + at : nullptr;
+	}
+
+	inline void Tag(SBF::TagType tag) {
+		if (auto out = Reserve(1)) *out = (uint8_t)tag;
+	}
+
+	template<typename T>
+	void WriteScalar(SBF::TagType tag, T value) {
+		if (auto out = Reserve(2 + sizeof(T))) {
+			out[0] = (uint8_t)tag;
+			Order::template Write<T>(out + 1, value);
+			out[1 + sizeof(T)] = (uint8_t)-(uint8_t)tag;
+		}
+	}
+
+	template<typename T>
+	void WriteArray(SBF::TagType tag, const Number *numbers, size_t count) {
+		if (auto out = Reserve(10 + sizeof(T) * count)) {
+			out[0] = (uint8_t)tag;
+			Order::template Write<uint64_t>(out + 1, count);
+
+			auto elements = out + 9;
+			for (size_t x = 0; x < count; x++) Order::template Write<T>(elements + x * sizeof(T), Element<T>(numbers[x]));
+
+			elements[count * sizeof(T)] = (uint8_t)-(uint8_t)tag;
+		}
+	}
+
+public:
+
+	size_t size = 0;
+
+	ByteSink(uint8_t *bytes, size_t room) : bytes(bytes), room(bytes ? room : 0) {}
+
+	void Discard() {}
+
+	void Key(std::string_view key) { String(key); }
+
+	void OpenTable() { Tag(SBF::TagType::Open_Table); }
+	void CloseTable() { Tag(SBF::TagType::Close_Table); }
+
+	void String(std::string_view text) {
+		if (auto out = Reserve(10 + text.size())) {
+			out[0] = (uint8_t)SBF::TagType::Open_String;
+			Order::template Write<uint64_t>(out + 1, text.size());
+			std::memcpy(out + 9, text.data(), text.size());
+			out[9 + text.size()] = (uint8_t)SBF::TagType::Close_String;
+		}
+	}
+
+	void Bool(bool value) { WriteScalar<uint8_t>(SBF::TagType::Open_U8, value); }
+
+	void Scalar(const Number &number) {
+		NumberRange range;
+		range.Add(number);
+
+		switch (range.ScalarType()) {
+		case NodeType_I32: WriteScalar<int32_t>(SBF::TagType::Open_I32, (int32_t)number.i); break;
+		case NodeType_I64: WriteScalar<int64_t>(SBF::TagType::Open_I64, number.i); break;
+		case NodeType_U64: WriteScalar<uint64_t>(SBF::TagType::Open_U64, number.u); break;
+		default: WriteScalar<double>(SBF::TagType::Open_F64, number.f); break;
+		}
+	}
+
+	void Numbers(NodeType type, const Number *numbers, size_t count) {
+		switch (type) {
+		case NodeType_I32A: WriteArray<int32_t>(SBF::TagType::Open_I32_Array, numbers, count); break;
+		case NodeType_I64A: WriteArray<int64_t>(SBF::TagType::Open_I64_Array, numbers, count); break;
+		case NodeType_U64A: WriteArray<uint64_t>(SBF::TagType::Open_U64_Array, numbers, count); break;
+		default: WriteArray<double>(SBF::TagType::Open_F64_Array, numbers, count); break;
+		}
+	}
+};
+
+template<typename Sink>
+void ReadJson(const char *json, size_t length, const SBF_JsonOptions *options, Sink &sink) {
+	Reader<Sink> reader(json, length, options ? options->max_depth : 0, sink);
+
+	try {
+		reader.Read();
+	} catch (...) {
+		sink.Discard();
+		throw;
+	}
+}
+
+template<typename Allocator>
+Node *JsonToTree(const char *json, size_t length, const SBF_JsonOptions *options, Allocator &allocator) {
+	TreeSink<Allocator> sink(allocator);
+	ReadJson(json, length, options, sink);
+	return sink.root;
+}
+
+template<typename Order>
+size_t JsonToBytes(const char *json, size_t json_length, uint8_t *bytes, size_t length, size_t *cursor, const SBF_JsonOptions *options) {
+	const auto room = *cursor <= length ? length - *cursor : 0;
+
+	ByteSink<Order> sink(bytes ? bytes + *cursor : nullptr, room);
+	ReadJson(json, json_length, options, sink);
+
+	if (sink.size <= room) *cursor += sink.size;
+	return sink.size;
+}
+
+/// Text written by SBF_NodeToJson: characters go to the buffer while they fit, and are only counted past that.
+struct TextWriter {
+	char *const json;
+	const size_t room;
+	const bool pretty;
+	size_t length = 0;
+
+	inline void Append(const char *chars, size_t count) {
+		if (length + count <= room) std::memcpy(json + length, chars, count);
+		length += count;
+	}
+
+	inline void Append(char c) {
+		if (length < room) json[length] = c;
+		length++;
+	}
+
+	void NewLine(size_t depth) {
+		if (!pretty) return;
+
+		Append('\n');
+		for (size_t x = 0; x < depth; x++) Append("  ", 2);
+	}
+
+	void String(const char *chars, size_t count) {
+		static const char hex[] = "0123456789abcdef";
+
+		Append('"');
+
+		size_t run = 0;
+
+		for (size_t x = 0; x < count; x++) {
+			const auto c = (uint8_t)chars[x];
+			if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+			Append(chars + run, x - run);
+			run = x + 1;
+
+			switch (c) {
+			case '"': Append("\\\"", 2); break;
+			case '\\': Append("\\\\", 2); break;
+			case '\n': Append("\\n", 2); break;
+			case '\r': Append("\\r", 2); break;
+			case '\t': Append("\\t", 2); break;
+			case '\b': Append("\\b", 2); break;
+			case '\f': Append("\\f", 2); break;
+			default:
+				{
+					const char escape[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 15] };
+					Append(escape, sizeof(escape));
+				}
+			}
+		}
+
+		Append(chars + run, count - run);
+		Append('"');
+	}
+
+	/// Floats are written in the shortest form that reads back as the same value,
+	/// with a fraction so that they read back as floats; JSON has no NaNs nor infinities.
+	template<typename T>
+	void Number(T value) {
+		char digits[40];
+
+		if constexpr (std::is_floating_point_v<T>) {
+			if (!std::isfinite(value)) {
+				Append("null", 4);
+				return;
+			}
+		}
+
+		const auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+		Append(digits, end - digits);
+
+		if constexpr (std::is_floating_point_v<T>) {
+			if (!std::memchr(digits, '.', end - digits) && !std::memchr(digits, 'e', end - digits)) Append(".0", 2);
+		}
+	}
+
+	template<typename T>
+	void Numbers(const Node *node) {
+		const auto array = (const T *)node->array;
+
+		Append('[');
+
+		for (size_t x = 0; x < node->array_length; x++) {
+			if (x) Append(", ", pretty ? 2 : 1);
+			Number(array[x]);
+		}
+
+		Append(']');
+	}
+
+	/// A string column holds one null-terminated string per row.
+	void StringColumn(const Node *column) {
+		Append('[');
+
+		for (size_t at = 0, row = 0; at < column->string_length; row++) {
+			const auto chars = column->string + at;
+			const auto count = std::strlen(chars);
+
+			if (row) Append(", ", pretty ? 2 : 1);
+			String(chars, count);
+
+			at += count + 1;
+		}
+
+		Append(']');
+	}
+
+	/// Writes any node but a table or columns node.
+	void Leaf(const Node *node, bool column) {
+		switch (node->type) {
+		case NodeType_I32: Number(node->i32); break;
+		case NodeType_I64: Number(node->i64); break;
+		case NodeType_F32: Number(node->f32); break;
+		case NodeType_F64: Number(node->f64); break;
+		case NodeType_I8: Number(node->i8); break;
+		case NodeType_U32: Number(node->u32); break;
+		case NodeType_U64: Number(node->u64); break;
+		case NodeType_U8: case NodeType_Char: Number(node->u8); break;
+
+		case NodeType_I32A: Numbers<int32_t>(node); break;
+		case NodeType_I64A: Numbers<int64_t>(node); break;
+		case NodeType_F32A: Numbers<float>(node); break;
+		case NodeType_F64A: Numbers<double>(node); break;
+		case NodeType_I8A: Numbers<int8_t>(node); break;
+		case NodeType_U32A: Numbers<uint32_t>(node); break;
+		case NodeType_U64A: Numbers<uint64_t>(node); break;
+		case NodeType_U8A: Numbers<uint8_t>(node); break;
+
+		case NodeType_String:
+			if (column) StringColumn(node);
+			else String(node->string, node->string_length);
+			break;
+
+		default: throw std::invalid_argument(std::string("cannot write a node of type ") + SBF::TypeName(node->type) + " as JSON");
+		}
+	}
+};
+
+inline bool IsContainer(const Node *node) { return node->type == NodeType_T || node->type == NodeType_Columns; }
+
+/// Tables (and columns nodes) being written on this thread, with the position of their next entry.
+thread_local std::vector<std::pair<const Node *, size_t>> tables_to_write;
+
+void WriteJson(TextWriter &out, const Node *root) {
+	if (!IsContainer(root)) {
+		out.Leaf(root, false);
+		return;
+	}
+
+	auto &pending = tables_to_write;
+	const auto base = pending.size();
+
+	out.Append('{');
+	pending.emplace_back(root, 0);
+
+	try {
+		while (pending.size() > base) {
+			const auto [table, x] = pending.back();
+			const auto depth = pending.size() - base;
+
+			if (x == table->table_length) {
+				pending.pop_back();
+
+				if (x) out.NewLine(depth - 1);
+				out.Append('}');
+				continue;
+			}
+
+			pending.back().second++;
+
+			if (x) out.Append(',');
+			out.NewLine(depth);
+
+			out.String(table->keys[x], std::strlen(table->keys[x]));
+			out.Append(": ", out.pretty ? 2 : 1);
+
+			const auto value = table->values[x];
+
+			if (!value) {
+				out.Append("null", 4);
+			} else if (IsContainer(value)) {
+				out.Append('{');
+				pending.emplace_back(value, 0);
+			} else {
+				out.Leaf(value, table->type == NodeType_Columns);
+			}
+		}
+	} catch (...) {
+		pending.resize(base);
+		throw;
+	}
+}
+
+};
+
+Node *SBF_JsonToNode(const char *json, size_t length, const SBF_JsonOptions *options) {
+	if (!json && length) throw std::invalid_argument("json argument must not be null");
+
+	if (options && options->arena) {
+		SBF::ArenaAllocator allocator = { options->arena->cursor };
+		return JsonToTree(json, length, options, allocator);
+	}
+
+	SBF::HeapAllocator allocator;
+	return JsonToTree(json, length, options, allocator);
+}
+
+size_t SBF_JsonToBytes(const char *json, size_t json_length, uint8_t *bytes, size_t length, size_t *cursor, const SBF_JsonOptions *options) {
+	if (!json && json_length) throw std::invalid_argument("json argument must not be null");
+	if (!cursor) throw std::invalid_argument("cursor argument must not be null");
+
+	if (options && (options->flags & SBF_JSON_BIG_ENDIAN)) return JsonToBytes<SBF::BigEndian>(json, json_length, bytes, length, cursor, options);
+
+	return JsonToBytes<SBF::LittleEndian>(json, json_length, bytes, length, cursor, options);
+}
+
+size_t SBF_NodeToJson(const Node *node, char *json, size_t length, const SBF_JsonOptions *options) {
+	if (!node) throw std::invalid_argument("node was null");
+
+	// The terminator goes after the text, so the text itself gets one character less.
+	TextWriter out = { json, json && length ? length - 1 : 0, options && (options->flags & SBF_JSON_PRETTY) };
+	WriteJson(out, node);
+
+	if (out.length <= out.room && json && length) json[out.length] = '\0';
+	return out.length;
+}
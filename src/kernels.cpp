@@ -0,0 +1,357 @@
+#include <stdexcept>
+#include <type_traits>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+
+#include "SBF/sbf.h"
+
+#include "node.h"
+
+// Array kernels are written once in kernels.inl over vectors whose width is set per inclusion,
+// then compiled into a namespace for each instruction set. The best one the CPU supports
+// is picked at runtime.
+
+#if defined(__GNUC__)
+	#define SBF_VECTORS 1
+#else
+	#define SBF_VECTORS 0
+#endif
+
+// Enabling an instruction set for a region of code takes GCC's target pragma.
+#if SBF_VECTORS && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+	#define SBF_X86 1
+#else
+	#define SBF_X86 0
+#endif
+
+namespace {
+
+/// Vectors processed before wide partial sums or counts are folded into the total.
+constexpr size_t Block_Vectors = 1 << 20;
+
+/// Reads a T from memory of any alignment.
+template<typename T>
+inline T Load(const void *data) {
+	T value;
+	std::memcpy(&value, data, sizeof(T));
+	return value;
+}
+
+#if SBF_VECTORS
+
+template<typename T, size_t Bytes>
+struct VectorOf {
+	typedef T type __attribute__((vector_size(Bytes)));
+};
+
+/// Vector of Lanes elements of type T.
+template<typename T, size_t Lanes>
+using Vector = typename VectorOf<T, Lanes * sizeof(T)>::type;
+
+/// Signed integer of the given size.
+template<size_t Size>
+using Int = std::conditional_t<Size == 4, int32_t, int64_t>;
+
+#endif
+
+/// Types sums are kept in: per lane within a block of at most Block vectors, and in total.
+/// Integer totals are unsigned, so that they wrap around instead of overflowing.
+template<typename T> struct SumTypes;
+template<> struct SumTypes<int8_t> { using Partial = int16_t; using Total = uint64_t; static constexpr size_t Block = 256; };
+template<> struct SumTypes<uint8_t> { using Partial = uint16_t; using Total = uint64_t; static constexpr size_t Block = 256; };
+template<> struct SumTypes<int32_t> { using Partial = int64_t; using Total = uint64_t; static constexpr size_t Block = Block_Vectors; };
+template<> struct SumTypes<uint32_t> { using Partial = uint64_t; using Total = uint64_t; static constexpr size_t Block = Block_Vectors; };
+template<> struct SumTypes<int64_t> { using Partial = uint64_t; using Total = uint64_t; static constexpr size_t Block = Block_Vectors; };
+template<> struct SumTypes<uint64_t> { using Partial = uint64_t; using Total = uint64_t; static constexpr size_t Block = Block_Vectors; };
+template<> struct SumTypes<float> { using Partial = double; using Total = double; static constexpr size_t Block = Block_Vectors; };
+template<> struct SumTypes<double> { using Partial = double; using Total = double; static constexpr size_t Block = Block_Vectors; };
+
+/// Identity of min: nothing compares above it (but NaN).
+template<typename T>
+constexpr T Highest() {
+	if constexpr (std::numeric_limits<T>::has_infinity) return std::numeric_limits<T>::infinity();
+	else return std::numeric_limits<T>::max();
+}
+
+/// Identity of max.
+template<typename T>
+constexpr T Lowest() {
+	if constexpr (std::numeric_limits<T>::has_infinity) return -std::numeric_limits<T>::infinity();
+	else return std::numeric_limits<T>::lowest();
+}
+
+/// Stores value in the SBF_Scalar member for T.
+template<typename T, typename V>
+inline void Store(SBF_Scalar &scalar, V value) {
+	if constexpr (std::is_floating_point_v<T>) scalar.f64 = (double)value;
+	else if constexpr (std::is_signed_v<T>) scalar.i64 = (int64_t)value;
+	else scalar.u64 = (uint64_t)value;
+}
+
+/// Smallest float not below value.
+float FloatAtLeast(double value) {
+	if (std::isinf(value)) return (float)value;
+	if (value > FLT_MAX) return INFINITY;
+	if (value < -FLT_MAX) return -FLT_MAX;
+
+	auto result = (float)value;
+	return (double)result < value ? std::nextafter(result, INFINITY) : result;
+}
+
+/// Largest float not above value.
+float FloatAtMost(double value) {
+	if (std::isinf(value)) return (float)value;
+	if (value < -FLT_MAX) return -INFINITY;
+	if (value > FLT_MAX) return FLT_MAX;
+
+	auto result = (float)value;
+	return (double)result > value ? std::nextafter(result, -INFINITY) : result;
+}
+
+/// Converts the bounds of a range filter to T, narrowing them to the values T can hold.
+/// Returns false if no value of T is in the range.
+template<typename T>
+bool RangeOf(SBF_Scalar low, SBF_Scalar high, T &from, T &to) {
+	if constexpr (std::is_same_v<T, float>) {
+		if (std::isnan(low.f64) || std::isnan(high.f64)) return false;
+		from = FloatAtLeast(low.f64);
+		to = FloatAtMost(high.f64);
+	} else if constexpr (std::is_same_v<T, double>) {
+		if (std::isnan(low.f64) || std::isnan(high.f64)) return false;
+		from = low.f64;
+		to = high.f64;
+	} else if constexpr (std::is_signed_v<T>) {
+		if (low.i64 > (int64_t)std::numeric_limits<T>::max() || high.i64 < (int64_t)std::numeric_limits<T>::min()) return false;
+		from = (T)std::max(low.i64, (int64_t)std::numeric_limits<T>::min());
+		to = (T)std::min(high.i64, (int64_t)std::numeric_limits<T>::max());
+	} else {
+		if (low.u64 > (uint64_t)std::numeric_limits<T>::max()) return false;
+		from = (T)low.u64;
+		to = (T)std::min(high.u64, (uint64_t)std::numeric_limits<T>::max());
+	}
+
+	return from <= to;
+}
+
+namespace Scalar {
+	#define SBF_KERNEL_BYTES 0
+	#include "kernels.inl"
+	#undef SBF_KERNEL_BYTES
+};
+
+// One register per vector: wider ones run out of registers once sums are widened.
+
+#if SBF_VECTORS
+namespace Baseline {
+	#define SBF_KERNEL_BYTES 16
+	#include "kernels.inl"
+	#undef SBF_KERNEL_BYTES
+};
+#endif
+
+#if SBF_X86
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace Avx2 {
+	#define SBF_KERNEL_BYTES 32
+	#include "kernels.inl"
+	#undef SBF_KERNEL_BYTES
+};
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512dq,avx512vl")
+namespace Avx512 {
+	#define SBF_KERNEL_BYTES 64
+	#include "kernels.inl"
+	#undef SBF_KERNEL_BYTES
+};
+#pragma GCC pop_options
+#endif
+
+/// Entry points of the kernels compiled for one instruction set.
+struct Kernels {
+	SBF_SimdLevel level;
+	void (*reduce)(NodeType type, const void *data, size_t length, uint32_t ops, SBF_Reduction &out);
+	size_t (*filter)(NodeType type, const void *data, size_t length, SBF_Scalar low, SBF_Scalar high, size_t *indices);
+	void (*histogram)(NodeType type, const void *data, size_t length, double low, double high, size_t bins, uint64_t *counts);
+};
+
+/// Every instruction set compiled in, from the lowest up.
+const Kernels compiled[] = {
+	{ SBF_SIMD_SCALAR, Scalar::ReduceArray, Scalar::FilterArray, Scalar::HistogramArray },
+#if SBF_VECTORS
+	{ SBF_SIMD_BASELINE, Baseline::ReduceArray, Baseline::FilterArray, Baseline::HistogramArray },
+#endif
+#if SBF_X86
+	{ SBF_SIMD_AVX2, Avx2::ReduceArray, Avx2::FilterArray, Avx2::HistogramArray },
+	{ SBF_SIMD_AVX512, Avx512::ReduceArray, Avx512::FilterArray, Avx512::HistogramArray },
+#endif
+};
+
+SBF_SimdLevel Supported() {
+#if SBF_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+			&& __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")) return SBF_SIMD_AVX512;
+
+	if (__builtin_cpu_supports("avx2")) return SBF_SIMD_AVX2;
+
+	return SBF_SIMD_BASELINE;
+#elif SBF_VECTORS
+	return SBF_SIMD_BASELINE;
+#else
+	return SBF_SIMD_SCALAR;
+#endif
+}
+
+/// Best kernels compiled in that are not above level.
+const Kernels *Select(SBF_SimdLevel level) {
+	const auto supported = Supported();
+	if (level > supported) level = supported;
+
+	const Kernels *best = &compiled[0];
+	for (auto &kernels : compiled) {
+		if (kernels.level <= level) best = &kernels;
+	}
+
+	return best;
+}
+
+std::atomic<const Kernels *> active = nullptr;
+
+const Kernels &Active() {
+	auto kernels = active.load(std::memory_order_acquire);
+
+	// The first call publishes the default, unless SBF_SetSimdLevel got there first.
+	if (!kernels) {
+		const Kernels *expected = nullptr;
+		kernels = Select(SBF_SIMD_AVX512);
+
+		if (!active.compare_exchange_strong(expected, kernels, std::memory_order_acq_rel, std::memory_order_acquire)) kernels = expected;
+	}
+
+	return *kernels;
+}
+
+void CheckBuffer(NodeType type, const void *data, size_t length) {
+	if (!SBF::IsArrayType(type)) throw std::invalid_argument("type must be an array or string type");
+	if (!data && length) throw std::invalid_argument("data argument must not be null");
+}
+
+void CheckArray(const Node *node) {
+	if (!node) throw std::invalid_argument("node pointer argument must not be null");
+	if (!SBF::IsArrayType(node->type)) throw std::invalid_argument("node must be an array or string");
+}
+
+/// An empty reduction: the identity of every operation.
+SBF_Reduction Identity(NodeType type) {
+	SBF_Reduction reduction = {};
+
+	switch (type) {
+	case NodeType_I8A: case NodeType_I32A: case NodeType_I64A:
+		reduction.min.i64 = INT64_MAX;
+		reduction.max.i64 = INT64_MIN;
+		break;
+
+	case NodeType_F32A: case NodeType_F64A:
+		reduction.sum.f64 = 0;
+		reduction.min.f64 = INFINITY;
+		reduction.max.f64 = -INFINITY;
+		break;
+
+	default:
+		reduction.min.u64 = UINT64_MAX;
+		reduction.max.u64 = 0;
+		break;
+	}
+
+	return reduction;
+}
+
+};
+
+SBF_Reduction SBF_BufferReduce(NodeType type, const void *data, size_t length, uint32_t ops) {
+	CheckBuffer(type, data, length);
+
+	auto reduction = Identity(type);
+	Active().reduce(type, data, length, ops, reduction);
+
+	// The identities of the element type are wider than those of the reduction.
+	if (!length) reduction = Identity(type);
+
+	return reduction;
+}
+
+SBF_Reduction SBF_ArrayReduce(const Node *node, uint32_t ops) {
+	CheckArray(node);
+	return SBF_BufferReduce(node->type, node->array, node->array_length, ops);
+}
+
+void SBF_MergeReductions(NodeType type, SBF_Reduction *into, const SBF_Reduction *from) {
+	if (!into || !from) throw std::invalid_argument("reduction arguments must not be null");
+	if (!SBF::IsArrayType(type)) throw std::invalid_argument("type must be an array or string type");
+
+	into->count += from->count;
+
+	switch (type) {
+	case NodeType_I8A: case NodeType_I32A: case NodeType_I64A:
+		into->sum.u64 += from->sum.u64;
+		into->min.i64 = std::min(into->min.i64, from->min.i64);
+		into->max.i64 = std::max(into->max.i64, from->max.i64);
+		break;
+
+	case NodeType_F32A: case NodeType_F64A:
+		into->sum.f64 += from->sum.f64;
+		into->min.f64 = std::min(into->min.f64, from->min.f64);
+		into->max.f64 = std::max(into->max.f64, from->max.f64);
+		break;
+
+	default:
+		into->sum.u64 += from->sum.u64;
+		into->min.u64 = std::min(into->min.u64, from->min.u64);
+		into->max.u64 = std::max(into->max.u64, from->max.u64);
+		break;
+	}
+}
+
+size_t SBF_BufferFilterRange(NodeType type, const void *data, size_t length, SBF_Scalar low, SBF_Scalar high, size_t *indices) {
+	CheckBuffer(type, data, length);
+	return Active().filter(type, data, length, low, high, indices);
+}
+
+size_t SBF_ArrayFilterRange(const Node *node, SBF_Scalar low, SBF_Scalar high, size_t *indices) {
+	CheckArray(node);
+	return SBF_BufferFilterRange(node->type, node->array, node->array_length, low, high, indices);
+}
+
+void SBF_BufferHistogram(NodeType type, const void *data, size_t length, double low, double high, size_t bins, uint64_t *counts) {
+	CheckBuffer(type, data, length);
+
+	if (!counts) throw std::invalid_argument("counts argument must not be null");
+	if (!bins) throw std::invalid_argument("histogram needs at least one bin");
+	if (!(low < high) || !std::isfinite(high - low)) throw std::invalid_argument("histogram range must be finite and not empty");
+
+	Active().histogram(type, data, length, low, high, bins, counts);
+}
+
+void SBF_ArrayHistogram(const Node *node, double low, double high, size_t bins, uint64_t *counts) {
+	CheckArray(node);
+	SBF_BufferHistogram(node->type, node->array, node->array_length, low, high, bins, counts);
+}
+
+SBF_SimdLevel SBF_GetSimdLevel(void) {
+	return Active().level;
+}
+
+SBF_SimdLevel SBF_SetSimdLevel(SBF_SimdLevel level) {
+	auto kernels = Select(level);
+	active.store(kernels, std::memory_order_release);
+	return kernels->level;
+}
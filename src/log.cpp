@@ -0,0 +1,187 @@
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "SBF/sbf.h"
+
+#include "checksum.h"
+#include "node.h"
+#include "io.h"
+
+// A log file is a regular SBF file (version byte + base node) followed by
+// zero or more update records. Every record is a patch table as produced by
+// SBF_Diff, which is self-delimiting thanks to its closing tag. In checksummed
+// files (format version 2), records are stored in checksummed blocks like the base node.
+
+namespace {
+
+/// Serializes record into a new buffer of size bytes, ready to be appended to a file
+/// whose version byte is version: in its byte order, and in a block if it is checksummed.
+uint8_t *EncodeRecord(const Node *record, uint8_t version, size_t &size) {
+	const bool checksum = SBF::FormatVersion(version) == SBF::ChecksumVersion;
+	const bool big_endian = version & SBF::BigEndianFlag;
+
+	const auto node_size = SBF_CalculateSize(record);
+	const auto header = checksum ? SBF::BlockHeaderSize : 0;
+
+	size = header + node_size + (checksum ? SBF::BlockTrailerSize : 0);
+
+	auto bytes = (uint8_t *)malloc(size);
+
+	SBF_EncodeOptions options = {};
+	if (big_endian) options.flags |= SBF_ENCODE_BIG_ENDIAN;
+
+	size_t cursor = header;
+	try {
+		SBF_SerializeEx(record, bytes, size, &cursor, &options);
+	} catch (...) {
+		free(bytes);
+		throw;
+	}
+
+	// Records are small: the checksum is computed while the bytes are still in cache.
+	if (checksum) {
+		if (big_endian) SBF::WriteBE<uint64_t>(bytes, node_size);
+		else SBF::WriteLE<uint64_t>(bytes, node_size);
+
+		const auto crc = SBF::Crc32c(0, bytes, cursor);
+
+		if (big_endian) SBF::WriteBE<uint32_t>(bytes + cursor, crc);
+		else SBF::WriteLE<uint32_t>(bytes + cursor, crc);
+	}
+
+	return bytes;
+}
+
+};
+
+size_t SBF_AppendFile(const char *filepath, const Node *record) {
+	if (!filepath) throw std::invalid_argument("file path argument must not be null");
+	if (!record) throw std::invalid_argument("record pointer argument must not be null");
+	if (record->type != NodeType_T) throw std::invalid_argument("log records must be tables");
+
+	// Records must land after any rewrite of the file still being flushed in the background.
+	SBF::WaitForPendingWrite(filepath);
+
+	size_t size = 0;
+
+#if defined(_WIN32)
+	if (!std::filesystem::is_regular_file(filepath)) throw std::runtime_error("file not found");
+
+	// A record cut short by a crash is cut off, so that the new one is not read as its continuation.
+	uint8_t version = 0;
+	const auto end = SBF::IntactFileEnd(filepath, &version);
+
+	if (end < std::filesystem::file_size(filepath)) std::filesystem::resize_file(filepath, end);
+
+	auto bytes = EncodeRecord(record, version, size);
+
+	std::ofstream file(filepath, std::ios::binary | std::ios::app);
+
+	if (!file.is_open()) {
+		free(bytes);
+		throw std::runtime_error("failed to open file");
+	}
+
+	file.write(reinterpret_cast<char *>(bytes), size);
+	file.close();
+
+	free(bytes);
+
+	return std::filesystem::file_size(filepath);
+#else
+	// No O_CREAT: appending only makes sense on top of a base written by SBF_WriteFile.
+	int fd = open(filepath, O_RDWR | O_APPEND | O_CLOEXEC);
+
+	if (fd < 0) throw std::runtime_error(std::string("failed to open file: ") + std::strerror(errno));
+
+	uint8_t *bytes = nullptr;
+	try {
+		// The version byte tells how the record is to be encoded. A record cut short by a crash
+		// is cut off, so that the new one is not read as its continuation.
+		uint8_t version = 0;
+		const auto end = SBF::IntactFileEnd(filepath, &version);
+
+		const auto existing = lseek(fd, 0, SEEK_END);
+		if (existing < 0) throw std::runtime_error(std::string("failed to seek file: ") + std::strerror(errno));
+
+		if (end < (size_t)existing && ftruncate(fd, end) != 0) {
+			throw std::runtime_error(std::string("failed to truncate file: ") + std::strerror(errno));
+		}
+
+		bytes = EncodeRecord(record, version, size);
+	} catch (...) {
+		close(fd);
+		throw;
+	}
+
+	// The record is written with as few calls as possible so that a crash
+	// leaves at most one truncated record at the tail.
+	size_t written = 0;
+	while (written < size) {
+		auto result = write(fd, bytes + written, size - written);
+
+		if (result < 0) {
+			if (errno == EINTR) continue;
+
+			auto error = errno;
+			close(fd);
+			free(bytes);
+			throw std::runtime_error(std::string("failed to write file: ") + std::strerror(error));
+		}
+
+		written += result;
+	}
+
+	auto end = lseek(fd, 0, SEEK_END);
+
+	close(fd);
+	free(bytes);
+
+	return end < 0 ? 0 : static_cast<size_t>(end);
+#endif
+}
+
+void SBF_Compact(const char *filepath) {
+	if (!filepath) throw std::invalid_argument("file path argument must not be null");
+
+	SBF::WaitForPendingWrite(filepath);
+
+	// The whole version byte is needed, byte order included, so the file is read here.
+	SBF::BlockVerifier verifier;
+	auto bytes = SBF::ReadFileAsBytes(filepath, &verifier);
+	auto node = SBF::DecodeFileBytes(bytes.data(), bytes.size(), nullptr, &verifier);
+
+	if (!node) throw std::runtime_error("file holds no base node");
+
+	const uint8_t version = bytes[0];
+	std::vector<uint8_t>().swap(bytes);
+
+	// Compaction replaces the only copy of the data; never leave it half-written.
+	SBF_WriteOptions options = {};
+	options.flags = SBF_WRITE_ATOMIC | SBF_WRITE_SYNC;
+
+	if (SBF::FormatVersion(version) == SBF::ChecksumVersion) options.flags |= SBF_WRITE_CHECKSUM;
+	if (version & SBF::BigEndianFlag) options.flags |= SBF_WRITE_BIG_ENDIAN;
+	options.array_alignment = SBF::FileAlignment(version);
+
+	try {
+		SBF_WriteFileEx(filepath, node, &options);
+	} catch (...) {
+		SBF_DestroyNode(node);
+		throw;
+	}
+
+	SBF_DestroyNode(node);
+}
@@ -0,0 +1,142 @@
+#include <stdexcept>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "node.h"
+
+// Lookups by key. Sorted tables keep their keys in canonical order (see SBF_SortTable), which is
+// what their bytes hold too, so they are binary-searched in place and ranges of keys are contiguous.
+
+namespace {
+
+void ExpectTable(const Node *table) {
+	if (!table) throw std::invalid_argument("table argument must not be null");
+
+	if (table->type != NodeType_T) throw std::invalid_argument(std::string("expected a table node, got ") + SBF::TypeName(table->type));
+}
+
+void ExpectSortedTable(const Node *table) {
+	ExpectTable(table);
+
+	if (!(table->flags & NodeFlag_Sorted)) throw std::invalid_argument("expected a sorted table");
+}
+
+/// Position of the first key of a sorted table for which before is false, before being true
+/// for a leading run of its keys. The halving does not branch on the comparison, which
+/// the compiler turns into a conditional move: every search takes the same steps.
+template<typename Before>
+size_t PartitionPoint(const Node *table, Before before) {
+	const auto keys = table->keys;
+
+	size_t base = 0;
+	size_t length = table->table_length;
+
+	if (!length) return 0;
+
+	while (length > 1) {
+		const auto half = length / 2;
+		base = before(keys[base + half - 1]) ? base + half : base;
+		length -= half;
+	}
+
+	return base + before(keys[base]);
+}
+
+/// Entries of the tables being sorted on this thread.
+thread_local std::vector<size_t> sort_order;
+thread_local std::vector<char *> sorted_keys;
+thread_local std::vector<Node *> sorted_values;
+
+};
+
+namespace SBF {
+
+size_t LowerBound(const Node *table, const char *key) {
+	return PartitionPoint(table, [key](const char *other) { return std::strcmp(other, key) < 0; });
+}
+
+size_t FindEntry(const Node *table, const char *key) {
+	const auto length = table->table_length;
+
+	if (table->flags & NodeFlag_Sorted) {
+		const auto x = LowerBound(table, key);
+		return x < length && std::strcmp(table->keys[x], key) == 0 ? x : length;
+	}
+
+	for (size_t x = 0; x < length; x++) {
+		if (std::strcmp(table->keys[x], key) == 0) return x;
+	}
+
+	return length;
+}
+
+};
+
+void SBF_SortTable(Node *table) {
+	ExpectTable(table);
+
+	if (table->flags & NodeFlag_Sorted) return;
+
+	const auto length = table->table_length;
+
+	auto &order = sort_order;
+	order.clear();
+
+	// Throws on duplicate keys before anything moved.
+	SBF::CanonicalOrder(table, order);
+
+	auto &keys = sorted_keys;
+	auto &values = sorted_values;
+	keys.resize(length);
+	values.resize(length);
+
+	for (size_t x = 0; x < length; x++) {
+		keys[x] = table->keys[order[x]];
+		values[x] = table->values[order[x]];
+	}
+
+	if (length) {
+		std::memcpy(table->keys, keys.data(), length * sizeof(char *));
+		std::memcpy(table->values, values.data(), length * sizeof(Node *));
+	}
+
+	table->flags |= NodeFlag_Sorted;
+}
+
+bool SBF_TableIsSorted(const Node *table) {
+	ExpectTable(table);
+
+	return table->flags & NodeFlag_Sorted;
+}
+
+Node *SBF_TableGet(const Node *table, const char *key) {
+	ExpectTable(table);
+	if (!key) throw std::invalid_argument("key argument must not be null");
+
+	const auto x = SBF::FindEntry(table, key);
+	return x < table->table_length ? table->values[x] : nullptr;
+}
+
+size_t SBF_TableLowerBound(const Node *table, const char *key) {
+	ExpectSortedTable(table);
+	if (!key) throw std::invalid_argument("key argument must not be null");
+
+	return SBF::LowerBound(table, key);
+}
+
+size_t SBF_TablePrefix(const Node *table, const char *prefix, size_t *first) {
+	ExpectSortedTable(table);
+	if (!prefix) throw std::invalid_argument("prefix argument must not be null");
+	if (!first) throw std::invalid_argument("first argument must not be null");
+
+	// Keys starting with the prefix come right after the keys before it, and before any other key after it.
+	const auto length = std::strlen(prefix);
+
+	*first = SBF::LowerBound(table, prefix);
+	const auto end = PartitionPoint(table, [prefix, length](const char *other) { return std::strncmp(other, prefix, length) <= 0; });
+
+	return end - *first;
+}
@@ -0,0 +1,199 @@
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <new>
+#include <bit>
+
+#include "SBF/sbf.h"
+
+#include "node.h"
+
+// Changes to trees in place. Arrays and tables keep the room they grow into (see SBF::Capacity),
+// so that growing them one element at a time takes amortized constant time.
+
+namespace {
+
+/// Smallest capacity given to a grown array or table.
+constexpr size_t Minimum_Capacity = 4;
+
+/// Power of two holding at least length elements, whose buffer (plus extra bytes) fits in a size_t.
+size_t GrownCapacity(size_t length, size_t element_size, size_t extra) {
+	constexpr size_t largest = (size_t)1 << (sizeof(size_t) * 8 - 1);
+
+	if (length > largest) throw std::length_error("node length too large");
+
+	const auto capacity = std::bit_ceil(length < Minimum_Capacity ? Minimum_Capacity : length);
+	if (capacity > (SIZE_MAX - extra) / element_size) throw std::length_error("node length too large");
+
+	return capacity;
+}
+
+void *Reallocate(void *buffer, size_t bytes) {
+	auto grown = realloc(buffer, bytes);
+	if (!grown) throw std::bad_alloc();
+
+	return grown;
+}
+
+void SetCapacity(Node *node, size_t capacity) {
+	const auto log = (uint32_t)std::countr_zero(capacity) + 1;
+	node->flags = (node->flags & ~NodeFlag_Capacity) | log << SBF::CapacityShift;
+}
+
+void ExpectArray(const Node *node) {
+	if (!node) throw std::invalid_argument("node argument must not be null");
+
+	if (!SBF::IsArrayType(node->type))
+		throw std::invalid_argument(std::string("expected an array or string node, got ") + SBF::TypeName(node->type));
+}
+
+void ExpectModifiableTable(const Node *table, const char *key) {
+	if (!table) throw std::invalid_argument("table argument must not be null");
+	if (!key) throw std::invalid_argument("key argument must not be null");
+
+	if (table->type != NodeType_T) throw std::invalid_argument(std::string("expected a table node, got ") + SBF::TypeName(table->type));
+
+	// Their keys and values belong to the arena, which cannot take heap nodes in or give its own back.
+	if (table->flags & NodeFlag_Arena) throw std::invalid_argument("tables allocated in an arena cannot be modified");
+}
+
+/// Sets the length of an array or string node with room for it, terminating strings.
+void SetArrayLength(Node *node, size_t length) {
+	node->array_length = length;
+
+	if (node->type == NodeType_String && node->string) node->string[length] = '\0';
+}
+
+};
+
+namespace SBF {
+
+void ReserveArray(Node *node, size_t length) {
+	if (length <= Capacity(node)) return;
+
+	if (node->flags & NodeFlag_Arena) throw std::invalid_argument("arrays allocated in an arena cannot grow");
+
+	const auto element_size = ArrayElementSize(node->type);
+	const size_t terminator = node->type == NodeType_String ? 1 : 0;
+	const auto capacity = GrownCapacity(length, element_size, terminator);
+
+	node->array = Reallocate(node->array, capacity * element_size + terminator);
+	SetCapacity(node, capacity);
+}
+
+void ReserveTable(Node *node, size_t length) {
+	if (length <= Capacity(node)) return;
+
+	if (node->flags & NodeFlag_Arena) throw std::invalid_argument("tables allocated in an arena cannot grow");
+
+	const auto capacity = GrownCapacity(length, sizeof(Node *), 0);
+
+	// Should the second one fail, the first buffer is only larger than its capacity says.
+	node->keys = (char **)Reallocate(node->keys, capacity * sizeof(char *));
+	node->values = (Node **)Reallocate(node->values, capacity * sizeof(Node *));
+	SetCapacity(node, capacity);
+}
+
+};
+
+void SBF_NodeSet_String(Node *node, const char *str) {
+	if (!str) throw std::invalid_argument("string argument must not be null");
+	if (!node || node->type != NodeType_String) throw std::invalid_argument("expected a string node");
+
+	// A part of the string itself is never longer than it, so it does not move.
+	const auto length = std::strlen(str);
+	SBF::ReserveArray(node, length);
+
+	std::memmove(node->string, str, length);
+	SetArrayLength(node, length);
+}
+
+void SBF_ArrayResize(Node *node, size_t length) {
+	ExpectArray(node);
+
+	const auto element_size = SBF::ArrayElementSize(node->type);
+	const auto old_length = node->array_length;
+
+	SBF::ReserveArray(node, length);
+
+	if (length > old_length) std::memset((uint8_t *)node->array + old_length * element_size, 0, (length - old_length) * element_size);
+
+	SetArrayLength(node, length);
+}
+
+void SBF_ArrayAppend(Node *node, const void *values, size_t count) {
+	ExpectArray(node);
+
+	if (!count) return;
+	if (!values) throw std::invalid_argument("values argument must not be null");
+
+	const auto element_size = SBF::ArrayElementSize(node->type);
+	const auto old_length = node->array_length;
+
+	if (count > SIZE_MAX - old_length) throw std::length_error("node length too large");
+
+	// Values taken from the array itself move with it.
+	const auto array = (uintptr_t)node->array;
+	const auto source = (uintptr_t)values;
+	const bool inside = array && source >= array && source < array + old_length * element_size;
+
+	SBF::ReserveArray(node, old_length + count);
+
+	const auto bytes = (uint8_t *)node->array;
+	const auto from = inside ? bytes + (source - array) : (const uint8_t *)values;
+
+	std::memcpy(bytes + old_length * element_size, from, count * element_size);
+
+	SetArrayLength(node, old_length + count);
+}
+
+void SBF_TableSet(Node *table, const char *key, Node *value) {
+	ExpectModifiableTable(table, key);
+
+	const auto length = table->table_length;
+	const bool sorted = table->flags & NodeFlag_Sorted;
+
+	// Sorted tables get new keys in their place rather than at the end.
+	const auto index = sorted ? SBF::LowerBound(table, key) : SBF::FindEntry(table, key);
+
+	if (index < length && std::strcmp(table->keys[index], key) == 0) {
+		if (table->values[index] != value) SBF_DestroyNode(table->values[index]);
+
+		table->values[index] = value;
+		return;
+	}
+
+	SBF::ReserveTable(table, length + 1);
+
+	const auto key_length = std::strlen(key);
+	auto copy = (char *)malloc(key_length + 1);
+	if (!copy) throw std::bad_alloc();
+	std::memcpy(copy, key, key_length + 1);
+
+	const auto tail = length - index;
+	std::memmove(table->keys + index + 1, table->keys + index, tail * sizeof(char *));
+	std::memmove(table->values + index + 1, table->values + index, tail * sizeof(Node *));
+
+	table->keys[index] = copy;
+	table->values[index] = value;
+	table->table_length++;
+}
+
+bool SBF_TableRemove(Node *table, const char *key) {
+	ExpectModifiableTable(table, key);
+
+	const auto index = SBF::FindEntry(table, key);
+	if (index == table->table_length) return false;
+
+	free(table->keys[index]);
+	SBF_DestroyNode(table->values[index]);
+
+	const auto tail = table->table_length - index - 1;
+	std::memmove(table->keys + index, table->keys + index + 1, tail * sizeof(char *));
+	std::memmove(table->values + index, table->values + index + 1, tail * sizeof(Node *));
+	table->table_length--;
+
+	return true;
+}
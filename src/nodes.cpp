@@ -1,5 +1,433 @@
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "node.h"
+#include "arena.h"
+#include "tags.h"
+#include "io.h"
+
+// Tree kernels: cloning, comparison and hashing. All of them walk the tree with a stack
+// of their own instead of the call stack, so that they handle any depth the decoder does.
+
+namespace {
+
+/// Clones being filled in on this thread: tables and columns whose values still point into the original.
+/// Calls only use the part above where it stood when they started.
+thread_local std::vector<Node *> clones_to_fill;
+
+/// Copies node but for the values of tables and columns, which are left pointing at the originals.
+template<typename Allocator>
+Node *CloneShell(Allocator &allocator, const Node *node) {
+	auto clone = allocator.NewNode();
+	const auto flags = clone->flags;
+
+	std::memcpy(clone, node, sizeof(Node));
+	clone->flags = flags | (node->flags & (NodeFlag_Sorted | NodeFlag_Encoding));
+
+	if (SBF::IsArrayType(node->type)) {
+		const auto bytes = node->array_length * SBF::ArrayElementSize(node->type);
+
+		clone->array = nullptr;
+		if (node->array) {
+			// Strings get a null terminator that is not part of their length.
+			clone->array = allocator.Allocate(node->type == NodeType_String ? bytes + 1 : bytes);
+			std::memcpy(clone->array, node->array, bytes);
+
+			if (node->type == NodeType_String) clone->string[bytes] = '\0';
+		}
+	} else if (node->type == NodeType_T || node->type == NodeType_Columns) {
+		const auto length = node->table_length;
+
+		clone->keys = (char **)allocator.Allocate(sizeof(char *) * length);
+		clone->values = (Node **)allocator.Allocate(sizeof(Node *) * length);
+
+		for (size_t x = 0; x < length; x++) {
+			const auto key_len = std::strlen(node->keys[x]);
+			clone->keys[x] = (char *)allocator.Allocate(key_len + 1);
+			std::memcpy(clone->keys[x], node->keys[x], key_len + 1);
+		}
+
+		if (length) std::memcpy(clone->values, node->values, sizeof(Node *) * length);
+	}
+
+	return clone;
+}
+
+template<typename Allocator>
+Node *Clone(Allocator &allocator, const Node *node) {
+	if (!node) return nullptr;
+
+	auto root = CloneShell(allocator, node);
+	if (root->type != NodeType_T && root->type != NodeType_Columns) return root;
+
+	auto &pending = clones_to_fill;
+	const auto base = pending.size();
+
+	pending.push_back(root);
+
+	while (pending.size() > base) {
+		auto clone = pending.back();
+		pending.pop_back();
+
+		for (size_t x = 0; x < clone->table_length; x++) {
+			auto value = clone->values[x];
+			if (!value) continue;
+
+			clone->values[x] = CloneShell(allocator, value);
+
+			if (value->type == NodeType_T || value->type == NodeType_Columns) pending.push_back(clone->values[x]);
+		}
+	}
+
+	return root;
+}
+
+bool LeavesEqual(const Node *a, const Node *b) {
+	switch (a->type) {
+	case NodeType_I8: return a->i8 == b->i8;
+	case NodeType_U8: return a->u8 == b->u8;
+	case NodeType_Char: return a->c == b->c;
+	case NodeType_I32: return a->i32 == b->i32;
+	case NodeType_U32: return a->u32 == b->u32;
+	case NodeType_I64: return a->i64 == b->i64;
+	case NodeType_U64: return a->u64 == b->u64;
+	// Floats are compared by representation, the same way they are serialized.
+	case NodeType_F32: return std::memcmp(&a->f32, &b->f32, sizeof(float)) == 0;
+	case NodeType_F64: return std::memcmp(&a->f64, &b->f64, sizeof(double)) == 0;
+
+	default:
+		if (!SBF::IsArrayType(a->type)) return false;
+		if (a->array_length != b->array_length) return false;
+		if (!a->array_length) return true;
+
+		// memcmp is vectorized by the C library, and stops at the first differing block.
+		return std::memcmp(a->array, b->array, a->array_length * SBF::ArrayElementSize(a->type)) == 0;
+	}
+}
+
+inline bool IsContainer(const Node *node) { return node->type == NodeType_T || node->type == NodeType_Columns; }
+
+/// Pairs of tables (or columns) left to compare on this thread.
+thread_local std::vector<std::pair<const Node *, const Node *>> tables_to_compare;
+
+/// XXH64, fed a piece at a time; the result does not depend on how the input is split.
+class Hasher {
+
+	static constexpr uint64_t Prime1 = 0x9e3779b185ebca87ull;
+	static constexpr uint64_t Prime2 = 0xc2b2ae3d27d4eb4full;
+	static constexpr uint64_t Prime3 = 0x165667b19e3779f9ull;
+	static constexpr uint64_t Prime4 = 0x85ebca77c2b2ae63ull;
+	static constexpr uint64_t Prime5 = 0x27d4eb2f165667c5ull;
+
+	static constexpr size_t Stripe = 32;
+
+	uint64_t lanes[4] = { Prime1 + Prime2, Prime2, 0, 0 - Prime1 };
+	uint64_t total = 0;
+
+	uint8_t buffer[Stripe];
+	size_t buffered = 0;
+
+	static inline uint64_t RotateLeft(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+	static inline uint64_t Round(uint64_t lane, uint64_t input) {
+		lane += input * Prime2;
+		return RotateLeft(lane, 31) * Prime1;
+	}
+
+	static inline uint64_t MergeRound(uint64_t hash, uint64_t lane) {
+		hash ^= Round(0, lane);
+		return hash * Prime1 + Prime4;
+	}
+
+	inline void Consume(const uint8_t *stripe) {
+		for (size_t l = 0; l < 4; l++) lanes[l] = Round(lanes[l], SBF::ReadLE<uint64_t>(stripe + l * 8));
+	}
+
+public:
+
+	void Update(const void *data, size_t size) {
+		if (!size) return;
+
+		auto bytes = (const uint8_t *)data;
+		total += size;
+
+		if (buffered) {
+			const auto fill = std::min(size, Stripe - buffered);
+			std::memcpy(buffer + buffered, bytes, fill);
+			buffered += fill;
+			bytes += fill;
+			size -= fill;
+
+			if (buffered < Stripe) return;
+
+			Consume(buffer);
+			buffered = 0;
+		}
+
+		for (; size >= Stripe; size -= Stripe, bytes += Stripe) Consume(bytes);
+
+		std::memcpy(buffer, bytes, size);
+		buffered = size;
+	}
+
+	/// Feeds count elements of Size bytes in little-endian order, as they are serialized.
+	template<size_t Size>
+	void UpdateArray(const void *data, size_t count) {
+		if constexpr (!SBF::LittleEndian::Swaps || Size == 1) {
+			Update(data, count * Size);
+		} else {
+			using U = SBF::UnsignedOfSize<Size>;
+
+			U chunk[512];
+			auto from = (const U *)data;
+
+			for (size_t done = 0; done < count;) {
+				const auto step = std::min(count - done, sizeof(chunk) / Size);
+				SBF::LittleEndian::CopyArray<U>(chunk, from + done, step);
+				Update(chunk, step * Size);
+				done += step;
+			}
+		}
+	}
+
+	uint64_t Digest() const {
+		uint64_t hash;
+
+		if (total >= Stripe) {
+			hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+			for (auto lane : lanes) hash = MergeRound(hash, lane);
+		} else {
+			hash = lanes[2] + Prime5;
+		}
+
+		hash += total;
+
+		size_t x = 0;
+
+		for (; buffered - x >= 8; x += 8) {
+			hash ^= Round(0, SBF::ReadLE<uint64_t>(buffer + x));
+			hash = RotateLeft(hash, 27) * Prime1 + Prime4;
+		}
+
+		if (buffered - x >= 4) {
+			hash ^= (uint64_t)SBF::ReadLE<uint32_t>(buffer + x) * Prime1;
+			hash = RotateLeft(hash, 23) * Prime2 + Prime3;
+			x += 4;
+		}
+
+		for (; x < buffered; x++) {
+			hash ^= buffer[x] * Prime5;
+			hash = RotateLeft(hash, 11) * Prime1;
+		}
+
+		hash ^= hash >> 33;
+		hash *= Prime2;
+		hash ^= hash >> 29;
+		hash *= Prime3;
+		hash ^= hash >> 32;
+
+		return hash;
+	}
+
+};
+
+// Tags are numbered like the node types; closing ones are their negation.
+inline uint8_t OpenTag(NodeType type) { return (uint8_t)type; }
+inline uint8_t CloseTag(NodeType type) { return (uint8_t)-(uint8_t)type; }
+
+/// Feeds a tag followed by a length, as in the header of an array, string or columns node.
+void HashHeader(Hasher &hasher, NodeType type, uint64_t length) {
+	uint8_t header[1 + sizeof(uint64_t)];
+
+	header[0] = OpenTag(type);
+	SBF::WriteLE<uint64_t>(header + 1, length);
+
+	hasher.Update(header, sizeof(header));
+}
+
+void HashKey(Hasher &hasher, const char *key) {
+	const auto key_len = std::strlen(key);
+	const uint8_t close = CloseTag(NodeType_String);
+
+	HashHeader(hasher, NodeType_String, key_len);
+	hasher.Update(key, key_len);
+	hasher.Update(&close, 1);
+}
+
+/// Feeds the bytes SBF_Serialize writes for any node but a table, arrays as raw whatever their encoding.
+void HashLeaf(Hasher &hasher, const Node *node) {
+	const auto type = node->type;
+
+	if (SBF::IsScalarType(type)) {
+		uint8_t bytes[2 + sizeof(uint64_t)];
+		const auto size = SBF::ScalarSize(type);
+
+		// The union members of one size share their bits, floats included.
+		bytes[0] = OpenTag(type);
+		switch (size) {
+		case 1: bytes[1] = node->u8; break;
+		case 4: SBF::WriteLE<uint32_t>(bytes + 1, node->u32); break;
+		default: SBF::WriteLE<uint64_t>(bytes + 1, node->u64); break;
+		}
+		bytes[1 + size] = CloseTag(type);
+
+		hasher.Update(bytes, size + 2);
+		return;
+	}
+
+	if (SBF::IsArrayType(type)) {
+		HashHeader(hasher, type, node->array_length);
+
+		switch (SBF::ArrayElementSize(type)) {
+		case 1: hasher.UpdateArray<1>(node->array, node->array_length); break;
+		case 4: hasher.UpdateArray<4>(node->array, node->array_length); break;
+		default: hasher.UpdateArray<8>(node->array, node->array_length); break;
+		}
+	} else if (type == NodeType_Columns) {
+		HashHeader(hasher, type, SBF::CheckColumns(node));
+
+		for (size_t x = 0; x < node->table_length; x++) {
+			HashKey(hasher, node->keys[x]);
+			HashLeaf(hasher, node->values[x]);
+		}
+	} else {
+		throw std::invalid_argument(std::string("invalid node type '") + std::to_string((uint8_t)type) + "'");
+	}
+
+	const uint8_t close = CloseTag(type);
+	hasher.Update(&close, 1);
+}
+
+/// A table being hashed, and its next entry.
+struct TableWalk {
+	const Node *table;
+	size_t next;
+};
+
+thread_local std::vector<TableWalk> tables_to_hash;
+
+};
+
 namespace SBF {
 
+Node *CloneNode(const Node *node, SBF_Arena *arena) {
+	if (arena) {
+		ArenaAllocator allocator = { arena->cursor };
+		return Clone(allocator, node);
+	}
+
+	SBF::HeapAllocator allocator;
+	return Clone(allocator, node);
+}
 
+bool NodesEqual(const Node *a, const Node *b) {
+	if (a == b) return true;
+	if (!a || !b || a->type != b->type) return false;
+
+	if (!IsContainer(a)) return LeavesEqual(a, b);
+
+	auto &pending = tables_to_compare;
+	const auto base = pending.size();
+
+	pending.push_back({ a, b });
+
+	while (pending.size() > base) {
+		const auto [table_a, table_b] = pending.back();
+		pending.pop_back();
+
+		if (table_a->table_length != table_b->table_length) {
+			pending.resize(base);
+			return false;
+		}
+
+		// Keys and leaves of a table are all checked before going deeper, so shallow differences are found first.
+		for (size_t x = 0; x < table_a->table_length; x++) {
+			const auto value_a = table_a->values[x];
+			const auto value_b = table_b->values[x];
+
+			bool equal = std::strcmp(table_a->keys[x], table_b->keys[x]) == 0;
+
+			if (equal && value_a != value_b) {
+				if (!value_a || !value_b || value_a->type != value_b->type) equal = false;
+				else if (IsContainer(value_a)) pending.push_back({ value_a, value_b });
+				else equal = LeavesEqual(value_a, value_b);
+			}
+
+			if (!equal) {
+				pending.resize(base);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
 
 };
+
+Node *SBF_CloneNode(const Node *node, SBF_Arena *arena) {
+	if (!node) throw std::invalid_argument("node was null");
+
+	return SBF::CloneNode(node, arena);
+}
+
+bool SBF_NodeEquals(const Node *a, const Node *b) {
+	return SBF::NodesEqual(a, b);
+}
+
+uint64_t SBF_NodeHash(const Node *node) {
+	if (!node) throw std::invalid_argument("node was null");
+
+	Hasher hasher;
+
+	if (node->type != NodeType_T) {
+		HashLeaf(hasher, node);
+		return hasher.Digest();
+	}
+
+	auto &stack = tables_to_hash;
+	const auto base = stack.size();
+
+	const uint8_t open = OpenTag(NodeType_T);
+	const uint8_t close = CloseTag(NodeType_T);
+
+	hasher.Update(&open, 1);
+	stack.push_back({ node, 0 });
+
+	try {
+		while (stack.size() > base) {
+			auto &walk = stack.back();
+
+			if (walk.next == walk.table->table_length) {
+				hasher.Update(&close, 1);
+				stack.pop_back();
+				continue;
+			}
+
+			const auto x = walk.next++;
+			const auto value = walk.table->values[x];
+
+			if (!value) throw std::invalid_argument("table value #" + std::to_string(x) + " was null");
+
+			HashKey(hasher, walk.table->keys[x]);
+
+			if (value->type == NodeType_T) {
+				hasher.Update(&open, 1);
+				stack.push_back({ value, 0 });
+			} else {
+				HashLeaf(hasher, value);
+			}
+		}
+	} catch (...) {
+		stack.resize(base);
+		throw;
+	}
+
+	return hasher.Digest();
+}
@@ -0,0 +1,697 @@
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "exceptions.h"
+#include "packed.h"
+#include "node.h"
+#include "tags.h"
+#include "io.h"
+
+// Bit-packing kernels and the encodings built on them; the layout is described in packed.h.
+// A block is packed one 128-bit vector of lanes at a time, so its offsets are shifted and masked
+// four (or two) at once, with a kernel compiled for every width so that every shift is a constant.
+
+namespace {
+
+/// Values in a block of a stream.
+constexpr size_t Block_Values = 128;
+
+/// Bytes of the offsets of a block per bit of their width.
+constexpr size_t Block_Bytes_Per_Bit = Block_Values / 8;
+
+/// Longest run of a run-length body, which bounds how many times larger than its body an array can decode to.
+constexpr size_t Max_Run = 256;
+
+/// Element tag, encoding and count at the start of every body.
+constexpr size_t Body_Header_Size = 2 + sizeof(uint64_t);
+
+/// Opening tag, body length and closing tag around every body.
+constexpr size_t Node_Overhead = 2 + sizeof(uint64_t);
+
+[[noreturn]] void Malformed(const std::string &what, size_t offset) {
+	throw SBF::DeserException(what, "Packed", offset);
+}
+
+#if defined(__GNUC__)
+
+template<typename U>
+struct LanesOf {
+	typedef U type __attribute__((vector_size(16)));
+};
+
+/// A 128-bit vector of words: four lanes of 32 bits, or two of 64.
+template<typename U>
+using Lanes = typename LanesOf<U>::type;
+
+#else
+
+/// Stands in for a 128-bit vector where compilers have no vector extensions.
+template<typename U>
+struct Lanes {
+	static constexpr size_t Count = 16 / sizeof(U);
+	U lane[Count];
+
+	Lanes &operator|=(const Lanes &other) { for (size_t l = 0; l < Count; l++) lane[l] |= other.lane[l]; return *this; }
+	Lanes operator&(const Lanes &other) const { auto result = *this; for (size_t l = 0; l < Count; l++) result.lane[l] &= other.lane[l]; return result; }
+	Lanes operator+(const Lanes &other) const { auto result = *this; for (size_t l = 0; l < Count; l++) result.lane[l] += other.lane[l]; return result; }
+	Lanes operator<<(unsigned shift) const { auto result = *this; for (auto &word : result.lane) word <<= shift; return result; }
+	Lanes operator>>(unsigned shift) const { auto result = *this; for (auto &word : result.lane) word >>= shift; return result; }
+};
+
+#endif
+
+template<typename V>
+inline V Load(const void *data) {
+	V vector;
+	std::memcpy(&vector, data, sizeof(V));
+	return vector;
+}
+
+template<typename V>
+inline void Store(void *data, const V &vector) {
+	std::memcpy(data, &vector, sizeof(V));
+}
+
+template<typename U>
+inline Lanes<U> Splat(U value) {
+	U lanes[16 / sizeof(U)];
+	for (auto &lane : lanes) lane = value;
+
+	return Load<Lanes<U>>(lanes);
+}
+
+/// Packs the 128 offsets of a block, each below 2^Width, into 16 * Width bytes.
+template<typename U, unsigned Width>
+void PackBlock(const U *offsets, uint8_t *out) {
+	using V = Lanes<U>;
+	constexpr unsigned Bits = sizeof(U) * 8;
+	constexpr size_t Count = 16 / sizeof(U);
+
+	if constexpr (Width > 0) {
+		auto word = Splat<U>(0);
+		unsigned shift = 0;
+
+		// Each lane holds Bits values, which fill Width words.
+		for (size_t j = 0; j < Bits; j++) {
+			const auto v = Load<V>(offsets + j * Count);
+			word |= v << shift;
+			shift += Width;
+
+			if (shift >= Bits) {
+				Store(out, word);
+				out += sizeof(V);
+
+				// The high bits of a value straddling two words start the next one.
+				shift -= Bits;
+				word = shift ? v >> (Width - shift) : Splat<U>(0);
+			}
+		}
+	}
+}
+
+/// Unpacks the 128 offsets of a block of the given width from 16 * Width bytes, adding reference to them.
+template<typename U, unsigned Width>
+void UnpackBlock(const uint8_t *in, U *values, U reference) {
+	using V = Lanes<U>;
+	constexpr unsigned Bits = sizeof(U) * 8;
+	constexpr size_t Count = 16 / sizeof(U);
+
+	const auto base = Splat<U>(reference);
+
+	if constexpr (Width == 0) {
+		for (size_t j = 0; j < Bits; j++) Store(values + j * Count, base);
+	} else {
+		constexpr U Mask = Width == Bits ? ~U(0) : (U(1) << (Width % Bits)) - 1;
+		const auto mask = Splat<U>(Mask);
+
+		auto word = Load<V>(in);
+		unsigned shift = 0;
+
+		for (size_t j = 0; j < Bits; j++) {
+			auto v = word >> shift;
+			const auto end = shift + Width;
+
+			if (end > Bits) {
+				in += sizeof(V);
+				word = Load<V>(in);
+				v |= word << (Bits - shift);
+				shift = end - Bits;
+			} else if (end == Bits) {
+				// The last value ends with the last word.
+				if (j + 1 < Bits) {
+					in += sizeof(V);
+					word = Load<V>(in);
+				}
+				shift = 0;
+			} else {
+				shift = end;
+			}
+
+			Store(values + j * Count, (v & mask) + base);
+		}
+	}
+}
+
+template<typename U>
+using PackFunction = void (*)(const U *offsets, uint8_t *out);
+
+template<typename U>
+using UnpackFunction = void (*)(const uint8_t *in, U *values, U reference);
+
+template<typename U, size_t... Widths>
+constexpr std::array<PackFunction<U>, sizeof...(Widths)> PackFunctions(std::index_sequence<Widths...>) {
+	return { { &PackBlock<U, Widths>... } };
+}
+
+template<typename U, size_t... Widths>
+constexpr std::array<UnpackFunction<U>, sizeof...(Widths)> UnpackFunctions(std::index_sequence<Widths...>) {
+	return { { &UnpackBlock<U, Widths>... } };
+}
+
+/// Kernels for every width, from 0 up to the bits of U.
+template<typename U>
+struct Kernels {
+	static constexpr auto pack = PackFunctions<U>(std::make_index_sequence<sizeof(U) * 8 + 1>());
+	static constexpr auto unpack = UnpackFunctions<U>(std::make_index_sequence<sizeof(U) * 8 + 1>());
+};
+
+inline size_t BlockCount(size_t values) {
+	return values / Block_Values + (values % Block_Values != 0);
+}
+
+/// Reference of a block and width of its offsets.
+template<typename U>
+struct Frame {
+	U reference;
+	unsigned width;
+};
+
+/// Frame of the count values of a block: its smallest value, compared as signed ones if Signed,
+/// and the bits its largest offset from it takes.
+template<typename U, bool Signed>
+Frame<U> FrameOf(const U *values, size_t count) {
+	// Flipping the sign bit orders signed values as unsigned ones, and leaves their differences alone.
+	constexpr U Flip = Signed ? U(1) << (sizeof(U) * 8 - 1) : U(0);
+
+	U low = ~U(0);
+	U high = 0;
+
+	for (size_t x = 0; x < count; x++) {
+		const U key = values[x] ^ Flip;
+		low = key < low ? key : low;
+		high = key > high ? key : high;
+	}
+
+	return { U(low ^ Flip), (unsigned)std::bit_width(U(high - low)) };
+}
+
+/// Bytes of a stream of count values, which next(scratch, &n) hands over n at a time, up to 128.
+template<typename U, bool Signed, typename Next>
+size_t StreamSize(size_t count, Next &&next) {
+	U scratch[Block_Values];
+	size_t size = 0;
+
+	for (size_t done = 0; done < count; ) {
+		size_t n;
+		const auto block = next(scratch, &n);
+
+		size += 1 + sizeof(U) + Block_Bytes_Per_Bit * FrameOf<U, Signed>(block, n).width;
+		done += n;
+	}
+
+	return size;
+}
+
+/// Writes a stream of count values, which next(scratch, &n) hands over n at a time, up to 128, and returns its end.
+template<typename Order, typename U, bool Signed, typename Next>
+uint8_t *WriteStream(uint8_t *out, size_t count, Next &&next) {
+	const auto blocks = BlockCount(count);
+
+	auto widths = out;
+	auto references = widths + blocks;
+	auto packed = references + blocks * sizeof(U);
+
+	U scratch[Block_Values];
+	U offsets[Block_Values];
+
+	for (size_t b = 0; b < blocks; b++) {
+		size_t n;
+		const auto block = next(scratch, &n);
+		const auto frame = FrameOf<U, Signed>(block, n);
+
+		for (size_t x = 0; x < n; x++) offsets[x] = block[x] - frame.reference;
+		std::fill(offsets + n, offsets + Block_Values, U(0));
+
+		widths[b] = (uint8_t)frame.width;
+		Order::template Write<U>(references + b * sizeof(U), frame.reference);
+
+		const auto bytes = Block_Bytes_Per_Bit * frame.width;
+		Kernels<U>::pack[frame.width](offsets, packed);
+
+		// Words are stored in the byte order of the buffer, like any other value.
+		if constexpr (Order::Swaps) Order::template CopyArray<U>(packed, packed, bytes / sizeof(U));
+
+		packed += bytes;
+	}
+
+	return packed;
+}
+
+/// Reads a stream of count values at in, which must end by end, into out; returns its end.
+template<typename Order, typename U>
+const uint8_t *ReadStream(const uint8_t *in, const uint8_t *end, size_t count, U *out, size_t tag_offset) {
+	constexpr unsigned Bits = sizeof(U) * 8;
+
+	const auto blocks = BlockCount(count);
+	if ((size_t)(end - in) / (1 + sizeof(U)) < blocks) Malformed(std::to_string(count) + " values exceed the body", tag_offset);
+
+	const auto widths = in;
+	const auto references = widths + blocks;
+	auto packed = references + blocks * sizeof(U);
+
+	U block[Block_Values];
+	uint8_t swapped[Block_Bytes_Per_Bit * Bits];
+
+	for (size_t b = 0; b < blocks; b++) {
+		const unsigned width = widths[b];
+		if (width > Bits) Malformed("block #" + std::to_string(b) + " is " + std::to_string(width) + " bits wide", tag_offset);
+
+		const auto bytes = Block_Bytes_Per_Bit * width;
+		if ((size_t)(end - packed) < bytes) Malformed("block #" + std::to_string(b) + " exceeds the body", tag_offset);
+
+		auto source = packed;
+		if constexpr (Order::Swaps) {
+			Order::template CopyArray<U>(swapped, packed, bytes / sizeof(U));
+			source = swapped;
+		}
+
+		// Whole blocks are unpacked in place; the last one may hold fewer values.
+		const auto n = std::min(Block_Values, count - b * Block_Values);
+		const auto target = n == Block_Values ? out + b * Block_Values : block;
+
+		Kernels<U>::unpack[width](source, target, Order::template Read<U>(references + b * sizeof(U)));
+		if (n < Block_Values) std::memcpy(out + b * Block_Values, block, n * sizeof(U));
+
+		packed += bytes;
+	}
+
+	return packed;
+}
+
+/// Hands over the values of an array where they are.
+template<typename U>
+struct ValueSource {
+	const U *values;
+	size_t count;
+	size_t next = 0;
+
+	const U *operator()(U *, size_t *n) {
+		*n = std::min(Block_Values, count - next);
+
+		const auto block = values + next;
+		next += *n;
+
+		return block;
+	}
+};
+
+/// Hands over the differences between the values of an array and the ones before them, the first one's from previous.
+template<typename U>
+struct DeltaSource {
+	const U *values;
+	size_t count;
+	U previous;
+	size_t next = 0;
+
+	const U *operator()(U *scratch, size_t *n) {
+		*n = std::min(Block_Values, count - next);
+		const auto from = values + next;
+
+		scratch[0] = from[0] - previous;
+		for (size_t x = 1; x < *n; x++) scratch[x] = from[x] - from[x - 1];
+
+		previous = from[*n - 1];
+		next += *n;
+
+		return scratch;
+	}
+};
+
+/// Runs of equal values an array is split into, at most Max_Run long: their values, and their lengths minus one.
+template<typename U>
+struct Runs {
+	std::vector<U> values;
+	std::vector<U> lengths;
+	size_t count = 0;
+
+	void Collect(const U *array, size_t count) {
+		// As many runs as values at most; the vectors keep their room from one array to the next.
+		if (values.size() < count) {
+			values.resize(count);
+			lengths.resize(count);
+		}
+
+		size_t runs = 0;
+
+		for (size_t next = 0; next < count; runs++) {
+			const auto start = next;
+			const auto value = array[next++];
+			const auto limit = std::min(count, start + Max_Run);
+
+			while (next < limit && array[next] == value) next++;
+
+			values[runs] = value;
+			lengths[runs] = U(next - start - 1);
+		}
+
+		this->count = runs;
+	}
+};
+
+/// Encodings of arrays of elements U, signed ones if Signed.
+template<typename U, bool Signed>
+struct Codec {
+	using Element = U;
+
+	/// Runs of the array being written or read on this thread.
+	static Runs<U> &RunScratch() {
+		thread_local Runs<U> runs;
+		return runs;
+	}
+
+	/// Bytes of the body, header included.
+	static size_t BodySize(const U *values, size_t count, SBF_ArrayEncoding encoding) {
+		switch (encoding) {
+		case SBF_ARRAY_FRAME_OF_REFERENCE:
+			return Body_Header_Size + StreamSize<U, Signed>(count, ValueSource<U> { values, count });
+
+		case SBF_ARRAY_DELTA:
+			return Body_Header_Size + sizeof(U) + StreamSize<U, true>(count, DeltaSource<U> { values, count, count ? values[0] : U(0) });
+
+		default:
+			{
+				auto &runs = RunScratch();
+				runs.Collect(values, count);
+
+				return Body_Header_Size + sizeof(uint64_t)
+					+ StreamSize<U, Signed>(runs.count, ValueSource<U> { runs.values.data(), runs.count })
+					+ StreamSize<U, false>(runs.count, ValueSource<U> { runs.lengths.data(), runs.count });
+			}
+		}
+	}
+
+	/// Writes the payload after the header, and returns its end.
+	template<typename Order>
+	static uint8_t *Write(uint8_t *out, const U *values, size_t count, SBF_ArrayEncoding encoding) {
+		switch (encoding) {
+		case SBF_ARRAY_FRAME_OF_REFERENCE:
+			return WriteStream<Order, U, Signed>(out, count, ValueSource<U> { values, count });
+
+		case SBF_ARRAY_DELTA:
+			{
+				// The first value is the base, so that the first difference is as small as the others.
+				const U base = count ? values[0] : U(0);
+				Order::template Write<U>(out, base);
+
+				return WriteStream<Order, U, true>(out + sizeof(U), count, DeltaSource<U> { values, count, base });
+			}
+
+		default:
+			{
+				auto &runs = RunScratch();
+				runs.Collect(values, count);
+
+				Order::template Write<uint64_t>(out, runs.count);
+
+				out = WriteStream<Order, U, Signed>(out + sizeof(uint64_t), runs.count, ValueSource<U> { runs.values.data(), runs.count });
+				return WriteStream<Order, U, false>(out, runs.count, ValueSource<U> { runs.lengths.data(), runs.count });
+			}
+		}
+	}
+
+	/// Decodes the payload from in up to end into the count elements at out.
+	template<typename Order>
+	static void Read(const uint8_t *in, const uint8_t *end, size_t count, SBF_ArrayEncoding encoding, U *out, size_t tag_offset) {
+		const uint8_t *stop;
+
+		switch (encoding) {
+		case SBF_ARRAY_FRAME_OF_REFERENCE:
+			stop = ReadStream<Order, U>(in, end, count, out, tag_offset);
+			break;
+
+		case SBF_ARRAY_DELTA:
+			{
+				// ReadPackedHeader made sure the base is there.
+				auto previous = Order::template Read<U>(in);
+				stop = ReadStream<Order, U>(in + sizeof(U), end, count, out, tag_offset);
+
+				for (size_t x = 0; x < count; x++) {
+					out[x] += previous;
+					previous = out[x];
+				}
+			}
+			break;
+
+		default:
+			{
+				// Runs are bounded by the body (see CheckCount), unlike the values they expand to.
+				auto &runs = RunScratch();
+				runs.count = (size_t)Order::template Read<uint64_t>(in);
+
+				if (runs.values.size() < runs.count) {
+					runs.values.resize(runs.count);
+					runs.lengths.resize(runs.count);
+				}
+
+				stop = ReadStream<Order, U>(in + sizeof(uint64_t), end, runs.count, runs.values.data(), tag_offset);
+				stop = ReadStream<Order, U>(stop, end, runs.count, runs.lengths.data(), tag_offset);
+
+				size_t total = 0;
+				for (size_t r = 0; r < runs.count; r++) {
+					if (runs.lengths[r] >= Max_Run) Malformed("run #" + std::to_string(r) + " is longer than " + std::to_string(Max_Run) + " values", tag_offset);
+					total += (size_t)runs.lengths[r] + 1;
+				}
+
+				if (total != count) Malformed("runs hold " + std::to_string(total) + " values instead of " + std::to_string(count), tag_offset);
+
+				for (size_t r = 0; r < runs.count; r++) {
+					const auto length = (size_t)runs.lengths[r] + 1;
+
+					if (length == 1) *out = runs.values[r];
+					else std::fill(out, out + length, runs.values[r]);
+
+					out += length;
+				}
+			}
+			break;
+		}
+
+		if (stop != end) Malformed("bytes past the end of the encoded values", tag_offset);
+	}
+
+	/// Bytes a payload of count values takes at the very least, which ReadPackedHeader checks before anything is allocated.
+	template<typename Order>
+	static void CheckCount(const uint8_t *in, size_t length, size_t count, SBF_ArrayEncoding encoding, size_t tag_offset) {
+		const auto block_size = 1 + sizeof(U);
+		size_t blocks = BlockCount(count);
+
+		if (encoding == SBF_ARRAY_DELTA) {
+			if (length < sizeof(U)) Malformed("missing base value", tag_offset);
+			length -= sizeof(U);
+		} else if (encoding == SBF_ARRAY_RUN_LENGTH) {
+			if (length < sizeof(uint64_t)) Malformed("missing run count", tag_offset);
+
+			const auto runs = Order::template Read<uint64_t>(in);
+			length -= sizeof(uint64_t);
+
+			if (BlockCount(runs) > length / block_size / 2)
+				Malformed(std::to_string(runs) + " runs exceed the body", tag_offset);
+			if (count / Max_Run > runs) Malformed(std::to_string(runs) + " runs cannot hold " + std::to_string(count) + " values", tag_offset);
+
+			return;
+		}
+
+		if (blocks > length / block_size) Malformed(std::to_string(count) + " values exceed the body", tag_offset);
+	}
+};
+
+/// Calls f with the codec of the type.
+template<typename F>
+decltype(auto) WithCodec(NodeType type, F &&f) {
+	switch (type) {
+	case NodeType_I32A: return f(Codec<uint32_t, true>());
+	case NodeType_U32A: return f(Codec<uint32_t, false>());
+	case NodeType_I64A: return f(Codec<uint64_t, true>());
+	default: return f(Codec<uint64_t, false>());
+	}
+}
+
+/// Whether any value of the integer array equals the one before it. Without such repeats, every run holds
+/// a single value, and run length writes the stream of frame of reference plus the run count and lengths.
+bool HasRepeats(const Node *node) {
+	return WithCodec(node->type, [&](auto codec) {
+		const auto values = (const typename decltype(codec)::Element *)node->array;
+
+		// Counted rather than searched for, which vectorizes.
+		size_t repeats = 0;
+		for (size_t x = 1; x < node->array_length; x++) repeats += values[x] == values[x - 1];
+
+		return repeats != 0;
+	});
+}
+
+size_t RawSize(const Node *node) {
+	return Node_Overhead + node->array_length * SBF::ArrayElementSize(node->type);
+}
+
+void CheckEncoding(SBF_ArrayEncoding encoding) {
+	if ((uint32_t)encoding > SBF_ARRAY_AUTO) throw std::invalid_argument("invalid array encoding " + std::to_string((uint32_t)encoding));
+}
+
+};
+
+namespace SBF {
+
+SBF_ArrayEncoding WrittenEncoding(const Node *node, size_t *size) {
+	const auto encoding = ArrayEncoding(node);
+
+	if (encoding == SBF_ARRAY_RAW || !IsPackableType(node->type)) {
+		if (size) *size = RawSize(node);
+		return SBF_ARRAY_RAW;
+	}
+
+	if (encoding != SBF_ARRAY_AUTO) {
+		if (size) *size = PackedSize(node, encoding);
+		return encoding;
+	}
+
+	// Ties go to the raw array, which decodes fastest.
+	auto best = SBF_ARRAY_RAW;
+	auto best_size = RawSize(node);
+
+	for (const auto candidate : { SBF_ARRAY_FRAME_OF_REFERENCE, SBF_ARRAY_DELTA, SBF_ARRAY_RUN_LENGTH }) {
+		if (candidate == SBF_ARRAY_RUN_LENGTH && !HasRepeats(node)) continue;
+
+		const auto candidate_size = PackedSize(node, candidate);
+
+		if (candidate_size < best_size) {
+			best = candidate;
+			best_size = candidate_size;
+		}
+	}
+
+	if (size) *size = best_size;
+	return best;
+}
+
+size_t PackedSize(const Node *node, SBF_ArrayEncoding encoding) {
+	return Node_Overhead + WithCodec(node->type, [&](auto codec) {
+		using C = decltype(codec);
+		return C::BodySize((const typename C::Element *)node->array, node->array_length, encoding);
+	});
+}
+
+template<typename Order>
+void EncodePacked(const Node *node, SBF_ArrayEncoding encoding, uint8_t *bytes, size_t *cursor) {
+	const auto out = bytes + *cursor;
+	const auto body = out + 1 + sizeof(uint64_t);
+
+	out[0] = (uint8_t)TagType::Open_Packed_Array;
+	body[0] = (uint8_t)node->type;
+	body[1] = (uint8_t)encoding;
+	Order::template Write<uint64_t>(body + 2, node->array_length);
+
+	const auto end = WithCodec(node->type, [&](auto codec) {
+		using C = decltype(codec);
+		return C::template Write<Order>(body + Body_Header_Size, (const typename C::Element *)node->array, node->array_length, encoding);
+	});
+
+	Order::template Write<uint64_t>(out + 1, (uint64_t)(end - body));
+	*end = (uint8_t)TagType::Close_Packed_Array;
+
+	*cursor += (size_t)(end - out) + 1;
+}
+
+template<typename Order>
+PackedHeader ReadPackedHeader(const uint8_t *body, size_t body_length, size_t tag_offset) {
+	if (body_length < Body_Header_Size) Malformed("body of " + std::to_string(body_length) + " bytes is too short", tag_offset);
+
+	if (body[0] > NodeType_Columns || !IsPackableType((NodeType)body[0])) Malformed("cannot decode to tag '" + std::to_string(body[0]) + "'", tag_offset);
+	const auto type = (NodeType)body[0];
+
+	if (body[1] < SBF_ARRAY_FRAME_OF_REFERENCE || body[1] > SBF_ARRAY_RUN_LENGTH) Malformed("unknown encoding " + std::to_string(body[1]), tag_offset);
+	const auto encoding = (SBF_ArrayEncoding)body[1];
+
+	const auto count = Order::template Read<uint64_t>(body + 2);
+	if (count > SIZE_MAX / ArrayElementSize(type)) Malformed(std::to_string(count) + " values do not fit in memory", tag_offset);
+
+	WithCodec(type, [&](auto codec) {
+		using C = decltype(codec);
+		C::template CheckCount<Order>(body + Body_Header_Size, body_length - Body_Header_Size, (size_t)count, encoding, tag_offset);
+	});
+
+	return { type, encoding, (size_t)count };
+}
+
+template<typename Order>
+void DecodePacked(const uint8_t *body, size_t body_length, const PackedHeader &header, void *out, size_t tag_offset) {
+	WithCodec(header.type, [&](auto codec) {
+		using C = decltype(codec);
+		C::template Read<Order>(body + Body_Header_Size, body + body_length, header.count, header.encoding, (typename C::Element *)out, tag_offset);
+	});
+}
+
+template void EncodePacked<LittleEndian>(const Node *, SBF_ArrayEncoding, uint8_t *, size_t *);
+template void EncodePacked<BigEndian>(const Node *, SBF_ArrayEncoding, uint8_t *, size_t *);
+template PackedHeader ReadPackedHeader<LittleEndian>(const uint8_t *, size_t, size_t);
+template PackedHeader ReadPackedHeader<BigEndian>(const uint8_t *, size_t, size_t);
+template void DecodePacked<LittleEndian>(const uint8_t *, size_t, const PackedHeader &, void *, size_t);
+template void DecodePacked<BigEndian>(const uint8_t *, size_t, const PackedHeader &, void *, size_t);
+
+};
+
+void SBF_NodeSet_ArrayEncoding(Node *node, SBF_ArrayEncoding encoding) {
+	if (!node) throw std::invalid_argument("node pointer argument must not be null");
+	CheckEncoding(encoding);
+
+	if (encoding != SBF_ARRAY_RAW && !SBF::IsPackableType(node->type))
+		throw std::invalid_argument("only I32A, I64A, U32A and U64A arrays can be encoded, not " + std::string(SBF::TypeName(node->type)));
+
+	node->flags = (node->flags & ~NodeFlag_Encoding) | ((uint32_t)encoding << SBF::EncodingShift);
+}
+
+SBF_ArrayEncoding SBF_NodeGet_ArrayEncoding(const Node *node) {
+	if (!node) throw std::invalid_argument("node pointer argument must not be null");
+
+	return SBF::ArrayEncoding(node);
+}
+
+size_t SBF_ArrayEncodedSize(const Node *node, SBF_ArrayEncoding encoding) {
+	if (!node) throw std::invalid_argument("node pointer argument must not be null");
+	CheckEncoding(encoding);
+
+	if (!SBF::IsArrayType(node->type)) throw std::invalid_argument("node must be an array, not " + std::string(SBF::TypeName(node->type)));
+	if (encoding == SBF_ARRAY_RAW) return RawSize(node);
+
+	if (!SBF::IsPackableType(node->type))
+		throw std::invalid_argument("only I32A, I64A, U32A and U64A arrays can be encoded, not " + std::string(SBF::TypeName(node->type)));
+
+	if (encoding != SBF_ARRAY_AUTO) return SBF::PackedSize(node, encoding);
+
+	// Resolve the encoding on a shallow copy, leaving the node's own alone.
+	auto copy = *node;
+	copy.flags = (copy.flags & ~NodeFlag_Encoding) | ((uint32_t)SBF_ARRAY_AUTO << SBF::EncodingShift);
+
+	size_t size;
+	SBF::WrittenEncoding(&copy, &size);
+	return size;
+}
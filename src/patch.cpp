@@ -0,0 +1,315 @@
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "node.h"
+
+// A patch is an ordinary node tree so that it can be serialized like any other.
+// Every patch node is a table holding at most one operation:
+//
+//   {}                                          no change
+//   { "set": <node> }                           replace the target with a copy of <node>
+//   { "delete": U8 }                            remove the target from its parent table
+//   { "table": { <key>: <patch>, ... } }        patch table entries by key;
+//                                               missing keys must carry a "set" (appended)
+//   { "splice": { "at": U64, "remove": U64, "insert": <array> } }
+//                                               replace a range of an array or string
+
+namespace {
+
+constexpr const char *Op_Set = "set";
+constexpr const char *Op_Delete = "delete";
+constexpr const char *Op_Table = "table";
+constexpr const char *Op_Splice = "splice";
+
+char *CopyKey(const char *key) {
+	auto len = std::strlen(key);
+	auto copy = (char *)malloc(len + 1);
+	std::memcpy(copy, key, len + 1);
+	return copy;
+}
+
+Node *MakeTable(const std::vector<const char *> &keys, const std::vector<Node *> &values) {
+	auto keys_arr = (char **)malloc(sizeof(char *) * keys.size());
+	auto values_arr = (Node **)malloc(sizeof(Node *) * values.size());
+
+	for (size_t x = 0; x < keys.size(); x++) {
+		keys_arr[x] = CopyKey(keys[x]);
+		values_arr[x] = values[x];
+	}
+
+	return SBF_CreateNode_Table(keys_arr, values_arr, keys.size());
+}
+
+Node *MakeOp(const char *op, Node *arg) { return MakeTable({ op }, { arg }); }
+
+Node *MakeNoop() { return SBF_CreateNode_Table(nullptr, nullptr, 0); }
+
+bool IsNoop(const Node *patch) { return patch->type == NodeType_T && patch->table_length == 0; }
+
+/// Returns true if the table has no duplicate keys, filling the index with key positions.
+bool IndexKeys(const Node *table, std::unordered_map<std::string_view, size_t> &index) {
+	index.reserve(table->table_length);
+
+	for (size_t x = 0; x < table->table_length; x++) {
+		if (!index.emplace(table->keys[x], x).second) return false;
+	}
+
+	return true;
+}
+
+Node *DiffArrays(const Node *old_node, const Node *new_node) {
+	const auto elem = SBF::ArrayElementSize(new_node->type);
+	const auto old_len = old_node->array_length;
+	const auto new_len = new_node->array_length;
+
+	auto old_bytes = (const uint8_t *)old_node->array;
+	auto new_bytes = (const uint8_t *)new_node->array;
+
+	size_t prefix = 0;
+	const auto shortest = old_len < new_len ? old_len : new_len;
+
+	while (prefix < shortest && std::memcmp(old_bytes + prefix * elem, new_bytes + prefix * elem, elem) == 0) prefix++;
+
+	if (prefix == old_len && prefix == new_len) return MakeNoop();
+
+	size_t suffix = 0;
+	while (
+		suffix < shortest - prefix &&
+		std::memcmp(
+			old_bytes + (old_len - 1 - suffix) * elem,
+			new_bytes + (new_len - 1 - suffix) * elem,
+			elem
+		) == 0
+	) suffix++;
+
+	const auto inserted = new_len - prefix - suffix;
+
+	// A splice carries three keyed entries; only worth it when it saves more than it costs.
+	const size_t splice_overhead = 64;
+	if (inserted * elem + splice_overhead >= new_len * elem) return MakeOp(Op_Set, SBF::CloneNode(new_node));
+
+	void *insert = nullptr;
+	if (inserted) {
+		auto bytes = inserted * elem;
+		insert = malloc(new_node->type == NodeType_String ? bytes + 1 : bytes);
+		std::memcpy(insert, new_bytes + prefix * elem, bytes);
+		if (new_node->type == NodeType_String) ((char *)insert)[bytes] = '\0';
+	}
+
+	auto splice = MakeTable(
+		{ "at", "remove", "insert" },
+		{
+			SBF_CreateNode_U64(prefix),
+			SBF_CreateNode_U64(old_len - prefix - suffix),
+			SBF_CreateNode_Array(new_node->type, insert, inserted)
+		}
+	);
+
+	return MakeOp(Op_Splice, splice);
+}
+
+Node *DiffTables(const Node *old_node, const Node *new_node) {
+	std::unordered_map<std::string_view, size_t> old_index, new_index;
+
+	if (!IndexKeys(old_node, old_index) || !IndexKeys(new_node, new_index))
+		return MakeOp(Op_Set, SBF::CloneNode(new_node));
+
+	// Patched tables keep the surviving entries in place and append new ones,
+	// so a reordered table cannot be expressed as per-key operations.
+	size_t expected = 0;
+	bool appending = false;
+
+	for (size_t x = 0; x < new_node->table_length; x++) {
+		auto found = old_index.find(new_node->keys[x]);
+
+		if (found == old_index.end()) {
+			appending = true;
+			continue;
+		}
+
+		while (expected < old_node->table_length && !new_index.contains(old_node->keys[expected])) expected++;
+
+		if (appending || found->second != expected) return MakeOp(Op_Set, SBF::CloneNode(new_node));
+
+		expected++;
+	}
+
+	std::vector<const char *> keys;
+	std::vector<Node *> values;
+
+	for (size_t x = 0; x < old_node->table_length; x++) {
+		if (new_index.contains(old_node->keys[x])) continue;
+
+		keys.push_back(old_node->keys[x]);
+		values.push_back(MakeOp(Op_Delete, SBF_CreateNode_U8(1)));
+	}
+
+	for (size_t x = 0; x < new_node->table_length; x++) {
+		auto found = old_index.find(new_node->keys[x]);
+
+		Node *child = found == old_index.end()
+			? MakeOp(Op_Set, SBF::CloneNode(new_node->values[x]))
+			: SBF_Diff(old_node->values[found->second], new_node->values[x]);
+
+		if (IsNoop(child)) {
+			SBF_DestroyNode(child);
+			continue;
+		}
+
+		keys.push_back(new_node->keys[x]);
+		values.push_back(child);
+	}
+
+	if (keys.empty()) return MakeNoop();
+
+	return MakeOp(Op_Table, MakeTable(keys, values));
+}
+
+const Node *FindEntry(const Node *table, const char *key) {
+	for (size_t x = 0; x < table->table_length; x++) {
+		if (std::strcmp(table->keys[x], key) == 0) return table->values[x];
+	}
+
+	return nullptr;
+}
+
+const Node *ExpectEntry(const Node *table, const char *key, NodeType type) {
+	auto entry = FindEntry(table, key);
+
+	if (!entry || entry->type != type)
+		throw std::invalid_argument(std::string("malformed patch; missing or invalid '") + key + "' entry");
+
+	return entry;
+}
+
+void ApplySplice(Node *target, const Node *splice) {
+	if (splice->type != NodeType_T) throw std::invalid_argument("malformed patch; splice must be a table");
+
+	const auto at = ExpectEntry(splice, "at", NodeType_U64)->u64;
+	const auto remove = ExpectEntry(splice, "remove", NodeType_U64)->u64;
+	const auto insert = FindEntry(splice, "insert");
+
+	if (!insert || insert->type != target->type)
+		throw std::invalid_argument("malformed patch; splice type does not match the target");
+
+	if (at > target->array_length || remove > target->array_length - at)
+		throw std::out_of_range("splice range exceeds the target array");
+
+	const auto elem = SBF::ArrayElementSize(target->type);
+	const auto tail = target->array_length - at - remove;
+	const auto new_len = target->array_length - remove + insert->array_length;
+	const auto terminator = target->type == NodeType_String ? 1 : 0;
+
+	SBF::ReserveArray(target, new_len);
+	auto bytes = (uint8_t *)target->array;
+
+	std::memmove(bytes + (at + insert->array_length) * elem, bytes + (at + remove) * elem, tail * elem);
+
+	if (insert->array_length) std::memcpy(bytes + at * elem, insert->array, insert->array_length * elem);
+
+	if (terminator) bytes[new_len] = '\0';
+
+	target->array = bytes;
+	target->array_length = new_len;
+}
+
+void ApplyTable(Node *target, const Node *entries) {
+	if (target->type != NodeType_T) throw std::invalid_argument("patch expects a table target");
+	if (entries->type != NodeType_T) throw std::invalid_argument("malformed patch; table operation must hold a table");
+
+	for (size_t e = 0; e < entries->table_length; e++) {
+		const auto key = entries->keys[e];
+		const auto child = entries->values[e];
+
+		if (child->type != NodeType_T) throw std::invalid_argument("malformed patch; entry must be a table");
+
+		const auto index = SBF::FindEntry(target, key);
+
+		const bool is_delete = child->table_length == 1 && std::strcmp(child->keys[0], Op_Delete) == 0;
+
+		if (is_delete) {
+			if (index == target->table_length) continue;
+
+			free(target->keys[index]);
+			SBF_DestroyNode(target->values[index]);
+
+			const auto tail = target->table_length - index - 1;
+			std::memmove(target->keys + index, target->keys + index + 1, tail * sizeof(char *));
+			std::memmove(target->values + index, target->values + index + 1, tail * sizeof(Node *));
+			target->table_length--;
+			continue;
+		}
+
+		if (index < target->table_length) {
+			SBF_ApplyPatch(&target->values[index], child);
+			continue;
+		}
+
+		if (child->table_length != 1 || std::strcmp(child->keys[0], Op_Set) != 0)
+			throw std::invalid_argument(std::string("patch modifies missing key '") + key + "'");
+
+		SBF::ReserveTable(target, target->table_length + 1);
+
+		// Patches append new keys, which only a sorted table whose keys are all before stays.
+		const auto length = target->table_length;
+		if (length && std::strcmp(target->keys[length - 1], key) >= 0) target->flags &= ~NodeFlag_Sorted;
+
+		target->keys[target->table_length] = CopyKey(key);
+		target->values[target->table_length] = SBF::CloneNode(child->values[0]);
+		target->table_length++;
+	}
+}
+
+};
+
+Node *SBF_Diff(const Node *old_node, const Node *new_node) {
+	if (!old_node || !new_node) throw std::invalid_argument("node arguments must not be null");
+
+	if (old_node->type != new_node->type) return MakeOp(Op_Set, SBF::CloneNode(new_node));
+
+	if (new_node->type == NodeType_T) return DiffTables(old_node, new_node);
+
+	if (SBF::IsArrayType(new_node->type)) return DiffArrays(old_node, new_node);
+
+	if (SBF::NodesEqual(old_node, new_node)) return MakeNoop();
+
+	return MakeOp(Op_Set, SBF::CloneNode(new_node));
+}
+
+void SBF_ApplyPatch(Node **node, const Node *patch) {
+	if (!node || !*node) throw std::invalid_argument("target node must not be null");
+	if (!patch) throw std::invalid_argument("patch must not be null");
+	if (patch->type != NodeType_T) throw std::invalid_argument("malformed patch; expected a table");
+
+	// Patches free the keys and nodes they replace and add heap clones, neither of which an arena table can take.
+	if ((*node)->flags & NodeFlag_Arena) throw std::invalid_argument("trees allocated in an arena cannot be patched");
+
+	if (patch->table_length == 0) return;
+	if (patch->table_length != 1) throw std::invalid_argument("malformed patch; expected a single operation");
+
+	const auto op = patch->keys[0];
+	const auto arg = patch->values[0];
+
+	if (std::strcmp(op, Op_Set) == 0) {
+		auto replacement = SBF::CloneNode(arg);
+		SBF_DestroyNode(*node);
+		*node = replacement;
+	} else if (std::strcmp(op, Op_Table) == 0) {
+		ApplyTable(*node, arg);
+	} else if (std::strcmp(op, Op_Splice) == 0) {
+		if (!SBF::IsArrayType((*node)->type)) throw std::invalid_argument("splice expects an array or string target");
+		ApplySplice(*node, arg);
+	} else if (std::strcmp(op, Op_Delete) == 0) {
+		throw std::invalid_argument("delete is only valid for table entries");
+	} else {
+		throw std::invalid_argument(std::string("unknown patch operation '") + op + "'");
+	}
+}
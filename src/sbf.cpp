@@ -1,4 +1,5 @@
 #include <filesystem>
+#include <algorithm>
 #include <fstream>
 #include <stdexcept>
 #include <stdlib.h>
@@ -9,51 +10,22 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <bit>
 
 #include "SBF/sbf.h"
 
 #include "exceptions.h"
+#include "checksum.h"
+#include "packed.h"
+#include "arena.h"
+#include "stats.h"
+#include "node.h"
 #include "tags.h"
 #include "io.h"
 
-// Memory inefficient. Needs better implementation in the future.
-typedef struct Node {
-	NodeType type;
-	
-	union {
-
-		int8_t i8;
-		uint8_t u8;
-		int32_t i32;
-		int64_t i64;
-		uint32_t u32;
-		uint64_t u64;
-		float f32;
-		double f64;
-		char c;
-
-		struct {
-			/// A non-null terminated character array.
-			char *string;
-			size_t string_length;
-		};
-
-		struct {
-			/// Array of type determinated by the type of the struct.
-			void *array;
-			size_t array_length;
-		};
-
-		struct {
-			char **keys;
-	        Node **values;
-			size_t table_length;
-		};	
-	};
-} Node;
-
 Node *SBF_CreateNode_I8(int8_t i8) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_I8;
 	node->i8 = i8;
@@ -63,6 +35,7 @@ Node *SBF_CreateNode_I8(int8_t i8) {
 
 Node *SBF_CreateNode_U8(uint8_t u8) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_U8;
 	node->u8 = u8;
@@ -72,6 +45,7 @@ Node *SBF_CreateNode_U8(uint8_t u8) {
 
 Node *SBF_CreateNode_Char(char c) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_Char;
 	node->c = c;
@@ -81,6 +55,7 @@ Node *SBF_CreateNode_Char(char c) {
 
 Node *SBF_CreateNode_I32(int32_t i32) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 	
 	node->type = NodeType_I32;
 	node->i32 = i32;
@@ -90,6 +65,7 @@ Node *SBF_CreateNode_I32(int32_t i32) {
 
 Node *SBF_CreateNode_I64(int64_t i64) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_I64;
 	node->i64 = i64;
@@ -99,6 +75,7 @@ Node *SBF_CreateNode_I64(int64_t i64) {
 
 Node *SBF_CreateNode_U32(uint32_t u32) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_U32;
 	node->u32 = u32;
@@ -108,6 +85,7 @@ Node *SBF_CreateNode_U32(uint32_t u32) {
 
 Node *SBF_CreateNode_U64(uint64_t u64) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_U64;
 	node->u64 = u64;
@@ -117,6 +95,7 @@ Node *SBF_CreateNode_U64(uint64_t u64) {
 
 Node *SBF_CreateNode_F32(float f32) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_F32;
 	node->f32 = f32;
@@ -126,6 +105,7 @@ Node *SBF_CreateNode_F32(float f32) {
 
 Node *SBF_CreateNode_F64(double f64) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_F64;
 	node->f64 = f64;
@@ -135,6 +115,7 @@ Node *SBF_CreateNode_F64(double f64) {
 
 Node *SBF_CreateNode_Array(NodeType type, void *array, size_t length) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = type;
 	node->array = array;
@@ -145,6 +126,7 @@ Node *SBF_CreateNode_Array(NodeType type, void *array, size_t length) {
 
 Node *SBF_CreateNode_String(char *str) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_String;
 	node->string = str;
@@ -155,6 +137,7 @@ Node *SBF_CreateNode_String(char *str) {
 
 Node *SBF_CreateNode_Table(char **keys, Node **values, size_t length) {
 	auto node = (Node *)malloc(sizeof(Node));
+	node->flags = 0;
 
 	node->type = NodeType_T;
 	node->keys = keys;
@@ -164,37 +147,83 @@ Node *SBF_CreateNode_Table(char **keys, Node **values, size_t length) {
 	return node;
 }
 
-void SBF_DestroyNode(Node *node) {
-	if (!node) return;
+namespace {
+
+/// Tables whose entries SBF_DestroyNode has yet to free.
+thread_local std::vector<Node *> tables_to_free;
+
+/// Frees a node that is not a table, unless it lives in an arena.
+void FreeLeaf(Node *node) {
+	if (node->flags & NodeFlag_Arena) return;
+
+	// The union members overlap, so only the ones matching the type are meaningful.
+	if (SBF::IsArrayType(node->type)) free(node->array);
 
-	if (node->array_length) free(node->array);
-	else if (node->table_length) {
-		for (auto x = 0; x < node->table_length; x++) {
+	// Columns are arrays, so a columns node is only ever one level deep.
+	if (node->type == NodeType_Columns) {
+		for (size_t x = 0; x < node->table_length; x++) {
 			free(node->keys[x]);
-			SBF_DestroyNode(node->values[x]);
+			if (node->values[x]) FreeLeaf(node->values[x]);
 		}
 
 		free(node->keys);
 		free(node->values);
-	} else if (node->string_length) {
-		free(node->string);
 	}
 
 	free(node);
 }
 
+};
+
+void SBF_DestroyNode(Node *node) {
+	if (!node) return;
+
+	// Arena nodes are released all at once with their arena.
+	if (node->flags & NodeFlag_Arena) return;
+
+	if (node->type != NodeType_T) {
+		FreeLeaf(node);
+		return;
+	}
+
+	// Only tables wait on the stack; leaves are freed as soon as they are seen.
+	auto &pending = tables_to_free;
+	const auto base = pending.size();
+
+	pending.push_back(node);
+
+	while (pending.size() > base) {
+		auto table = pending.back();
+		pending.pop_back();
+
+		for (size_t x = 0; x < table->table_length; x++) {
+			free(table->keys[x]);
+
+			auto value = table->values[x];
+			if (!value) continue;
+
+			if (value->type == NodeType_T && !(value->flags & NodeFlag_Arena)) pending.push_back(value);
+			else FreeLeaf(value);
+		}
+
+		free(table->keys);
+		free(table->values);
+		free(table);
+	}
+}
+
 
 NodeType SBF_GetNodeType(const Node *node) { return node->type; }
-int8_t SBF_NodeGet_I8(Node *node) { return node->i8; }
-uint8_t SBF_NodeGet_U8(Node *node) { return node->u8; }
-char SBF_NodeGet_Char(Node *node) { return node->c; }
-int32_t SBF_NodeGet_I32(Node *node) { return node->i32; }
-int64_t SBF_NodeGet_I64(Node *node) { return node->i64; }
-uint32_t SBF_NodeGet_U32(Node *node) { return node->u32; }
-uint64_t SBF_NodeGet_U64(Node *node) { return node->u64; }
-float SBF_NodeGet_F32(Node *node) { return node->f32; }
-double SBF_NodeGet_F64(Node *node) { return node->f64; }
-size_t SBF_NodeGet_ArrayLength(Node *node) { return node->array_length; }
+int8_t SBF_NodeGet_I8(const Node *node) { return node->i8; }
+uint8_t SBF_NodeGet_U8(const Node *node) { return node->u8; }
+char SBF_NodeGet_Char(const Node *node) { return node->c; }
+int32_t SBF_NodeGet_I32(const Node *node) { return node->i32; }
+int64_t SBF_NodeGet_I64(const Node *node) { return node->i64; }
+uint32_t SBF_NodeGet_U32(const Node *node) { return node->u32; }
+uint64_t SBF_NodeGet_U64(const Node *node) { return node->u64; }
+float SBF_NodeGet_F32(const Node *node) { return node->f32; }
+double SBF_NodeGet_F64(const Node *node) { return node->f64; }
+size_t SBF_NodeGet_ArrayLength(const Node *node) { return node->array_length; }
 int8_t *SBF_NodeGet_I8A(Node *node) { return (int8_t *)node->array; }
 uint8_t *SBF_NodeGet_U8A(Node *node) { return (uint8_t *)node->array; }
 int32_t *SBF_NodeGet_I32A(Node *node) { return (int32_t *)node->array; }
@@ -211,46 +240,105 @@ void SBF_NodeGet_Table(Node *node, char ***keys, Node ***values) {
 	*values = node->values;
 }
 
-Node *SBF_Deserialize(const uint8_t *bytes, size_t length, size_t *begin) {
-	static const char *type_names[] = {
-		"UNKNOWN", 
-
-		"I32",  "I64",  "F32",  "F64",  "I8",
-		"U32",  "U64",                  "U8",
-		"Char",
-		"I32A", "I64A", "F32A", "F64A", "I8A",
-		"U32A", "U64A",                 "U32A",
-		"String",
-		"T"
-	};
-
-	static const size_t type_sizes[] = {
-		0,
-
-		4, 8, 4, 8, 1,
-		4, 8,       1,
-		1,
-		8, 8, 8, 8, 8,
-		8, 8,       8,
-		8,
-		0
-	};
-
-	if (*begin >= length) return nullptr;
-
-	auto type_byte = bytes[*begin];
+void SBF_NodeSet_I8(Node *node, int8_t i8) { node->i8 = i8; }
+void SBF_NodeSet_U8(Node *node, uint8_t u8) { node->u8 = u8; }
+void SBF_NodeSet_Char(Node *node, char c) { node->c = c; }
+void SBF_NodeSet_I32(Node *node, int32_t i32) { node->i32 = i32; }
+void SBF_NodeSet_I64(Node *node, int64_t i64) { node->i64 = i64; }
+void SBF_NodeSet_U32(Node *node, uint32_t u32) { node->u32 = u32; }
+void SBF_NodeSet_U64(Node *node, uint64_t u64) { node->u64 = u64; }
+void SBF_NodeSet_F32(Node *node, float f32) { node->f32 = f32; }
+void SBF_NodeSet_F64(Node *node, double f64) { node->f64 = f64; }
+
+namespace {
+
+/// Entries of the tables currently being decoded on this thread.
+/// Shared by every nesting level, so a table costs no allocations until its final arrays.
+struct TableScratch {
+	std::vector<char *> keys;
+	std::vector<Node *> values;
+};
+
+thread_local TableScratch table_scratch;
+
+/// Stack of the tables the iterative decoder is inside of, shared by nested calls on this thread.
+struct OpenTable {
+	size_t tag_offset;
+	size_t first_key;
+	size_t first_value;
+	size_t table_length;
+	size_t key_bytes;
+	/// Closing tag of the table, whose keys are checked to be in order if it is a sorted one.
+	uint8_t close_tag;
+};
+
+thread_local std::vector<OpenTable> open_tables;
+
+const char *const type_names[] = {
+	"UNKNOWN", 
+
+	"I32",  "I64",  "F32",  "F64",  "I8",
+	"U32",  "U64",                  "U8",
+	"Char",
+	"I32A", "I64A", "F32A", "F64A", "I8A",
+	"U32A", "U64A",                 "U8A",
+	"String",
+	"T",
+	"Columns",
+	"Sorted T",
+	"Packed"
+};
+
+const size_t type_sizes[] = {
+	0,
+
+	4, 8, 4, 8, 1,
+	4, 8,       1,
+	1,
+	8, 8, 8, 8, 8,
+	8, 8,       8,
+	8,
+	0,
+	8,
+	0,
+	8
+};
+
+/// Depth the recursive decoder stops at when no maximum is given, to stay clear of the stack's end.
+constexpr size_t Default_Recursive_Max_Depth = 1024;
+
+/// Opening tag of a node, checked against the bytes left for it.
+struct Header {
+	uint8_t type_byte;
+	SBF::TagType type;
+	const char *type_name;
+	size_t type_size;
+	size_t array_length;
+	size_t element_size;
+	size_t tag_offset;
+};
+
+/// Reads the opening tag at *begin and moves past it; the fixed-size part and
+/// any array payload are known to fit in the buffer afterwards.
+template<typename Order>
+Header DecodeHeader(const uint8_t *bytes, size_t length, size_t *begin) {
+	Header header;
+
+	if (!bytes[*begin]) *begin = SBF::SkipPadding(bytes, length, *begin);
+
+	header.type_byte = bytes[*begin];
 	
-	if (type_byte < 1 || type_byte > 19) 
-		throw SBF::SerdeException(std::string("invalid tag '") + std::to_string(type_byte) + "'");
-
-	auto type = static_cast<SBF::TagType>(type_byte);
+	if (header.type_byte < 1 || header.type_byte > (uint8_t)SBF::TagType::Open_Packed_Array) 
+		throw SBF::SerdeException(std::string("invalid tag '") + std::to_string(header.type_byte) + "'");
 
-	const auto type_name = type_names[static_cast<int>(type)];
-	const auto type_size = type_sizes[static_cast<int>(type)];
+	header.type = static_cast<SBF::TagType>(header.type_byte);
+	header.type_name = type_names[header.type_byte];
+	header.type_size = type_sizes[header.type_byte];
+	header.tag_offset = *begin;
 
 	*begin = *begin + 1;
 
-	auto expected_length = type_size + 1;
+	auto expected_length = header.type_size + 1;
 	
 	if (length - *begin < expected_length) 
 		throw SBF::DeserException(
@@ -258,295 +346,667 @@ Node *SBF_Deserialize(const uint8_t *bytes, size_t length, size_t *begin) {
 				+ std::to_string(expected_length)
 				+ " bytes, but got "
 				+ std::to_string(length - *begin), 
-			type_name, 
+			header.type_name, 
 			*begin
 		);
 
-	size_t array_length = 0; // if is array
-	if (type_byte > 9 && type_byte < 19) array_length = SBF::Read<uint64_t>(bytes + *begin);
+	header.array_length = 0; // if is array
+	header.element_size = 0;
+	if (header.type_byte > 9 && header.type_byte < 19) {
+		header.array_length = Order::template Read<uint64_t>(bytes + *begin);
+		header.element_size = type_sizes[header.type_byte - 9];
+	} else if (header.type == SBF::TagType::Open_Packed_Array) {
+		// Encoded arrays are checked as the bytes of their body.
+		header.array_length = Order::template Read<uint64_t>(bytes + *begin);
+		header.element_size = 1;
+	}
 
-	expected_length = type_size + 1 + (array_length * type_sizes[static_cast<int>(type) - 9]);
-	// Make sure bytes fit the array.
-	if (length - *begin < expected_length) 
+	// Make sure bytes fit the array; a hostile length must not wrap the multiplication around.
+	if (header.element_size && header.array_length > (length - *begin - expected_length) / header.element_size)
 		throw SBF::DeserException(
-			std::string("bytes array too small; expected at least ")
-				+ std::to_string(expected_length)
-				+ " bytes, but got "
-				+ std::to_string(length - *begin),
-			type_name, 
+			std::string("array length ")
+				+ std::to_string(header.array_length)
+				+ " exceeds the remaining "
+				+ std::to_string(length - *begin)
+				+ " bytes",
+			header.type_name,
 			*begin
 		);
-	
-	Node *node = nullptr;
 
-	switch (type) {
-	case SBF::TagType::Open_I32:
-		node = SBF_CreateNode_I32(SBF::Read<int32_t>(bytes + *begin)); break;
+	return header;
+}
 
-	case SBF::TagType::Open_I64:
-		node = SBF_CreateNode_I32(SBF::Read<int64_t>(bytes + *begin)); break;
+template<typename Order, typename T, typename Allocator>
+inline Node *DecodeScalar(Allocator &allocator, NodeType type, const uint8_t *bytes) {
+	auto node = allocator.NewNode();
+	node->type = type;
 
-	case SBF::TagType::Open_F32:
-		node = SBF_CreateNode_F32(SBF::Read<float>(bytes + *begin)); break;
+	T value = Order::template Read<T>(bytes);
+	std::memcpy(&node->u64, &value, sizeof(T));
 
-	case SBF::TagType::Open_F64:
-		node = SBF_CreateNode_F64(SBF::Read<double>(bytes + *begin)); break;
+	return node;
+}
 
-	case SBF::TagType::Open_I8:
-		node = SBF_CreateNode_I8(SBF::Read<int8_t>(bytes + *begin)); break;
+template<typename Order, typename T, typename Allocator>
+inline Node *DecodeArray(Allocator &allocator, NodeType type, const uint8_t *bytes, size_t array_length, size_t offset) {
+	SBF::Stats::ArraySpan span(type, offset, 9 + sizeof(T) * array_length);
 
-	case SBF::TagType::Open_U32:
-		node = SBF_CreateNode_U32(SBF::Read<uint32_t>(bytes + *begin)); break;
+	auto node = allocator.NewNode();
+	node->type = type;
+	node->array = nullptr;
+	node->array_length = array_length;
 
-	case SBF::TagType::Open_U64:
-		node = SBF_CreateNode_U64(SBF::Read<uint64_t>(bytes + *begin)); break;
+	if (array_length) {
+		auto array = (T *)allocator.Allocate(sizeof(T) * array_length);
+		Order::template CopyArray<T>(array, bytes, array_length);
 
-	case SBF::TagType::Open_U8:
-		node = SBF_CreateNode_U8(SBF::Read<uint8_t>(bytes + *begin)); break;
-	
-	case SBF::TagType::Open_Char:
-		node = SBF_CreateNode_Char((char)SBF::Read<uint8_t>(bytes + *begin)); break;
-	
-	case SBF::TagType::Open_I32_Array:
-		if (!length) {
-			node = SBF_CreateNode_Array(NodeType_I32A, nullptr, 0);
-		} else {
-			auto array = (int32_t *)malloc(sizeof(int32_t) * array_length);
-			for (auto x = 0; x < array_length; x++) {
-				array[x] = SBF::Read<int32_t>(bytes + *begin + 8 + x*type_sizes[static_cast<int>(type) - 9]);
-			}
+		node->array = array;
+	}
 
-			node = SBF_CreateNode_Array(NodeType_I32A, array, array_length);
-		}
-		break;
+	return node;
+}
 
+/// Decodes an encoded array from its body, into a node of the type it decodes to.
+template<typename Order, typename Allocator>
+inline Node *DecodePackedArray(Allocator &allocator, const uint8_t *body, size_t body_length, size_t offset) {
+	const auto header = SBF::ReadPackedHeader<Order>(body, body_length, offset);
 
-	case SBF::TagType::Open_I64_Array:
-		if (!length) {
-			node = SBF_CreateNode_Array(NodeType_I64A, nullptr, 0);
-		} else {
-			auto array = (int64_t *)malloc(sizeof(int64_t) * array_length);
-			for (auto x = 0; x < array_length; x++) {
-				array[x] = SBF::Read<int64_t>(bytes + *begin + 8 + x*type_sizes[static_cast<int>(type) - 9]);
-			}
+	SBF::Stats::ArraySpan span(header.type, offset, 9 + body_length);
 
-			node = SBF_CreateNode_Array(NodeType_I64A, array, array_length);
-		}
-		break;
+	auto node = allocator.NewNode();
+	node->type = header.type;
+	node->flags |= (uint32_t)header.encoding << SBF::EncodingShift;
+	node->array = nullptr;
+	node->array_length = header.count;
 
-	case SBF::TagType::Open_F32_Array:
-		if (!length) {
-			node = SBF_CreateNode_Array(NodeType_F32A, nullptr, 0);
-		} else {
-			auto array = (float *) malloc(sizeof(float) * array_length);
-			for (auto x = 0; x < array_length; x++) {
-				array[x] = SBF::Read<float>(bytes + *begin + 8 + x*type_sizes[static_cast<int>(type) - 9]);
-			}
+	if (header.count) {
+		node->array = allocator.Allocate(SBF::ArrayElementSize(header.type) * header.count);
 
-			node = SBF_CreateNode_Array(NodeType_F32A, array, array_length);
+		try {
+			SBF::DecodePacked<Order>(body, body_length, header, node->array, offset);
+		} catch (...) {
+			allocator.Destroy(node);
+			throw;
 		}
-		break;
+	}
 
-	case SBF::TagType::Open_F64_Array:
-		if (!length) {
-			node = SBF_CreateNode_Array(NodeType_F64A, nullptr, 0);
-		} else {
-			auto array = (double *)malloc(sizeof(double) * array_length);
-			for (auto x = 0; x < array_length; x++) {
-				array[x] = SBF::Read<double>(bytes + *begin + 8 + x*type_sizes[static_cast<int>(type) - 9]);
-			}
+	return node;
+}
 
-			node = SBF_CreateNode_Array(NodeType_F64A, array, array_length);
-		}
-		break;
+/// Decodes the payload of any node but a table; *begin is past the opening tag.
+template<typename Order, typename Allocator>
+Node *DecodeLeaf(Allocator &allocator, const Header &header, const uint8_t *bytes, size_t begin) {
+	const auto data = bytes + begin;
+	const auto array_data = data + 8;
+	const auto array_length = header.array_length;
+	const auto tag_offset = header.tag_offset;
+
+	switch (header.type) {
+	case SBF::TagType::Open_I32: return DecodeScalar<Order, int32_t>(allocator, NodeType_I32, data);
+	case SBF::TagType::Open_I64: return DecodeScalar<Order, int64_t>(allocator, NodeType_I64, data);
+	case SBF::TagType::Open_F32: return DecodeScalar<Order, float>(allocator, NodeType_F32, data);
+	case SBF::TagType::Open_F64: return DecodeScalar<Order, double>(allocator, NodeType_F64, data);
+	case SBF::TagType::Open_I8: return DecodeScalar<Order, int8_t>(allocator, NodeType_I8, data);
+	case SBF::TagType::Open_U32: return DecodeScalar<Order, uint32_t>(allocator, NodeType_U32, data);
+	case SBF::TagType::Open_U64: return DecodeScalar<Order, uint64_t>(allocator, NodeType_U64, data);
+	case SBF::TagType::Open_U8: return DecodeScalar<Order, uint8_t>(allocator, NodeType_U8, data);
+	case SBF::TagType::Open_Char: return DecodeScalar<Order, uint8_t>(allocator, NodeType_Char, data);
+
+	case SBF::TagType::Open_I32_Array: return DecodeArray<Order, int32_t>(allocator, NodeType_I32A, array_data, array_length, tag_offset);
+	case SBF::TagType::Open_I64_Array: return DecodeArray<Order, int64_t>(allocator, NodeType_I64A, array_data, array_length, tag_offset);
+	case SBF::TagType::Open_F32_Array: return DecodeArray<Order, float>(allocator, NodeType_F32A, array_data, array_length, tag_offset);
+	case SBF::TagType::Open_F64_Array: return DecodeArray<Order, double>(allocator, NodeType_F64A, array_data, array_length, tag_offset);
+	case SBF::TagType::Open_I8_Array: return DecodeArray<Order, int8_t>(allocator, NodeType_I8A, array_data, array_length, tag_offset);
+	case SBF::TagType::Open_U32_Array: return DecodeArray<Order, uint32_t>(allocator, NodeType_U32A, array_data, array_length, tag_offset);
+	case SBF::TagType::Open_U64_Array: return DecodeArray<Order, uint64_t>(allocator, NodeType_U64A, array_data, array_length, tag_offset);
+	case SBF::TagType::Open_U8_Array: return DecodeArray<Order, uint8_t>(allocator, NodeType_U8A, array_data, array_length, tag_offset);
 
-	case SBF::TagType::Open_I8_Array:
-		if (!length) {
-			node = SBF_CreateNode_Array(NodeType_I8A, nullptr, 0);
-		} else {
-			auto array = (int8_t *)malloc(sizeof(int8_t) * array_length);
-			for (auto x = 0; x < array_length; x++) {
-				array[x] = SBF::Read<int8_t>(bytes + *begin + 8 + x*type_sizes[static_cast<int>(type) - 9]);
-			}
+	case SBF::TagType::Open_String:
+		{
+			SBF::Stats::ArraySpan span(NodeType_String, tag_offset, 9 + array_length);
 
-			node = SBF_CreateNode_Array(NodeType_I8A, array, array_length);
-		}
-		break;
+			auto array = (char *)allocator.Allocate(sizeof(char) * array_length + 1);
+			std::memcpy(array, array_data, array_length);
+			array[array_length] = '\0';
 
-	case SBF::TagType::Open_U32_Array:
-		if (!length) {
-			node = SBF_CreateNode_Array(NodeType_U32A, nullptr, 0);
-		} else {
-			auto array = (uint32_t *)malloc(sizeof(uint32_t) * array_length);
-			for (auto x = 0; x < array_length; x++) {
-				array[x] = SBF::Read<uint32_t>(bytes + *begin + 8 + x*type_sizes[static_cast<int>(type) - 9]);
-			}
+			auto node = allocator.NewNode();
+			node->type = NodeType_String;
+			node->string = array;
+			node->string_length = array_length;
 
-			node = SBF_CreateNode_Array(NodeType_U32A, array, array_length);
+			return node;
 		}
-		break;
 
-	case SBF::TagType::Open_U64_Array:
-		if (!length) {
-			node = SBF_CreateNode_Array(NodeType_U64A, nullptr, 0);
-		} else {
-			auto array = (uint64_t *)malloc(sizeof(uint64_t) * array_length);
-			for (auto x = 0; x < array_length; x++) {
-				array[x] = SBF::Read<uint64_t>(bytes + *begin + 8 + x*type_sizes[static_cast<int>(type) - 9]);
-			}
+	case SBF::TagType::Open_Packed_Array: return DecodePackedArray<Order>(allocator, array_data, array_length, tag_offset);
 
-			node = SBF_CreateNode_Array(NodeType_U64A, array, array_length);
-		}
-		break;
+	default: throw SBF::SerdeException(std::string("unknown tag '")+std::to_string(header.type_byte)+"'");
+	}
+}
 
-	case SBF::TagType::Open_U8_Array:
-		if (!length) {
-			node = SBF_CreateNode_Array(NodeType_U8A, nullptr, 0);
-		} else {
-			auto array = (uint8_t *)malloc(sizeof(uint8_t) * array_length);
-			for (auto x = 0; x < array_length; x++) {
-				array[x] = SBF::Read<uint8_t>(bytes + *begin + 8 + x*type_sizes[static_cast<int>(type) - 9]);
-			}
+/// Checks and moves past the closing tag of node; destroys node if it does not match.
+template<typename Allocator>
+void DecodeClosingTag(Allocator &allocator, const Header &header, Node *node, const uint8_t *bytes, size_t length, size_t *begin) {
+	if (*begin >= length) {
+		allocator.Destroy(node);
+		throw SBF::DeserException("bytes array too small", header.type_name, *begin);
+	}
 
-			node = SBF_CreateNode_Array(NodeType_U8A, array, array_length);
-		}
-		break;
+	auto closing_byte = bytes[*begin];
 
+	if ((uint8_t)(closing_byte * -1) != header.type_byte) {
+		allocator.Destroy(node);
 
-	case SBF::TagType::Open_String:
-		if (!length) {
-			node = SBF_CreateNode_Array(NodeType_String, nullptr, 0);
-		} else {
-			auto array = (char *)malloc(sizeof(char) * array_length + 1);
-			std::memcpy(array, bytes + *begin + 8, array_length);
-			array[array_length] = '\0';
-			node = SBF_CreateNode_Array(NodeType_String, array, array_length);
+		// The byte found may not close any type at all.
+		const auto closed_byte = (uint8_t)(closing_byte * -1);
+		const auto closed_name = closed_byte >= 1 && closed_byte <= (uint8_t)SBF::TagType::Open_Packed_Array
+			? std::string(type_names[closed_byte])
+			: "byte " + std::to_string(closing_byte);
+
+		throw SBF::DeserException(
+			std::string("closing tag mismatch; expected ") 
+				+ header.type_name
+				+ ", but got "
+				+ closed_name, 
+			header.type_name, 
+			*begin
+		);
+	}
+
+	*begin = *begin + 1;
+}
+
+/// Decodes a leaf node, from its opening tag up to and including its closing tag.
+template<typename Order, typename Allocator>
+Node *DecodeLeafNode(Allocator &allocator, const Header &header, const uint8_t *bytes, size_t length, size_t *begin) {
+	auto node = DecodeLeaf<Order>(allocator, header, bytes, *begin);
+
+	// If it's a table then type_size = 0 and array_length = 0!;
+	*begin += header.type_size + (header.array_length * header.element_size);
+
+	DecodeClosingTag(allocator, header, node, bytes, length, begin);
+
+	SBF::Stats::CountNode(node->type, SBF::IsArrayType(node->type) ? header.array_length * header.element_size : header.type_size);
+
+	return node;
+}
+
+/// Decodes the key of table entry #entry at *begin into the scratch keys.
+/// Keys are only needed as C strings, so they are copied straight out of the buffer.
+template<typename Order, typename Allocator>
+size_t DecodeKey(Allocator &allocator, const uint8_t *bytes, size_t length, size_t *begin, size_t entry) {
+	if (static_cast<SBF::TagType>(bytes[*begin]) != SBF::TagType::Open_String) {
+		throw SBF::DeserException("table entry must be String", type_names[(int)SBF::TagType::Open_Table], *begin);
+	}
+
+	if (length - *begin < 10) {
+		throw SBF::DeserException("failed to deserialize table key #" + std::to_string(entry) + ": bytes array too small", type_names[(int)SBF::TagType::Open_Table], *begin);
+	}
+
+	const auto key_length = Order::template Read<uint64_t>(bytes + *begin + 1);
+
+	if (key_length > length - *begin - 10 || bytes[*begin + 9 + key_length] != (uint8_t)SBF::TagType::Close_String) {
+		throw SBF::DeserException("failed to deserialize table key #" + std::to_string(entry) + ": malformed String", type_names[(int)SBF::TagType::Open_Table], *begin);
+	}
+
+	auto key_chars = (char *)allocator.Allocate(key_length + 1);
+	std::memcpy(key_chars, bytes + *begin + 9, key_length);
+	key_chars[key_length] = '\0';
+
+	table_scratch.keys.push_back(key_chars);
+
+	*begin += 10 + key_length;
+
+	return key_length;
+}
+
+/// Checks that the key of entry #entry of a sorted table, the last scratch key, comes after the one before it.
+void ExpectSortedKey(size_t entry, size_t offset) {
+	if (!entry) return;
+
+	const auto &keys = table_scratch.keys;
+	if (std::strcmp(keys[keys.size() - 2], keys.back()) < 0) return;
+
+	throw SBF::DeserException(
+		"key #" + std::to_string(entry) + " of a sorted table is not after the one before it",
+		type_names[(int)SBF::TagType::Open_Sorted_Table],
+		offset
+	);
+}
+
+/// Whether the opening tag is the one of a table, sorted or not.
+inline bool IsTable(SBF::TagType type) {
+	return type == SBF::TagType::Open_Table || type == SBF::TagType::Open_Sorted_Table;
+}
+
+/// Moves the last table_length scratch entries into a new table (or columns) node.
+template<typename Allocator>
+Node *BuildTable(Allocator &allocator, NodeType type, size_t first_key, size_t first_value, size_t table_length) {
+	auto &scratch = table_scratch;
+
+	char **keys = nullptr;
+	Node **values = nullptr;
+
+	if (table_length) {
+		keys = (char **)allocator.Allocate(sizeof(char *) * table_length);
+		values = (Node **)allocator.Allocate(sizeof(Node *) * table_length);
+
+		std::memcpy(keys, scratch.keys.data() + first_key, sizeof(char *) * table_length);
+		std::memcpy(values, scratch.values.data() + first_value, sizeof(Node *) * table_length);
+
+		scratch.keys.resize(first_key);
+		scratch.values.resize(first_value);
+	}
+
+	auto node = allocator.NewNode();
+	node->type = type;
+	node->keys = keys;
+	node->values = values;
+	node->table_length = table_length;
+
+	return node;
+}
+
+/// Releases the scratch entries from first_key and first_value on.
+template<typename Allocator>
+void DiscardScratch(Allocator &allocator, size_t first_key, size_t first_value) {
+	auto &scratch = table_scratch;
+
+	for (auto x = first_key; x < scratch.keys.size(); x++) allocator.Free(scratch.keys[x]);
+	for (auto x = first_value; x < scratch.values.size(); x++) allocator.Destroy(scratch.values[x]);
+
+	scratch.keys.resize(first_key);
+	scratch.values.resize(first_value);
+}
+
+/// Decodes a columns node, from its opening tag up to and including its closing tag.
+/// Every column is checked to hold the rows announced in the header.
+template<typename Order, typename Allocator>
+Node *DecodeColumns(Allocator &allocator, const Header &header, const uint8_t *bytes, size_t length, size_t *begin) {
+	const auto rows = Order::template Read<uint64_t>(bytes + *begin);
+	*begin += header.type_size;
+
+	auto &scratch = table_scratch;
+	const auto first_key = scratch.keys.size();
+	const auto first_value = scratch.values.size();
+
+	size_t count = 0;
+	size_t key_bytes = 0;
+
+	try {
+		while (true) {
+			if (*begin >= length) throw SBF::DeserException("bytes array too small", header.type_name, *begin);
+
+			if (static_cast<SBF::TagType>(bytes[*begin]) == SBF::TagType::Close_Columns) break;
+
+			key_bytes += DecodeKey<Order>(allocator, bytes, length, begin, count);
+
+			if (*begin >= length) throw SBF::DeserException("missing column #" + std::to_string(count), header.type_name, *begin);
+
+			const auto column_offset = *begin;
+			const auto column_header = DecodeHeader<Order>(bytes, length, begin);
+
+			if (!SBF::IsArrayTag(column_header.type_byte))
+				throw SBF::DeserException("column #" + std::to_string(count) + " must be an array", header.type_name, column_offset);
+
+			auto column = DecodeLeafNode<Order>(allocator, column_header, bytes, length, begin);
+			scratch.values.push_back(column);
+
+			if (column->type == NodeType_String && column->string_length && column->string[column->string_length - 1] != '\0')
+				throw SBF::DeserException("string column #" + std::to_string(count) + " does not end with a null character", header.type_name, column_offset);
+
+			if (SBF::ColumnRows(column) != rows)
+				throw SBF::DeserException(
+					"column #" + std::to_string(count) + " holds " + std::to_string(SBF::ColumnRows(column))
+						+ " rows, but the header announces " + std::to_string(rows),
+					header.type_name,
+					column_offset
+				);
+
+			count++;
 		}
-		break;
 
-	case SBF::TagType::Open_Table:
-		{
-			if (*begin >= length)
-				throw SBF::DeserException("bytes array too small", type_name, *begin);
+		if (rows && !count) throw SBF::DeserException("rows without any column", header.type_name, *begin);
+	} catch (...) {
+		DiscardScratch(allocator, first_key, first_value);
+		throw;
+	}
 
-			std::vector<char *> keys_vec;
-			std::vector<Node *> values_vec;
+	auto node = BuildTable(allocator, NodeType_Columns, first_key, first_value, count);
 
-			const auto cleanup = [&keys_vec, &values_vec]() {
-				for (auto key : keys_vec) free(key);
-				for (auto node : values_vec) SBF_DestroyNode(node);
-			};
+	DecodeClosingTag(allocator, header, node, bytes, length, begin);
 
-			size_t table_length = 0;
+	SBF::Stats::CountNode(NodeType_Columns, key_bytes);
 
-			while (true) {
-				if (static_cast<SBF::TagType>(bytes[*begin]) == SBF::TagType::Close_Table) break;
+	return node;
+}
 
-				// Deserialize key
+[[noreturn]] void ThrowDepthExceeded(size_t max_depth, size_t offset) {
+	throw SBF::DeserException("nesting exceeds the maximum depth of " + std::to_string(max_depth), type_names[(int)SBF::TagType::Open_Table], offset);
+}
 
-				auto key_byte = static_cast<int8_t>(bytes[*begin]);
+/// Reference decoder, recursing into table values.
+template<typename Order, typename Allocator>
+Node *DecodeRecursive(const uint8_t *bytes, size_t length, size_t *begin, Allocator &allocator, size_t depth, size_t max_depth) {
+	if (*begin >= length) return nullptr;
 
-				if (static_cast<SBF::TagType>(key_byte) != SBF::TagType::Open_String) {
-					cleanup();
-					throw SBF::DeserException("table entry must be String", type_name, *begin);
-				}
+	if (depth > max_depth) ThrowDepthExceeded(max_depth, *begin);
 
-				Node * key_node = nullptr;
-				try {
-					key_node = SBF_Deserialize(bytes, length, begin);
-				} catch (SBF::SerdeException &se) {
-					cleanup();
-					throw SBF::DeserException(
-						std::string("failed to deserialize table key #") 
-							+ std::to_string(table_length) + ": " 
-							+ se.what(), 
-						type_name, 
-						*begin
-					);
-				}
+	SBF::Stats::DecodeScope scope;
 
-				auto key_chars = (char *)malloc(key_node->string_length + 1);
-				std::memcpy(key_chars, key_node->string, key_node->string_length);
-				key_chars[key_node->string_length] = '\0';
+	const auto header = DecodeHeader<Order>(bytes, length, begin);
 
-				keys_vec.push_back(key_chars);
+	if (header.type == SBF::TagType::Open_Columns) return DecodeColumns<Order>(allocator, header, bytes, length, begin);
+	if (!IsTable(header.type)) return DecodeLeafNode<Order>(allocator, header, bytes, length, begin);
 
-				SBF_DestroyNode(key_node);
+	const bool sorted = header.type == SBF::TagType::Open_Sorted_Table;
+	const auto close_tag = (uint8_t)-header.type_byte;
+
+	Node *node = nullptr;
+	size_t key_bytes = 0;
+
+	{
+		SBF::Stats::TableSpan span(header.tag_offset, begin);
+
+		auto &scratch = table_scratch;
+		// The enclosing table may hold one more key than values at this point.
+		const auto first_key = scratch.keys.size();
+		const auto first_value = scratch.values.size();
+
+		size_t table_length = 0;
+
+		try {
+			while (true) {
+				if (*begin >= length) throw SBF::DeserException("bytes array too small", header.type_name, *begin);
+
+				if (bytes[*begin] == close_tag) break;
+
+				const auto key_offset = *begin;
+				key_bytes += DecodeKey<Order>(allocator, bytes, length, begin, table_length);
+
+				if (sorted) ExpectSortedKey(table_length, key_offset);
 
-				// Deserialize value
-				
 				Node *value_node = nullptr;
 
 				try {
-					value_node = SBF_Deserialize(bytes, length, begin);
+					value_node = DecodeRecursive<Order>(bytes, length, begin, allocator, depth + 1, max_depth);
 				} catch (SBF::SerdeException &se) {
-					cleanup();
 					throw SBF::DeserException(
 						std::string("failed to deserialize table value #") 
 							+ std::to_string(table_length) 
 							+ ": " 
 							+ se.what(), 
-						type_name, 
+						header.type_name, 
 						*begin
 					);
 				}
+
+				if (!value_node) throw SBF::DeserException("missing value of table entry #" + std::to_string(table_length), header.type_name, *begin);
 				
-				values_vec.push_back(value_node);
+				scratch.values.push_back(value_node);
 
 				table_length++;
 			}
+		} catch (...) {
+			DiscardScratch(allocator, first_key, first_value);
+			throw;
+		}
+
+		node = BuildTable(allocator, NodeType_T, first_key, first_value, table_length);
+		if (sorted) node->flags |= NodeFlag_Sorted;
+	}
+
+	DecodeClosingTag(allocator, header, node, bytes, length, begin);
+
+	SBF::Stats::CountNode(NodeType_T, key_bytes);
+
+	return node;
+}
+
+/// Decoder keeping the tables it is inside of on an explicit stack instead of the call stack.
+template<typename Order, typename Allocator>
+Node *DecodeIterative(const uint8_t *bytes, size_t length, size_t *begin, Allocator &allocator, size_t max_depth) {
+	if (*begin >= length) return nullptr;
+
+	SBF::Stats::DecodeScope scope;
+
+	auto &scratch = table_scratch;
+	auto &stack = open_tables;
+
+	// Hooks may decode from within this call, so only the stack above base is ours.
+	const auto base = stack.size();
+	const auto base_key = scratch.keys.size();
+	const auto base_value = scratch.values.size();
+
+	try {
+		while (true) {
+			// Decode the value at *begin: the root, or the value of the last key read.
+
+			if (*begin >= length) {
+				throw SBF::DeserException(
+					"missing value of table entry #" + std::to_string(stack.back().table_length),
+					type_names[(int)SBF::TagType::Open_Table],
+					*begin
+				);
+			}
+
+			const auto depth = stack.size() - base + 1;
+			if (depth > max_depth) ThrowDepthExceeded(max_depth, *begin);
+
+			SBF::Stats::ReachDepth((uint32_t)depth);
+
+			const auto header = DecodeHeader<Order>(bytes, length, begin);
+
+			Node *node = nullptr;
+
+			if (IsTable(header.type)) {
+				SBF::Stats::EnterTable(header.tag_offset);
+				stack.push_back({ header.tag_offset, scratch.keys.size(), scratch.values.size(), 0, 0, (uint8_t)-header.type_byte });
+			} else if (header.type == SBF::TagType::Open_Columns) {
+				node = DecodeColumns<Order>(allocator, header, bytes, length, begin);
+			} else {
+				node = DecodeLeafNode<Order>(allocator, header, bytes, length, begin);
+			}
+
+			// Close every table that ends here, and read the key of the next entry.
+
+			while (true) {
+				if (node) {
+					if (stack.size() == base) return node;
+
+					scratch.values.push_back(node);
+					stack.back().table_length++;
+					node = nullptr;
+				}
+
+				auto &table = stack.back();
+
+				if (*begin >= length) throw SBF::DeserException("bytes array too small", type_names[(int)SBF::TagType::Open_Table], *begin);
+
+				if (bytes[*begin] != table.close_tag) {
+					const auto key_offset = *begin;
+					table.key_bytes += DecodeKey<Order>(allocator, bytes, length, begin, table.table_length);
+
+					if (table.close_tag == (uint8_t)SBF::TagType::Close_Sorted_Table) ExpectSortedKey(table.table_length, key_offset);
+					break;
+				}
 
-			char **keys = (char **)malloc(sizeof(char *) * keys_vec.size());
-			Node **values = (Node **)malloc(sizeof(Node *) * values_vec.size());
+				const auto closed = table;
 
-			std::memcpy(keys, keys_vec.data(), sizeof(char *) * keys_vec.size());
-			std::memcpy(values, values_vec.data(), sizeof(Node *) * values_vec.size());
+				node = BuildTable(allocator, NodeType_T, closed.first_key, closed.first_value, closed.table_length);
+				if (closed.close_tag == (uint8_t)SBF::TagType::Close_Sorted_Table) node->flags |= NodeFlag_Sorted;
+				stack.pop_back();
 
-			node = SBF_CreateNode_Table(keys, values, table_length);
+				*begin = *begin + 1;
+
+				SBF::Stats::LeaveTable(closed.tag_offset, *begin - 1 - closed.tag_offset);
+				SBF::Stats::CountNode(NodeType_T, closed.key_bytes);
+			}
+		}
+	} catch (...) {
+		// Tables still open are reported as done, so every trace begin has its end.
+		for (auto x = stack.size(); x > base; x--) {
+			SBF::Stats::LeaveTable(stack[x - 1].tag_offset, *begin - stack[x - 1].tag_offset);
 		}
-		break;
 
-	default: throw SBF::SerdeException(std::string("unknown tag '")+std::to_string(type_byte)+"'");
+		stack.resize(base);
+		DiscardScratch(allocator, base_key, base_value);
+		throw;
 	}
-	
-	// If it's a table then type_size = 0 and array_length = 0!;
-	*begin += type_size + (array_length * type_sizes[static_cast<int>(type) - 9]);
+}
 
-	if (*begin >= length)
-		throw SBF::DeserException("bytes array too small", type_name, *begin);
+template<typename Order, typename Allocator>
+Node *DecodeIn(const uint8_t *bytes, size_t length, size_t *begin, Allocator &allocator, const SBF_DecodeOptions *options) {
+	if (options && (options->flags & SBF_DECODE_RECURSIVE)) {
+		const auto max_depth = options->max_depth ? options->max_depth : Default_Recursive_Max_Depth;
+		return DecodeRecursive<Order>(bytes, length, begin, allocator, 1, max_depth);
+	}
 
-	auto closing_byte = bytes[*begin];
+	const auto max_depth = options && options->max_depth ? options->max_depth : SIZE_MAX;
+	return DecodeIterative<Order>(bytes, length, begin, allocator, max_depth);
+}
 
-	if ((uint8_t)(closing_byte * -1) != type_byte)
-		throw SBF::DeserException(
-			std::string("closing tag mismatch; expected ") 
-				+ type_name
-				+ ", but got "
-				+ type_names[(uint8_t)(closing_byte * -1)], 
-			type_name, 
-			*begin
-		);
+/// The decoder is compiled for each byte order, so neither pays for checking which one it reads.
+template<typename Allocator>
+Node *Decode(const uint8_t *bytes, size_t length, size_t *begin, Allocator &allocator, const SBF_DecodeOptions *options) {
+	if (options && (options->flags & SBF_DECODE_BIG_ENDIAN)) return DecodeIn<SBF::BigEndian>(bytes, length, begin, allocator, options);
 
-	*begin = *begin + 1;
+	return DecodeIn<SBF::LittleEndian>(bytes, length, begin, allocator, options);
+}
+
+};
 
-	return std::move(node);
+Node *SBF_Deserialize(const uint8_t *bytes, size_t length, size_t *begin) {
+	SBF::HeapAllocator allocator;
+	return Decode(bytes, length, begin, allocator, nullptr);
 }
 
-void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *cursor) {
-	if (!node) throw std::invalid_argument("node was null");
+Node *SBF_DeserializeEx(const uint8_t *bytes, size_t length, size_t *begin, const SBF_DecodeOptions *options) {
+	if (options && options->arena) {
+		SBF::ArenaAllocator allocator = { options->arena->cursor };
+		return Decode(bytes, length, begin, allocator, options);
+	}
+
+	SBF::HeapAllocator allocator;
+	return Decode(bytes, length, begin, allocator, options);
+}
+
+namespace SBF {
+
+const char *TypeName(NodeType type) {
+	return type >= NodeType_I32 && type <= NodeType_Columns ? type_names[type] : type_names[0];
+}
+
+size_t CheckAlignment(uint32_t alignment) {
+	if (alignment && (alignment > MaxArrayAlignment || !std::has_single_bit(alignment)))
+		throw std::invalid_argument("array alignment " + std::to_string(alignment) + " is not 0 or a power of two up to " + std::to_string(MaxArrayAlignment));
+
+	return alignment;
+}
+
+size_t SkipPadding(const uint8_t *bytes, size_t length, size_t offset) {
+	const auto start = offset;
 
-	auto size = SBF_CalculateSize(node);
+	while (offset < length && !bytes[offset]) {
+		if (++offset - start == MaxArrayAlignment) throw DeserException("padding longer than " + std::to_string(MaxArrayAlignment - 1) + " bytes", "Padding", start);
+	}
+
+	if (offset == length) throw DeserException("bytes array too small", "Padding", offset);
+
+	if (bytes[offset] < (uint8_t)TagType::Open_I32_Array || bytes[offset] > (uint8_t)TagType::Open_U8_Array)
+		throw DeserException("padding before a node other than an array", "Padding", offset);
+
+	return offset;
+}
+
+Node *DeserializeInArena(const uint8_t *bytes, size_t length, size_t *begin, ArenaCursor &cursor, const SBF_DecodeOptions *options) {
+	ArenaAllocator allocator = { cursor };
+	return Decode(bytes, length, begin, allocator, options);
+}
+
+};
+
+namespace {
+
+/// A table being walked by the encoder, size calculation or destruction, and its next entry.
+struct TableWalk {
+	const Node *table;
+	size_t next;
+	/// Where the canonical order of the table's entries starts in canonical_order, when encoding canonically.
+	size_t order;
+};
+
+/// Stack of the tables walked on this thread, in place of the call stack.
+/// Calls only use the part above where it stood when they started.
+thread_local std::vector<TableWalk> table_walk;
+
+/// Canonical order of the entries of the tables and columns being encoded on this thread, one after the other.
+/// Calls only use the part above where it stood when they started.
+thread_local std::vector<size_t> canonical_order;
+
+/// The only NaN a canonical encoding writes, whatever the sign and payload of the NaN at hand.
+template<typename T>
+inline T CanonicalNaN() {
+	if constexpr (sizeof(T) == sizeof(uint32_t)) return std::bit_cast<T>(UINT32_C(0x7fc00000));
+	else return std::bit_cast<T>(UINT64_C(0x7ff8000000000000));
+}
+
+template<bool Canonical, typename T>
+inline T EncodedFloat(T value) {
+	if constexpr (Canonical) return value != value ? CanonicalNaN<T>() : value;
+	else return value;
+}
 
-	static const auto next = [&cursor](int bytes) {
+/// Encodes a float array at bytes like CopyArray, with every NaN written as the canonical one.
+template<typename Order, typename T>
+void CopyCanonicalFloats(uint8_t *bytes, const T *array, size_t length) {
+	// Arrays are checked for NaNs as they are copied, in one pass that compiles to vector moves and compares
+	// (accumulated in an integer as wide as the elements: a bool keeps it from being vectorized).
+	SBF::UnsignedOfSize<sizeof(T)> any = 0;
+
+	for (size_t x = 0; x < length; x++) {
+		Order::template Write<T>(bytes + x * sizeof(T), array[x]);
+		any |= array[x] != array[x];
+	}
+
+	// Nearly all of them have none.
+	if (!any) return;
+
+	for (size_t x = 0; x < length; x++) {
+		if (array[x] != array[x]) Order::template Write<T>(bytes + x * sizeof(T), CanonicalNaN<T>());
+	}
+}
+
+template<typename Order>
+void EncodeKey(const char *key, uint8_t *bytes, size_t *cursor) {
+	auto key_len = std::strlen(key);
+
+	bytes[*cursor] = (uint8_t) SBF::TagType::Open_String;
+	Order::template Write<uint64_t>(bytes + *cursor + 1, key_len);
+	std::memcpy(bytes + *cursor + 9, key, key_len);
+	bytes[*cursor + 9 + key_len] = (uint8_t) SBF::TagType::Close_String;
+
+	*cursor += key_len + 10;
+}
+
+/// Writes any node but a table at *cursor, arrays aligned as alignment asks; the caller made sure it fits.
+template<typename Order, bool Canonical>
+void EncodeLeaf(const Node *node, uint8_t *bytes, size_t *cursor, size_t alignment) {
+	const auto next = [cursor](size_t bytes) {
 		*cursor = *cursor + bytes;
 	};
 
-	if (length < size) throw std::invalid_argument(
-		std::string("bytes array is too small; expected at least ")
-			+ std::to_string(size)
-			+ " bytes, but got instead "
-			+ std::to_string(length)
-		);
+	// Encoded arrays are never padded, as their elements are not read in place.
+	// Canonical encodings write every array raw, so that the encodings set on nodes do not change the bytes.
+	if (!Canonical && (node->flags & NodeFlag_Encoding)) {
+		const auto encoding = SBF::WrittenEncoding(node);
+		if (encoding != SBF_ARRAY_RAW) return SBF::EncodePacked<Order>(node, encoding, bytes, cursor);
+	}
+
+	if (alignment) {
+		const auto padding = SBF::ArrayPadding(node->type, *cursor, alignment);
+		std::memset(bytes + *cursor, 0, padding);
+		next(padding);
+	}
 
 	uint8_t typeu = static_cast<uint8_t>(node->type);
 
@@ -572,7 +1032,7 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_I32: 
 		bytes[*cursor] = (uint8_t) Tag::Open_I32;
 		next(1);
-		SBF::Write<int32_t>(bytes + *cursor, node->i32); 
+		Order::template Write<int32_t>(bytes + *cursor, node->i32); 
 		next(sizeof(int32_t));
 		bytes[*cursor] = (uint8_t) Tag::Close_I32;
 		break;
@@ -580,7 +1040,7 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_U32: 
 		bytes[*cursor] = (uint8_t) Tag::Open_U32;
 		next(1);
-		SBF::Write<uint32_t>(bytes + *cursor, node->u32); 
+		Order::template Write<uint32_t>(bytes + *cursor, node->u32); 
 		next(sizeof(uint32_t));
 		bytes[*cursor] = (uint8_t) Tag::Close_U32;
 		break;
@@ -588,7 +1048,7 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_I64: 
 		bytes[*cursor] = (uint8_t) Tag::Open_I64;
 		next(1);
-		SBF::Write<int64_t>(bytes + *cursor, node->i64); 
+		Order::template Write<int64_t>(bytes + *cursor, node->i64); 
 		next(sizeof(int64_t));
 		bytes[*cursor] = (uint8_t) Tag::Close_I64;
 		break;
@@ -596,7 +1056,7 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_U64: 
 		bytes[*cursor] = (uint8_t) Tag::Open_U64;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->u64); 
+		Order::template Write<uint64_t>(bytes + *cursor, node->u64); 
 		next(sizeof(uint64_t));
 		bytes[*cursor] = (uint8_t) Tag::Close_U64;
 		break;
@@ -604,7 +1064,7 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_F32: 
 		bytes[*cursor] = (uint8_t) Tag::Open_F32;
 		next(1);
-		SBF::Write<float>(bytes + *cursor, node->f32); 
+		Order::template Write<float>(bytes + *cursor, EncodedFloat<Canonical>(node->f32));
 		next(sizeof(float));
 		bytes[*cursor] = (uint8_t) Tag::Close_F32;
 		break;
@@ -612,7 +1072,7 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_F64: 
 		bytes[*cursor] = (uint8_t) Tag::Open_F64;
 		next(1);
-		SBF::Write<double>(bytes + *cursor, node->f64); 
+		Order::template Write<double>(bytes + *cursor, EncodedFloat<Canonical>(node->f64));
 		next(sizeof(double));
 		bytes[*cursor] = (uint8_t) Tag::Close_F64;
 		break;
@@ -628,9 +1088,9 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_I8A:
 		bytes[*cursor] = (uint8_t) Tag::Open_I8_Array;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->array_length);
+		Order::template Write<uint64_t>(bytes + *cursor, node->array_length);
 		next(sizeof(uint64_t));
-		std::memcpy(bytes + *cursor, (int8_t *)node->array, node->array_length);
+		Order::template CopyArray<int8_t>(bytes + *cursor, node->array, node->array_length);
 		next(node->array_length);
 		bytes[*cursor] = (uint8_t) Tag::Close_I8_Array;
 		break;
@@ -638,9 +1098,9 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_U8A:
 		bytes[*cursor] = (uint8_t) Tag::Open_U8_Array;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->array_length);
+		Order::template Write<uint64_t>(bytes + *cursor, node->array_length);
 		next(sizeof(uint64_t));
-		std::memcpy(bytes + *cursor, (uint8_t *)node->array, node->array_length);
+		Order::template CopyArray<uint8_t>(bytes + *cursor, node->array, node->array_length);
 		next(node->array_length);
 		bytes[*cursor] = (uint8_t) Tag::Close_U8_Array;
 		break;
@@ -648,9 +1108,9 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_I32A:
 		bytes[*cursor] = (uint8_t) Tag::Open_I32_Array;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->array_length);
+		Order::template Write<uint64_t>(bytes + *cursor, node->array_length);
 		next(sizeof(uint64_t));
-		std::memcpy(bytes + *cursor, (int32_t *)node->array, node->array_length);
+		Order::template CopyArray<int32_t>(bytes + *cursor, node->array, node->array_length);
 		next(node->array_length * sizeof(int32_t));
 		bytes[*cursor] = (uint8_t) Tag::Close_I32_Array;
 		break;
@@ -658,9 +1118,9 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_U32A:
 		bytes[*cursor] = (uint8_t) Tag::Open_U32_Array;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->array_length);
+		Order::template Write<uint64_t>(bytes + *cursor, node->array_length);
 		next(sizeof(uint64_t));
-		std::memcpy(bytes + *cursor, (uint32_t *)node->array, node->array_length);
+		Order::template CopyArray<uint32_t>(bytes + *cursor, node->array, node->array_length);
 		next(node->array_length * sizeof(uint32_t));
 		bytes[*cursor] = (uint8_t) Tag::Close_U32_Array;
 		break;
@@ -668,9 +1128,9 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_I64A:
 		bytes[*cursor] = (uint8_t) Tag::Open_I64_Array;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->array_length);
+		Order::template Write<uint64_t>(bytes + *cursor, node->array_length);
 		next(sizeof(uint64_t));
-		std::memcpy(bytes + *cursor, (int64_t *)node->array, node->array_length);
+		Order::template CopyArray<int64_t>(bytes + *cursor, node->array, node->array_length);
 		next(node->array_length * sizeof(int64_t));
 		bytes[*cursor] = (uint8_t) Tag::Close_I64_Array;
 		break;
@@ -678,9 +1138,9 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_U64A:
 		bytes[*cursor] = (uint8_t) Tag::Open_U64_Array;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->array_length);
+		Order::template Write<uint64_t>(bytes + *cursor, node->array_length);
 		next(sizeof(uint64_t));
-		std::memcpy(bytes + *cursor, (uint64_t *)node->array, node->array_length);
+		Order::template CopyArray<uint64_t>(bytes + *cursor, node->array, node->array_length);
 		next(node->array_length * sizeof(uint64_t));
 		bytes[*cursor] = (uint8_t) Tag::Close_U64_Array;
 		break;
@@ -688,9 +1148,10 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_F32A:
 		bytes[*cursor] = (uint8_t) Tag::Open_F32_Array;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->array_length);
+		Order::template Write<uint64_t>(bytes + *cursor, node->array_length);
 		next(sizeof(uint64_t));
-		std::memcpy(bytes + *cursor, (float *)node->array, node->array_length);
+		if constexpr (Canonical) CopyCanonicalFloats<Order>(bytes + *cursor, (const float *)node->array, node->array_length);
+		else Order::template CopyArray<float>(bytes + *cursor, node->array, node->array_length);
 		next(node->array_length * sizeof(float));
 		bytes[*cursor] = (uint8_t) Tag::Close_F32_Array;
 		break;
@@ -698,9 +1159,10 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_F64A:
 		bytes[*cursor] = (uint8_t) Tag::Open_F64_Array;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->array_length);
+		Order::template Write<uint64_t>(bytes + *cursor, node->array_length);
 		next(sizeof(uint64_t));
-		std::memcpy(bytes + *cursor, (double *)node->array, node->array_length);
+		if constexpr (Canonical) CopyCanonicalFloats<Order>(bytes + *cursor, (const double *)node->array, node->array_length);
+		else Order::template CopyArray<double>(bytes + *cursor, node->array, node->array_length);
 		next(node->array_length * sizeof(double));
 		bytes[*cursor] = (uint8_t) Tag::Close_F64_Array;
 		break;
@@ -708,40 +1170,32 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	case NodeType_String:
 		bytes[*cursor] = (uint8_t) Tag::Open_String;
 		next(1);
-		SBF::Write<uint64_t>(bytes + *cursor, node->string_length);
+		Order::template Write<uint64_t>(bytes + *cursor, node->string_length);
 		next(sizeof(uint64_t));
-		std::memcpy(bytes + *cursor, (char *)node->string, node->string_length);
+		Order::template CopyArray<char>(bytes + *cursor, node->string, node->string_length);
 		next(node->string_length);
 		bytes[*cursor] = (uint8_t) Tag::Close_String;
 		break;
 
-	case NodeType_T:
-		bytes[*cursor] = (uint8_t) Tag::Open_Table;
-		
+	case NodeType_Columns:
+		bytes[*cursor] = (uint8_t) Tag::Open_Columns;
 		next(1);
-		
-		for (auto i = 0; i < node->table_length; i++) {
-			// key
-			auto key_len = std::strlen(node->keys[i]);
-			
-			bytes[*cursor] = (uint8_t) Tag::Open_String;
-			next(1);
-			SBF::Write<uint64_t>(bytes + *cursor, key_len);
-			next(sizeof(uint64_t));
-			std::memcpy(bytes + *cursor, node->keys[i], key_len);
-			next(key_len);
-			bytes[*cursor] = (uint8_t) Tag::Close_String;
-
-			// Value
-			next(1);
-			SBF_Serialize(node->values[i], bytes, length, cursor);
-		
-			// SBF_Serialize stops at an offset of one byte
-			// |0|0|0|0|0|0|0|0
-			// | .. bytes .. |^ stops here
-		}
+		Order::template Write<uint64_t>(bytes + *cursor, node->table_length ? SBF::ColumnRows(node->values[0]) : 0);
+		next(sizeof(uint64_t));
+		{
+			const auto order = canonical_order.size();
+			if constexpr (Canonical) SBF::CanonicalOrder(node, canonical_order);
+
+			for (size_t n = 0; n < node->table_length; n++) {
+				const auto x = Canonical ? canonical_order[order + n] : n;
+
+				EncodeKey<Order>(node->keys[x], bytes, cursor);
+				EncodeLeaf<Order, Canonical>(node->values[x], bytes, cursor, alignment);
+			}
 
-		bytes[*cursor] = (uint8_t) (Tag::Close_Table);
+			if constexpr (Canonical) canonical_order.resize(order);
+		}
+		bytes[*cursor] = (uint8_t) Tag::Close_Columns;
 		break;
 
 	default: throw std::invalid_argument(std::string("invalid node type '") + std::to_string(typeu) + "'");
@@ -753,7 +1207,9 @@ void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *curs
 	// then the function stops one byte beyond the boundries of the array.
 }
 
-size_t SBF_CalculateSize(const Node *node) {
+/// Encoded size of any node but a table, canonically written if Canonical.
+template<bool Canonical>
+size_t LeafSize(const Node *node) {
 	static const int8_t sizes[] = {
 		0,
 
@@ -772,6 +1228,13 @@ size_t SBF_CalculateSize(const Node *node) {
 	if (typei > 0 && typei < 10) 
 		return sizes[typei] + 2; // Account for the opening and closing tags.
 	
+	// Integer arrays written encoded, or as they are if no encoding is smaller
+	if (!Canonical && (node->flags & NodeFlag_Encoding) && SBF::IsPackableType(node->type)) {
+		size_t size;
+		SBF::WrittenEncoding(node, &size);
+		return size;
+	}
+
 	// Array nodes
 	if (typei > 9 && typei < 18) 
 		// Array size (length byes) + array length * array element size + opening & closing tags.
@@ -782,57 +1245,604 @@ size_t SBF_CalculateSize(const Node *node) {
 		// String length bytes + string length + opening & closing tags.
 		return sizes[typei] + node->string_length + 2;
 
-	// Table nodes
-	size_t table_length = 2;
+	// Columns (checked here, so the encoder never writes a malformed one)
+	if (typei == 20) {
+		SBF::CheckColumns(node);
+
+		// Row count + opening & closing tags.
+		size_t size = sizeof(uint64_t) + 2;
+		for (size_t x = 0; x < node->table_length; x++) {
+			size += std::strlen(node->keys[x]) + sizeof(uint64_t) + 2 + LeafSize<Canonical>(node->values[x]);
+		}
+
+		return size;
+	}
+
+	throw std::invalid_argument(std::string("invalid node type '") + std::to_string(typei) + "'");
+}
+
+/// Zero bytes written before node at offset, canonically written if Canonical.
+template<bool Canonical>
+size_t LeafPadding(const Node *node, size_t offset, size_t alignment) {
+	if constexpr (Canonical) return alignment ? SBF::ArrayPadding(node->type, offset, alignment) : 0;
+	else return SBF::NodePadding(node, offset, alignment);
+}
+
+/// Encoded size of any node but a table written at offset, arrays aligned as alignment asks.
+template<bool Canonical>
+size_t AlignedLeafSize(const Node *node, size_t offset, size_t alignment) {
+	if (node->type != NodeType_Columns) return LeafPadding<Canonical>(node, offset, alignment) + LeafSize<Canonical>(node);
+
+	SBF::CheckColumns(node);
+
+	// The padding of each column depends on the ones before it, so they are added up in the order they are written.
+	const auto order = canonical_order.size();
+	if constexpr (Canonical) SBF::CanonicalOrder(node, canonical_order);
+
+	auto end = offset + 1 + sizeof(uint64_t);
+	for (size_t n = 0; n < node->table_length; n++) {
+		const auto x = Canonical ? canonical_order[order + n] : n;
 
-	for (auto e = 0; e < node->table_length; e++) {
-		table_length += std::strlen(node->keys[e]) + sizeof(uint64_t) + 2;
-		table_length += SBF_CalculateSize(node->values[e]); // Recursive call!
+		end += std::strlen(node->keys[x]) + sizeof(uint64_t) + 2;
+		end += LeafPadding<Canonical>(node->values[x], end, alignment) + LeafSize<Canonical>(node->values[x]);
 	}
 
-	return table_length;
+	if constexpr (Canonical) canonical_order.resize(order);
+
+	return end + 1 - offset;
+}
+
+/// Size Serialize<Order, Canonical, Sorted> writes for node at offset with aligned arrays:
+/// the walk of SBF_CalculateSize, through the entries in the order they are written.
+template<bool Canonical, bool Sorted>
+size_t AlignedSize(const Node *node, size_t offset, size_t alignment) {
+	auto &stack = table_walk;
+	auto &order = canonical_order;
+
+	const auto base = stack.size();
+	const auto order_base = order.size();
+
+	constexpr bool Ordered = Canonical || Sorted;
+
+	auto end = offset;
+
+	try {
+		if (node->type != NodeType_T) return AlignedLeafSize<Canonical>(node, offset, alignment);
+
+		const auto push = [&stack, &order](const Node *table) {
+			const auto first = order.size();
+			if constexpr (Ordered) SBF::CanonicalOrder(table, order);
+
+			stack.push_back({ table, 0, first });
+		};
+
+		end++;
+		push(node);
+
+		while (stack.size() > base) {
+			auto &walk = stack.back();
+
+			if (walk.next == walk.table->table_length) {
+				end++;
+				if constexpr (Ordered) order.resize(walk.order);
+				stack.pop_back();
+				continue;
+			}
+
+			const auto n = walk.next++;
+			const auto x = Ordered ? order[walk.order + n] : n;
+			const auto value = walk.table->values[x];
+
+			if (!value) throw std::invalid_argument("table value #" + std::to_string(x) + " was null");
+
+			end += std::strlen(walk.table->keys[x]) + sizeof(uint64_t) + 2;
+
+			if (value->type == NodeType_T) {
+				end++;
+				push(value);
+			} else {
+				end += AlignedLeafSize<Canonical>(value, end, alignment);
+			}
+		}
+	} catch (...) {
+		stack.resize(base);
+		order.resize(order_base);
+		throw;
+	}
+
+	return end - offset;
+}
+
+/// Size SBF_SerializeEx writes for node without aligned arrays, canonically if Canonical.
+template<bool Canonical>
+size_t TreeSize(const Node *node) {
+	if (!node) throw std::invalid_argument("node was null");
+
+	if (node->type != NodeType_T) return LeafSize<Canonical>(node);
+
+	auto &stack = table_walk;
+	const auto base = stack.size();
+
+	size_t size = 2; // Opening and closing tags.
+	stack.push_back({ node, 0, 0 });
+
+	try {
+		while (stack.size() > base) {
+			auto &walk = stack.back();
+
+			if (walk.next == walk.table->table_length) {
+				stack.pop_back();
+				continue;
+			}
+
+			const auto x = walk.next++;
+			const auto value = walk.table->values[x];
+
+			if (!value) throw std::invalid_argument("table value #" + std::to_string(x) + " was null");
+
+			size += std::strlen(walk.table->keys[x]) + sizeof(uint64_t) + 2;
+
+			if (value->type == NodeType_T) {
+				size += 2;
+				stack.push_back({ value, 0, 0 });
+			} else {
+				size += LeafSize<Canonical>(value);
+			}
+		}
+	} catch (...) {
+		stack.resize(base);
+		throw;
+	}
+
+	return size;
+}
+
+/// Serializes node at *cursor in the byte order Order, canonically if Canonical,
+/// with the tables as sorted ones if Sorted, and arrays aligned as alignment asks.
+template<typename Order, bool Canonical, bool Sorted>
+void Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *cursor, size_t alignment) {
+	if (!node) throw std::invalid_argument("node was null");
+
+	// Also rejects null values and invalid types anywhere in the tree, so nothing below can fail halfway.
+	auto size = alignment ? AlignedSize<Canonical, Sorted>(node, *cursor, alignment) : TreeSize<Canonical>(node);
+
+	if (*cursor > length || length - *cursor < size) throw std::invalid_argument(
+		std::string("bytes array is too small; expected at least ")
+			+ std::to_string(size)
+			+ " bytes, but got instead "
+			+ std::to_string(*cursor > length ? 0 : length - *cursor)
+		);
+
+	auto &stack = table_walk;
+	auto &order = canonical_order;
+
+	const auto base = stack.size();
+	const auto order_base = order.size();
+	const auto start = *cursor;
+
+	// Canonical and sorted tables are both written in key order.
+	constexpr bool Ordered = Canonical || Sorted;
+	constexpr auto Open_Table = (uint8_t)(Sorted ? SBF::TagType::Open_Sorted_Table : SBF::TagType::Open_Table);
+	constexpr auto Close_Table = (uint8_t)(Sorted ? SBF::TagType::Close_Sorted_Table : SBF::TagType::Close_Table);
+
+	// In key order, a tree can still fail on duplicate keys, found as its tables are sorted.
+	try {
+		if (node->type != NodeType_T) {
+			EncodeLeaf<Order, Canonical>(node, bytes, cursor, alignment);
+			return;
+		}
+
+		const auto push = [&stack, &order](const Node *table) {
+			const auto first = order.size();
+			if constexpr (Ordered) SBF::CanonicalOrder(table, order);
+
+			stack.push_back({ table, 0, first });
+		};
+
+		bytes[(*cursor)++] = Open_Table;
+		push(node);
+
+		while (stack.size() > base) {
+			auto &walk = stack.back();
+
+			if (walk.next == walk.table->table_length) {
+				bytes[(*cursor)++] = Close_Table;
+				if constexpr (Ordered) order.resize(walk.order);
+				stack.pop_back();
+				continue;
+			}
+
+			const auto n = walk.next++;
+			const auto x = Ordered ? order[walk.order + n] : n;
+			const auto value = walk.table->values[x];
+
+			EncodeKey<Order>(walk.table->keys[x], bytes, cursor);
+
+			if (value->type == NodeType_T) {
+				bytes[(*cursor)++] = Open_Table;
+				push(value);
+			} else {
+				EncodeLeaf<Order, Canonical>(value, bytes, cursor, alignment);
+			}
+		}
+	} catch (...) {
+		stack.resize(base);
+		order.resize(order_base);
+		*cursor = start;
+		throw;
+	}
+}
+
+};
+
+void SBF_Serialize(const Node *node, uint8_t *bytes, size_t length, size_t *cursor) {
+	Serialize<SBF::LittleEndian, false, false>(node, bytes, length, cursor, 0);
+}
+
+namespace {
+
+template<typename Order, bool Canonical>
+void SerializeIn(const Node *node, uint8_t *bytes, size_t length, size_t *cursor, uint32_t flags, size_t alignment) {
+	if (flags & SBF_ENCODE_SORTED_TABLES) Serialize<Order, Canonical, true>(node, bytes, length, cursor, alignment);
+	else Serialize<Order, Canonical, false>(node, bytes, length, cursor, alignment);
+}
+
+template<typename Order>
+void SerializeIn(const Node *node, uint8_t *bytes, size_t length, size_t *cursor, uint32_t flags, size_t alignment) {
+	if (flags & SBF_ENCODE_CANONICAL) SerializeIn<Order, true>(node, bytes, length, cursor, flags, alignment);
+	else SerializeIn<Order, false>(node, bytes, length, cursor, flags, alignment);
+}
+
+};
+
+void SBF_SerializeEx(const Node *node, uint8_t *bytes, size_t length, size_t *cursor, const SBF_EncodeOptions *options) {
+	const auto flags = options ? options->flags : 0;
+	const auto alignment = SBF::CheckAlignment(options ? options->array_alignment : 0);
+
+	if (flags & SBF_ENCODE_BIG_ENDIAN) SerializeIn<SBF::BigEndian>(node, bytes, length, cursor, flags, alignment);
+	else SerializeIn<SBF::LittleEndian>(node, bytes, length, cursor, flags, alignment);
+}
+
+size_t SBF_CalculateSize(const Node *node) {
+	return TreeSize<false>(node);
+}
+
+size_t SBF_CalculateSizeEx(const Node *node, size_t offset, const SBF_EncodeOptions *options) {
+	const auto flags = options ? options->flags : 0;
+	const auto alignment = SBF::CheckAlignment(options ? options->array_alignment : 0);
+
+	if (!alignment) return flags & SBF_ENCODE_CANONICAL ? TreeSize<true>(node) : TreeSize<false>(node);
+	if (!node) throw std::invalid_argument("node was null");
+
+	if (flags & SBF_ENCODE_CANONICAL) return AlignedSize<true, false>(node, offset, alignment);
+	if (flags & SBF_ENCODE_SORTED_TABLES) return AlignedSize<false, true>(node, offset, alignment);
+	return AlignedSize<false, false>(node, offset, alignment);
 }
 
 void SBF_WriteFile(const char *filepath, const Node *node) {
+	SBF_WriteFileEx(filepath, node, nullptr);
+}
+
+void SBF_WriteFileEx(const char *filepath, const Node *node, const SBF_WriteOptions *options) {
 	if (!filepath) throw std::invalid_argument("file path argument must not be null");
 	if (!node) throw std::invalid_argument("node pointer argument must not be null");	
 
-	std::ofstream file(filepath, std::ios::binary);
-
-	if (!file.is_open()) {
-		throw std::runtime_error("failed to open file");
-	}
+	const SBF_WriteOptions defaults = {};
+	if (!options) options = &defaults;
 
-	auto node_size = SBF_CalculateSize(node);
+	// Arrays are aligned from the start of the file, past the header.
+	const bool checksum = options->flags & SBF_WRITE_CHECKSUM;
+	const auto encode = SBF::EncodeOptionsFor(*options);
+	const auto node_size = SBF_CalculateSizeEx(node, SBF::FileHeaderSize(checksum), &encode);
+	const auto size = SBF::FileImageSize(node_size, checksum);
 	
-	auto bytes = (uint8_t *)malloc(1 + node_size);
-	bytes[0] = 1; // Version
+	auto bytes = (uint8_t *)malloc(size);
 
-	size_t cursor = 1;
-	SBF_Serialize(node, bytes, node_size, &cursor);
+	try {
+		size_t cursor = SBF::EncodeFileHeader(bytes, node_size, *options);
+		SBF_SerializeEx(node, bytes, size, &cursor, &encode);
 
-	file.write(reinterpret_cast<char *>(bytes), node_size + 1);
+		// The checksum is filled in while writing.
+		if (checksum) cursor += SBF::BlockTrailerSize;
 
-	file.close();
+		SBF::WriteBytesToFile(filepath, bytes, cursor, *options);
+	} catch (...) {
+		free(bytes);
+		throw;
+	}
 
 	free(bytes);
 }
 
+void SBF_FlushPendingWrites(void) {
+	SBF::FlushPendingWrites();
+}
+
 Node *SBF_ReadFile(const char *filepath, uint8_t *version) {
 	if (!filepath) throw std::invalid_argument("file path argument must not be null");
 	std::filesystem::path path(filepath);
+
+	SBF::WaitForPendingWrite(path);
 	
-	auto bytes = SBF::ReadFileAsBytes(path);
+	SBF::BlockVerifier verifier;
+	auto bytes = SBF::ReadFileAsBytes(path, &verifier);
+
+	return SBF::DecodeFileBytes(bytes.data(), bytes.size(), version, &verifier);
+}
+
+namespace SBF {
+
+size_t EncodeFileHeader(uint8_t *bytes, size_t node_size, const SBF_WriteOptions &options) {
+	const bool big_endian = options.flags & SBF_WRITE_BIG_ENDIAN;
+	const auto alignment = CheckAlignment(options.array_alignment);
+	const uint8_t flags = (big_endian ? BigEndianFlag : 0) | (alignment ? (std::countr_zero(alignment) + 1) << AlignmentShift : 0);
+
+	if (!(options.flags & SBF_WRITE_CHECKSUM)) {
+		bytes[0] = 1 | flags; // Version
+		return 1;
+	}
+
+	bytes[0] = ChecksumVersion | flags;
+
+	if (big_endian) WriteBE<uint64_t>(bytes + 1, node_size);
+	else WriteLE<uint64_t>(bytes + 1, node_size);
+
+	return 1 + BlockHeaderSize;
+}
+
+namespace {
+
+/// Checks the blocks of a checksummed image with verifier, and returns the end of the intact ones.
+/// Only the last block may be cut short or damaged, which is what a crash in SBF_AppendFile
+/// can leave behind; everything else must pass its checksum.
+size_t CheckBlocks(const uint8_t *bytes, size_t size, BlockVerifier &verifier) {
+	verifier.Advance(bytes, size);
+
+	const auto verified = verifier.Verified();
+	const auto failed_end = verifier.FailedEnd();
+
+	if (verified == 1) throw SBF::SerdeException("base node is truncated or fails its checksum");
+
+	// Zeros at the end are blocks the filesystem allocated before the crash kept them from being written.
+	if (failed_end && failed_end < size && std::any_of(bytes + failed_end, bytes + size, [](uint8_t byte) { return byte != 0; })) {
+		throw SBF::SerdeException("update record at byte " + std::to_string(verified) + " fails its checksum");
+	}
+
+	return verified;
+}
+
+/// Decodes the blocks of a checksummed image found intact by verifier.
+Node *DecodeBlocks(const uint8_t *bytes, size_t size, BlockVerifier &verifier, const SBF_DecodeOptions &options) {
+	const auto verified = CheckBlocks(bytes, size, verifier);
+
+	Node *node = nullptr;
+
+	for (size_t block = 1; block < verified; ) {
+		const auto length = options.flags & SBF_DECODE_BIG_ENDIAN ? ReadBE<uint64_t>(bytes + block) : ReadLE<uint64_t>(bytes + block);
+		const auto start = block + BlockHeaderSize;
+
+		size_t cursor = 0;
+		Node *decoded = nullptr;
+
+		try {
+			decoded = SBF_DeserializeEx(bytes + start, length, &cursor, &options);
+
+			if (!decoded) throw SBF::SerdeException("empty block at byte " + std::to_string(block));
+			if (cursor != length) throw SBF::DeserException("block holds more than one node", "Block", start + cursor);
+
+			if (node) SBF_ApplyPatch(&node, decoded);
+		} catch (...) {
+			if (decoded != node) SBF_DestroyNode(decoded);
+			SBF_DestroyNode(node);
+			throw;
+		}
+
+		if (!node) node = decoded;
+		else SBF_DestroyNode(decoded);
+
+		block = start + length + BlockTrailerSize;
+	}
+
+	return node;
+}
+
+/// Decodes the update record at *cursor in bytes, moving *cursor past it.
+/// Returns null, leaving *cursor where it was, for a record cut short by the end of bytes, which is
+/// what a crash in SBF_AppendFile can leave behind; any other malformed record throws.
+Node *DecodeRecord(const uint8_t *bytes, size_t size, size_t *cursor, const SBF_DecodeOptions &options) {
+	const auto start = *cursor;
+
+	try {
+		return SBF_DeserializeEx(bytes, size, cursor, &options);
+	} catch (SBF::SerdeException &) {
+		*cursor = start;
+
+		// Zeros at the end are blocks the filesystem allocated before the crash kept them from being written.
+		auto end = size;
+		while (end > start && !bytes[end - 1]) end--;
+
+		if (end == start) return nullptr;
+
+		// The incremental decoder tells bytes that stop too early from bytes that are wrong:
+		// it asks for more only while what it was fed is the start of a well-formed node.
+		auto decoder = SBF_CreateDecoder(&options);
+		auto status = SBF_DECODE_DONE;
+		size_t used = 0;
+
+		try {
+			status = SBF_DecoderFeed(decoder, bytes + start, end - start, &used);
+		} catch (SBF::SerdeException &) {}
 
-	if (bytes.size() < 3) {
+		SBF_DestroyDecoder(decoder);
+
+		if (status == SBF_DECODE_NEED_MORE) return nullptr;
+
+		throw SBF::SerdeException("update record at byte " + std::to_string(start + 1) + " is malformed");
+	}
+}
+
+/// End of the blocks of a checksummed image of size bytes, found by their lengths alone; read(offset, length)
+/// returns the bytes at offset. Only the last whole block is checked against its checksum:
+/// a crash in SBF_AppendFile can damage no other, and readers check them all anyway.
+template<typename Reader>
+size_t LastBlockEnd(Reader &&read, size_t size, bool big_endian) {
+	size_t block = 1;
+	size_t last = 0;
+
+	while (size - block >= BlockHeaderSize) {
+		const auto header = read(block, BlockHeaderSize);
+		const auto length = big_endian ? ReadBE<uint64_t>(header) : ReadLE<uint64_t>(header);
+		const auto room = size - block - BlockHeaderSize;
+
+		// No node is empty: a zero length is where the filesystem allocated blocks the crash kept from being written.
+		if (length == 0 || room < BlockTrailerSize || length > room - BlockTrailerSize) break;
+
+		last = block;
+		block += BlockHeaderSize + length + BlockTrailerSize;
+	}
+
+	if (last) {
+		const auto summed = block - last - BlockTrailerSize;
+		const auto image = read(last, summed + BlockTrailerSize);
+		const auto expected = big_endian ? ReadBE<uint32_t>(image + summed) : ReadLE<uint32_t>(image + summed);
+
+		if (Crc32c(0, image, summed) != expected) block = last;
+	}
+
+	if (block == 1) throw SBF::SerdeException("base node is truncated or fails its checksum");
+
+	return block;
+}
+
+/// End of the base node and the update records of an image without checksums that are whole.
+/// Records are stepped over without being decoded, but for the one the walk stops at.
+size_t RecordsEnd(const uint8_t *bytes, size_t size) {
+	const bool big_endian = bytes[0] & BigEndianFlag;
+
+	SBF_DecodeOptions options = {};
+	if (big_endian) options.flags |= SBF_DECODE_BIG_ENDIAN;
+
+	auto cursor = SkipSerialized(bytes, size, 1, big_endian);
+
+	while (cursor < size) {
+		try {
+			cursor = SkipSerialized(bytes, size, cursor, big_endian);
+			continue;
+		} catch (SBF::SerdeException &) {}
+
+		// Decoding it tells a record cut short, which ends the intact part, from a malformed one, which throws.
+		size_t at = cursor - 1;
+		auto record = DecodeRecord(bytes + 1, size - 1, &at, options);
+		if (!record) break;
+
+		SBF_DestroyNode(record);
+		cursor = 1 + at;
+	}
+
+	return cursor;
+}
+
+};
+
+size_t IntactFileEnd(const uint8_t *bytes, size_t size) {
+	if (size < 3) throw SBF::SerdeException("file holds no base node");
+
+	const bool big_endian = bytes[0] & BigEndianFlag;
+
+	if (FormatVersion(bytes[0]) == ChecksumVersion) {
+		return LastBlockEnd([bytes](size_t offset, size_t) { return bytes + offset; }, size, big_endian);
+	}
+
+	return RecordsEnd(bytes, size);
+}
+
+size_t IntactFileEnd(const std::filesystem::path &filepath, uint8_t *version) {
+	std::ifstream file(filepath, std::ios::binary);
+
+	if (!file.is_open()) throw std::runtime_error("failed to open file");
+
+	const auto size = std::filesystem::file_size(filepath);
+	if (size < 3) throw SBF::SerdeException("file holds no base node");
+
+	char first = 0;
+	if (!file.get(first)) throw std::runtime_error("failed to read file");
+
+	*version = (uint8_t)first;
+
+	if (FormatVersion(*version) != ChecksumVersion) {
+		file.close();
+
+		auto bytes = ReadFileAsBytes(filepath, nullptr);
+		return RecordsEnd(bytes.data(), bytes.size());
+	}
+
+	std::vector<uint8_t> buffer;
+
+	auto read = [&](size_t offset, size_t length) {
+		buffer.resize(length);
+
+		file.seekg(offset);
+		if (!file.read((char *)buffer.data(), length)) throw std::runtime_error("failed to read file");
+
+		return (const uint8_t *)buffer.data();
+	};
+
+	return LastBlockEnd(read, size, *version & BigEndianFlag);
+}
+
+Node *DecodeFileBytes(const uint8_t *bytes, size_t size, uint8_t *version, BlockVerifier *verifier) {
+	if (size < 3) {
 		if (version) *version = 0;
 		return nullptr;
 	}
 
-	// Ineffective for now.
-	if (version) *version = bytes[0];
+	if (version) *version = FormatVersion(bytes[0]);
+
+	SBF_DecodeOptions options = {};
+	if (bytes[0] & BigEndianFlag) options.flags |= SBF_DECODE_BIG_ENDIAN;
+
+	if (FormatVersion(bytes[0]) == ChecksumVersion) {
+		BlockVerifier local;
+		return DecodeBlocks(bytes, size, verifier ? *verifier : local, options);
+	}
 
 	size_t cursor = 0;
-	return SBF_Deserialize(bytes.data() + 1, bytes.size() - 1, &cursor);
+	auto node = SBF_DeserializeEx(bytes + 1, size - 1, &cursor, &options);
+
+	return node ? ReplayRecords(node, bytes, size, 1 + cursor) : nullptr;
+}
+
+Node *ReplayRecords(Node *node, const uint8_t *bytes, size_t size, size_t offset) {
+	SBF_DecodeOptions options = {};
+	if (bytes[0] & BigEndianFlag) options.flags |= SBF_DECODE_BIG_ENDIAN;
+
+	// Replay update records appended by SBF_AppendFile.
+	size_t cursor = offset - 1;
+	while (cursor < size - 1) {
+		Node *record = nullptr;
+
+		try {
+			record = DecodeRecord(bytes + 1, size - 1, &cursor, options);
+		} catch (...) {
+			SBF_DestroyNode(node);
+			throw;
+		}
+
+		// Everything before a record cut short by a crash is intact, so only the tail is dropped.
+		if (!record) break;
+
+		try {
+			SBF_ApplyPatch(&node, record);
+		} catch (...) {
+			SBF_DestroyNode(record);
+			SBF_DestroyNode(node);
+			throw;
+		}
+
+		SBF_DestroyNode(record);
+	}
+
+	return node;
 }
 
+};
@@ -0,0 +1,515 @@
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "exceptions.h"
+#include "packed.h"
+#include "node.h"
+#include "tags.h"
+#include "io.h"
+
+// A selector is compiled into one step per segment of its path, each one picking
+// entries of the tables (or columns) picked by the step before.
+// Over serialized bytes nothing is copied: only the keys of those tables are read, arrays and
+// strings are stepped over using their length prefix, and tables that cannot match tag by tag.
+// SBF_ScanBytes steps over a whole node the same way, counting what it steps over.
+
+struct SBF_Selector {
+
+	struct Step {
+		enum Kind { Key, Any, Index } kind;
+		std::string key;
+		size_t index;
+	};
+
+	std::vector<Step> steps;
+
+};
+
+namespace {
+
+using Step = SBF_Selector::Step;
+
+[[noreturn]] void SyntaxError(const char *path, size_t at, const char *what) {
+	throw std::invalid_argument(std::string("invalid selector '") + path + "' at character " + std::to_string(at) + ": " + what);
+}
+
+/// Parses a quoted key starting at the opening quote; *at moves past the closing one.
+std::string ParseQuoted(const char *path, size_t *at) {
+	std::string key;
+
+	for (auto x = *at + 1; path[x]; x++) {
+		if (path[x] == '"') {
+			*at = x + 1;
+			return key;
+		}
+
+		if (path[x] == '\\') {
+			if (path[x + 1] != '"' && path[x + 1] != '\\') SyntaxError(path, x, "only \\\" and \\\\ can be escaped");
+			x++;
+		}
+
+		key += path[x];
+	}
+
+	SyntaxError(path, *at, "unterminated quoted key");
+}
+
+/// Parses the inside of brackets: *, an index or a quoted key; *at moves past the closing bracket.
+Step ParseBracket(const char *path, size_t *at) {
+	auto x = *at + 1;
+	Step step = { Step::Any, "", 0 };
+
+	if (path[x] == '*') {
+		x++;
+	} else if (path[x] == '"') {
+		step.kind = Step::Key;
+		step.key = ParseQuoted(path, &x);
+	} else if (path[x] >= '0' && path[x] <= '9') {
+		step.kind = Step::Index;
+
+		for (; path[x] >= '0' && path[x] <= '9'; x++) {
+			const size_t digit = path[x] - '0';
+			if (step.index > (SIZE_MAX - digit) / 10) SyntaxError(path, x, "index too large");
+			step.index = step.index * 10 + digit;
+		}
+	} else {
+		SyntaxError(path, x, "expected *, an index or a quoted key");
+	}
+
+	if (path[x] != ']') SyntaxError(path, x, "expected ]");
+
+	*at = x + 1;
+	return step;
+}
+
+std::vector<Step> Parse(const char *path) {
+	std::vector<Step> steps;
+	size_t x = 0;
+
+	while (path[x]) {
+		if (path[x] == '[') {
+			steps.push_back(ParseBracket(path, &x));
+			continue;
+		}
+
+		if (!steps.empty()) {
+			if (path[x] != '.') SyntaxError(path, x, "expected . or [");
+			x++;
+		}
+
+		const auto start = x;
+		while (path[x] && path[x] != '.' && path[x] != '[' && path[x] != ']' && path[x] != '"') x++;
+
+		if (path[x] == ']' || path[x] == '"') SyntaxError(path, x, "unexpected character in key; quote it as [\"...\"]");
+		if (start == x) SyntaxError(path, x, "empty key");
+
+		std::string key(path + start, x - start);
+
+		if (key == "*") steps.push_back({ Step::Any, "", 0 });
+		else steps.push_back({ Step::Key, std::move(key), 0 });
+	}
+
+	return steps;
+}
+
+inline bool Matches(const Step &step, size_t entry, const char *key, size_t key_length) {
+	switch (step.kind) {
+	case Step::Any: return true;
+	case Step::Index: return entry == step.index;
+	default: return key_length == step.key.size() && std::memcmp(key, step.key.data(), key_length) == 0;
+	}
+}
+
+/// Visits the nodes under node matched from the given step on; false once the callback asked to stop.
+bool SelectNodes(const std::vector<Step> &steps, size_t step, Node *node, SBF_SelectNodeCallback callback, void *user, size_t &count) {
+	if (step == steps.size()) {
+		count++;
+		return !callback || callback(node, user);
+	}
+
+	if (node->type != NodeType_T && node->type != NodeType_Columns) return true;
+
+	const auto &current = steps[step];
+
+	if (current.kind == Step::Index) {
+		if (current.index >= node->table_length) return true;
+		return SelectNodes(steps, step + 1, node->values[current.index], callback, user, count);
+	}
+
+	// A key is found in a sorted table without looking at the others.
+	if (current.kind == Step::Key && (node->flags & NodeFlag_Sorted)) {
+		const auto x = SBF::FindEntry(node, current.key.c_str());
+		if (x == node->table_length) return true;
+		return SelectNodes(steps, step + 1, node->values[x], callback, user, count);
+	}
+
+	for (size_t x = 0; x < node->table_length; x++) {
+		if (!Matches(current, x, node->keys[x], std::strlen(node->keys[x]))) continue;
+		if (!SelectNodes(steps, step + 1, node->values[x], callback, user, count)) return false;
+	}
+
+	return true;
+}
+
+// Stepping over serialized nodes. Offsets are always checked against the length,
+// and closing tags against their opening ones, so malformed bytes throw like in the decoder.
+
+[[noreturn]] void Malformed(const std::string &what, uint8_t tag, size_t offset) {
+	throw SBF::DeserException(what, tag == (uint8_t)SBF::TagType::Open_Packed_Array ? "Packed" : SBF::TypeName((NodeType)tag), offset);
+}
+
+/// Returns the offset past the closing tag of the scalar, array or string at offset.
+template<typename Order = SBF::LittleEndian>
+size_t SkipLeaf(const uint8_t *bytes, size_t length, size_t offset) {
+	const auto tag = bytes[offset];
+	const auto type = (NodeType)tag;
+	const auto left = length - offset - 1;
+
+	size_t end;
+
+	if (SBF::IsScalarType(type)) {
+		const auto size = SBF::ScalarSize(type);
+		if (left < size + 1) Malformed("bytes array too small", tag, offset + 1);
+
+		end = offset + 1 + size;
+	} else {
+		if (left < 9) Malformed("bytes array too small", tag, offset + 1);
+
+		// The body of an encoded array is stepped over as bytes, once its header is checked.
+		const auto packed = tag == (uint8_t)SBF::TagType::Open_Packed_Array;
+		const auto element_size = packed ? 1 : SBF::ArrayElementSize(type);
+
+		const auto array_length = Order::template Read<uint64_t>(bytes + offset + 1);
+		if (array_length > (left - 9) / element_size)
+			Malformed("array length " + std::to_string(array_length) + " exceeds the remaining bytes", tag, offset + 1);
+
+		end = offset + 9 + array_length * element_size;
+		if (end >= length) Malformed("bytes array too small", tag, end);
+
+		if (packed) SBF::ReadPackedHeader<Order>(bytes + offset + 9, array_length, offset);
+	}
+
+	if (bytes[end] != (uint8_t)-tag) Malformed("closing tag mismatch", tag, end);
+
+	return end + 1;
+}
+
+/// Reads the key of the table entry at offset, and returns the offset of its value.
+template<typename Order = SBF::LittleEndian>
+size_t ReadKey(const uint8_t *bytes, size_t length, size_t offset, uint8_t table_tag, const char **key, size_t *key_length) {
+	if (bytes[offset] != (uint8_t)SBF::TagType::Open_String) Malformed("table entry must be String", table_tag, offset);
+	if (length - offset < 10) Malformed("table key: bytes array too small", table_tag, offset);
+
+	const auto size = Order::template Read<uint64_t>(bytes + offset + 1);
+
+	if (size > length - offset - 10 || bytes[offset + 9 + size] != (uint8_t)SBF::TagType::Close_String)
+		Malformed("malformed table key", table_tag, offset);
+
+	*key = (const char *)bytes + offset + 9;
+	*key_length = size;
+
+	return offset + 10 + size;
+}
+
+/// Adds a node of the given tag at depth, taking bytes of its own, to stats.
+void Count(SBF_ScanStats &stats, uint8_t tag, size_t depth, size_t bytes) {
+	const auto type = tag == (uint8_t)SBF::TagType::Open_Sorted_Table ? NodeType_T : (NodeType)tag;
+
+	stats.nodes[type]++;
+	stats.bytes[type] += bytes;
+	stats.depths[depth < SBF_SCAN_DEPTHS ? depth : SBF_SCAN_DEPTHS - 1]++;
+
+	if (depth > stats.max_depth) stats.max_depth = depth;
+}
+
+/// Adds the scalar, array or string at offset, taking bytes of its own, to stats;
+/// an encoded array counts as the type it decodes to.
+void CountLeaf(SBF_ScanStats &stats, const uint8_t *bytes, size_t offset, size_t depth, size_t size) {
+	auto tag = bytes[offset];
+
+	if (tag == (uint8_t)SBF::TagType::Open_Packed_Array) {
+		stats.packed_arrays++;
+		tag = bytes[offset + 9];
+	}
+
+	Count(stats, tag, depth, size);
+}
+
+/// Adds the key read from start up to its value at offset to stats.
+inline void CountKey(SBF_ScanStats *stats, size_t start, size_t offset) {
+	if (!stats) return;
+
+	stats->keys++;
+	stats->key_bytes += offset - start;
+}
+
+/// Returns the offset of the node at offset, past the padding before it if any, which is added to stats.
+inline size_t SkipPadding(const uint8_t *bytes, size_t length, size_t offset, SBF_ScanStats *stats) {
+	if (offset >= length || bytes[offset]) return offset;
+
+	const auto node = SBF::SkipPadding(bytes, length, offset);
+	if (stats) stats->padding_bytes += node - offset;
+
+	return node;
+}
+
+/// Returns the offset past the closing tag of the columns node at offset;
+/// with stats, counts it and its columns as if it were at depth.
+template<typename Order = SBF::LittleEndian>
+size_t SkipColumns(const uint8_t *bytes, size_t length, size_t offset, SBF_ScanStats *stats = nullptr, size_t depth = 0) {
+	const auto tag = (uint8_t)SBF::TagType::Open_Columns;
+
+	if (length - offset - 1 < 8) Malformed("bytes array too small", tag, offset + 1);
+	offset += 9;
+
+	while (true) {
+		if (offset >= length) Malformed("bytes array too small", tag, offset);
+
+		if (bytes[offset] == (uint8_t)SBF::TagType::Close_Columns) {
+			if (stats) Count(*stats, tag, depth, 10);
+			return offset + 1;
+		}
+
+		const auto start = offset;
+		const char *key;
+		size_t key_length;
+		offset = ReadKey<Order>(bytes, length, offset, tag, &key, &key_length);
+		CountKey(stats, start, offset);
+		offset = SkipPadding(bytes, length, offset, stats);
+
+		if (offset >= length || !SBF::IsArrayTag(bytes[offset])) Malformed("column must be an array", tag, offset);
+
+		const auto column = offset;
+		offset = SkipLeaf<Order>(bytes, length, offset);
+
+		if (stats) CountLeaf(*stats, bytes, column, depth + 1, offset - column);
+	}
+}
+
+inline bool IsTableTag(uint8_t tag) {
+	return tag == (uint8_t)SBF::TagType::Open_Table || tag == (uint8_t)SBF::TagType::Open_Sorted_Table;
+}
+
+inline bool IsTableCloseTag(uint8_t tag) {
+	return tag == (uint8_t)SBF::TagType::Close_Table || tag == (uint8_t)SBF::TagType::Close_Sorted_Table;
+}
+
+/// Returns the offset past the closing tag of the node at offset, adding every node in it to stats if given.
+/// Nested tables are only counted, so any depth is stepped over without a stack;
+/// either kind of table closes any of them, and the order of sorted keys is not checked.
+template<typename Order = SBF::LittleEndian>
+size_t SkipNode(const uint8_t *bytes, size_t length, size_t offset, SBF_ScanStats *stats = nullptr) {
+	const auto table = (uint8_t)SBF::TagType::Open_Table;
+	size_t open = 0;
+
+	while (true) {
+		if (offset >= length) Malformed("bytes array too small", table, offset);
+
+		offset = SkipPadding(bytes, length, offset, stats);
+
+		const auto tag = bytes[offset];
+		const auto start = offset;
+
+		if (IsTableTag(tag)) {
+			if (stats) Count(*stats, tag, open + 1, 2);
+
+			open++;
+			offset++;
+		} else if (tag == (uint8_t)SBF::TagType::Open_Columns) {
+			offset = SkipColumns<Order>(bytes, length, offset, stats, open + 1);
+		} else if ((tag >= 1 && tag <= (uint8_t)SBF::TagType::Open_String) || tag == (uint8_t)SBF::TagType::Open_Packed_Array) {
+			offset = SkipLeaf<Order>(bytes, length, offset);
+			if (stats) CountLeaf(*stats, bytes, start, open + 1, offset - start);
+		} else {
+			Malformed("invalid tag '" + std::to_string(tag) + "'", table, offset);
+		}
+
+		// Close every table that ends here, then step over the key of the next entry.
+		while (open) {
+			if (offset >= length) Malformed("bytes array too small", table, offset);
+
+			if (IsTableCloseTag(bytes[offset])) {
+				open--;
+				offset++;
+				continue;
+			}
+
+			const auto key = offset;
+			const char *chars;
+			size_t key_length;
+			offset = ReadKey<Order>(bytes, length, offset, table, &chars, &key_length);
+			CountKey(stats, key, offset);
+			break;
+		}
+
+		if (!open) return offset;
+	}
+}
+
+/// Visits the serialized nodes matched from the given step on, starting with the node at *offset,
+/// which moves past it. Returns false once the callback asked to stop.
+bool SelectBytes(const std::vector<Step> &steps, size_t step, const uint8_t *bytes, size_t length, size_t *offset,
+		SBF_SelectBytesCallback callback, void *user, size_t &count) {
+	if (*offset >= length) Malformed("bytes array too small", (uint8_t)SBF::TagType::Open_Table, *offset);
+
+	// Matches span from their tag, without the padding before it.
+	*offset = SkipPadding(bytes, length, *offset, nullptr);
+
+	if (step == steps.size()) {
+		const auto start = *offset;
+		*offset = SkipNode(bytes, length, start);
+
+		count++;
+		return !callback || callback(start, *offset - start, user);
+	}
+
+	const auto tag = bytes[*offset];
+	const auto columns = tag == (uint8_t)SBF::TagType::Open_Columns;
+
+	if (!IsTableTag(tag) && !columns) {
+		*offset = SkipNode(bytes, length, *offset);
+		return true;
+	}
+
+	if (columns) {
+		if (length - *offset - 1 < 8) Malformed("bytes array too small", tag, *offset + 1);
+		*offset += 8;
+	}
+
+	*offset += 1;
+
+	const auto &current = steps[step];
+
+	for (size_t entry = 0; ; entry++) {
+		if (*offset >= length) Malformed("bytes array too small", tag, *offset);
+
+		if (bytes[*offset] == (uint8_t)-tag) {
+			*offset += 1;
+			return true;
+		}
+
+		const char *key;
+		size_t key_length;
+		*offset = ReadKey(bytes, length, *offset, tag, &key, &key_length);
+
+		if (*offset >= length) Malformed("missing value of entry #" + std::to_string(entry), tag, *offset);
+
+		*offset = SkipPadding(bytes, length, *offset, nullptr);
+		if (columns && !SBF::IsArrayTag(bytes[*offset])) Malformed("column must be an array", tag, *offset);
+
+		if (!Matches(current, entry, key, key_length)) {
+			*offset = SkipNode(bytes, length, *offset);
+			continue;
+		}
+
+		if (!SelectBytes(steps, step + 1, bytes, length, offset, callback, user, count)) return false;
+	}
+}
+
+bool KeepFirst(Node *node, void *user) {
+	*(Node **)user = node;
+	return false;
+}
+
+};
+
+SBF_Selector *SBF_CompileSelector(const char *path) {
+	if (!path) throw std::invalid_argument("path argument must not be null");
+
+	auto selector = new SBF_Selector;
+
+	try {
+		selector->steps = Parse(path);
+	} catch (...) {
+		delete selector;
+		throw;
+	}
+
+	return selector;
+}
+
+void SBF_DestroySelector(SBF_Selector *selector) {
+	delete selector;
+}
+
+size_t SBF_SelectNodes(const SBF_Selector *selector, Node *root, SBF_SelectNodeCallback callback, void *user) {
+	if (!selector) throw std::invalid_argument("selector argument must not be null");
+	if (!root) throw std::invalid_argument("root argument must not be null");
+
+	size_t count = 0;
+	SelectNodes(selector->steps, 0, root, callback, user, count);
+
+	return count;
+}
+
+Node *SBF_SelectFirst(const SBF_Selector *selector, Node *root) {
+	Node *first = nullptr;
+	SBF_SelectNodes(selector, root, KeepFirst, &first);
+
+	return first;
+}
+
+size_t SBF_SelectBytes(const SBF_Selector *selector, const uint8_t *bytes, size_t length, size_t *begin, SBF_SelectBytesCallback callback, void *user) {
+	if (!selector) throw std::invalid_argument("selector argument must not be null");
+	if (!begin) throw std::invalid_argument("begin argument must not be null");
+
+	// Like SBF_Deserialize, there is no node past the end.
+	if (*begin >= length) return 0;
+
+	auto offset = *begin;
+	size_t count = 0;
+
+	if (SelectBytes(selector->steps, 0, bytes, length, &offset, callback, user, count)) *begin = offset;
+
+	return count;
+}
+
+bool SBF_ScanBytes(const uint8_t *bytes, size_t length, size_t *begin, SBF_ScanStats *stats) {
+	if (!begin) throw std::invalid_argument("begin argument must not be null");
+	if (!stats) throw std::invalid_argument("stats argument must not be null");
+
+	if (*begin >= length) return false;
+
+	// Counted apart, so that stats are left as they were by malformed bytes.
+	auto scanned = *stats;
+	*begin = SkipNode(bytes, length, *begin, &scanned);
+	scanned.trees++;
+
+	*stats = scanned;
+
+	return true;
+}
+
+const void *SBF_ArrayInBytes(const uint8_t *bytes, size_t length, size_t offset, NodeType *type, size_t *count) {
+	if (!type) throw std::invalid_argument("type argument must not be null");
+	if (!count) throw std::invalid_argument("count argument must not be null");
+
+	if (offset >= length) Malformed("bytes array too small", (uint8_t)SBF::TagType::Open_I32_Array, offset);
+
+	offset = SkipPadding(bytes, length, offset, nullptr);
+
+	const auto tag = bytes[offset];
+	if (tag == (uint8_t)SBF::TagType::Open_Packed_Array) Malformed("array is encoded, so its elements can only be read decoded", tag, offset);
+	if (!SBF::IsArrayType((NodeType)tag)) Malformed("not an array", tag, offset);
+
+	// Checks the length and the closing tag.
+	SkipLeaf(bytes, length, offset);
+
+	*type = (NodeType)tag;
+	*count = SBF::Read<uint64_t>(bytes + offset + 1);
+
+	return bytes + offset + 9;
+}
+
+namespace SBF {
+
+size_t SkipSerialized(const uint8_t *bytes, size_t length, size_t offset, bool big_endian) {
+	return big_endian ? SkipNode<BigEndian>(bytes, length, offset) : SkipNode(bytes, length, offset);
+}
+
+};
@@ -0,0 +1,129 @@
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+
+#include "SBF/sbf.h"
+
+#include "stats.h"
+
+#if defined(SBF_ENABLE_STATS)
+
+namespace {
+
+struct Global {
+	std::atomic<uint64_t> nodes[SBF_STATS_NODE_TYPES];
+	std::atomic<uint64_t> bytes[SBF_STATS_NODE_TYPES];
+	std::atomic<uint64_t> allocations;
+	std::atomic<uint64_t> allocated_bytes;
+	std::atomic<uint64_t> array_copy_ns;
+	std::atomic<uint64_t> table_parse_ns;
+	std::atomic<uint64_t> max_depth;
+	std::atomic<uint64_t> decodes;
+};
+
+Global global = {};
+
+std::mutex hooks_mutex;
+SBF_TraceHooks hooks = {};
+// Lets decodes skip the mutex while no hooks are installed, the common case.
+std::atomic<bool> hooks_installed = false;
+
+void Add(std::atomic<uint64_t> &counter, uint64_t value) {
+	if (value) counter.fetch_add(value, std::memory_order_relaxed);
+}
+
+};
+
+namespace SBF::Stats {
+
+uint64_t Now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()
+	).count();
+}
+
+void LoadHooks() {
+	if (!hooks_installed.load(std::memory_order_acquire)) {
+		local.hooks = {};
+		return;
+	}
+
+	std::lock_guard lock(hooks_mutex);
+	local.hooks = hooks;
+}
+
+void Publish() {
+	for (size_t x = 0; x < SBF_STATS_NODE_TYPES; x++) {
+		Add(global.nodes[x], local.nodes[x]);
+		Add(global.bytes[x], local.bytes[x]);
+	}
+
+	Add(global.allocations, local.allocations);
+	Add(global.allocated_bytes, local.allocated_bytes);
+	Add(global.array_copy_ns, local.array_copy_ns);
+	Add(global.table_parse_ns, local.table_parse_ns);
+	Add(global.decodes, 1);
+
+	auto max_depth = global.max_depth.load(std::memory_order_relaxed);
+	while (local.max_depth > max_depth && !global.max_depth.compare_exchange_weak(max_depth, local.max_depth, std::memory_order_relaxed));
+
+	local = {};
+}
+
+};
+
+bool SBF_GetStats(SBF_Stats *stats) {
+	if (!stats) return true;
+
+	for (size_t x = 0; x < SBF_STATS_NODE_TYPES; x++) {
+		stats->nodes[x] = global.nodes[x].load(std::memory_order_relaxed);
+		stats->bytes[x] = global.bytes[x].load(std::memory_order_relaxed);
+	}
+
+	stats->allocations = global.allocations.load(std::memory_order_relaxed);
+	stats->allocated_bytes = global.allocated_bytes.load(std::memory_order_relaxed);
+	stats->array_copy_ns = global.array_copy_ns.load(std::memory_order_relaxed);
+	stats->table_parse_ns = global.table_parse_ns.load(std::memory_order_relaxed);
+	stats->max_depth = global.max_depth.load(std::memory_order_relaxed);
+	stats->decodes = global.decodes.load(std::memory_order_relaxed);
+
+	return true;
+}
+
+void SBF_ResetStats(void) {
+	for (size_t x = 0; x < SBF_STATS_NODE_TYPES; x++) {
+		global.nodes[x].store(0, std::memory_order_relaxed);
+		global.bytes[x].store(0, std::memory_order_relaxed);
+	}
+
+	global.allocations.store(0, std::memory_order_relaxed);
+	global.allocated_bytes.store(0, std::memory_order_relaxed);
+	global.array_copy_ns.store(0, std::memory_order_relaxed);
+	global.table_parse_ns.store(0, std::memory_order_relaxed);
+	global.max_depth.store(0, std::memory_order_relaxed);
+	global.decodes.store(0, std::memory_order_relaxed);
+}
+
+bool SBF_SetTraceHooks(const SBF_TraceHooks *trace_hooks) {
+	std::lock_guard lock(hooks_mutex);
+
+	hooks = trace_hooks ? *trace_hooks : SBF_TraceHooks{};
+	hooks_installed.store(hooks.begin || hooks.end, std::memory_order_release);
+
+	return true;
+}
+
+#else
+
+bool SBF_GetStats(SBF_Stats *stats) {
+	if (stats) std::memset(stats, 0, sizeof(SBF_Stats));
+	return false;
+}
+
+void SBF_ResetStats(void) {}
+
+bool SBF_SetTraceHooks(const SBF_TraceHooks *) { return false; }
+
+#endif
@@ -0,0 +1,638 @@
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SBF/sbf.h"
+
+#include "exceptions.h"
+#include "packed.h"
+#include "arena.h"
+#include "node.h"
+#include "tags.h"
+#include "io.h"
+
+// The incremental decoder reads the same bytes as SBF_DeserializeEx, and rejects the same malformed ones,
+// but from chunks of any size: it stops wherever a chunk ends and picks up from there with the next one.
+// Its state is the node being read (a tag, a fixed-size field, an array or key being filled, a closing tag)
+// and the tables and columns nodes open around it, whose entries wait on the decoder's own stacks.
+// Arrays and keys are filled in place as their bytes arrive, in buffers growing with what was received,
+// so a length announced by a hostile peer costs nothing until its bytes are actually sent.
+
+namespace {
+
+using Tag = SBF::TagType;
+
+enum class State : uint8_t {
+	/// Expecting the opening tag of a node, or padding before an array.
+	Value,
+	/// Reading the fixed-size part after an opening tag: a scalar, or the length of an array or columns node.
+	Fixed,
+	/// Filling the elements of an array or string.
+	Payload,
+	/// Expecting the closing tag of the leaf just read.
+	Close,
+	/// Expecting the key of the next entry of the innermost table or columns node, or its closing tag.
+	Entry,
+	/// Reading the length of a key, then filling it, then its closing tag.
+	KeyLength,
+	KeyChars,
+	KeyClose,
+	/// A whole node was read; it waits for SBF_DecoderTake.
+	Done,
+};
+
+/// A table or columns node whose entries are being read.
+struct Frame {
+	uint8_t tag;
+	size_t tag_offset;
+	size_t first_key;
+	size_t first_value;
+	size_t length;
+	/// Rows announced by a columns node.
+	uint64_t rows;
+};
+
+/// Size of the fixed part following each opening tag.
+constexpr uint8_t fixed_sizes[] = {
+	0,
+	4, 8, 4, 8, 1, 4, 8, 1, 1,
+	8, 8, 8, 8, 8, 8, 8, 8, 8,
+	0, 8, 0, 8,
+};
+
+/// Smallest step a payload buffer grows by, so that small chunks do not reallocate every time.
+constexpr size_t Min_Payload_Growth = 4096;
+
+inline bool IsNumericArrayTag(uint8_t tag) {
+	return tag >= (uint8_t)Tag::Open_I32_Array && tag <= (uint8_t)Tag::Open_U8_Array;
+}
+
+inline bool IsTableTag(uint8_t tag) {
+	return tag == (uint8_t)Tag::Open_Table || tag == (uint8_t)Tag::Open_Sorted_Table;
+}
+
+/// Name of the node an opening tag starts, as used in error messages.
+inline const char *TagName(uint8_t tag) {
+	if (tag == (uint8_t)Tag::Open_Packed_Array) return "Packed";
+	return SBF::TypeName(IsTableTag(tag) ? NodeType_T : (NodeType)tag);
+}
+
+/// Size of the elements of an array, string or key; encoded arrays are filled as the bytes of their body.
+inline size_t PayloadElementSize(uint8_t tag) {
+	return tag == (uint8_t)Tag::Open_Packed_Array ? 1 : SBF::ArrayElementSize((NodeType)tag);
+}
+
+/// Swaps count elements of an array of the given tag in place.
+template<typename Order>
+void SwapInPlace(uint8_t tag, uint8_t *bytes, size_t count) {
+	switch ((Tag)tag) {
+	case Tag::Open_I32_Array: Order::template CopyArray<int32_t>(bytes, bytes, count); break;
+	case Tag::Open_I64_Array: Order::template CopyArray<int64_t>(bytes, bytes, count); break;
+	case Tag::Open_F32_Array: Order::template CopyArray<float>(bytes, bytes, count); break;
+	case Tag::Open_F64_Array: Order::template CopyArray<double>(bytes, bytes, count); break;
+	case Tag::Open_U32_Array: Order::template CopyArray<uint32_t>(bytes, bytes, count); break;
+	case Tag::Open_U64_Array: Order::template CopyArray<uint64_t>(bytes, bytes, count); break;
+	default: break;
+	}
+}
+
+};
+
+struct SBF_Decoder {
+	SBF_DecodeOptions options;
+	size_t max_depth;
+
+	State state = State::Value;
+
+	/// Bytes of the current message read so far; offsets in errors count from its start.
+	size_t offset = 0;
+
+	/// Opening tag of the node being read, and where it was.
+	uint8_t tag = 0;
+	size_t tag_offset = 0;
+
+	/// Zero bytes read in a row before the node.
+	size_t padding = 0;
+
+	uint8_t fixed[8];
+	size_t fixed_size = 0;
+	size_t fixed_filled = 0;
+
+	/// Elements of the array, string or key being read; always malloc'd, and handed over to heap trees.
+	uint8_t *payload = nullptr;
+	size_t payload_size = 0;
+	size_t payload_filled = 0;
+	size_t payload_capacity = 0;
+	/// Bytes at the start of the payload already in the order of the CPU.
+	size_t payload_swapped = 0;
+	uint64_t array_length = 0;
+
+	/// Scalar or array read up to its closing tag.
+	Node *leaf = nullptr;
+
+	std::vector<Frame> frames;
+	std::vector<char *> keys;
+	std::vector<Node *> values;
+
+	/// The node read, until taken.
+	Node *done = nullptr;
+
+	/// Releases everything read so far, and gets ready for a new message.
+	void Reset() {
+		// Nodes in an arena are left to it, and so are keys.
+		SBF_DestroyNode(leaf);
+		SBF_DestroyNode(done);
+
+		for (auto value : values) SBF_DestroyNode(value);
+		if (!options.arena) for (auto key : keys) free(key);
+
+		free(payload);
+
+		leaf = nullptr;
+		done = nullptr;
+		payload = nullptr;
+		payload_size = payload_filled = payload_capacity = payload_swapped = 0;
+
+		frames.clear();
+		keys.clear();
+		values.clear();
+
+		state = State::Value;
+		offset = 0;
+		padding = 0;
+	}
+
+	~SBF_Decoder() { Reset(); }
+
+	[[noreturn]] void Fail(const std::string &what, const char *name, size_t at) const {
+		throw SBF::DeserException(what, name, at);
+	}
+
+	[[noreturn]] void Fail(const std::string &what, uint8_t tag, size_t at) const {
+		Fail(what, TagName(tag), at);
+	}
+
+	/// Starts filling a payload of size bytes.
+	void BeginPayload(size_t size) {
+		payload_size = size;
+		payload_filled = 0;
+		payload_swapped = 0;
+	}
+
+	/// Makes room for at least bytes in the payload buffer, growing it geometrically but never past limit.
+	void GrowPayload(size_t bytes, size_t limit) {
+		if (bytes <= payload_capacity) return;
+
+		auto capacity = payload_capacity * 2;
+		if (capacity < Min_Payload_Growth) capacity = Min_Payload_Growth;
+		if (capacity < bytes) capacity = bytes;
+		if (capacity > limit) capacity = limit;
+
+		auto grown = (uint8_t *)realloc(payload, capacity);
+		if (!grown) throw std::bad_alloc();
+
+		payload = grown;
+		payload_capacity = capacity;
+	}
+
+	/// Copies what the chunk holds of the payload; returns true once it is complete.
+	bool FillPayload(const uint8_t *&chunk, size_t &available, size_t room) {
+		const auto take = available < payload_size - payload_filled ? available : payload_size - payload_filled;
+
+		GrowPayload(payload_filled + take, payload_size + room);
+		if (take) std::memcpy(payload + payload_filled, chunk, take);
+
+		payload_filled += take;
+		chunk += take;
+		available -= take;
+		offset += take;
+
+		if (payload_filled < payload_size) return false;
+
+		GrowPayload(payload_size + room, payload_size + room);
+		return true;
+	}
+
+	/// Copies what the chunk holds of the fixed-size field; returns true once it is complete.
+	bool FillFixed(const uint8_t *&chunk, size_t &available) {
+		const auto take = available < fixed_size - fixed_filled ? available : fixed_size - fixed_filled;
+
+		std::memcpy(fixed + fixed_filled, chunk, take);
+
+		fixed_filled += take;
+		chunk += take;
+		available -= take;
+		offset += take;
+
+		return fixed_filled == fixed_size;
+	}
+
+	/// Hands the payload buffer over as the contents of a node: as it is on the heap, copied into an arena.
+	template<typename Allocator>
+	void *TakePayload(Allocator &allocator, size_t bytes) {
+		if (!options.arena) {
+			auto taken = payload;
+			payload = nullptr;
+			payload_capacity = 0;
+			return taken;
+		}
+
+		auto copy = allocator.Allocate(bytes);
+		std::memcpy(copy, payload, bytes);
+		return copy;
+	}
+
+	/// Files a complete node: as the result, or as the value of the innermost table or columns node.
+	/// Returns true for the result.
+	bool Finish(Node *node) {
+		if (frames.empty()) {
+			done = node;
+			state = State::Done;
+			return true;
+		}
+
+		auto &frame = frames.back();
+
+		if (frame.tag == (uint8_t)Tag::Open_Columns) {
+			const auto column = frame.length;
+
+			if (node->type == NodeType_String && node->string_length && node->string[node->string_length - 1] != '\0') {
+				SBF_DestroyNode(node);
+				Fail("string column #" + std::to_string(column) + " does not end with a null character", frame.tag, tag_offset);
+			}
+
+			if (SBF::ColumnRows(node) != frame.rows) {
+				const auto rows = SBF::ColumnRows(node);
+				SBF_DestroyNode(node);
+
+				Fail("column #" + std::to_string(column) + " holds " + std::to_string(rows)
+					+ " rows, but the header announces " + std::to_string(frame.rows), frame.tag, tag_offset);
+			}
+		}
+
+		values.push_back(node);
+		frame.length++;
+		state = State::Entry;
+
+		return false;
+	}
+
+	/// Builds the table or columns node of the innermost frame out of its entries.
+	template<typename Allocator>
+	Node *BuildFrame(Allocator &allocator) {
+		const auto frame = frames.back();
+		const auto type = frame.tag == (uint8_t)Tag::Open_Columns ? NodeType_Columns : NodeType_T;
+
+		if (type == NodeType_Columns && frame.rows && !frame.length) Fail("rows without any column", frame.tag, offset);
+
+		char **table_keys = nullptr;
+		Node **table_values = nullptr;
+
+		if (frame.length) {
+			table_keys = (char **)allocator.Allocate(sizeof(char *) * frame.length);
+			table_values = (Node **)allocator.Allocate(sizeof(Node *) * frame.length);
+
+			std::memcpy(table_keys, keys.data() + frame.first_key, sizeof(char *) * frame.length);
+			std::memcpy(table_values, values.data() + frame.first_value, sizeof(Node *) * frame.length);
+		}
+
+		keys.resize(frame.first_key);
+		values.resize(frame.first_value);
+		frames.pop_back();
+
+		auto node = allocator.NewNode();
+		node->type = type;
+		node->keys = table_keys;
+		node->values = table_values;
+		node->table_length = frame.length;
+
+		if (frame.tag == (uint8_t)Tag::Open_Sorted_Table) node->flags |= NodeFlag_Sorted;
+
+		return node;
+	}
+
+	/// Creates the node of an encoded array whose body has been read, decoding it.
+	template<typename Order, typename Allocator>
+	Node *BuildPacked(Allocator &allocator) {
+		const auto header = SBF::ReadPackedHeader<Order>(payload, payload_size, tag_offset);
+
+		auto node = allocator.NewNode();
+		node->type = header.type;
+		node->flags |= (uint32_t)header.encoding << SBF::EncodingShift;
+		node->array = nullptr;
+		node->array_length = header.count;
+
+		if (header.count) {
+			node->array = allocator.Allocate(SBF::ArrayElementSize(header.type) * header.count);
+
+			try {
+				SBF::DecodePacked<Order>(payload, payload_size, header, node->array, tag_offset);
+			} catch (...) {
+				allocator.Destroy(node);
+				throw;
+			}
+		}
+
+		return node;
+	}
+
+	/// Creates the node of a scalar, array or string whose bytes have all been read.
+	template<typename Order, typename Allocator>
+	Node *BuildLeaf(Allocator &allocator) {
+		if (tag == (uint8_t)Tag::Open_Packed_Array) return BuildPacked<Order>(allocator);
+
+		auto node = allocator.NewNode();
+		node->type = (NodeType)tag;
+
+		if (SBF::IsScalarType(node->type)) {
+			switch (node->type) {
+			case NodeType_I32: node->i32 = Order::template Read<int32_t>(fixed); break;
+			case NodeType_I64: node->i64 = Order::template Read<int64_t>(fixed); break;
+			case NodeType_F32: node->f32 = Order::template Read<float>(fixed); break;
+			case NodeType_F64: node->f64 = Order::template Read<double>(fixed); break;
+			case NodeType_U32: node->u32 = Order::template Read<uint32_t>(fixed); break;
+			case NodeType_U64: node->u64 = Order::template Read<uint64_t>(fixed); break;
+			default: node->u64 = 0; node->u8 = fixed[0]; break;
+			}
+
+			return node;
+		}
+
+		if (node->type == NodeType_String) {
+			payload[array_length] = '\0';
+			node->string = (char *)TakePayload(allocator, array_length + 1);
+			node->string_length = array_length;
+			return node;
+		}
+
+		node->array = array_length ? TakePayload(allocator, payload_size) : nullptr;
+		node->array_length = array_length;
+
+		return node;
+	}
+
+	/// Reads the opening tag of a node (or a byte of padding before it) at the start of the chunk.
+	void ReadTag(const uint8_t *&chunk, size_t &available) {
+		const auto byte = *chunk;
+		const bool column = !frames.empty() && frames.back().tag == (uint8_t)Tag::Open_Columns;
+
+		if (!byte) {
+			if (++padding == SBF::MaxArrayAlignment) Fail("padding longer than " + std::to_string(SBF::MaxArrayAlignment - 1) + " bytes", "Padding", offset + 1 - padding);
+
+			chunk++;
+			available--;
+			offset++;
+			return;
+		}
+
+		if (padding && !IsNumericArrayTag(byte)) Fail("padding before a node other than an array", "Padding", offset);
+
+		if (byte > (uint8_t)Tag::Open_Packed_Array) Fail("invalid tag '" + std::to_string(byte) + "'", (uint8_t)Tag::Open_Table, offset);
+
+		if (column && !SBF::IsArrayTag(byte)) Fail("column #" + std::to_string(frames.back().length) + " must be an array", frames.back().tag, offset);
+
+		// Columns nodes hold no tables, so only tables count towards the depth.
+		if (!column && frames.size() + 1 > max_depth)
+			Fail("nesting exceeds the maximum depth of " + std::to_string(max_depth), (uint8_t)Tag::Open_Table, offset);
+
+		tag = byte;
+		tag_offset = offset;
+		padding = 0;
+
+		chunk++;
+		available--;
+		offset++;
+
+		if (IsTableTag(tag)) {
+			frames.push_back({ tag, tag_offset, keys.size(), values.size(), 0, 0 });
+			state = State::Entry;
+			return;
+		}
+
+		fixed_size = fixed_sizes[tag];
+		fixed_filled = 0;
+		state = State::Fixed;
+	}
+
+	/// Reads the key of the next entry, or the closing tag of the innermost table or columns node.
+	template<typename Allocator>
+	bool ReadEntry(Allocator &allocator, const uint8_t *&chunk, size_t &available) {
+		const auto &frame = frames.back();
+		const auto byte = *chunk;
+
+		if (byte == (uint8_t)-frame.tag) {
+			chunk++;
+			available--;
+			offset++;
+
+			return Finish(BuildFrame(allocator));
+		}
+
+		if (byte != (uint8_t)Tag::Open_String) Fail("table entry must be String", frame.tag, offset);
+
+		chunk++;
+		available--;
+		offset++;
+
+		fixed_size = sizeof(uint64_t);
+		fixed_filled = 0;
+		state = State::KeyLength;
+
+		return false;
+	}
+
+	/// Files the key just read, checking the order of the keys of sorted tables.
+	template<typename Allocator>
+	void EndKey(Allocator &allocator) {
+		payload[array_length] = '\0';
+		keys.push_back((char *)TakePayload(allocator, array_length + 1));
+
+		const auto &frame = frames.back();
+
+		if (frame.tag == (uint8_t)Tag::Open_Sorted_Table && frame.length && std::strcmp(keys[keys.size() - 2], keys.back()) >= 0)
+			Fail("key #" + std::to_string(frame.length) + " of a sorted table is not after the one before it", frame.tag, tag_offset);
+
+		state = State::Value;
+	}
+
+	/// Starts reading an array, string or key of the given element size once its length is known.
+	void BeginArray(size_t element_size, uint8_t owner) {
+		if (array_length > (SIZE_MAX - 1) / element_size)
+			Fail("array length " + std::to_string(array_length) + " is too large", owner, offset - sizeof(uint64_t));
+
+		BeginPayload(array_length * element_size);
+	}
+
+	/// Reads the chunk up to the end of the node; returns true if it ends there.
+	template<typename Order, typename Allocator>
+	bool Run(Allocator &allocator, const uint8_t *&chunk, size_t &available) {
+		while (available) {
+			switch (state) {
+			case State::Value:
+				ReadTag(chunk, available);
+				break;
+
+			case State::Fixed:
+				if (!FillFixed(chunk, available)) break;
+
+				if (tag == (uint8_t)Tag::Open_Columns) {
+					frames.push_back({ tag, tag_offset, keys.size(), values.size(), 0, Order::template Read<uint64_t>(fixed) });
+					state = State::Entry;
+				} else if (SBF::IsScalarType((NodeType)tag)) {
+					leaf = BuildLeaf<Order>(allocator);
+					state = State::Close;
+				} else {
+					array_length = Order::template Read<uint64_t>(fixed);
+					BeginArray(PayloadElementSize(tag), tag);
+					state = State::Payload;
+				}
+				break;
+
+			case State::Payload:
+				{
+					const auto string = tag == (uint8_t)Tag::Open_String;
+					const auto complete = FillPayload(chunk, available, string ? 1 : 0);
+
+					// Swap the elements completed so far while they are still in cache.
+					if constexpr (Order::Swaps) {
+						const auto element_size = PayloadElementSize(tag);
+						const auto ready = payload_filled / element_size * element_size;
+
+						SwapInPlace<Order>(tag, payload + payload_swapped, (ready - payload_swapped) / element_size);
+						payload_swapped = ready;
+					}
+
+					if (!complete) break;
+
+					leaf = BuildLeaf<Order>(allocator);
+					state = State::Close;
+				}
+				break;
+
+			case State::Close:
+				if (*chunk != (uint8_t)-tag) Fail("closing tag mismatch; expected " + std::string(TagName(tag)), tag, offset);
+
+				chunk++;
+				available--;
+				offset++;
+
+				{
+					auto node = leaf;
+					leaf = nullptr;
+
+					if (Finish(node)) return true;
+				}
+				break;
+
+			case State::Entry:
+				if (ReadEntry(allocator, chunk, available)) return true;
+				break;
+
+			case State::KeyLength:
+				if (!FillFixed(chunk, available)) break;
+
+				tag_offset = offset - 1 - sizeof(uint64_t);
+				array_length = Order::template Read<uint64_t>(fixed);
+				BeginArray(1, frames.back().tag);
+				state = State::KeyChars;
+				break;
+
+			case State::KeyChars:
+				if (FillPayload(chunk, available, 1)) state = State::KeyClose;
+				break;
+
+			case State::KeyClose:
+				if (*chunk != (uint8_t)Tag::Close_String)
+					Fail("failed to deserialize table key #" + std::to_string(frames.back().length) + ": malformed String", frames.back().tag, tag_offset);
+
+				chunk++;
+				available--;
+				offset++;
+
+				EndKey(allocator);
+				break;
+
+			case State::Done:
+				return true;
+			}
+		}
+
+		return state == State::Done;
+	}
+
+	template<typename Order>
+	bool RunIn(const uint8_t *&chunk, size_t &available) {
+		if (options.arena) {
+			SBF::ArenaAllocator allocator = { options.arena->cursor };
+			return Run<Order>(allocator, chunk, available);
+		}
+
+		SBF::HeapAllocator allocator;
+		return Run<Order>(allocator, chunk, available);
+	}
+};
+
+SBF_Decoder *SBF_CreateDecoder(const SBF_DecodeOptions *options) {
+	auto decoder = new SBF_Decoder;
+
+	decoder->options = options ? *options : SBF_DecodeOptions {};
+	decoder->max_depth = decoder->options.max_depth ? decoder->options.max_depth : SIZE_MAX;
+
+	return decoder;
+}
+
+void SBF_DestroyDecoder(SBF_Decoder *decoder) {
+	delete decoder;
+}
+
+SBF_DecodeStatus SBF_DecoderFeed(SBF_Decoder *decoder, const uint8_t *chunk, size_t length, size_t *used) {
+	if (!decoder) throw std::invalid_argument("decoder argument must not be null");
+	if (!chunk && length) throw std::invalid_argument("chunk argument must not be null");
+
+	if (used) *used = 0;
+	if (decoder->state == State::Done) return SBF_DECODE_DONE;
+
+	auto next = chunk;
+	auto available = length;
+	bool complete;
+
+	try {
+		if (decoder->options.flags & SBF_DECODE_BIG_ENDIAN) complete = decoder->RunIn<SBF::BigEndian>(next, available);
+		else complete = decoder->RunIn<SBF::LittleEndian>(next, available);
+
+		if (complete && available && !used) throw SBF::DeserException("bytes past the end of the node", "Stream", decoder->offset);
+	} catch (...) {
+		decoder->Reset();
+		throw;
+	}
+
+	if (used) *used = next - chunk;
+
+	return complete ? SBF_DECODE_DONE : SBF_DECODE_NEED_MORE;
+}
+
+Node *SBF_DecoderTake(SBF_Decoder *decoder) {
+	if (!decoder) throw std::invalid_argument("decoder argument must not be null");
+	if (decoder->state != State::Done) return nullptr;
+
+	auto node = decoder->done;
+	decoder->done = nullptr;
+	decoder->Reset();
+
+	return node;
+}
+
+void SBF_DecoderReset(SBF_Decoder *decoder) {
+	if (!decoder) throw std::invalid_argument("decoder argument must not be null");
+
+	decoder->Reset();
+}
+
+size_t SBF_DecoderOffset(const SBF_Decoder *decoder) {
+	if (!decoder) throw std::invalid_argument("decoder argument must not be null");
+
+	return decoder->offset;
+}
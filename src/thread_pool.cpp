@@ -0,0 +1,111 @@
+#include "thread_pool.h"
+
+#include <functional>
+#include <algorithm>
+#include <exception>
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <thread>
+#include <mutex>
+
+namespace SBF {
+
+ThreadPool::ThreadPool(size_t thread_count) {
+	if (!thread_count) thread_count = 1;
+
+	threads.reserve(thread_count);
+	for (size_t x = 0; x < thread_count; x++) threads.emplace_back([this]() { Run(); });
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+		changed.notify_all();
+	}
+
+	// Queued jobs still run before the workers exit.
+	for (auto &thread : threads) thread.join();
+}
+
+void ThreadPool::Run() {
+	std::unique_lock lock(mutex);
+
+	while (true) {
+		changed.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+		if (jobs.empty()) return;
+
+		auto job = std::move(jobs.front());
+		jobs.pop_front();
+
+		lock.unlock();
+		job();
+		lock.lock();
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> job) {
+	std::lock_guard lock(mutex);
+
+	jobs.push_back(std::move(job));
+	changed.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t parts, const std::function<void(size_t part, size_t parts)> &body) {
+	if (parts <= 1) {
+		if (parts) body(0, 1);
+		return;
+	}
+
+	// Outlives the call: helpers may only get scheduled after every part is done.
+	struct State {
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::atomic<size_t> next = 0;
+		size_t done = 0;
+		std::exception_ptr error;
+	};
+
+	auto state = std::make_shared<State>();
+
+	const auto work = [state, parts, &body]() {
+		while (true) {
+			auto part = state->next.fetch_add(1);
+			if (part >= parts) return;
+
+			std::exception_ptr error;
+			try {
+				body(part, parts);
+			} catch (...) {
+				error = std::current_exception();
+			}
+
+			std::lock_guard lock(state->mutex);
+			if (error && !state->error) state->error = error;
+			if (++state->done == parts) state->finished.notify_all();
+		}
+	};
+
+	auto helpers = std::min(parts - 1, Size());
+	for (size_t x = 0; x < helpers; x++) {
+		// body is only touched for parts claimed before the caller returns.
+		Submit([state, parts, work]() { if (state->next.load() < parts) work(); });
+	}
+
+	work();
+
+	std::unique_lock lock(state->mutex);
+	state->finished.wait(lock, [&]() { return state->done == parts; });
+
+	if (state->error) std::rethrow_exception(state->error);
+}
+
+ThreadPool &ThreadPool::Shared() {
+	// At least two workers, so a blocking file job never starves everything else.
+	static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()));
+	return pool;
+}
+
+};
@@ -0,0 +1,183 @@
+#include "uring.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <memory>
+
+#if defined(SBF_HAS_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace SBF {
+
+#if defined(SBF_HAS_IO_URING)
+
+std::unique_ptr<Uring> Uring::Create(unsigned entries) {
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+
+	int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+
+	// Old kernels, seccomp filters and containers commonly disable io_uring.
+	if (fd < 0) return nullptr;
+
+	std::unique_ptr<Uring> ring(new Uring());
+	ring->ring_fd = fd;
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap) {
+		if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(nullptr, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		ring->sq_ring = nullptr;
+		return nullptr;
+	}
+
+	if (single_mmap) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(nullptr, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = nullptr;
+			return nullptr;
+		}
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	ring->sqes = mmap(nullptr, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = nullptr;
+		return nullptr;
+	}
+
+	auto sq = static_cast<uint8_t *>(ring->sq_ring);
+	ring->sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	ring->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	ring->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+	ring->sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	ring->sq_entries = params.sq_entries;
+
+	auto cq = static_cast<uint8_t *>(ring->cq_ring);
+	ring->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	ring->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	ring->cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	ring->cqes = cq + params.cq_off.cqes;
+
+	return ring;
+}
+
+Uring::~Uring() {
+	if (sqes) munmap(sqes, sqes_size);
+	if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+	if (sq_ring) munmap(sq_ring, sq_ring_size);
+	if (ring_fd >= 0) close(ring_fd);
+}
+
+bool Uring::Queue(uint8_t opcode, int fd, const void *buffer, uint32_t length, uint64_t offset, uint64_t tag) {
+	// Only this thread writes the tail; the kernel advances the head.
+	const auto tail = *sq_tail;
+	const auto head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+	if (tail - head >= sq_entries) return false;
+
+	const auto index = tail & sq_mask;
+	auto sqe = static_cast<io_uring_sqe *>(sqes) + index;
+
+	std::memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<uint64_t>(buffer);
+	sqe->len = length;
+	sqe->off = offset;
+	sqe->user_data = tag;
+
+	sq_array[index] = index;
+	__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	queued++;
+	return true;
+}
+
+bool Uring::QueueRead(int fd, void *buffer, uint32_t length, uint64_t offset, uint64_t tag) {
+	return Queue(IORING_OP_READ, fd, buffer, length, offset, tag);
+}
+
+bool Uring::QueueWrite(int fd, const void *buffer, uint32_t length, uint64_t offset, uint64_t tag) {
+	return Queue(IORING_OP_WRITE, fd, buffer, length, offset, tag);
+}
+
+void Uring::Submit(unsigned wait_for) {
+	while (true) {
+		auto result = syscall(
+			__NR_io_uring_enter,
+			ring_fd,
+			queued,
+			wait_for,
+			wait_for ? IORING_ENTER_GETEVENTS : 0,
+			nullptr,
+			0
+		);
+
+		if (result >= 0) {
+			queued -= (unsigned)result;
+			return;
+		}
+
+		if (errno == EINTR) continue;
+
+		throw std::runtime_error(std::string("io_uring submission failed: ") + std::strerror(errno));
+	}
+}
+
+void Uring::Wait() {
+	while (true) {
+		auto result = syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+		if (result >= 0) return;
+		if (errno == EINTR) continue;
+
+		throw std::runtime_error(std::string("io_uring wait failed: ") + std::strerror(errno));
+	}
+}
+
+bool Uring::PopCompletion(uint64_t &tag, int32_t &result) {
+	const auto head = *cq_head;
+	const auto tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail) return false;
+
+	auto cqe = static_cast<io_uring_cqe *>(cqes) + (head & cq_mask);
+	tag = cqe->user_data;
+	result = cqe->res;
+
+	__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+#else
+
+std::unique_ptr<Uring> Uring::Create(unsigned) { return nullptr; }
+
+Uring::~Uring() {}
+
+bool Uring::Queue(uint8_t, int, const void *, uint32_t, uint64_t, uint64_t) { return false; }
+bool Uring::QueueRead(int, void *, uint32_t, uint64_t, uint64_t) { return false; }
+bool Uring::QueueWrite(int, const void *, uint32_t, uint64_t, uint64_t) { return false; }
+void Uring::Submit(unsigned) {}
+void Uring::Wait() {}
+bool Uring::PopCompletion(uint64_t &, int32_t &) { return false; }
+
+#endif
+
+};
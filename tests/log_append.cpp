@@ -0,0 +1,151 @@
+// Update records of log files, with checksums or without: one cut short by a crash at the tail is ignored
+// and cut off by the next append, while a damaged one with more records after it is an error for the reader.
+// SBF_AppendFile refuses a malformed record too, but only checks the checksum of the last block.
+
+#include <filesystem>
+#include <exception>
+#include <iostream>
+#include <fstream>
+#include <string>
+
+#include "SBF/sbf.h"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const char *what) {
+	if (condition) return;
+
+	std::cerr << "FAILED: " << what << "\n";
+	failures++;
+}
+
+Node *Tree(int32_t x) {
+	auto table = SBF_CreateNode_Table(nullptr, nullptr, 0);
+	SBF_TableSet(table, "x", SBF_CreateNode_I32(x));
+	return table;
+}
+
+/// Appends the patch turning {x: from} into {x: to}.
+void AppendChange(const std::string &path, int32_t from, int32_t to) {
+	auto old_tree = Tree(from);
+	auto new_tree = Tree(to);
+	auto patch = SBF_Diff(old_tree, new_tree);
+
+	SBF_AppendFile(path.c_str(), patch);
+
+	SBF_DestroyNode(patch);
+	SBF_DestroyNode(new_tree);
+	SBF_DestroyNode(old_tree);
+}
+
+int32_t ReadX(const std::string &path) {
+	auto tree = SBF_ReadFile(path.c_str(), nullptr);
+	auto x = SBF_NodeGet_I32(SBF_TableGet(tree, "x"));
+	SBF_DestroyNode(tree);
+	return x;
+}
+
+void TornAppend(const std::string &path, uint32_t write_flags) {
+	SBF_WriteOptions options = {};
+	options.flags = write_flags;
+
+	auto base = Tree(1);
+	SBF_WriteFileEx(path.c_str(), base, &options);
+	SBF_DestroyNode(base);
+
+	AppendChange(path, 1, 2);
+	Check(ReadX(path) == 2, "the appended record is replayed");
+
+	// A crash in the middle of the append leaves the record cut short.
+	const auto size = std::filesystem::file_size(path);
+	std::filesystem::resize_file(path, size - 2);
+	Check(ReadX(path) == 1, "a torn record at the tail is ignored");
+
+	AppendChange(path, 1, 3);
+	Check(ReadX(path) == 3, "a record appended after a torn one is replayed");
+
+	AppendChange(path, 3, 4);
+	Check(ReadX(path) == 4, "appends keep working after a torn record");
+
+	SBF_Compact(path.c_str());
+	Check(ReadX(path) == 4, "compaction keeps every record");
+}
+
+void DamagedRecord(const std::string &path, uint32_t write_flags) {
+	SBF_WriteOptions options = {};
+	options.flags = write_flags;
+
+	// In checksummed files, the base node and the records are in blocks: a u64 length, the node and a u32 checksum.
+	const bool checksum = write_flags & SBF_WRITE_CHECKSUM;
+
+	auto base = Tree(1);
+	const auto base_end = 1 + SBF_CalculateSize(base) + (checksum ? 12 : 0);
+	const auto record_start = base_end + (checksum ? 8 : 0);
+
+	SBF_WriteFileEx(path.c_str(), base, &options);
+	SBF_DestroyNode(base);
+
+	AppendChange(path, 1, 2);
+	AppendChange(path, 2, 3);
+
+	// Damage the first record, which has another one after it.
+	{
+		std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(record_start);
+		file.put((char)0x7f);
+	}
+
+	bool threw = false;
+	try {
+		SBF_DestroyNode(SBF_ReadFile(path.c_str(), nullptr));
+	} catch (std::exception &) {
+		threw = true;
+	}
+	Check(threw, "a damaged record before the tail throws");
+
+	const auto size = std::filesystem::file_size(path);
+
+	threw = false;
+	try {
+		AppendChange(path, 3, 4);
+	} catch (std::exception &) {
+		threw = true;
+	}
+
+	if (checksum) {
+		Check(!threw && std::filesystem::file_size(path) > size, "appending steps over blocks without checking them");
+
+		threw = false;
+		try {
+			SBF_DestroyNode(SBF_ReadFile(path.c_str(), nullptr));
+		} catch (std::exception &) {
+			threw = true;
+		}
+		Check(threw, "a damaged block before the tail still throws after an append");
+	} else {
+		Check(threw, "appending after a malformed record throws");
+		Check(std::filesystem::file_size(path) == size, "a refused append leaves the file as it was");
+	}
+}
+
+};
+
+int main() {
+	const auto path = (std::filesystem::temp_directory_path() / "sbf_log_append.sav").string();
+
+	try {
+		for (uint32_t flags : { 0u, (uint32_t)SBF_WRITE_BIG_ENDIAN, (uint32_t)SBF_WRITE_CHECKSUM, (uint32_t)(SBF_WRITE_CHECKSUM | SBF_WRITE_BIG_ENDIAN) }) {
+			TornAppend(path, flags);
+			DamagedRecord(path, flags);
+		}
+	} catch (std::exception &e) {
+		std::cerr << "FAILED: " << e.what() << "\n";
+		failures++;
+	}
+
+	std::filesystem::remove(path);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,862 @@
+// Command-line tool for looking into SBF files: where their space goes, what they hold,
+// rewriting them with other options, and how long they take to load and save.
+//
+// Usage: sbf-tool stats FILE [--select PATH]
+//        sbf-tool dump FILE [--select PATH] [--depth N] [--items N] [--chars N] [--lines N]
+//        sbf-tool convert INPUT OUTPUT [--checksum] [--big-endian] [--canonical] [--sorted-tables] [--align N] [--pack] [--raw] [--pretty]
+//        sbf-tool bench FILE [--min-time SECONDS] [--dir DIR]
+//
+// Only the public API is used, so it works on any build of the library; decoder times
+// are broken down when the library is built with SBF_ENABLE_STATS.
+
+#include <filesystem>
+#include <stdexcept>
+#include <exception>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <type_traits>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "SBF/sbf.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/// Top bit of the version byte of big-endian files.
+constexpr uint8_t Big_Endian_Flag = 0x80;
+
+/// Bits of the version byte holding the base-2 logarithm plus one of the array alignment of the base node.
+constexpr uint8_t Alignment_Mask = 0x70;
+constexpr int Alignment_Shift = 4;
+
+/// Format version of files stored in checksummed blocks.
+constexpr uint8_t Checksum_Version = 2;
+
+// Framing of a block in a checksummed file: the length of the node before it, its CRC32C after it.
+constexpr size_t Block_Header_Size = 8;
+constexpr size_t Block_Trailer_Size = 4;
+
+const char *const type_names[] = {
+	"None",
+	"I32", "I64", "F32", "F64", "I8", "U32", "U64", "U8", "Char",
+	"I32A", "I64A", "F32A", "F64A", "I8A", "U32A", "U64A", "U8A",
+	"String", "T", "Columns",
+};
+
+const char *TypeName(NodeType type) {
+	return type <= NodeType_Columns ? type_names[type] : "UNKNOWN";
+}
+
+/// Command-line arguments: positional ones, and options with their values.
+struct Args {
+	std::vector<std::string> positional;
+	std::map<std::string, std::string> options;
+
+	bool Has(const std::string &name) const { return options.count(name) != 0; }
+
+	std::string Get(const std::string &name, const std::string &fallback) const {
+		auto found = options.find(name);
+		return found == options.end() ? fallback : found->second;
+	}
+
+	size_t GetSize(const std::string &name, size_t fallback) const {
+		return Has(name) ? std::strtoull(Get(name, "").c_str(), nullptr, 10) : fallback;
+	}
+};
+
+/// Options taking a value; the others are flags.
+const char *const valued_options[] = { "--select", "--depth", "--items", "--chars", "--lines", "--min-time", "--dir", "--align" };
+
+Args ParseArgs(int argc, char **argv, int first) {
+	Args args;
+
+	for (int x = first; x < argc; x++) {
+		std::string arg = argv[x];
+
+		if (arg.rfind("--", 0) != 0) {
+			args.positional.push_back(arg);
+			continue;
+		}
+
+		const bool valued = std::find_if(std::begin(valued_options), std::end(valued_options),
+			[&](const char *name) { return arg == name; }) != std::end(valued_options);
+
+		if (!valued) {
+			args.options[arg] = "";
+			continue;
+		}
+
+		if (x + 1 >= argc) throw std::invalid_argument("missing value for " + arg);
+		args.options[arg] = argv[++x];
+	}
+
+	return args;
+}
+
+std::vector<uint8_t> ReadBytes(const std::string &path) {
+	auto file = std::fopen(path.c_str(), "rb");
+	if (!file) throw std::runtime_error("failed to open " + path);
+
+	std::vector<uint8_t> bytes(std::filesystem::file_size(path));
+	const auto read = std::fread(bytes.data(), 1, bytes.size(), file);
+	std::fclose(file);
+
+	if (read != bytes.size()) throw std::runtime_error("failed to read " + path);
+
+	return bytes;
+}
+
+void WriteBytes(const std::string &path, const void *bytes, size_t size) {
+	auto file = std::fopen(path.c_str(), "wb");
+	if (!file) throw std::runtime_error("failed to open " + path);
+
+	const auto written = std::fwrite(bytes, 1, size, file);
+	if (std::fclose(file) != 0 || written != size) throw std::runtime_error("failed to write " + path);
+}
+
+uint64_t ReadU64(const uint8_t *bytes, bool big_endian) {
+	uint64_t value = 0;
+
+	for (size_t x = 0; x < 8; x++) {
+		const auto byte = big_endian ? bytes[x] : bytes[7 - x];
+		value = value << 8 | byte;
+	}
+
+	return value;
+}
+
+/// A file image, and where its base node and update records are.
+struct Image {
+	std::vector<uint8_t> bytes;
+	uint8_t version = 0;
+	bool big_endian = false;
+	/// Alignment of the arrays of the base node; 0 when packed.
+	uint32_t alignment = 0;
+
+	struct Span { size_t offset, length; };
+	std::vector<Span> nodes;
+
+	/// Bytes after the last intact node: a record torn by a crash, which readers ignore.
+	size_t torn = 0;
+
+	SBF_DecodeOptions DecodeOptions() const {
+		SBF_DecodeOptions options = {};
+		if (big_endian) options.flags |= SBF_DECODE_BIG_ENDIAN;
+		return options;
+	}
+};
+
+/// Steps over the node at *begin, ending by limit, and scans it into stats.
+void StepOver(const Image &image, size_t limit, size_t *begin, SBF_ScanStats &stats) {
+	if (!image.big_endian) {
+		SBF_ScanBytes(image.bytes.data(), limit, begin, &stats);
+		return;
+	}
+
+	// Scans only read little-endian bytes: the node is decoded, and scanned once written in that order.
+	auto options = image.DecodeOptions();
+	auto node = SBF_DeserializeEx(image.bytes.data(), limit, begin, &options);
+
+	try {
+		std::vector<uint8_t> little(SBF_CalculateSize(node));
+		size_t cursor = 0;
+		SBF_Serialize(node, little.data(), little.size(), &cursor);
+
+		cursor = 0;
+		SBF_ScanBytes(little.data(), little.size(), &cursor, &stats);
+	} catch (...) {
+		SBF_DestroyNode(node);
+		throw;
+	}
+
+	SBF_DestroyNode(node);
+}
+
+/// Reads a file and finds its nodes, scanning them into stats on the way.
+Image OpenImage(const std::string &path, SBF_ScanStats &stats) {
+	Image image;
+	image.bytes = ReadBytes(path);
+
+	if (image.bytes.empty()) throw std::runtime_error(path + " is empty");
+
+	image.version = image.bytes[0] & ~(Big_Endian_Flag | Alignment_Mask);
+	image.big_endian = image.bytes[0] & Big_Endian_Flag;
+
+	if (const auto log = (image.bytes[0] & Alignment_Mask) >> Alignment_Shift) image.alignment = 1u << (log - 1);
+
+	const auto size = image.bytes.size();
+	size_t offset = 1;
+
+	while (offset < size) {
+		size_t start = offset;
+		size_t limit = size;
+
+		if (image.version == Checksum_Version) {
+			if (size - offset < Block_Header_Size + Block_Trailer_Size) break;
+
+			const auto length = ReadU64(image.bytes.data() + offset, image.big_endian);
+			if (length > size - offset - Block_Header_Size - Block_Trailer_Size) break;
+
+			start = offset + Block_Header_Size;
+			limit = start + length;
+		}
+
+		// Only the base node must be intact; a record may be torn at the end.
+		size_t end = start;
+
+		try {
+			StepOver(image, limit, &end, stats);
+			if (image.version == Checksum_Version && end != limit) throw std::runtime_error("block holds more than one node");
+		} catch (std::exception &) {
+			if (image.nodes.empty()) throw;
+			break;
+		}
+
+		image.nodes.push_back({ start, end - start });
+		offset = image.version == Checksum_Version ? end + Block_Trailer_Size : end;
+	}
+
+	if (image.nodes.empty()) throw std::runtime_error(path + " holds no node");
+
+	image.torn = size - std::min(size, offset);
+
+	return image;
+}
+
+/// Bytes in the unit that reads best.
+std::string Size(uint64_t bytes) {
+	char text[32];
+
+	if (bytes < 10000) std::snprintf(text, sizeof(text), "%llu bytes", (unsigned long long)bytes);
+	else if (bytes < 10000000) std::snprintf(text, sizeof(text), "%.1f kB", bytes / 1e3);
+	else std::snprintf(text, sizeof(text), "%.1f MB", bytes / 1e6);
+
+	return text;
+}
+
+void PrintScan(const SBF_ScanStats &stats, uint64_t total) {
+	std::printf("\n%-10s %14s %16s %8s\n", "type", "nodes", "bytes", "share");
+
+	const auto row = [&](const char *name, uint64_t nodes, uint64_t bytes) {
+		std::printf("%-10s %14llu %16llu %7.1f%%\n", name, (unsigned long long)nodes, (unsigned long long)bytes,
+			total ? 100.0 * bytes / total : 0.0);
+	};
+
+	for (size_t type = 1; type <= NodeType_Columns; type++) {
+		if (stats.nodes[type]) row(TypeName((NodeType)type), stats.nodes[type], stats.bytes[type]);
+	}
+
+	row("keys", stats.keys, stats.key_bytes);
+
+	if (stats.padding_bytes) {
+		std::printf("%-10s %14s %16llu %7.1f%%\n", "padding", "-", (unsigned long long)stats.padding_bytes,
+			total ? 100.0 * stats.padding_bytes / total : 0.0);
+	}
+
+	// Already counted above as the arrays they decode to.
+	if (stats.packed_arrays) std::printf("%-10s %14llu\n", "encoded", (unsigned long long)stats.packed_arrays);
+
+	std::printf("\n%-10s %14s\n", "depth", "nodes");
+
+	for (size_t depth = 1; depth < SBF_SCAN_DEPTHS; depth++) {
+		if (!stats.depths[depth]) continue;
+
+		const auto last = depth == SBF_SCAN_DEPTHS - 1;
+		std::printf("%-10s %14llu\n", (std::to_string(depth) + (last ? "+" : "")).c_str(), (unsigned long long)stats.depths[depth]);
+	}
+
+	std::printf("\nmax depth  %llu\n", (unsigned long long)stats.max_depth);
+}
+
+int Stats(const Args &args) {
+	if (args.positional.size() != 1) throw std::invalid_argument("usage: sbf-tool stats FILE [--select PATH]");
+
+	const auto &path = args.positional[0];
+
+	SBF_ScanStats stats = {};
+	auto image = OpenImage(path, stats);
+
+	std::printf("file       %s, %s\n", path.c_str(), Size(image.bytes.size()).c_str());
+	std::printf("format     version %u, %s-endian", image.version, image.big_endian ? "big" : "little");
+	if (image.alignment) std::printf(", arrays aligned to %u bytes", image.alignment);
+	std::printf("\n");
+	uint64_t records = 0;
+	for (size_t x = 1; x < image.nodes.size(); x++) records += image.nodes[x].length;
+
+	std::printf("nodes      base node of %s, %zu update records of %s\n",
+		Size(image.nodes[0].length).c_str(), image.nodes.size() - 1, Size(records).c_str());
+	if (image.torn) std::printf("torn       %zu bytes at the end, ignored by readers\n", image.torn);
+
+	uint64_t total = image.bytes.size();
+
+	if (args.Has("--select")) {
+		if (image.big_endian) throw std::invalid_argument("--select only reads little-endian files");
+
+		// Only what the selector matches in the base node, each match as a tree of its own.
+		auto selector = SBF_CompileSelector(args.Get("--select", "").c_str());
+
+		struct Matches { const Image *image; SBF_ScanStats stats; uint64_t bytes; } matches = { &image, {}, 0 };
+		size_t begin = image.nodes[0].offset;
+
+		try {
+			SBF_SelectBytes(selector, image.bytes.data(), image.nodes[0].offset + image.nodes[0].length, &begin,
+				[](size_t offset, size_t length, void *user) {
+					auto &matches = *(Matches *)user;
+					SBF_ScanBytes(matches.image->bytes.data(), offset + length, &offset, &matches.stats);
+					matches.bytes += length;
+					return true;
+				}, &matches);
+		} catch (...) {
+			SBF_DestroySelector(selector);
+			throw;
+		}
+
+		SBF_DestroySelector(selector);
+
+		std::printf("selected   %llu nodes, %s\n", (unsigned long long)matches.stats.trees, Size(matches.bytes).c_str());
+
+		stats = matches.stats;
+		total = matches.bytes;
+	}
+
+	PrintScan(stats, total);
+
+	// The decoder's own counters, when built in: what decoding the file costs.
+	SBF_ResetStats();
+
+	uint8_t version = 0;
+	auto node = SBF_ReadFile(path.c_str(), &version);
+	SBF_DestroyNode(node);
+
+	SBF_Stats decoded;
+	if (SBF_GetStats(&decoded)) {
+		std::printf("\ndecoding   %llu allocations of %s; %.3f ms parsing tables, %.3f ms copying arrays\n",
+			(unsigned long long)decoded.allocations, Size(decoded.allocated_bytes).c_str(),
+			decoded.table_parse_ns / 1e6, decoded.array_copy_ns / 1e6);
+	}
+
+	return 0;
+}
+
+/// Bounds of the output of dump.
+struct DumpLimits {
+	size_t depth;
+	size_t items;
+	size_t chars;
+	size_t lines;
+};
+
+/// Thrown once dump printed as many lines as it may.
+struct OutputFull {};
+
+class Dumper {
+	const DumpLimits limits;
+	size_t lines = 0;
+
+	void Line(size_t indent, const std::string &text) {
+		if (lines == limits.lines) throw OutputFull();
+
+		std::printf("%*s%s\n", (int)(indent * 2), "", text.c_str());
+		lines++;
+	}
+
+	std::string Quote(const char *chars, size_t length) const {
+		std::string text = "\"";
+
+		for (size_t x = 0; x < length && x < limits.chars; x++) {
+			const auto c = (unsigned char)chars[x];
+
+			if (c == '"' || c == '\\') text += std::string("\\") + (char)c;
+			else if (c == '\n') text += "\\n";
+			else if (c < 0x20 || c == 0x7f) {
+				char escaped[8];
+				std::snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+				text += escaped;
+			} else {
+				text += (char)c;
+			}
+		}
+
+		return text + (length > limits.chars ? "\"..." : "\"");
+	}
+
+	template<typename T>
+	static std::string Number(T value) {
+		if constexpr (std::is_floating_point_v<T>) {
+			char number[32];
+			std::snprintf(number, sizeof(number), "%.9g", (double)value);
+			return number;
+		} else {
+			return std::to_string(value);
+		}
+	}
+
+	template<typename T>
+	std::string Elements(const T *array, size_t length) const {
+		std::string text = "[";
+
+		for (size_t x = 0; x < length && x < limits.items; x++) {
+			if (x) text += ", ";
+			text += Number(array[x]);
+		}
+
+		if (length > limits.items) text += ", ... " + std::to_string(length - limits.items) + " more";
+
+		return text + "]";
+	}
+
+	/// The strings of a string column, one after the other, each ending with a null character.
+	std::string Strings(const char *chars, size_t length) const {
+		std::string text = "[";
+		size_t count = 0;
+
+		for (size_t x = 0; x < length; count++) {
+			const auto string_length = strnlen(chars + x, length - x);
+
+			if (count < limits.items) text += (count ? ", " : "") + Quote(chars + x, string_length);
+			x += string_length + 1;
+		}
+
+		if (count > limits.items) text += ", ... " + std::to_string(count - limits.items) + " more";
+
+		return text + "]";
+	}
+
+public:
+	explicit Dumper(const DumpLimits &limits) : limits(limits) {}
+
+	void Dump(Node *node, size_t indent, const std::string &prefix) {
+		const auto type = SBF_GetNodeType(node);
+
+		std::string text;
+
+		switch (type) {
+		case NodeType_I32: text = "I32 " + Number(SBF_NodeGet_I32(node)); break;
+		case NodeType_I64: text = "I64 " + Number(SBF_NodeGet_I64(node)); break;
+		case NodeType_I8: text = "I8 " + Number(SBF_NodeGet_I8(node)); break;
+		case NodeType_U32: text = "U32 " + Number(SBF_NodeGet_U32(node)); break;
+		case NodeType_U64: text = "U64 " + Number(SBF_NodeGet_U64(node)); break;
+		case NodeType_U8: text = "U8 " + Number(SBF_NodeGet_U8(node)); break;
+		case NodeType_Char: {
+			const auto c = SBF_NodeGet_Char(node);
+			text = "Char " + Quote(&c, 1);
+			break;
+		}
+		case NodeType_F32: text = "F32 " + Number(SBF_NodeGet_F32(node)); break;
+		case NodeType_F64: text = "F64 " + Number(SBF_NodeGet_F64(node)); break;
+		case NodeType_I32A: text = Elements(SBF_NodeGet_I32A(node), SBF_NodeGet_ArrayLength(node)); break;
+		case NodeType_I64A: text = Elements(SBF_NodeGet_I64A(node), SBF_NodeGet_ArrayLength(node)); break;
+		case NodeType_F32A: text = Elements(SBF_NodeGet_F32A(node), SBF_NodeGet_ArrayLength(node)); break;
+		case NodeType_F64A: text = Elements(SBF_NodeGet_F64A(node), SBF_NodeGet_ArrayLength(node)); break;
+		case NodeType_I8A: text = Elements(SBF_NodeGet_I8A(node), SBF_NodeGet_ArrayLength(node)); break;
+		case NodeType_U32A: text = Elements(SBF_NodeGet_U32A(node), SBF_NodeGet_ArrayLength(node)); break;
+		case NodeType_U64A: text = Elements(SBF_NodeGet_U64A(node), SBF_NodeGet_ArrayLength(node)); break;
+		case NodeType_U8A: text = Elements(SBF_NodeGet_U8A(node), SBF_NodeGet_ArrayLength(node)); break;
+		case NodeType_String: text = Quote(SBF_NodeGet_String(node), SBF_NodeGet_StringLength(node)); break;
+		case NodeType_T: DumpTable(node, indent, prefix); return;
+		case NodeType_Columns: DumpColumns(node, indent, prefix); return;
+		default: text = "UNKNOWN"; break;
+		}
+
+		// Arrays carry their type and length before the elements.
+		if (type >= NodeType_I32A && type <= NodeType_String) {
+			text = std::string(TypeName(type)) + "[" + std::to_string(SBF_NodeGet_ArrayLength(node)) + "] " + text;
+		}
+
+		Line(indent, prefix + text);
+	}
+
+private:
+	void DumpTable(Node *node, size_t indent, const std::string &prefix) {
+		char **keys;
+		Node **values;
+		SBF_NodeGet_Table(node, &keys, &values);
+
+		const auto length = SBF_NodeGet_TableLength(node);
+		const auto header = prefix + "T[" + std::to_string(length) + (SBF_TableIsSorted(node) ? ", sorted]" : "]");
+
+		if (!length) return Line(indent, header + " {}");
+		if (indent >= limits.depth) return Line(indent, header + " {...}");
+
+		Line(indent, header + " {");
+
+		for (size_t x = 0; x < length && x < limits.items; x++) {
+			Dump(values[x], indent + 1, Quote(keys[x], std::strlen(keys[x])) + ": ");
+		}
+
+		if (length > limits.items) Line(indent + 1, "... " + std::to_string(length - limits.items) + " more entries");
+
+		Line(indent, "}");
+	}
+
+	void DumpColumns(Node *node, size_t indent, const std::string &prefix) {
+		char **names;
+		Node **columns;
+		SBF_NodeGet_Columns(node, &names, &columns);
+
+		const auto count = SBF_NodeGet_ColumnCount(node);
+		const auto header = prefix + "Columns[" + std::to_string(SBF_NodeGet_RowCount(node)) + " rows]";
+
+		if (!count) return Line(indent, header + " {}");
+		if (indent >= limits.depth) return Line(indent, header + " {...}");
+
+		Line(indent, header + " {");
+
+		for (size_t x = 0; x < count && x < limits.items; x++) {
+			const auto name = Quote(names[x], std::strlen(names[x])) + ": ";
+
+			if (SBF_GetNodeType(columns[x]) == NodeType_String) {
+				Line(indent + 1, name + "String column " + Strings(SBF_NodeGet_String(columns[x]), SBF_NodeGet_StringLength(columns[x])));
+			} else {
+				Dump(columns[x], indent + 1, name);
+			}
+		}
+
+		if (count > limits.items) Line(indent + 1, "... " + std::to_string(count - limits.items) + " more columns");
+
+		Line(indent, "}");
+	}
+};
+
+int Dump(const Args &args) {
+	if (args.positional.size() != 1) {
+		throw std::invalid_argument("usage: sbf-tool dump FILE [--select PATH] [--depth N] [--items N] [--chars N] [--lines N]");
+	}
+
+	const DumpLimits limits = {
+		args.GetSize("--depth", 8),
+		std::max<size_t>(1, args.GetSize("--items", 16)),
+		args.GetSize("--chars", 80),
+		std::max<size_t>(1, args.GetSize("--lines", 1000)),
+	};
+
+	uint8_t version = 0;
+	auto root = SBF_ReadFile(args.positional[0].c_str(), &version);
+
+	if (!root) {
+		std::printf("(empty file)\n");
+		return 0;
+	}
+
+	std::vector<Node *> nodes = { root };
+
+	if (args.Has("--select")) {
+		auto selector = SBF_CompileSelector(args.Get("--select", "").c_str());
+
+		nodes.clear();
+		SBF_SelectNodes(selector, root, [](Node *node, void *user) {
+			((std::vector<Node *> *)user)->push_back(node);
+			return true;
+		}, &nodes);
+
+		SBF_DestroySelector(selector);
+	}
+
+	Dumper dumper(limits);
+
+	try {
+		for (auto node : nodes) dumper.Dump(node, 0, "");
+	} catch (OutputFull &) {
+		std::printf("... stopped after %zu lines (--lines)\n", limits.lines);
+	} catch (...) {
+		SBF_DestroyNode(root);
+		throw;
+	}
+
+	SBF_DestroyNode(root);
+
+	return 0;
+}
+
+/// Files named *.json are converted from and to JSON.
+bool IsJson(const std::string &path) {
+	return std::filesystem::path(path).extension() == ".json";
+}
+
+/// Marks every integer array of the tree, columns included, to be written with the smallest encoding.
+void PackArrays(Node *root) {
+	std::vector<Node *> pending = { root };
+
+	while (!pending.empty()) {
+		auto node = pending.back();
+		pending.pop_back();
+
+		switch (SBF_GetNodeType(node)) {
+		case NodeType_I32A: case NodeType_I64A: case NodeType_U32A: case NodeType_U64A:
+			SBF_NodeSet_ArrayEncoding(node, SBF_ARRAY_AUTO);
+			break;
+
+		case NodeType_T:
+			{
+				char **keys;
+				Node **values;
+				SBF_NodeGet_Table(node, &keys, &values);
+				pending.insert(pending.end(), values, values + SBF_NodeGet_TableLength(node));
+			}
+			break;
+
+		case NodeType_Columns:
+			{
+				char **names;
+				Node **columns;
+				SBF_NodeGet_Columns(node, &names, &columns);
+				pending.insert(pending.end(), columns, columns + SBF_NodeGet_ColumnCount(node));
+			}
+			break;
+
+		default: break;
+		}
+	}
+}
+
+int Convert(const Args &args) {
+	if (args.positional.size() != 2) {
+		throw std::invalid_argument("usage: sbf-tool convert INPUT OUTPUT [--checksum] [--big-endian] [--canonical] [--sorted-tables] [--align N] [--pack] [--raw] [--pretty]");
+	}
+
+	Node *node = nullptr;
+
+	if (IsJson(args.positional[0])) {
+		const auto text = ReadBytes(args.positional[0]);
+		node = SBF_JsonToNode((const char *)text.data(), text.size(), nullptr);
+	} else {
+		// Update records are applied on the way, so the output is compacted.
+		uint8_t version = 0;
+		node = SBF_ReadFile(args.positional[0].c_str(), &version);
+	}
+
+	if (!node) throw std::runtime_error(args.positional[0] + " holds no node");
+
+	try {
+		if (args.Has("--pack")) PackArrays(node);
+
+		if (IsJson(args.positional[1])) {
+			SBF_JsonOptions json = {};
+			if (args.Has("--pretty")) json.flags |= SBF_JSON_PRETTY;
+
+			std::vector<char> text(SBF_NodeToJson(node, nullptr, 0, &json) + 1);
+			SBF_NodeToJson(node, text.data(), text.size(), &json);
+
+			WriteBytes(args.positional[1], text.data(), text.size() - 1);
+		} else if (args.Has("--raw")) {
+			// The node alone, as it would be sent over the wire, without the file header.
+			SBF_EncodeOptions encode = {};
+			if (args.Has("--big-endian")) encode.flags |= SBF_ENCODE_BIG_ENDIAN;
+			if (args.Has("--canonical")) encode.flags |= SBF_ENCODE_CANONICAL;
+			if (args.Has("--sorted-tables")) encode.flags |= SBF_ENCODE_SORTED_TABLES;
+			encode.array_alignment = (uint32_t)args.GetSize("--align", 0);
+
+			std::vector<uint8_t> bytes(SBF_CalculateSizeEx(node, 0, &encode));
+			size_t cursor = 0;
+			SBF_SerializeEx(node, bytes.data(), bytes.size(), &cursor, &encode);
+
+			WriteBytes(args.positional[1], bytes.data(), bytes.size());
+		} else {
+			SBF_WriteOptions options = {};
+			options.flags = SBF_WRITE_ATOMIC;
+			if (args.Has("--checksum")) options.flags |= SBF_WRITE_CHECKSUM;
+			if (args.Has("--big-endian")) options.flags |= SBF_WRITE_BIG_ENDIAN;
+			if (args.Has("--canonical")) options.flags |= SBF_WRITE_CANONICAL;
+			if (args.Has("--sorted-tables")) options.flags |= SBF_WRITE_SORTED_TABLES;
+			options.array_alignment = (uint32_t)args.GetSize("--align", 0);
+
+			SBF_WriteFileEx(args.positional[1].c_str(), node, &options);
+		}
+	} catch (...) {
+		SBF_DestroyNode(node);
+		throw;
+	}
+
+	std::printf("%s: %s -> %s: %s\n",
+		args.positional[0].c_str(), Size(std::filesystem::file_size(args.positional[0])).c_str(),
+		args.positional[1].c_str(), Size(std::filesystem::file_size(args.positional[1])).c_str());
+
+	SBF_DestroyNode(node);
+
+	return 0;
+}
+
+/// Runs body until min_time elapsed, setup running untimed before every round; returns seconds per round.
+template<typename Body, typename Setup>
+double Time(double min_time, Body body, Setup setup) {
+	size_t rounds = 0;
+	double elapsed = 0;
+
+	do {
+		setup();
+
+		const auto start = Clock::now();
+		body();
+		elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+
+		rounds++;
+	} while (elapsed < min_time);
+
+	return elapsed / rounds;
+}
+
+template<typename Body>
+double Time(double min_time, Body body) {
+	return Time(min_time, body, []() {});
+}
+
+void PrintTime(const char *operation, double seconds, size_t bytes) {
+	std::printf("%-22s %10.3f %12.1f\n", operation, seconds * 1e3, bytes / 1e6 / seconds);
+}
+
+int Bench(const Args &args) {
+	if (args.positional.size() != 1) throw std::invalid_argument("usage: sbf-tool bench FILE [--min-time SECONDS] [--dir DIR]");
+
+	const auto &path = args.positional[0];
+	const auto min_time = std::strtod(args.Get("--min-time", "1").c_str(), nullptr);
+	const std::filesystem::path dir = args.Get("--dir", std::filesystem::temp_directory_path().string());
+
+	SBF_ScanStats stats = {};
+	auto image = OpenImage(path, stats);
+
+	const auto base = image.bytes.data() + image.nodes[0].offset;
+	const auto base_length = image.nodes[0].length;
+
+	std::printf("%s: %s, base node of %s, %zu update records, max depth %llu\n", path.c_str(),
+		Size(image.bytes.size()).c_str(), Size(base_length).c_str(), image.nodes.size() - 1,
+		(unsigned long long)stats.max_depth);
+
+	std::printf("\n%-22s %10s %12s\n", "operation", "ms/op", "MB/s");
+
+	Node *node = nullptr;
+	const auto release = [&]() {
+		SBF_DestroyNode(node);
+		node = nullptr;
+	};
+
+	PrintTime("read_file", Time(min_time, [&]() { node = SBF_ReadFile(path.c_str(), nullptr); }, release), image.bytes.size());
+	release();
+
+	// The base node alone, with each decoder.
+	const auto decode = [&](const SBF_DecodeOptions &options) {
+		size_t begin = 0;
+		node = SBF_DeserializeEx(base, base_length, &begin, &options);
+	};
+
+	auto options = image.DecodeOptions();
+	PrintTime("decode_iterative", Time(min_time, [&]() { decode(options); }, release), base_length);
+	release();
+
+	options.flags |= SBF_DECODE_RECURSIVE;
+	options.max_depth = stats.max_depth;
+
+	try {
+		PrintTime("decode_recursive", Time(min_time, [&]() { decode(options); }, release), base_length);
+	} catch (std::exception &e) {
+		std::printf("%-22s %s\n", "decode_recursive", e.what());
+	}
+
+	release();
+
+	auto arena = SBF_CreateArena(0);
+	options = image.DecodeOptions();
+	options.arena = arena;
+
+	PrintTime("decode_arena", Time(min_time, [&]() { decode(options); }, [&]() { SBF_ResetArena(arena); }), base_length);
+
+	SBF_DestroyArena(arena);
+	node = nullptr;
+
+	// Where the decoder's time goes, when the library counts it.
+	SBF_ResetStats();
+	decode(image.DecodeOptions());
+
+	SBF_Stats decoded;
+	const auto counted = SBF_GetStats(&decoded);
+
+	// Saving the tree decoded from the file, records applied.
+	release();
+	node = SBF_ReadFile(path.c_str(), nullptr);
+
+	const auto size = SBF_CalculateSize(node);
+	std::vector<uint8_t> bytes(size);
+
+	SBF_EncodeOptions encode = {};
+	if (image.big_endian) encode.flags |= SBF_ENCODE_BIG_ENDIAN;
+
+	PrintTime("calculate_size", Time(min_time, [&]() { SBF_CalculateSize(node); }), size);
+	PrintTime("serialize", Time(min_time, [&]() {
+		size_t cursor = 0;
+		SBF_SerializeEx(node, bytes.data(), bytes.size(), &cursor, &encode);
+	}), size);
+
+	const auto out = (dir / "sbf-tool-bench.sbf").string();
+
+	SBF_WriteOptions write = {};
+	if (image.big_endian) write.flags |= SBF_WRITE_BIG_ENDIAN;
+
+	try {
+		PrintTime("write_file", Time(min_time, [&]() { SBF_WriteFileEx(out.c_str(), node, &write); }), size);
+
+		write.flags |= SBF_WRITE_CHECKSUM;
+		PrintTime("write_file_checksum", Time(min_time, [&]() { SBF_WriteFileEx(out.c_str(), node, &write); }), size);
+	} catch (...) {
+		std::filesystem::remove(out);
+		release();
+		throw;
+	}
+
+	std::filesystem::remove(out);
+	release();
+
+	if (counted) {
+		std::printf("\none decode: %llu allocations of %s; %.3f ms parsing tables, %.3f ms copying arrays\n",
+			(unsigned long long)decoded.allocations, Size(decoded.allocated_bytes).c_str(),
+			decoded.table_parse_ns / 1e6, decoded.array_copy_ns / 1e6);
+	}
+
+	return 0;
+}
+
+void PrintUsage() {
+	std::fprintf(stderr,
+		"usage: sbf-tool COMMAND ARGS\n"
+		"\n"
+		"  stats FILE [--select PATH]         nodes, bytes and depths by type, without decoding\n"
+		"  dump FILE [--select PATH]          print the tree, bounded by --depth, --items, --chars and --lines\n"
+		"  convert INPUT OUTPUT [options]     rewrite with --checksum, --big-endian, --canonical, --sorted-tables,\n"
+		"                                     arrays aligned to --align N bytes, integer arrays encoded with --pack\n"
+		"                                     (but with --canonical, which writes them raw),\n"
+		"                                     or as a bare node with --raw;\n"
+		"                                     update records are applied.\n"
+		"                                     *.json files are read and written as JSON (--pretty indents it)\n"
+		"  bench FILE [--min-time S] [--dir D] time reading, decoding with each decoder, and writing\n");
+}
+
+};
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		PrintUsage();
+		return 2;
+	}
+
+	const std::string command = argv[1];
+
+	try {
+		const auto args = ParseArgs(argc, argv, 2);
+
+		if (command == "stats") return Stats(args);
+		if (command == "dump") return Dump(args);
+		if (command == "convert") return Convert(args);
+		if (command == "bench") return Bench(args);
+	} catch (std::exception &e) {
+		std::fprintf(stderr, "sbf-tool: %s\n", e.what());
+		return 1;
+	}
+
+	PrintUsage();
+	return 2;
+}